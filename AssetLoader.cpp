@@ -0,0 +1,99 @@
+﻿#include "AssetLoader.hpp"
+#include "MeshCache.hpp"
+#include "Texture.hpp"
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+    double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+AssetLoader::AssetLoader(size_t thread_count)
+    : pool(thread_count), start_time(Clock::now()) {
+}
+
+void AssetLoader::requestModel(const std::filesystem::path& path) {
+    const std::string key = path.string();
+    if (pending_models.count(key) != 0) {
+        return;
+    }
+    pending_models[key] = pool.submit([path]() {
+        DecodedModel result;
+        auto start = Clock::now();
+        // The pool already loads several files at once, a chunked parse per job would start
+        // hardware_concurrency() more threads inside every worker
+        result.ok = loadMeshData(path, result.data, true, 1, &result.report);
+        for (const auto& material : result.data.materials) {
+            result.material_images.push_back(material.diffuse_map.empty() ? cv::Mat() : decodeTexture(material.diffuse_map));
+        }
+        result.decode_ms = elapsedMs(start);
+        return result;
+    }).share();
+}
+
+void AssetLoader::requestTexture(const std::filesystem::path& path) {
+    const std::string key = path.string();
+    if (pending_textures.count(key) != 0) {
+        return;
+    }
+    pending_textures[key] = pool.submit([path]() {
+        DecodedTexture result;
+        auto start = Clock::now();
+        result.image = decodeTexture(path);
+        result.decode_ms = elapsedMs(start);
+        return result;
+    }).share();
+}
+
+Model* AssetLoader::createModel(const std::filesystem::path& path, ShaderProgram shader, VertexFormat vertex_format) {
+    requestModel(path);
+
+    auto wait_start = Clock::now();
+    const DecodedModel& decoded = pending_models[path.string()].get();
+    const double wait_ms = elapsedMs(wait_start);
+    if (!decoded.ok) {
+        throw std::runtime_error("Failed to load OBJ file: " + path.string());
+    }
+    printMeshLoadReport(path, decoded.data, decoded.report);
+
+    auto upload_start = Clock::now();
+    Model* model = new Model(path.stem().string(), decoded.data, shader, decoded.material_images, vertex_format);
+    timings.push_back(Timing{ path.filename().string(), decoded.decode_ms, wait_ms, elapsedMs(upload_start) });
+    return model;
+}
+
+GLuint AssetLoader::createTexture(const std::filesystem::path& path) {
+    requestTexture(path);
+
+    auto wait_start = Clock::now();
+    const DecodedTexture& decoded = pending_textures[path.string()].get();
+    const double wait_ms = elapsedMs(wait_start);
+    if (decoded.image.empty()) {
+        std::cerr << "Failed to load texture: " << path << std::endl;
+        return 0;
+    }
+
+    auto upload_start = Clock::now();
+    GLuint texture = uploadTexture(decoded.image);
+    timings.push_back(Timing{ path.filename().string(), decoded.decode_ms, wait_ms, elapsedMs(upload_start) });
+    return texture;
+}
+
+void AssetLoader::printTimings(std::ostream& out) const {
+    double decode_sum = 0.0, upload_sum = 0.0;
+    out << "Asset loading (" << pool.size() << " worker threads):\n";
+    out << std::left << std::setw(28) << "  asset" << std::right
+        << std::setw(12) << "decode ms" << std::setw(12) << "wait ms" << std::setw(12) << "upload ms" << "\n";
+    out << std::fixed << std::setprecision(2);
+    for (const auto& t : timings) {
+        out << "  " << std::left << std::setw(26) << t.name << std::right
+            << std::setw(12) << t.decode_ms << std::setw(12) << t.wait_ms << std::setw(12) << t.upload_ms << "\n";
+        decode_sum += t.decode_ms;
+        upload_sum += t.upload_ms;
+    }
+    out << "  decode total " << decode_sum << " ms (on workers), upload total " << upload_sum
+        << " ms, wall clock " << elapsedMs(start_time) << " ms" << std::endl;
+}
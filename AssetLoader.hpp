@@ -0,0 +1,61 @@
+﻿#pragma once
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "assets.hpp"
+#include "MeshCache.hpp"
+#include "Model.hpp"
+#include "ShaderProgram.hpp"
+#include "ThreadPool.hpp"
+
+// Loading stage for startup assets. OBJ parsing (through the mesh cache) and image decoding
+// run on a worker pool as soon as they are requested; only the final GL uploads happen
+// on the context thread, when the asset is taken with createModel()/createTexture().
+class AssetLoader {
+public:
+    explicit AssetLoader(size_t thread_count = std::thread::hardware_concurrency());
+
+    // Queue CPU work, returns immediately (requesting the same file twice is a no-op)
+    void requestModel(const std::filesystem::path& path);
+    void requestTexture(const std::filesystem::path& path);
+
+    // GL thread: waits for the decoded asset and uploads it.
+    // createModel throws like Model::Model, createTexture returns 0 like App::textureInit.
+    Model* createModel(const std::filesystem::path& path, ShaderProgram shader,
+        VertexFormat vertex_format = VertexFormat::Packed);
+    GLuint createTexture(const std::filesystem::path& path);
+
+    void printTimings(std::ostream& out) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct DecodedModel {
+        MeshData data;
+        MeshLoadReport report;                // printed by createModel() on the GL thread
+        std::vector<cv::Mat> material_images; // decoded map_Kd per material
+        bool ok{ false };
+        double decode_ms{ 0.0 };
+    };
+    struct DecodedTexture {
+        cv::Mat image;
+        double decode_ms{ 0.0 };
+    };
+    struct Timing {
+        std::string name;
+        double decode_ms;  // worker thread
+        double wait_ms;    // GL thread blocked on the worker result
+        double upload_ms;  // GL thread
+    };
+
+    ThreadPool pool;
+    std::map<std::string, std::shared_future<DecodedModel>> pending_models;
+    std::map<std::string, std::shared_future<DecodedTexture>> pending_textures;
+    std::vector<Timing> timings;
+    Clock::time_point start_time;
+};
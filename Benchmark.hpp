@@ -0,0 +1,57 @@
+﻿#pragma once
+#include <filesystem>
+#include <vector>
+
+// Command line micro-benchmarks, they run without a window or GL context. Each module has its own
+// Benchmark<Module>.cpp, the result table and the self-checks deciding the exit code are in BenchmarkReport.hpp.
+// Usage: my_app --bench-obj [models_dir] [iterations]
+//        my_app --bench-obj-threads [obj_file] [max_threads] [iterations]
+//        my_app --bench-meshopt [models_dir]
+//        my_app --check-vertex-packing [models_dir]   (exit code 1 if an error bound is exceeded)
+//        my_app --bench-clusters [heightmap] [lights] [frames]
+//        my_app --bench-terrain [heightmap] [frames]
+//        my_app --bench-terrain-streaming [tiles.terrain] [memory_mb] [frames]
+//        my_app --bench-terrain-build [heightmap] [iterations]   (heightmap.png and heightmap2.png by default)
+//        my_app --bench-heightfield [heightmap] [queries]
+//        my_app --bench-scene-graph [nodes] [frames]
+//        my_app --bench-entities [entities] [frames]
+//        my_app --bench-culling [boxes] [frames]
+//        my_app --bench-bvh [objects] [queries]
+// The rendering benchmark (my_app --benchmark <scenario.json>) needs a GL context, see BenchmarkScenario.hpp
+int benchmarkOBJLoader(const std::filesystem::path& models_dir, int iterations = 5);
+int benchmarkOBJThreads(const std::filesystem::path& obj_file, unsigned int max_threads, int iterations = 5);
+int benchmarkMeshOptimizer(const std::filesystem::path& models_dir);
+int checkVertexPacking(const std::filesystem::path& models_dir);
+// Light cluster assignment (scalar, SSE, SSE + threads) over the terrain, exit code 1 if the
+// variants disagree or a lit point does not find its light in its cluster
+int benchmarkLightClusters(const std::filesystem::path& heightmap_file, int light_count = 1000, int frames = 200);
+// Terrain chunk selection along a camera circle: triangles drawn against the full mesh, GPU memory of
+// both terrain modes. Exit code 1 if an index variant does not cover its chunk exactly or
+// neighbouring chunks do not share their border
+int benchmarkTerrain(const std::filesystem::path& heightmap_file, int frames = 200);
+// TerrainTileCache on a 60 Hz flight across a tile file (my_app --make-terrain-tiles): update time,
+// memory against the budget, frames with wanted tiles still loading. Exit code 1 if the budget is
+// exceeded, a loaded tile differs from the file or the wanted tiles do not arrive once the camera stops.
+int benchmarkTerrainStreaming(const std::filesystem::path& tiles_file, size_t memory_mb = 256, int frames = 600);
+// Terrain vertex grid (TerrainBuilder.hpp) from 8 and 16 bit samples: scalar, SSE, SSE + threads.
+// Exit code 1 if the vertices are not bit for bit the scalar ones.
+int benchmarkTerrainBuild(const std::vector<std::filesystem::path>& heightmap_files, int iterations = 10);
+// TerrainHeightField queries at random points: heights scalar and SSE, normals, rays through the
+// min/max pyramid and cell by cell. Exit code 1 if the SSE heights are not the scalar ones or
+// the two ray casts disagree.
+int benchmarkHeightField(const std::filesystem::path& heightmap_file, int queries = 100000);
+// SceneGraph::update on a static scene, with 1% of the objects moving and with every matrix rebuilt
+// each frame (as before the scene graph). Exit code 1 if a cached world matrix or box differs from
+// the one computed from scratch.
+int benchmarkSceneGraph(int node_count = 100000, int frames = 100);
+// Per-frame walk over the placed objects (opaque list, transparent distances) in the EntityStore
+// columns against heap-allocated objects behind a vector of pointers, as App kept them before.
+// Exit code 1 if a handle survives destroy() or a live handle finds the wrong entity.
+int benchmarkEntities(int entity_count = 50000, int frames = 100);
+// View frustum test of world boxes along a camera circle: boxes one by one (Frustum::intersects),
+// box columns scalar and SSE (Frustum::cullBoxes). Exit code 1 if the variants disagree.
+int benchmarkCulling(int box_count = 100000, int frames = 100);
+// Bvh over a synthetic scene: build time, frustum queries against all boxes with SSE, picking rays,
+// radius queries, then the same after refitting 1% moved objects. Exit code 1 if a query result
+// differs from testing every box.
+int benchmarkBvh(int object_count = 100000, int queries = 100000);
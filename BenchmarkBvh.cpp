@@ -0,0 +1,167 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "Bvh.hpp"
+#include "Frustum.hpp"
+#include "SceneGraph.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int benchmarkBvh(int object_count, int queries) {
+    object_count = std::max(object_count, 1);
+    queries = std::max(queries, 1);
+    // Objects of 1 to 5 units placed over a 512 x 512 world
+    std::mt19937 rng(2024);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const AABB local{ glm::vec3(-1.0f, 0.0f, -1.0f), glm::vec3(1.0f, 2.0f, 1.0f) };
+    std::vector<AABB> boxes(object_count);
+    for (auto& box : boxes) {
+        box = transformBounds(composeTransform(glm::vec3(unit(rng) * 512.0f, unit(rng) * 10.0f, unit(rng) * 512.0f),
+            glm::vec3(0.0f, unit(rng) * 6.2831853f, 0.0f), glm::vec3(0.5f + 2.0f * unit(rng))), local);
+    }
+    std::vector<float> min_x(object_count), min_y(object_count), min_z(object_count), max_x(object_count), max_y(object_count), max_z(object_count);
+    auto toColumns = [&]() {
+        for (int i = 0; i < object_count; ++i) {
+            min_x[i] = boxes[i].min.x;
+            min_y[i] = boxes[i].min.y;
+            min_z[i] = boxes[i].min.z;
+            max_x[i] = boxes[i].max.x;
+            max_y[i] = boxes[i].max.y;
+            max_z[i] = boxes[i].max.z;
+        }
+    };
+    toColumns();
+
+    constexpr int BUILDS = 5;
+    Bvh bvh;
+    auto start = BenchmarkClock::now();
+    for (int i = 0; i < BUILDS; ++i) {
+        bvh.build(boxes.data(), boxes.size());
+    }
+    const double build_ms = elapsedMs(start) / BUILDS;
+
+    // Every check compares the tree against all boxes tested one by one
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 20000.0f);
+    const int frames = std::max(queries / 1000, 10);
+    const int checked = std::min(queries, 1000);
+    std::vector<uint32_t> found, expected;
+    std::vector<uint8_t> visible(object_count);
+    struct Timings {
+        double frustum_ms{ 0.0 }, linear_ms{ 0.0 }, ray_ms{ 0.0 }, sphere_ms{ 0.0 };
+        size_t in_view{ 0 }, hits{ 0 }, mismatches{ 0 };
+    };
+    auto runQueries = [&]() {
+        Timings result;
+        // Camera circling inside the world, looking outwards and a little down
+        for (int frame = 0; frame < frames; ++frame) {
+            const float angle = 6.2831853f * frame / frames;
+            const glm::vec3 eye(256.0f + 100.0f * std::cos(angle), 30.0f, 256.0f + 100.0f * std::sin(angle));
+            const glm::vec3 ahead(std::cos(angle), -0.2f, std::sin(angle));
+            const Frustum frustum(projection * glm::lookAt(eye, eye + ahead, glm::vec3(0.0f, 1.0f, 0.0f)));
+            found.clear();
+            start = BenchmarkClock::now();
+            bvh.frustum(frustum, found);
+            result.frustum_ms += elapsedMs(start);
+            start = BenchmarkClock::now();
+            frustum.cullBoxes(min_x.data(), min_y.data(), min_z.data(), max_x.data(), max_y.data(), max_z.data(),
+                boxes.size(), visible.data());
+            result.linear_ms += elapsedMs(start);
+            expected.clear();
+            for (int i = 0; i < object_count; ++i) {
+                if (visible[i]) {
+                    expected.push_back(i);
+                }
+            }
+            std::sort(found.begin(), found.end());
+            result.mismatches += found != expected ? 1 : 0;
+            result.in_view += found.size();
+        }
+
+        // Picking rays from above the objects, down at 10 to 45 degrees
+        std::mt19937 query_rng(7);
+        for (int i = 0; i < queries; ++i) {
+            const glm::vec3 origin(unit(query_rng) * 512.0f, 20.0f, unit(query_rng) * 512.0f);
+            const float yaw = unit(query_rng) * 6.2831853f, pitch = glm::radians(10.0f + 35.0f * unit(query_rng));
+            const glm::vec3 direction(std::cos(yaw) * std::cos(pitch), -std::sin(pitch), std::sin(yaw) * std::cos(pitch));
+            uint32_t item;
+            float t;
+            start = BenchmarkClock::now();
+            const bool hit = bvh.raycast(origin, direction, 1000.0f, item, t);
+            result.ray_ms += elapsedMs(start);
+            result.hits += hit ? 1 : 0;
+            if (i < checked) {
+                bool nearest_hit = false;
+                float nearest_t = 1000.0f, box_t;
+                for (int j = 0; j < object_count; ++j) {
+                    if (intersectRayBox(origin, direction, boxes[j], nearest_t, box_t) && (!nearest_hit || box_t < nearest_t)) {
+                        nearest_t = box_t;
+                        nearest_hit = true;
+                    }
+                }
+                // Objects hit at the same distance are equally right
+                result.mismatches += (hit != nearest_hit || (hit && t != nearest_t)) ? 1 : 0;
+            }
+        }
+
+        // Objects within 10 units of points around the objects
+        for (int i = 0; i < queries; ++i) {
+            const glm::vec3 center(unit(query_rng) * 512.0f, unit(query_rng) * 10.0f, unit(query_rng) * 512.0f);
+            found.clear();
+            start = BenchmarkClock::now();
+            bvh.overlapSphere(center, 10.0f, found);
+            result.sphere_ms += elapsedMs(start);
+            if (i < checked) {
+                expected.clear();
+                for (int j = 0; j < object_count; ++j) {
+                    if (boxes[j].distance(center) <= 10.0f) {
+                        expected.push_back(j);
+                    }
+                }
+                std::sort(found.begin(), found.end());
+                result.mismatches += found != expected ? 1 : 0;
+            }
+        }
+        return result;
+    };
+    const Timings built = runQueries();
+
+    // 1% of the objects move by up to 10 units: refit instead of a new build
+    std::vector<uint32_t> moved;
+    for (int i = 0; i < object_count; i += 100) {
+        moved.push_back(i);
+        const glm::vec3 offset((unit(rng) - 0.5f) * 20.0f, 0.0f, (unit(rng) - 0.5f) * 20.0f);
+        boxes[i].min += offset;
+        boxes[i].max += offset;
+    }
+    toColumns();
+    start = BenchmarkClock::now();
+    for (const uint32_t i : moved) {
+        bvh.update(i, boxes[i]);
+    }
+    const double refit_ms = elapsedMs(start);
+    const Timings refitted = runQueries();
+
+    std::cout << "BVH, " << object_count << " objects over 512 x 512, " << bvh.nodeCount() << " nodes, depth " << bvh.depth() << "\n";
+    BenchmarkTable table({ { "query", 34 }, { "time", 10 } });
+    table.row({ "build (" + std::to_string(BVH_BINS) + " SAH bins)", build_ms }, "ms");
+    table.row({ "frustum, BVH", built.frustum_ms / frames }, "ms/frame (" + formatFixed(100.0 * built.in_view
+        / (static_cast<double>(object_count) * frames), 1) + "% in view)");
+    table.row({ "frustum, all boxes SSE", built.linear_ms / frames }, "ms/frame");
+    table.row({ "ray, nearest object", 1000.0 * built.ray_ms / queries }, "us/query ("
+        + formatFixed(100.0 * built.hits / queries, 1) + "% hit)");
+    table.row({ "sphere, radius 10", 1000.0 * built.sphere_ms / queries }, "us/query");
+    table.row({ "refit " + std::to_string(moved.size()) + " moved objects", refit_ms }, "ms ("
+        + formatFixed(build_ms / refit_ms, 1) + "x faster than a build)");
+    table.row({ "after refit: frustum", refitted.frustum_ms / frames }, "ms/frame");
+    table.row({ "after refit: ray", 1000.0 * refitted.ray_ms / queries }, "us/query");
+
+    BenchmarkChecks checks;
+    checks.check(built.mismatches == 0, "queries match all boxes tested one by one (differing: ", built.mismatches, ")");
+    checks.check(refitted.mismatches == 0, "queries after the refit match too (differing: ", refitted.mismatches, ")");
+    return checks.exitCode();
+}
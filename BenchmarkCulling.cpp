@@ -0,0 +1,83 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "Frustum.hpp"
+#include "SceneGraph.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int benchmarkCulling(int box_count, int frames) {
+    box_count = std::max(box_count, 1);
+    frames = std::max(frames, 1);
+    // Unit boxes of models placed over a 1000 x 1000 terrain, moved to world space by their matrices
+    std::mt19937 rng(2023);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<glm::mat4> matrices(box_count);
+    for (auto& matrix : matrices) {
+        matrix = composeTransform(glm::vec3(unit(rng) * 1000.0f, unit(rng) * 20.0f, unit(rng) * 1000.0f),
+            glm::vec3(0.0f, unit(rng) * 6.2831853f, 0.0f), glm::vec3(0.5f + 2.0f * unit(rng)));
+    }
+    const AABB local{ glm::vec3(-1.0f, 0.0f, -1.0f), glm::vec3(1.0f, 2.0f, 1.0f) };
+    std::vector<AABB> boxes(box_count);
+    auto start = BenchmarkClock::now();
+    for (int i = 0; i < box_count; ++i) {
+        boxes[i] = transformBounds(matrices[i], local);
+    }
+    const double transform_ms = elapsedMs(start);
+    std::vector<float> min_x(box_count), min_y(box_count), min_z(box_count), max_x(box_count), max_y(box_count), max_z(box_count);
+    for (int i = 0; i < box_count; ++i) {
+        min_x[i] = boxes[i].min.x;
+        min_y[i] = boxes[i].min.y;
+        min_z[i] = boxes[i].min.z;
+        max_x[i] = boxes[i].max.x;
+        max_y[i] = boxes[i].max.y;
+        max_z[i] = boxes[i].max.z;
+    }
+
+    // Camera circling over the middle, looking outwards and a little down, like App's projection
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 20000.0f);
+    std::vector<uint8_t> one_by_one(box_count), scalar(box_count), sse(box_count);
+    double one_by_one_ms = 0.0, scalar_ms = 0.0, sse_ms = 0.0;
+    size_t visible = 0, mismatches = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        const float angle = 6.2831853f * frame / frames;
+        const glm::vec3 eye(500.0f + 100.0f * std::cos(angle), 40.0f, 500.0f + 100.0f * std::sin(angle));
+        const glm::vec3 ahead(std::cos(angle), -0.2f, std::sin(angle));
+        const Frustum frustum(projection * glm::lookAt(eye, eye + ahead, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+        start = BenchmarkClock::now();
+        for (int i = 0; i < box_count; ++i) {
+            one_by_one[i] = frustum.intersects(boxes[i]);
+        }
+        one_by_one_ms += elapsedMs(start);
+        start = BenchmarkClock::now();
+        frustum.cullBoxesScalar(min_x.data(), min_y.data(), min_z.data(), max_x.data(), max_y.data(), max_z.data(),
+            box_count, scalar.data());
+        scalar_ms += elapsedMs(start);
+        start = BenchmarkClock::now();
+        frustum.cullBoxes(min_x.data(), min_y.data(), min_z.data(), max_x.data(), max_y.data(), max_z.data(),
+            box_count, sse.data());
+        sse_ms += elapsedMs(start);
+
+        for (int i = 0; i < box_count; ++i) {
+            visible += sse[i];
+            mismatches += (one_by_one[i] != scalar[i] || scalar[i] != sse[i]) ? 1 : 0;
+        }
+    }
+
+    std::cout << "Frustum culling, " << box_count << " boxes, " << frames << " frames, "
+        << formatFixed(100.0 * visible / (static_cast<double>(box_count) * frames), 1) << "% in view\n";
+    BenchmarkTable table({ { "test", 34 }, { "ms", 10 }, { "speedup", 10, 1 } });
+    table.row({ "world boxes from model matrices", transform_ms }, "once");
+    table.row({ "AABB one by one", one_by_one_ms / frames, 1.0 }, "per frame");
+    table.row({ "box columns, scalar", scalar_ms / frames, one_by_one_ms / scalar_ms }, "per frame");
+    table.row({ "box columns, SSE", sse_ms / frames, one_by_one_ms / sse_ms }, "per frame");
+
+    BenchmarkChecks checks;
+    checks.check(mismatches == 0, "one by one, scalar and SSE results identical (differing: ", mismatches, ")");
+    return checks.exitCode();
+}
@@ -0,0 +1,140 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "EntityStore.hpp"
+#include "SceneGraph.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+int benchmarkEntities(int entity_count, int frames) {
+    entity_count = std::max(entity_count, 2);
+    frames = std::max(frames, 1);
+    std::mt19937 rng(2022);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // Before: one heap object per placement with its own transform and flags, in allocation order
+    struct HeapObject {
+        std::string name;
+        glm::vec3 origin, orientation, scale;
+        glm::vec4 tint;
+        uint32_t model;
+        bool transparent;
+    };
+    std::vector<HeapObject*> objects;
+    SceneGraph scene;
+    EntityStore entities;
+    std::vector<EntityHandle> handles;
+    for (int i = 0; i < entity_count; ++i) {
+        const glm::vec3 position(unit(rng) * 1000.0f, unit(rng) * 20.0f, unit(rng) * 1000.0f);
+        const glm::vec3 rotation(0.0f, unit(rng) * 6.2831853f, 0.0f), scale(0.3f + unit(rng));
+        const bool transparent = i % 10 == 0;
+        const glm::vec4 tint(static_cast<float>(i), 1.0f, 1.0f, 1.0f);  // identifies the entity in the check
+        objects.push_back(new HeapObject{ "object" + std::to_string(i), position, rotation, scale, tint,
+            static_cast<uint32_t>(i % 3), transparent });
+
+        const SceneNodeId node = scene.create();
+        scene.setTransform(node, position, rotation, scale);
+        scene.setLocalBounds(node, AABB{ glm::vec3(-1.0f), glm::vec3(1.0f) });
+        handles.push_back(entities.create(scene, node, static_cast<uint32_t>(i % 3), tint,
+            transparent ? ENTITY_VISIBLE | ENTITY_TRANSPARENT : ENTITY_VISIBLE));
+    }
+    std::vector<SceneNodeId> changed;
+    scene.update(&changed);
+    entities.syncTransforms(scene, changed);
+
+    // One frame's CPU side of the passes: the model matrix of every opaque object and the
+    // camera distances of the transparent ones, sorted
+    const glm::vec3 camera(500.0f, 30.0f, 500.0f);
+    std::vector<std::pair<float, uint32_t>> order;
+    float checksum = 0.0f;
+    auto start = BenchmarkClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        std::vector<HeapObject*> transparent_list;
+        for (const HeapObject* object : objects) {
+            if (!object->transparent) {
+                checksum += composeTransform(object->origin, object->orientation, object->scale)[3].x * object->tint.y;
+            }
+        }
+        for (HeapObject* object : objects) {
+            if (object->transparent) {
+                transparent_list.push_back(object);
+            }
+        }
+        std::sort(transparent_list.begin(), transparent_list.end(), [&](const HeapObject* a, const HeapObject* b) {
+            return glm::distance(camera, a->origin) > glm::distance(camera, b->origin);
+        });
+        checksum += transparent_list.front()->origin.x;
+    }
+    const double pointers_ms = elapsedMs(start) / frames;
+
+    start = BenchmarkClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        const uint8_t* flags = entities.flagColumn();
+        const glm::mat4* world = entities.worldMatrixColumn();
+        const glm::vec4* tints = entities.tintColumn();
+        for (size_t i = 0; i < entities.size(); ++i) {
+            if ((flags[i] & ENTITY_TRANSPARENT) == 0) {
+                checksum += world[i][3].x * tints[i].y;
+            }
+        }
+        order.clear();
+        const float* min_x = entities.minXColumn();
+        const float* min_y = entities.minYColumn();
+        const float* min_z = entities.minZColumn();
+        const float* max_x = entities.maxXColumn();
+        const float* max_y = entities.maxYColumn();
+        const float* max_z = entities.maxZColumn();
+        for (uint32_t i = 0; i < entities.size(); ++i) {
+            if (flags[i] & ENTITY_TRANSPARENT) {
+                const float dx = (min_x[i] + max_x[i]) * 0.5f - camera.x;
+                const float dy = (min_y[i] + max_y[i]) * 0.5f - camera.y;
+                const float dz = (min_z[i] + max_z[i]) * 0.5f - camera.z;
+                order.emplace_back(dx * dx + dy * dy + dz * dz, i);
+            }
+        }
+        std::sort(order.begin(), order.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+            return a.first > b.first;
+        });
+        checksum += entities.worldMatrixColumn()[order.front().second][3].x;
+    }
+    const double columns_ms = elapsedMs(start) / frames;
+
+    // Handles: destroy every third entity, place new ones into the freed slots
+    size_t errors = 0;
+    for (size_t i = 0; i < handles.size(); i += 3) {
+        entities.destroy(handles[i]);
+    }
+    std::vector<EntityHandle> reused;
+    for (size_t i = 0; i < handles.size(); i += 3) {
+        reused.push_back(entities.create(scene, scene.create(), 0, glm::vec4(-1.0f)));
+    }
+    for (size_t i = 0; i < handles.size(); ++i) {
+        const bool should_live = i % 3 != 0;
+        if (entities.alive(handles[i]) != should_live) {
+            ++errors;
+        }
+        else if (should_live && entities.tintColumn()[entities.indexOf(handles[i])].x != static_cast<float>(i)) {
+            ++errors;
+        }
+    }
+    for (const EntityHandle& handle : reused) {
+        errors += entities.alive(handle) && entities.tintColumn()[entities.indexOf(handle)].x == -1.0f ? 0 : 1;
+    }
+    for (HeapObject* object : objects) {
+        delete object;
+    }
+
+    std::cout << "Placed objects, " << entity_count << " entities (every 10th transparent), " << frames << " frames\n";
+    BenchmarkTable table({ { "layout", 40 }, { "ms/frame", 10 }, { "speedup", 10, 1 } });
+    table.row({ "vector<HeapObject*>, matrices per frame", pointers_ms, 1.0 });
+    table.row({ "EntityStore columns, cached matrices", columns_ms, pointers_ms / columns_ms },
+        "checksum " + formatFixed(checksum, 0));
+
+    BenchmarkChecks checks;
+    checks.check(errors == 0, "handles right after destroy and reuse (wrong: ", errors, ")");
+    return checks.exitCode();
+}
@@ -0,0 +1,160 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "TerrainHeightField.hpp"
+#include "TerrainTiles.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+int benchmarkHeightField(const std::filesystem::path& heightmap_file, int queries) {
+    cv::Mat heightmap;
+    if (!readBenchmarkHeightmap(heightmap_file, cv::IMREAD_GRAYSCALE | cv::IMREAD_ANYDEPTH, heightmap)) {
+        return 1;
+    }
+    queries = std::max(queries, 1);
+    TerrainHeightField field;
+    auto start = BenchmarkClock::now();
+    field.build(heightmap, BENCHMARK_TERRAIN_HEIGHT);
+    const double build_ms = elapsedMs(start);
+    const float size_x = static_cast<float>(field.columns() - 1), size_z = static_cast<float>(field.rows() - 1);
+    std::cout << "Terrain height field " << heightmap.cols << "x" << heightmap.rows << ", "
+        << (heightmap.depth() == CV_16U ? 16 : 8) << " bit, " << field.pyramidLevels() << " pyramid levels, built in "
+        << formatFixed(build_ms, 3) << " ms\n";
+
+    // Points a little past the border too, they are clamped
+    std::mt19937 rng(2020);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<glm::vec2> positions(queries);
+    for (auto& position : positions) {
+        position = glm::vec2(unit(rng) * (size_x + 20.0f) - 10.0f, unit(rng) * (size_z + 20.0f) - 10.0f);
+    }
+    std::vector<float> scalar(queries), sse(queries);
+    start = BenchmarkClock::now();
+    field.heightsAtScalar(positions.data(), scalar.data(), positions.size());
+    const double scalar_ms = elapsedMs(start);
+    start = BenchmarkClock::now();
+    field.heightsAt(positions.data(), sse.data(), positions.size());
+    const double sse_ms = elapsedMs(start);
+
+    glm::vec3 normal_sum(0.0f);
+    start = BenchmarkClock::now();
+    for (const auto& position : positions) {
+        normal_sum += field.normalAt(position.x, position.y);
+    }
+    const double normal_ms = elapsedMs(start);
+
+    // Rays from above the terrain looking slightly down, like the camera does
+    struct Ray {
+        glm::vec3 origin, direction;
+    };
+    const int ray_count = std::max(queries / 10, 1);
+    std::vector<Ray> rays(ray_count);
+    for (auto& ray : rays) {
+        const float angle = unit(rng) * 6.2831853f;
+        ray.origin = glm::vec3(unit(rng) * size_x, BENCHMARK_TERRAIN_HEIGHT + 2.0f + unit(rng) * 10.0f, unit(rng) * size_z);
+        ray.direction = glm::normalize(glm::vec3(std::cos(angle), -0.02f - 0.3f * unit(rng), std::sin(angle)));
+    }
+    const float max_t = 2.0f * (size_x + size_z);
+    // Distance of every ray's hit, -1 for a miss
+    auto castRays = [&](const TerrainHeightField& target, bool pyramid, std::vector<float>& hits) {
+        hits.assign(ray_count, -1.0f);
+        const auto cast_start = BenchmarkClock::now();
+        for (int i = 0; i < ray_count; ++i) {
+            float t;
+            const bool hit = pyramid ? target.raycast(rays[i].origin, rays[i].direction, max_t, t)
+                : target.raycastCells(rays[i].origin, rays[i].direction, max_t, t);
+            hits[i] = hit ? t : -1.0f;
+        }
+        return elapsedMs(cast_start);
+    };
+    // The same cell triangles are intersected, only the [t0, t1] they are clipped to differ
+    auto disagreeing = [&](const std::vector<float>& a, const std::vector<float>& b) {
+        size_t count = 0;
+        for (int i = 0; i < ray_count; ++i) {
+            count += (a[i] < 0.0f) != (b[i] < 0.0f) || std::abs(a[i] - b[i]) > 1e-3f * std::max(1.0f, b[i]) ? 1 : 0;
+        }
+        return count;
+    };
+    std::vector<float> pyramid_t, cells_t;
+    const double pyramid_ms = castRays(field, true, pyramid_t);
+    const double cells_ms = castRays(field, false, cells_t);
+    size_t hits = 0;
+    float worst_surface = 0.0f;
+    for (int i = 0; i < ray_count; ++i) {
+        if (pyramid_t[i] >= 0.0f) {
+            ++hits;
+            const glm::vec3 hit = rays[i].origin + rays[i].direction * pyramid_t[i];
+            worst_surface = std::max(worst_surface, std::abs(hit.y - field.heightAt(hit.x, hit.z)));
+        }
+    }
+
+    // The same surface from the tiles of a TerrainTileCache (TerrainMode::Streamed): chunk pyramid,
+    // corners from the loaded tiles. Before any tile is loaded the field is the coarse chunk surface.
+    const std::filesystem::path tiles_file = std::filesystem::temp_directory_path() / "bench_heightfield.terrain";
+    double tile_heights_ms = 0.0, tile_raycast_ms = 0.0;
+    float worst_tile_height = 0.0f;
+    size_t tile_disagreeing = 0, coarse_disagreeing = 0;
+    bool tiles_ok = false;
+    {
+        TerrainTileFile tiles;
+        if (writeTerrainTiles(heightmap, tiles_file) && tiles.open(tiles_file)) {
+            TerrainTileCache cache(tiles, static_cast<size_t>(tiles.tileCount()) * TERRAIN_TILE_BYTES);
+            TerrainHeightField tile_field;
+            tile_field.build(cache, BENCHMARK_TERRAIN_HEIGHT);
+            std::vector<float> coarse_t, coarse_cells_t;
+            castRays(tile_field, true, coarse_t);
+            castRays(tile_field, false, coarse_cells_t);
+            coarse_disagreeing = disagreeing(coarse_t, coarse_cells_t);
+
+            const glm::vec2 center(tiles.width() * 0.5f, tiles.height() * 0.5f);
+            const float radius = 2.0f * static_cast<float>(tiles.width() + tiles.height());
+            const auto loading = BenchmarkClock::now();
+            while (cache.getStats().resident_tiles < static_cast<size_t>(tiles.tileCount()) && elapsedMs(loading) < 5000.0) {
+                cache.update(center, radius, tiles.tileCount());
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            std::vector<float> tile_heights(queries), tile_t;
+            start = BenchmarkClock::now();
+            tile_field.heightsAt(positions.data(), tile_heights.data(), positions.size());
+            tile_heights_ms = elapsedMs(start);
+            for (int i = 0; i < queries; ++i) {
+                worst_tile_height = std::max(worst_tile_height, std::abs(tile_heights[i] - scalar[i]));
+            }
+            tile_raycast_ms = castRays(tile_field, true, tile_t);
+            tile_disagreeing = disagreeing(tile_t, cells_t);
+            tiles_ok = cache.getStats().resident_tiles == static_cast<size_t>(tiles.tileCount());
+        }
+    }
+    std::error_code ignored;
+    std::filesystem::remove(tiles_file, ignored);
+
+    BenchmarkTable table({ { "query", 26 }, { "count", 10 }, { "ms", 12 }, { "ns per query", 14 } });
+    table.row({ "heightAt scalar", queries, scalar_ms, scalar_ms * 1e6 / queries });
+    table.row({ "heightsAt SSE", queries, sse_ms, sse_ms * 1e6 / queries });
+    table.row({ "normalAt", queries, normal_ms, normal_ms * 1e6 / queries },
+        "checksum " + formatFixed(normal_sum.y, 3));
+    table.row({ "raycast cell by cell", ray_count, cells_ms, cells_ms * 1e6 / ray_count });
+    table.row({ "raycast pyramid", ray_count, pyramid_ms, pyramid_ms * 1e6 / ray_count },
+        std::to_string(hits) + " hitting, largest distance to the surface " + formatFixed(worst_surface, 5));
+    if (tiles_ok) {
+        table.row({ "heightAt from tiles", queries, tile_heights_ms, tile_heights_ms * 1e6 / queries });
+        table.row({ "raycast from tiles", ray_count, tile_raycast_ms, tile_raycast_ms * 1e6 / ray_count });
+    }
+
+    BenchmarkChecks checks;
+    checks.check(std::memcmp(scalar.data(), sse.data(), scalar.size() * sizeof(float)) == 0, "SSE heights identical to the scalar ones");
+    checks.check(disagreeing(pyramid_t, cells_t) == 0, "pyramid and cell by cell rays agree");
+    if (checks.check(tiles_ok, "tiles written to ", tiles_file.string(), " and all loaded")) {
+        checks.check(coarse_disagreeing == 0, "pyramid and cell by cell rays agree on the coarse surface (disagreeing: ",
+            coarse_disagreeing, ")");
+        checks.check(tile_disagreeing == 0, "rays from tiles agree (disagreeing: ", tile_disagreeing, ")");
+        checks.check(worst_tile_height < 1e-3f, "heights from tiles match (largest difference ",
+            formatFixed(worst_tile_height, 5), ")");
+    }
+    return checks.exitCode();
+}
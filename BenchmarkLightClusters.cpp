@@ -0,0 +1,127 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "LightClusters.hpp"
+#include "ThreadPool.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int benchmarkLightClusters(const std::filesystem::path& heightmap_file, int light_count, int frames) {
+    cv::Mat heightmap;
+    if (!readBenchmarkHeightmap(heightmap_file, cv::IMREAD_GRAYSCALE, heightmap)) {
+        return 1;
+    }
+    light_count = std::max(light_count, 1);
+    frames = std::max(frames, 1);
+    auto terrainHeight = [&](float x, float z) {
+        const int col = std::clamp(static_cast<int>(x), 0, heightmap.cols - 1);
+        const int row = std::clamp(static_cast<int>(z), 0, heightmap.rows - 1);
+        return heightmap.at<uchar>(row, col) / 255.0f * BENCHMARK_TERRAIN_HEIGHT;
+    };
+
+    // Small lights a few units above the terrain, attenuation as in App::add_demo_lights()
+    std::mt19937 rng(2012);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<GpuLight> lights(light_count);
+    for (GpuLight& light : lights) {
+        light = GpuLight{};
+        light.position = glm::vec3(unit(rng) * (heightmap.cols - 1), 0.0f, unit(rng) * (heightmap.rows - 1));
+        light.position.y = terrainHeight(light.position.x, light.position.z) + 2.0f + 4.0f * unit(rng);
+        light.diffuse = glm::vec3(unit(rng), unit(rng), unit(rng));
+        light.specular = light.diffuse * 0.5f;
+        light.constant = 1.0f;
+        light.linear = 0.35f;
+        light.quadratic = 0.44f;
+        light.radius = lightRadius(light);
+    }
+
+    // Camera circles over the terrain, looking ahead along the path and slightly down
+    const float fov_y = glm::radians(60.0f);
+    const float aspect = 16.0f / 9.0f;
+    const glm::vec2 center(heightmap.cols * 0.5f, heightmap.rows * 0.5f);
+    const float path_radius = std::min(heightmap.cols, heightmap.rows) * 0.3f;
+    std::vector<glm::mat4> views(frames);
+    for (int f = 0; f < frames; ++f) {
+        const float angle = 6.2831853f * f / frames;
+        const glm::vec3 eye(center.x + std::cos(angle) * path_radius, 0.0f, center.y + std::sin(angle) * path_radius);
+        const glm::vec3 ahead = eye + glm::vec3(-std::sin(angle), -0.15f, std::cos(angle));
+        const float lift = terrainHeight(eye.x, eye.z) + 8.0f;
+        views[f] = glm::lookAt(eye + glm::vec3(0.0f, lift, 0.0f), ahead + glm::vec3(0.0f, lift, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    LightClusterGrid reference, grid;
+    reference.setProjection(fov_y, aspect);
+    grid.setProjection(fov_y, aspect);
+    ThreadPool pool;
+
+    std::cout << "Light clustering, " << light_count << " lights (radius " << formatFixed(lights[0].radius, 3)
+        << "), " << frames << " frames, grid " << CLUSTER_GRID_X << "x" << CLUSTER_GRID_Y << "x" << CLUSTER_GRID_Z
+        << ", " << pool.size() << " threads\n";
+
+    // Every variant has to produce the lists of the scalar path
+    double scalar_ms = 0.0, simd_ms = 0.0, threaded_ms = 0.0;
+    size_t references = 0, max_per_cluster = 0, occupied = 0, misses = 0;
+    bool identical = true;
+    std::uniform_real_distribution<float> ndc(-1.0f, 1.0f);
+    for (int f = 0; f < frames; ++f) {
+        auto start = BenchmarkClock::now();
+        reference.assignScalar(views[f], lights);
+        scalar_ms += elapsedMs(start);
+
+        start = BenchmarkClock::now();
+        grid.assign(views[f], lights);
+        simd_ms += elapsedMs(start);
+        identical = identical && grid.lightIndices() == reference.lightIndices();
+
+        start = BenchmarkClock::now();
+        grid.assign(views[f], lights, &pool);
+        threaded_ms += elapsedMs(start);
+        identical = identical && grid.lightIndices() == reference.lightIndices();
+        for (size_t c = 0; c < CLUSTER_COUNT; ++c) {
+            const ClusterRange& a = grid.clusterRanges()[c];
+            const ClusterRange& b = reference.clusterRanges()[c];
+            identical = identical && a.offset == b.offset && a.count == b.count;
+            max_per_cluster = std::max<size_t>(max_per_cluster, a.count);
+            occupied += a.count > 0;
+        }
+        references += grid.lightIndices().size();
+
+        // Conservativeness: a point lit by a light has to find the light in its cluster
+        const glm::mat4 inverse_view = glm::inverse(views[f]);
+        const glm::vec4 scale = grid.shaderScale(1, 1);
+        for (int sample = 0; sample < 1000; ++sample) {
+            const float x = ndc(rng), y = ndc(rng);
+            const float depth = 0.5f * std::pow(1000.0f, unit(rng));
+            const glm::vec3 view_position(x * std::tan(fov_y * 0.5f) * aspect * depth, y * std::tan(fov_y * 0.5f) * depth, -depth);
+            const glm::vec3 world = glm::vec3(inverse_view * glm::vec4(view_position, 1.0f));
+            const GLuint tile_x = std::min<GLuint>(static_cast<GLuint>((x * 0.5f + 0.5f) * CLUSTER_GRID_X), CLUSTER_GRID_X - 1);
+            const GLuint tile_y = std::min<GLuint>(static_cast<GLuint>((y * 0.5f + 0.5f) * CLUSTER_GRID_Y), CLUSTER_GRID_Y - 1);
+            const float s = std::log(depth) * scale.z + scale.w;
+            const GLuint z = static_cast<GLuint>(std::clamp(s, 0.0f, static_cast<float>(CLUSTER_GRID_Z - 1)));
+            const ClusterRange& range = grid.clusterRanges()[(z * CLUSTER_GRID_Y + tile_y) * CLUSTER_GRID_X + tile_x];
+            const GLuint* list = grid.lightIndices().data() + range.offset;
+            for (GLuint i = 0; i < static_cast<GLuint>(lights.size()); ++i) {
+                if (glm::distance(world, lights[i].position) < lights[i].radius
+                    && !std::binary_search(list, list + range.count, i)) {
+                    ++misses;
+                }
+            }
+        }
+    }
+
+    BenchmarkTable table({ { "assignment", 22 }, { "ms/frame", 10 }, { "speedup", 10, 2 } });
+    table.row({ "scalar, 1 thread", scalar_ms / frames, 1.0 });
+    table.row({ "SSE, 1 thread", simd_ms / frames, scalar_ms / simd_ms });
+    table.row({ "SSE, " + std::to_string(pool.size()) + " threads", threaded_ms / frames, scalar_ms / threaded_ms });
+    std::cout << "lights per occupied cluster " << formatFixed(occupied > 0 ? static_cast<double>(references) / occupied : 0.0, 1)
+        << " (max " << max_per_cluster << ") instead of " << light_count << " per fragment\n";
+
+    BenchmarkChecks checks;
+    checks.check(identical, "SSE and threaded lists identical to the scalar ones");
+    checks.check(misses == 0, "lit samples find their light in their cluster (missing: ", misses, ")");
+    return checks.exitCode();
+}
@@ -0,0 +1,44 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "MeshOptimizer.hpp"
+#include "OBJloader.hpp"
+#include <iostream>
+
+int benchmarkMeshOptimizer(const std::filesystem::path& models_dir) {
+    if (!std::filesystem::is_directory(models_dir)) {
+        std::cerr << "Benchmark: not a directory: " << models_dir << std::endl;
+        return 1;
+    }
+
+    std::cout << "Mesh optimizer benchmark, FIFO cache of " << VERTEX_CACHE_SIZE << " vertices\n";
+    BenchmarkTable table({ { "file", 24 }, { "triangles", 10 }, { "vertices", 10 }, { "ACMR in", 12 }, { "ACMR out", 10 },
+        { "ATVR in", 10 }, { "ATVR out", 10 }, { "ms", 10, 2 }, { "stable", 8 } });
+    size_t unstable = 0;
+    for (const auto& path : listOBJFiles(models_dir)) {
+        MeshData data;
+        bool ok;
+        {
+            MuteStdout mute;
+            ok = loadOBJMesh(path.string(), data);
+        }
+        if (!ok) {
+            table.row({ path.filename().string() }, "(unsupported, skipped)");
+            continue;
+        }
+
+        // Run twice, the output has to be identical (deterministic cache files)
+        MeshData second = data;
+        const auto start = BenchmarkClock::now();
+        const MeshOptimizationStats stats = optimizeMesh(data);
+        const double ms = elapsedMs(start);
+        optimizeMesh(second);
+        const bool stable = data.indices == second.indices && data.vertices.size() == second.vertices.size();
+        unstable += stable ? 0 : 1;
+        table.row({ path.filename().string(), data.indices.size() / 3, data.vertices.size(), stats.acmr_before,
+            stats.acmr_after, stats.atvr_before, stats.atvr_after, ms, stable });
+    }
+
+    BenchmarkChecks checks;
+    checks.check(unstable == 0, "optimizeMesh gives the same output twice (files differing: ", unstable, ")");
+    return checks.exitCode();
+}
@@ -0,0 +1,81 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "OBJloader.hpp"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+int benchmarkOBJLoader(const std::filesystem::path& models_dir, int iterations) {
+    if (!std::filesystem::is_directory(models_dir)) {
+        std::cerr << "Benchmark: not a directory: " << models_dir << std::endl;
+        return 1;
+    }
+    iterations = std::max(iterations, 1);
+
+    std::cout << "OBJ loader benchmark, " << iterations << " iterations per file\n";
+    BenchmarkTable table({ { "file", 24 }, { "KiB", 10, 1 }, { "vertices", 12 }, { "min ms", 12 }, { "avg ms", 12 },
+        { "MiB/s", 12, 1 } });
+    double total_ms = 0.0;
+    for (const auto& path : listOBJFiles(models_dir)) {
+        const double size_kib = static_cast<double>(std::filesystem::file_size(path)) / 1024.0;
+
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        bool ok = true;
+        double min_ms = 1e30, sum_ms = 0.0;
+        for (int i = 0; i < iterations && ok; ++i) {
+            MuteStdout mute;
+            const auto start = BenchmarkClock::now();
+            ok = loadOBJ(path.string(), vertices, uvs, normals);
+            const double ms = elapsedMs(start);
+            min_ms = std::min(min_ms, ms);
+            sum_ms += ms;
+        }
+        if (!ok) {
+            table.row({ path.filename().string(), size_kib }, "(unsupported, skipped)");
+            continue;
+        }
+        total_ms += min_ms;
+        table.row({ path.filename().string(), size_kib, vertices.size(), min_ms, sum_ms / iterations,
+            (size_kib / 1024.0) / (min_ms / 1000.0) });
+    }
+    std::cout << "Total (best runs): " << formatFixed(total_ms, 3) << " ms" << std::endl;
+    return 0;
+}
+
+int benchmarkOBJThreads(const std::filesystem::path& obj_file, unsigned int max_threads, int iterations) {
+    if (!std::filesystem::is_regular_file(obj_file)) {
+        std::cerr << "Benchmark: file not found: " << obj_file << std::endl;
+        return 1;
+    }
+    iterations = std::max(iterations, 1);
+    if (max_threads == 0) {
+        max_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::cout << "Chunked OBJ parse of " << obj_file.filename().string() << ", "
+        << iterations << " iterations, " << std::thread::hardware_concurrency() << " hardware threads\n";
+    BenchmarkTable table({ { "threads", 8 }, { "min ms", 12 }, { "speedup", 12, 2 } });
+    double single_ms = 0.0;
+    for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+        std::vector<vertex> vertices;
+        std::vector<GLuint> indices;
+        double min_ms = 1e30;
+        for (int i = 0; i < iterations; ++i) {
+            MuteStdout mute;
+            const auto start = BenchmarkClock::now();
+            if (!loadOBJIndexed(obj_file.string(), vertices, indices, threads)) {
+                return 1;
+            }
+            min_ms = std::min(min_ms, elapsedMs(start));
+        }
+        if (threads == 1) {
+            single_ms = min_ms;
+        }
+        table.row({ threads, min_ms, single_ms / min_ms });
+    }
+    std::cout.flush();
+    return 0;
+}
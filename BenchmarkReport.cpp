@@ -0,0 +1,79 @@
+﻿#include "BenchmarkReport.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+double elapsedMs(BenchmarkClock::time_point start, BenchmarkClock::time_point stop) {
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+std::string formatFixed(double value, int precision) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(precision) << value;
+    return text.str();
+}
+
+std::vector<std::filesystem::path> listOBJFiles(const std::filesystem::path& dir) {
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".obj") {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+bool readBenchmarkHeightmap(const std::filesystem::path& file, int flags, cv::Mat& heightmap) {
+    heightmap = cv::imread(file.string(), flags);
+    if (heightmap.empty()) {
+        std::cerr << "Benchmark: cannot read heightmap " << file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+BenchmarkTable::BenchmarkTable(std::vector<Column> columns) : columns(std::move(columns)) {
+    for (size_t c = 0; c < this->columns.size(); ++c) {
+        const Column& column = this->columns[c];
+        std::cout << (c == 0 ? std::left : std::right) << std::setw(column.width) << column.title;
+    }
+    std::cout << std::right << "\n";
+}
+
+void BenchmarkTable::row(std::initializer_list<Cell> cells, const std::string& note) {
+    size_t c = 0;
+    for (const Cell& cell : cells) {
+        if (c == columns.size()) {
+            break;
+        }
+        const Column& column = columns[c];
+        std::cout << (c == 0 ? std::left : std::right) << std::setw(column.width);
+        switch (cell.kind) {
+        case Cell::Kind::Text:
+            std::cout << cell.text;
+            break;
+        case Cell::Kind::Integer:
+            std::cout << static_cast<long long>(cell.number);
+            break;
+        case Cell::Kind::Real:
+            std::cout << std::fixed << std::setprecision(column.precision) << cell.number << std::defaultfloat;
+            break;
+        case Cell::Kind::Flag:
+            std::cout << (cell.number != 0.0 ? "yes" : "NO");
+            break;
+        }
+        ++c;
+    }
+    std::cout << std::right;
+    if (!note.empty()) {
+        std::cout << "  " << note;
+    }
+    std::cout << "\n";
+}
+
+int BenchmarkChecks::exitCode() const {
+    std::cout.flush();
+    return failures == 0 ? 0 : 1;
+}
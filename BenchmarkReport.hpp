@@ -0,0 +1,90 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Shared parts of the command line benchmarks (Benchmark.hpp, one Benchmark<Module>.cpp per
+// module): timing, the result table and the self-checks that decide the exit code.
+
+using BenchmarkClock = std::chrono::steady_clock;
+
+constexpr float BENCHMARK_TERRAIN_HEIGHT = 20.0f;  // terrain scale of App, heightmap 255 / 65535
+
+double elapsedMs(BenchmarkClock::time_point start, BenchmarkClock::time_point stop = BenchmarkClock::now());
+
+// The loaders report every file to std::cout, mute it while measuring
+class MuteStdout {
+public:
+    MuteStdout() : saved(std::cout.rdbuf(nullptr)) {}
+    ~MuteStdout() { std::cout.rdbuf(saved); }
+    MuteStdout(const MuteStdout&) = delete;
+    MuteStdout& operator=(const MuteStdout&) = delete;
+
+private:
+    std::streambuf* saved;
+};
+
+// value with the given number of decimals, for notes and free text lines
+std::string formatFixed(double value, int precision);
+// .obj files of a directory, sorted by name
+std::vector<std::filesystem::path> listOBJFiles(const std::filesystem::path& dir);
+// cv::imread with the given flags, prints the error and returns false if the file cannot be read
+bool readBenchmarkHeightmap(const std::filesystem::path& file, int flags, cv::Mat& heightmap);
+
+// Results on std::cout, one row per measurement: the first column left aligned, the others right
+// aligned to their width. Floating point cells are printed fixed with the column's precision,
+// booleans as yes / NO. The constructor prints the header.
+class BenchmarkTable {
+public:
+    struct Column {
+        std::string title;
+        int width;
+        int precision{ 3 };
+    };
+
+    class Cell {
+    public:
+        Cell(const char* text) : text(text) {}
+        Cell(const std::string& text) : text(text) {}
+        template <typename T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
+        Cell(T value) : number(static_cast<double>(value)), kind(std::is_same_v<T, bool> ? Kind::Flag
+            : std::is_integral_v<T> ? Kind::Integer : Kind::Real) {}
+
+    private:
+        friend class BenchmarkTable;
+        enum class Kind { Text, Integer, Real, Flag };
+        std::string text;
+        double number{ 0.0 };
+        Kind kind{ Kind::Text };
+    };
+
+    explicit BenchmarkTable(std::vector<Column> columns);
+    // Cells fill the first columns, note follows the last of them (units, ratios, "skipped")
+    void row(std::initializer_list<Cell> cells, const std::string& note = "");
+
+private:
+    std::vector<Column> columns;
+};
+
+// Correctness checks run alongside the measurements. Every check prints one line, a failed one
+// makes exitCode() 1.
+class BenchmarkChecks {
+public:
+    template <typename... Parts>
+    bool check(bool passed, const Parts&... description) {
+        std::cout << (passed ? "ok      " : "FAILED  ");
+        (std::cout << ... << description) << "\n";
+        failures += passed ? 0 : 1;
+        return passed;
+    }
+    int exitCode() const;
+
+private:
+    size_t failures{ 0 };
+};
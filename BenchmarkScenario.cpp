@@ -0,0 +1,220 @@
+﻿#include "BenchmarkScenario.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+    glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t) {
+        const float t2 = t * t;
+        const float t3 = t2 * t;
+        return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2
+            + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+
+    glm::vec3 readVec3(const json& value, const char* what) {
+        if (!value.is_array() || value.size() != 3) {
+            throw std::runtime_error(std::string(what) + " must be an array [x, y, z]");
+        }
+        return glm::vec3(value[0].get<float>(), value[1].get<float>(), value[2].get<float>());
+    }
+
+    struct Statistics {
+        float mean{ 0.0f }, min{ 0.0f }, p50{ 0.0f }, p90{ 0.0f }, p95{ 0.0f }, p99{ 0.0f }, max{ 0.0f };
+        size_t count{ 0 };
+    };
+
+    // Nearest rank percentiles like Profiler::frameTimePercentiles, negative samples are skipped
+    Statistics statistics(std::vector<float> values) {
+        values.erase(std::remove_if(values.begin(), values.end(), [](float v) { return v < 0.0f; }), values.end());
+        Statistics result;
+        result.count = values.size();
+        if (values.empty()) {
+            return result;
+        }
+        std::sort(values.begin(), values.end());
+        const size_t n = values.size();
+        auto rank = [&](float p) {
+            const size_t index = static_cast<size_t>(std::ceil(p * n));
+            return values[std::clamp<size_t>(index, 1, n) - 1];
+        };
+        double sum = 0.0;
+        for (float v : values) {
+            sum += v;
+        }
+        result.mean = static_cast<float>(sum / n);
+        result.min = values.front();
+        result.p50 = rank(0.50f);
+        result.p90 = rank(0.90f);
+        result.p95 = rank(0.95f);
+        result.p99 = rank(0.99f);
+        result.max = values.back();
+        return result;
+    }
+
+    json toJson(const Statistics& s) {
+        return json{ {"mean", s.mean}, {"min", s.min}, {"p50", s.p50}, {"p90", s.p90},
+            {"p95", s.p95}, {"p99", s.p99}, {"max", s.max}, {"samples", s.count} };
+    }
+}
+
+CameraKey CameraPath::sample(float t) const {
+    if (keys.empty()) {
+        return CameraKey{ glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+    }
+    if (keys.size() == 1) {
+        return keys.front();
+    }
+    const float position = std::clamp(t, 0.0f, 1.0f) * (keys.size() - 1);
+    const size_t segment = std::min(static_cast<size_t>(position), keys.size() - 2);
+    const float local = position - segment;
+
+    const CameraKey& k0 = keys[segment > 0 ? segment - 1 : 0];
+    const CameraKey& k1 = keys[segment];
+    const CameraKey& k2 = keys[segment + 1];
+    const CameraKey& k3 = keys[std::min(segment + 2, keys.size() - 1)];
+    return CameraKey{
+        catmullRom(k0.position, k1.position, k2.position, k3.position, local),
+        catmullRom(k0.target, k1.target, k2.target, k3.target, local)
+    };
+}
+
+BenchmarkScenario BenchmarkScenario::load(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open benchmark scenario: " + path.string());
+    }
+    json config;
+    try {
+        config = json::parse(file);
+    }
+    catch (const json::exception& e) {
+        throw std::runtime_error("Invalid benchmark scenario " + path.string() + ": " + e.what());
+    }
+
+    BenchmarkScenario scenario;
+    try {
+        scenario.name = config.value("name", path.stem().string());
+        scenario.frames = config.value("frames", scenario.frames);
+        scenario.warmup_frames = config.value("warmup_frames", scenario.warmup_frames);
+        if (config.contains("resolution")) {
+            scenario.width = config["resolution"].at(0).get<int>();
+            scenario.height = config["resolution"].at(1).get<int>();
+        }
+        scenario.lights = config.value("lights", scenario.lights);
+        scenario.chrome_trace = config.value("chrome_trace", scenario.chrome_trace);
+        scenario.output = config.value("output", "benchmark_" + scenario.name);
+
+        std::vector<CameraKey> keys;
+        for (const auto& key : config.at("camera_path")) {
+            keys.push_back(CameraKey{ readVec3(key.at("position"), "position"), readVec3(key.at("target"), "target") });
+        }
+        scenario.camera_path = CameraPath(std::move(keys));
+    }
+    catch (const json::exception& e) {
+        throw std::runtime_error("Invalid benchmark scenario " + path.string() + ": " + e.what());
+    }
+
+    if (scenario.camera_path.empty()) {
+        throw std::runtime_error("Benchmark scenario " + path.string() + " has no camera_path keys");
+    }
+    if (scenario.frames < 1 || scenario.warmup_frames < 0) {
+        throw std::runtime_error("Benchmark scenario " + path.string() + ": frames must be > 0, warmup_frames >= 0");
+    }
+    if (scenario.width < 1 || scenario.height < 1) {
+        throw std::runtime_error("Benchmark scenario " + path.string() + ": invalid resolution");
+    }
+    return scenario;
+}
+
+bool writeBenchmarkReport(const BenchmarkScenario& scenario, const std::vector<BenchmarkFrame>& frames,
+    const std::string& renderer, const std::string& gl_version) {
+    std::vector<float> frame_ms, cpu_ms, gpu_ms, draw_calls, triangles;
+    for (const auto& frame : frames) {
+        frame_ms.push_back(frame.frame_ms);
+        cpu_ms.push_back(frame.cpu_ms);
+        gpu_ms.push_back(frame.gpu_ms);
+        draw_calls.push_back(static_cast<float>(frame.draw_calls));
+        triangles.push_back(static_cast<float>(frame.triangles));
+    }
+    const Statistics frame_stats = statistics(frame_ms);
+    const Statistics cpu_stats = statistics(cpu_ms);
+    const Statistics gpu_stats = statistics(gpu_ms);
+    const Statistics draw_stats = statistics(draw_calls);
+    const Statistics triangle_stats = statistics(triangles);
+
+    std::filesystem::path csv_path = scenario.output;
+    csv_path += ".csv";
+    std::ofstream csv(csv_path);
+    if (!csv.is_open()) {
+        std::cerr << "Cannot write " << csv_path << std::endl;
+        return false;
+    }
+    csv << "frame,frame_ms,cpu_ms,gpu_ms,draw_calls,triangles\n" << std::fixed << std::setprecision(4);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const BenchmarkFrame& frame = frames[i];
+        csv << i << ',' << frame.frame_ms << ',' << frame.cpu_ms << ',' << frame.gpu_ms << ','
+            << frame.draw_calls << ',' << frame.triangles << '\n';
+    }
+
+    json report = {
+        {"scenario", scenario.name},
+        {"renderer", renderer},
+        {"gl_version", gl_version},
+        {"resolution", {scenario.width, scenario.height}},
+        {"frames", frames.size()},
+        {"warmup_frames", scenario.warmup_frames},
+        {"lights", scenario.lights},
+        {"fps_mean", frame_stats.mean > 0.0f ? 1000.0f / frame_stats.mean : 0.0f},
+        {"frame_ms", toJson(frame_stats)},
+        {"cpu_ms", toJson(cpu_stats)},
+        {"gpu_ms", toJson(gpu_stats)},
+        {"draw_calls", toJson(draw_stats)},
+        {"triangles", toJson(triangle_stats)}
+    };
+    std::filesystem::path json_path = scenario.output;
+    json_path += ".json";
+    std::ofstream summary(json_path);
+    if (!summary.is_open()) {
+        std::cerr << "Cannot write " << json_path << std::endl;
+        return false;
+    }
+    summary << report.dump(4);
+
+    const std::ios_base::fmtflags flags = std::cout.flags();
+    const std::streamsize precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(2)
+        << "Benchmark " << scenario.name << ": " << frames.size() << " frames at "
+        << scenario.width << "x" << scenario.height << " on " << renderer << "\n"
+        << "  frame ms  mean " << frame_stats.mean << "  p50 " << frame_stats.p50 << "  p95 " << frame_stats.p95
+        << "  p99 " << frame_stats.p99 << "  max " << frame_stats.max << "  (" << 1000.0f / std::max(frame_stats.mean, 1e-3f) << " FPS)\n"
+        << "  cpu ms    p50 " << cpu_stats.p50 << "  p95 " << cpu_stats.p95 << "\n"
+        << "  gpu ms    p50 " << gpu_stats.p50 << "  p95 " << gpu_stats.p95 << "  (" << gpu_stats.count << " samples)\n"
+        << std::setprecision(0)
+        << "  per frame " << draw_stats.mean << " draw calls, " << triangle_stats.mean << " triangles\n"
+        << "Results: " << csv_path.string() << ", " << json_path.string() << std::endl;
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+    return csv.good() && summary.good();
+}
+
+bool writeCameraPath(const std::filesystem::path& path, const std::vector<CameraKey>& keys) {
+    json camera_path = json::array();
+    for (const auto& key : keys) {
+        camera_path.push_back({
+            {"position", {key.position.x, key.position.y, key.position.z}},
+            {"target", {key.target.x, key.target.y, key.target.z}}
+        });
+    }
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << json{ {"name", path.stem().string()}, {"camera_path", camera_path} }.dump(4);
+    return file.good();
+}
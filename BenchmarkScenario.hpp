@@ -0,0 +1,71 @@
+﻿#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Headless benchmark: my_app --benchmark <scenario.json> flies the camera along a scripted path
+// over the scene, renders into an offscreen framebuffer in a hidden window and writes the frame
+// statistics. There is no input, no ImGui and no vsync, animations run on a fixed 60 Hz clock
+// so every run renders the same frames. On a GPU-less Linux box it runs on Mesa llvmpipe
+// under a virtual X server:
+//     LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a ./my_app --benchmark resources/benchmarks/terrain_flyover.json
+//
+// Scenario file (everything except camera_path is optional):
+//     { "name": "terrain_flyover", "frames": 600, "warmup_frames": 60, "resolution": [1280, 720],
+//       "lights": 256, "output": "benchmark_terrain_flyover", "chrome_trace": false,
+//       "camera_path": [ { "position": [x, y, z], "target": [x, y, z] }, ... ] }
+// F7 in the interactive app records camera keys, they are saved as recorded_camera_path.json
+// in the same format when the window closes.
+
+struct CameraKey {
+    glm::vec3 position;
+    glm::vec3 target;  // point the camera looks at
+};
+
+// Uniform Catmull-Rom spline through the keys, the first and the last key are repeated at the ends
+class CameraPath {
+public:
+    CameraPath() = default;
+    explicit CameraPath(std::vector<CameraKey> keys) : keys(std::move(keys)) {}
+
+    CameraKey sample(float t) const;  // t in [0, 1] over the whole path
+    const std::vector<CameraKey>& getKeys() const { return keys; }
+    bool empty() const { return keys.empty(); }
+
+private:
+    std::vector<CameraKey> keys;
+};
+
+struct BenchmarkScenario {
+    std::string name{ "benchmark" };
+    CameraPath camera_path;
+    int frames{ 600 };          // measured frames, the path is traversed once
+    int warmup_frames{ 60 };    // rendered at the start of the path first, not measured
+    int width{ 1280 };          // offscreen framebuffer
+    int height{ 720 };
+    size_t lights{ 0 };         // demo lights, like --lights N
+    bool chrome_trace{ false }; // also write <output>.trace.json from the profiler
+    std::filesystem::path output;  // <output>.csv per frame, <output>.json summary
+
+    // Throws std::runtime_error if the file cannot be read or a value is invalid
+    static BenchmarkScenario load(const std::filesystem::path& path);
+};
+
+// One measured frame
+struct BenchmarkFrame {
+    float frame_ms{ 0.0f };  // start of this frame to the start of the next one
+    float cpu_ms{ 0.0f };    // building and submitting the frame
+    float gpu_ms{ -1.0f };   // first to last GPU command of the frame (timestamps), negative if unknown
+    uint64_t draw_calls{ 0 };
+    uint64_t triangles{ 0 };
+};
+
+// Writes <output>.csv and <output>.json and prints the summary, false if a file cannot be written
+bool writeBenchmarkReport(const BenchmarkScenario& scenario, const std::vector<BenchmarkFrame>& frames,
+    const std::string& renderer, const std::string& gl_version);
+
+// Camera keys as a scenario file that --benchmark accepts
+bool writeCameraPath(const std::filesystem::path& path, const std::vector<CameraKey>& keys);
@@ -0,0 +1,98 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "SceneGraph.hpp"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int benchmarkSceneGraph(int node_count, int frames) {
+    node_count = std::max(node_count, 4);
+    frames = std::max(frames, 1);
+    // Objects of 4 nodes: a body with two parts, one of them with a part of its own (like a
+    // tractor with wheels and a loader arm)
+    std::mt19937 rng(2021);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomTransform = [&](SceneGraph& scene, SceneNodeId node, float spread) {
+        scene.setTransform(node, glm::vec3(unit(rng), unit(rng), unit(rng)) * spread,
+            glm::vec3(unit(rng), unit(rng), unit(rng)) * 6.2831853f, glm::vec3(0.5f + unit(rng)));
+        scene.setLocalBounds(node, AABB{ glm::vec3(-1.0f), glm::vec3(1.0f) });
+    };
+    SceneGraph scene;
+    std::vector<SceneNodeId> objects;
+    std::vector<SceneNodeId> all;
+    for (int i = 0; i + 4 <= node_count; i += 4) {
+        const SceneNodeId body = scene.create();
+        const SceneNodeId first = scene.create(body), second = scene.create(body);
+        const SceneNodeId third = scene.create(second);
+        randomTransform(scene, body, 1000.0f);
+        randomTransform(scene, first, 2.0f);
+        randomTransform(scene, second, 2.0f);
+        randomTransform(scene, third, 2.0f);
+        objects.push_back(body);
+        all.insert(all.end(), { body, first, second, third });
+    }
+    scene.update();
+
+    // Every frame every matrix from scratch, parents before children like the update
+    std::vector<glm::mat4> rebuilt(all.size());
+    auto start = BenchmarkClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        for (size_t i = 0; i < all.size(); i += 4) {
+            for (size_t k = 0; k < 4; ++k) {
+                const SceneNodeId node = all[i + k];
+                const glm::mat4 local = composeTransform(scene.position(node), scene.rotation(node), scene.scale(node));
+                const size_t parent = k == 0 ? 0 : (k == 3 ? i + 2 : i);
+                rebuilt[i + k] = k == 0 ? local : rebuilt[parent] * local;
+            }
+        }
+    }
+    const double rebuild_ms = elapsedMs(start) / frames;
+
+    size_t computed = 0;
+    start = BenchmarkClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        computed += scene.update();
+    }
+    const double static_ms = elapsedMs(start) / frames;
+    const size_t static_computed = computed;
+
+    const size_t moving = std::max<size_t>(objects.size() / 100, 1);
+    computed = 0;
+    double moving_ms = 0.0;
+    for (int frame = 0; frame < frames; ++frame) {
+        for (size_t i = 0; i < moving; ++i) {
+            const SceneNodeId body = objects[(static_cast<size_t>(frame) * moving + i) % objects.size()];
+            scene.setPosition(body, scene.position(body) + glm::vec3(0.1f, 0.0f, 0.0f));
+        }
+        start = BenchmarkClock::now();
+        computed += scene.update();
+        moving_ms += elapsedMs(start);
+    }
+    moving_ms /= frames;
+
+    // Cached results against a recomputation with the final transforms
+    size_t mismatches = 0;
+    for (size_t i = 0; i < all.size(); ++i) {
+        const SceneNodeId node = all[i];
+        const SceneNodeId parent = scene.parent(node);
+        const glm::mat4 local = composeTransform(scene.position(node), scene.rotation(node), scene.scale(node));
+        const glm::mat4 world = parent == NO_SCENE_NODE ? local : scene.worldMatrix(parent) * local;
+        const AABB bounds = transformBounds(world, AABB{ glm::vec3(-1.0f), glm::vec3(1.0f) });
+        float error = glm::length(bounds.min - scene.worldBounds(node).min) + glm::length(bounds.max - scene.worldBounds(node).max);
+        for (int c = 0; c < 4; ++c) {
+            error += glm::length(world[c] - scene.worldMatrix(node)[c]);
+        }
+        mismatches += error > 1e-3f ? 1 : 0;
+    }
+
+    std::cout << "Scene graph, " << all.size() << " nodes in " << objects.size() << " objects, " << frames << " frames\n";
+    BenchmarkTable table({ { "update", 30 }, { "ms/frame", 12 }, { "matrices/frame", 18 } });
+    table.row({ "rebuild all every frame", rebuild_ms, all.size() }, "checksum " + formatFixed(rebuilt.back()[3].x, 3));
+    table.row({ "cached, static", static_ms, static_computed / frames });
+    table.row({ "cached, 1% of objects moving", moving_ms, computed / frames });
+
+    BenchmarkChecks checks;
+    checks.check(mismatches == 0, "cached matrices match a recomputation (differing: ", mismatches, ")");
+    return checks.exitCode();
+}
@@ -0,0 +1,137 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "Terrain.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <set>
+#include <utility>
+
+namespace {
+    // Heightmap samples (x, z) an index range uses on one border line of its chunk
+    std::set<std::pair<int, int>> edgeVertices(const Terrain& terrain, const Terrain::IndexRange& range,
+        const Terrain::Chunk& chunk, bool vertical, int line) {
+        std::set<std::pair<int, int>> result;
+        const int stride = terrain.rowStride();
+        for (GLuint i = range.first; i < range.first + range.count; ++i) {
+            const int x = static_cast<int>(terrain.getIndices()[i]) % stride;
+            const int z = static_cast<int>(terrain.getIndices()[i]) / stride;
+            if ((vertical ? x : z) == line) {
+                result.insert({ chunk.x0 + x, chunk.z0 + z });
+            }
+        }
+        return result;
+    }
+}
+
+int benchmarkTerrain(const std::filesystem::path& heightmap_file, int frames) {
+    cv::Mat heightmap;
+    if (!readBenchmarkHeightmap(heightmap_file, cv::IMREAD_GRAYSCALE, heightmap)) {
+        return 1;
+    }
+    frames = std::max(frames, 1);
+
+    // The app's default mode, Mesh mode only for the comparison (same chunks and index lists up to the row stride)
+    Terrain terrain, mesh_terrain;
+    auto start = BenchmarkClock::now();
+    terrain.build(heightmap, BENCHMARK_TERRAIN_HEIGHT, 1.0f, TerrainMode::Heightmap);
+    const double build_ms = elapsedMs(start);
+    start = BenchmarkClock::now();
+    mesh_terrain.build(heightmap, BENCHMARK_TERRAIN_HEIGHT, 1.0f, TerrainMode::Mesh);
+    const double mesh_build_ms = elapsedMs(start);
+    std::cout << "Terrain " << heightmap.cols << "x" << heightmap.rows << ", " << terrain.chunksX() << "x" << terrain.chunksZ()
+        << " chunks of " << TERRAIN_CHUNK_SIZE << " cells, " << terrain.getSizeClasses().size() << " chunk sizes, "
+        << terrain.getIndices().size() << " indices in all variants\n";
+    BenchmarkTable modes({ { "mode", 20 }, { "GPU KB", 10, 1 }, { "build ms", 10, 1 } });
+    modes.row({ "heightmap", terrain.gpuMemory() / 1024.0, build_ms });
+    modes.row({ "vertex grid", mesh_terrain.gpuMemory() / 1024.0, mesh_build_ms });
+
+    // Every variant covers its chunk exactly once: no triangle flipped, total area = chunk area. Where two
+    // stitched edges meet, one triangle is flat seen from above, it closes the T-junction of the corner cell.
+    size_t bad_variants = 0;
+    const int stride = terrain.rowStride();
+    for (const auto& size_class : terrain.getSizeClasses()) {
+        for (const auto& level : size_class.variants) {
+            for (const auto& range : level) {
+                long long area = 0;
+                bool wound = true;
+                for (GLuint i = range.first; i < range.first + range.count; i += 3) {
+                    int x[3], z[3];
+                    for (int k = 0; k < 3; ++k) {
+                        x[k] = static_cast<int>(terrain.getIndices()[i + k]) % stride;
+                        z[k] = static_cast<int>(terrain.getIndices()[i + k]) / stride;
+                    }
+                    const long long doubled = static_cast<long long>(z[1] - z[0]) * (x[2] - x[0]) - static_cast<long long>(x[1] - x[0]) * (z[2] - z[0]);
+                    wound = wound && doubled >= 0;
+                    area += doubled;
+                }
+                if (!wound || area != 2LL * size_class.cells_x * size_class.cells_z) {
+                    ++bad_variants;
+                }
+            }
+        }
+    }
+
+    // Camera circles over the terrain like in --bench-clusters, same projection as App
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 20000.0f);
+    const glm::vec2 center(heightmap.cols * 0.5f, heightmap.rows * 0.5f);
+    const float path_radius = std::min(heightmap.cols, heightmap.rows) * 0.3f;
+    double select_ms = 0.0, triangles = 0.0, visible = 0.0;
+    size_t min_triangles = SIZE_MAX, max_triangles = 0, cracks = 0;
+    for (int f = 0; f < frames; ++f) {
+        const float angle = 6.2831853f * f / frames;
+        const int col = std::clamp(static_cast<int>(center.x + std::cos(angle) * path_radius), 0, heightmap.cols - 1);
+        const int row = std::clamp(static_cast<int>(center.y + std::sin(angle) * path_radius), 0, heightmap.rows - 1);
+        const glm::vec3 eye(static_cast<float>(col), heightmap.at<uchar>(row, col) / 255.0f * BENCHMARK_TERRAIN_HEIGHT + 8.0f,
+            static_cast<float>(row));
+        const glm::vec3 ahead = eye + glm::vec3(-std::sin(angle), -0.15f, std::cos(angle));
+        const glm::mat4 view = glm::lookAt(eye, ahead, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        start = BenchmarkClock::now();
+        terrain.select(projection * view, eye);
+        select_ms += elapsedMs(start);
+        const size_t drawn = terrain.lastStats().triangles;
+        triangles += static_cast<double>(drawn);
+        visible += static_cast<double>(terrain.lastStats().visible_chunks);
+        min_triangles = std::min(min_triangles, drawn);
+        max_triangles = std::max(max_triangles, drawn);
+
+        // Crack free: neighbouring chunks use the same vertices on their shared border
+        for (int cz = 0; cz < terrain.chunksZ(); ++cz) {
+            for (int cx = 0; cx < terrain.chunksX(); ++cx) {
+                const Terrain::Chunk& chunk = terrain.getChunks()[cz * terrain.chunksX() + cx];
+                const Terrain::SizeClass& size_class = terrain.getSizeClasses()[chunk.size_class];
+                if (cx + 1 < terrain.chunksX()) {
+                    const Terrain::Chunk& east = terrain.getChunks()[cz * terrain.chunksX() + cx + 1];
+                    if (edgeVertices(terrain, terrain.chunkIndices(cx, cz), chunk, true, size_class.cells_x)
+                        != edgeVertices(terrain, terrain.chunkIndices(cx + 1, cz), east, true, 0)) {
+                        ++cracks;
+                    }
+                }
+                if (cz + 1 < terrain.chunksZ()) {
+                    const Terrain::Chunk& south = terrain.getChunks()[(cz + 1) * terrain.chunksX() + cx];
+                    if (edgeVertices(terrain, terrain.chunkIndices(cx, cz), chunk, false, size_class.cells_z)
+                        != edgeVertices(terrain, terrain.chunkIndices(cx, cz + 1), south, false, 0)) {
+                        ++cracks;
+                    }
+                }
+            }
+        }
+    }
+
+    const double average = triangles / frames;
+    BenchmarkTable selection({ { "per frame", 20 }, { "average", 10 } });
+    selection.row({ "select ms", select_ms / frames });
+    selection.row({ "visible chunks", static_cast<size_t>(visible / frames + 0.5) },
+        "of " + std::to_string(terrain.getChunks().size()));
+    selection.row({ "triangles", static_cast<size_t>(average + 0.5) }, "min " + std::to_string(min_triangles) + ", max "
+        + std::to_string(max_triangles) + ", " + formatFixed(terrain.fullTriangles() / std::max(average, 1.0), 1)
+        + "x fewer than the " + std::to_string(terrain.fullTriangles()) + " at full detail");
+
+    BenchmarkChecks checks;
+    checks.check(bad_variants == 0, "index variants cover their chunk exactly once (with holes or overlaps: ", bad_variants, ")");
+    checks.check(cracks == 0, "neighbouring chunks share their border vertices (cracked borders: ", cracks, ")");
+    return checks.exitCode();
+}
@@ -0,0 +1,57 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "TerrainBuilder.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+int benchmarkTerrainBuild(const std::vector<std::filesystem::path>& heightmap_files, int iterations) {
+    iterations = std::max(iterations, 1);
+    ThreadPool pool;
+    std::cout << "Terrain vertex grid, best of " << iterations << " runs, " << pool.size() << " threads\n";
+    BenchmarkTable table({ { "heightmap", 24 }, { "bits", 8 }, { "scalar ms", 12 }, { "SSE ms", 12 }, { "threads ms", 14 },
+        { "speedup", 10, 1 }, { "identical", 11 } });
+
+    size_t differing = 0;
+    for (const auto& file : heightmap_files) {
+        // 8 bit as App loads it, 16 bit as the file stores it
+        for (const int flags : { static_cast<int>(cv::IMREAD_GRAYSCALE), cv::IMREAD_GRAYSCALE | cv::IMREAD_ANYDEPTH }) {
+            cv::Mat heightmap;
+            if (!readBenchmarkHeightmap(file, flags, heightmap)) {
+                return 1;
+            }
+            auto best = [&](auto build, std::vector<vertex>& vertices) {
+                double min_ms = 1e30;
+                for (int i = 0; i < iterations; ++i) {
+                    const auto start = BenchmarkClock::now();
+                    build(vertices);
+                    min_ms = std::min(min_ms, elapsedMs(start));
+                }
+                return min_ms;
+            };
+            std::vector<vertex> scalar, sse, threaded;
+            const double scalar_ms = best([&](std::vector<vertex>& v) {
+                buildTerrainVerticesScalar(heightmap, BENCHMARK_TERRAIN_HEIGHT, 1.0f, v);
+            }, scalar);
+            const double sse_ms = best([&](std::vector<vertex>& v) {
+                buildTerrainVertices(heightmap, BENCHMARK_TERRAIN_HEIGHT, 1.0f, v);
+            }, sse);
+            const double threaded_ms = best([&](std::vector<vertex>& v) {
+                buildTerrainVertices(heightmap, BENCHMARK_TERRAIN_HEIGHT, 1.0f, v, &pool);
+            }, threaded);
+            const size_t bytes = scalar.size() * sizeof(vertex);
+            const bool identical = sse.size() == scalar.size() && threaded.size() == scalar.size()
+                && std::memcmp(sse.data(), scalar.data(), bytes) == 0 && std::memcmp(threaded.data(), scalar.data(), bytes) == 0;
+            differing += identical ? 0 : 1;
+
+            table.row({ file.filename().string() + " " + std::to_string(heightmap.cols) + "x" + std::to_string(heightmap.rows),
+                heightmap.depth() == CV_16U ? 16 : 8, scalar_ms, sse_ms, threaded_ms, scalar_ms / threaded_ms, identical });
+        }
+    }
+
+    BenchmarkChecks checks;
+    checks.check(differing == 0, "SSE and threaded vertices bit for bit the scalar ones (differing grids: ", differing, ")");
+    return checks.exitCode();
+}
@@ -0,0 +1,95 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "TerrainTiles.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int benchmarkTerrainStreaming(const std::filesystem::path& tiles_file, size_t memory_mb, int frames) {
+    TerrainTileFile file;
+    if (!file.open(tiles_file)) {
+        return 1;
+    }
+    frames = std::max(frames, 1);
+    const float radius = 1024.0f;     // App's default terrain_view_distance
+    const size_t gpu_tiles = 64;      // App's default terrain_gpu_tiles, the cache wants as many
+    TerrainTileCache cache(file, memory_mb << 20);
+    std::cout << "Terrain tiles " << file.width() << "x" << file.height() << ", " << file.tilesX() << "x" << file.tilesZ()
+        << " tiles of " << TERRAIN_TILE_CELLS << " cells, " << formatFixed(file.tileCount() * (TERRAIN_TILE_BYTES / 1048576.0), 1)
+        << " MB of heights, budget " << formatFixed(cache.memoryBudget() / 1048576.0, 1) << " MB" << std::endl;
+
+    // Loaded tiles hold exactly the file's samples
+    size_t mismatches = 0;
+    auto verify = [&]() {
+        for (int index : cache.wantedTiles()) {
+            const uint16_t* samples = cache.tile(index);
+            if (samples && std::memcmp(samples, file.tile(index), TERRAIN_TILE_BYTES) != 0) {
+                ++mismatches;
+            }
+        }
+    };
+    // Wanted tiles not in memory yet with cells closer than reach, the far ones are prefetched ahead of time
+    auto missing = [&](const glm::vec2& position, float reach) {
+        return static_cast<size_t>(std::count_if(cache.wantedTiles().begin(), cache.wantedTiles().end(), [&](int index) {
+            const glm::vec2 low(static_cast<float>(index % file.tilesX() * TERRAIN_TILE_CELLS),
+                static_cast<float>(index / file.tilesX() * TERRAIN_TILE_CELLS));
+            const glm::vec2 high = low + glm::vec2(static_cast<float>(TERRAIN_TILE_CELLS));
+            const float distance = glm::length(glm::max(glm::max(low - position, position - high), glm::vec2(0.0f)));
+            return distance <= reach && cache.tile(index) == nullptr;
+        }));
+    };
+
+    // Diagonal flight corner to corner at a steady 60 Hz pace, the loads run while the "frame" sleeps
+    const glm::vec2 from(file.width() * 0.05f, file.height() * 0.05f);
+    const glm::vec2 to(file.width() * 0.95f, file.height() * 0.95f);
+    const auto frame_time = std::chrono::microseconds(16667);
+    std::vector<double> update_ms;
+    update_ms.reserve(frames);
+    size_t peak_bytes = 0, frames_missing = 0, tiles_missing = 0;
+    auto next_frame = BenchmarkClock::now();
+    for (int f = 0; f < frames; ++f) {
+        const glm::vec2 position = from + (to - from) * (static_cast<float>(f) / std::max(frames - 1, 1));
+        const auto start = BenchmarkClock::now();
+        cache.update(position, radius, gpu_tiles);
+        update_ms.push_back(elapsedMs(start));
+        peak_bytes = std::max(peak_bytes, cache.getStats().used_bytes);
+        const size_t not_loaded = missing(position, radius * 0.5f);
+        frames_missing += not_loaded > 0;
+        tiles_missing += not_loaded;
+        verify();
+        next_frame += frame_time;
+        std::this_thread::sleep_until(next_frame);
+    }
+
+    // The camera stops: everything it wants arrives
+    const auto settle = BenchmarkClock::now();
+    while (missing(to, radius) > 0 && elapsedMs(settle) < 5000.0) {
+        cache.update(to, radius, gpu_tiles);
+        peak_bytes = std::max(peak_bytes, cache.getStats().used_bytes);
+        std::this_thread::sleep_for(frame_time);
+    }
+    const double settle_ms = elapsedMs(settle);
+    const size_t left = missing(to, radius);
+    verify();
+
+    std::sort(update_ms.begin(), update_ms.end());
+    const TerrainTileCache::Stats& stats = cache.getStats();
+    BenchmarkTable table({ { "", 20 }, { "value", 10, 3 } });
+    table.row({ "update ms, median", update_ms[update_ms.size() / 2] }, "max " + formatFixed(update_ms.back(), 3));
+    table.row({ "peak memory MB", peak_bytes / 1048576.0 }, "of " + formatFixed(cache.memoryBudget() / 1048576.0, 1));
+    table.row({ "loads", stats.loads }, std::to_string(stats.evictions) + " evictions");
+    table.row({ "frames waiting", frames_missing }, "of " + std::to_string(frames) + " for tiles within "
+        + formatFixed(radius * 0.5f, 0) + " cells ("
+        + formatFixed(frames_missing ? static_cast<double>(tiles_missing) / frames_missing : 0.0, 1) + " tiles on average)");
+    table.row({ "settled in ms", settle_ms });
+
+    BenchmarkChecks checks;
+    checks.check(peak_bytes <= cache.memoryBudget(), "memory stays within the budget");
+    checks.check(mismatches == 0, "loaded tiles hold the file's samples (differing: ", mismatches, ")");
+    checks.check(left == 0, "wanted tiles arrive once the camera stops (missing: ", left, ")");
+    return checks.exitCode();
+}
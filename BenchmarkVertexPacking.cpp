@@ -0,0 +1,69 @@
+﻿#include "Benchmark.hpp"
+#include "BenchmarkReport.hpp"
+#include "OBJloader.hpp"
+#include "VertexPacking.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+int checkVertexPacking(const std::filesystem::path& models_dir) {
+    if (!std::filesystem::is_directory(models_dir)) {
+        std::cerr << "Benchmark: not a directory: " << models_dir << std::endl;
+        return 1;
+    }
+
+    // Error bounds of the packed_vertex encodings
+    constexpr float MAX_POSITION_ERROR = 0.5f / 65535.0f + 1e-6f;  // relative to the AABB extent
+    constexpr float MAX_NORMAL_DEGREES = 0.25f;                     // 10 bit snorm per component
+    constexpr float MAX_UV_ERROR = 1.0f / 2048.0f;                  // half float, relative
+    auto scientific = [](float value) {
+        std::ostringstream text;
+        text << std::scientific << std::setprecision(2) << value;
+        return text.str();
+    };
+
+    std::cout << "Packed vertex round trip (" << sizeof(vertex) << " -> " << sizeof(packed_vertex) << " bytes)\n";
+    BenchmarkTable table({ { "file", 24 }, { "vertices", 10 }, { "pos err/ext", 14 }, { "normal deg", 12 }, { "uv err", 12 },
+        { "ok", 6 } });
+    size_t failed = 0;
+    for (const auto& path : listOBJFiles(models_dir)) {
+        MeshData data;
+        bool ok;
+        {
+            MuteStdout mute;
+            ok = loadOBJMesh(path.string(), data);
+        }
+        if (!ok) {
+            table.row({ path.filename().string() }, "(unsupported, skipped)");
+            continue;
+        }
+
+        const PositionQuantization quantization = computePositionQuantization(data.vertices);
+        float position_error = 0.0f, normal_degrees = 0.0f, uv_error = 0.0f;
+        for (const vertex& v : data.vertices) {
+            const vertex r = unpackVertex(packVertex(v, quantization), quantization);
+            for (int c = 0; c < 3; ++c) {
+                position_error = std::max(position_error, std::abs(r.position[c] - v.position[c]) / quantization.scale[c]);
+            }
+            const float length = glm::length(v.normal);
+            if (length > 0.0f) {
+                const float cosine = glm::clamp(glm::dot(v.normal / length, glm::normalize(r.normal)), -1.0f, 1.0f);
+                normal_degrees = std::max(normal_degrees, glm::degrees(std::acos(cosine)));
+            }
+            for (int c = 0; c < 2; ++c) {
+                uv_error = std::max(uv_error, std::abs(r.texCoord[c] - v.texCoord[c]) / std::max(1.0f, std::abs(v.texCoord[c])));
+            }
+        }
+        const bool passed = position_error <= MAX_POSITION_ERROR && normal_degrees <= MAX_NORMAL_DEGREES && uv_error <= MAX_UV_ERROR;
+        failed += passed ? 0 : 1;
+        table.row({ path.filename().string(), data.vertices.size(), scientific(position_error), normal_degrees,
+            scientific(uv_error), passed });
+    }
+
+    BenchmarkChecks checks;
+    checks.check(failed == 0, "round trip within ", scientific(MAX_POSITION_ERROR), " of the extent, ", MAX_NORMAL_DEGREES,
+        " degrees, uv ", scientific(MAX_UV_ERROR), " (files exceeding: ", failed, ")");
+    return checks.exitCode();
+}
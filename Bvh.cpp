@@ -0,0 +1,359 @@
+﻿#include "Bvh.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+namespace {
+    // Depth first traversal keeps at most one pending sibling per level
+    constexpr int STACK_SIZE = BVH_MAX_DEPTH + 2;
+
+    // Written out per component, called for every item at every level of build()
+    AABB merge(const AABB& a, const AABB& b) {
+        return AABB{ glm::vec3(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)),
+            glm::vec3(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)) };
+    }
+
+    AABB emptyBox() {
+        return AABB{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+    }
+
+    float halfArea(const AABB& box) {
+        const glm::vec3 d = box.max - box.min;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    constexpr uint8_t ALL_PLANES = 0x3F;
+    constexpr uint8_t OUTSIDE = 0xFF;
+
+    // Of the planes in mask, those box straddles (OUTSIDE if it is behind one of them). A box
+    // inside a plane has all its children inside it, they skip the plane.
+    uint8_t straddledPlanes(const Frustum& frustum, const AABB& box, uint8_t mask) {
+        uint8_t straddled = 0;
+        for (int i = 0; i < 6; ++i) {
+            if (!(mask & (1 << i))) {
+                continue;
+            }
+            const glm::vec4& plane = frustum.getPlanes()[i];
+            // furthest corner along the normal (as in Frustum::intersects) and the nearest one
+            const glm::vec3 far_corner(plane.x >= 0.0f ? box.max.x : box.min.x,
+                plane.y >= 0.0f ? box.max.y : box.min.y,
+                plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(glm::vec3(plane), far_corner) + plane.w < 0.0f) {
+                return OUTSIDE;
+            }
+            const glm::vec3 near_corner(plane.x >= 0.0f ? box.min.x : box.max.x,
+                plane.y >= 0.0f ? box.min.y : box.max.y,
+                plane.z >= 0.0f ? box.min.z : box.max.z);
+            if (glm::dot(glm::vec3(plane), near_corner) + plane.w < 0.0f) {
+                straddled |= 1 << i;
+            }
+        }
+        return straddled;
+    }
+}
+
+bool intersectRayBox(const glm::vec3& origin, const glm::vec3& direction, const AABB& box, float max_t, float& t) {
+    float t0 = 0.0f, t1 = max_t;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (direction[axis] == 0.0f) {
+            if (origin[axis] < box.min[axis] || origin[axis] > box.max[axis]) {
+                return false;
+            }
+            continue;
+        }
+        const float inverse = 1.0f / direction[axis];
+        float near_t = (box.min[axis] - origin[axis]) * inverse;
+        float far_t = (box.max[axis] - origin[axis]) * inverse;
+        if (near_t > far_t) {
+            std::swap(near_t, far_t);
+        }
+        t0 = std::max(t0, near_t);
+        t1 = std::min(t1, far_t);
+        if (t0 > t1) {
+            return false;
+        }
+    }
+    t = t0;
+    return true;
+}
+
+void Bvh::build(const AABB* boxes, size_t count) {
+    clear();
+    if (count == 0) {
+        return;
+    }
+    item_boxes.assign(boxes, boxes + count);
+    items.resize(count);
+    item_leaves.resize(count);
+    std::vector<BuildItem> build_items(count);
+    for (size_t i = 0; i < count; ++i) {
+        build_items[i] = BuildItem{ boxes[i], boxes[i].center(), static_cast<uint32_t>(i) };
+    }
+
+    nodes.reserve(2 * (count / BVH_MAX_LEAF_ITEMS + 1));
+    parents.reserve(nodes.capacity());
+    subtree_items.reserve(nodes.capacity());
+    nodes.push_back(Node{ AABB{}, 0, static_cast<uint32_t>(count) });
+    parents.push_back(0);
+    subtree_items.emplace_back(0u, static_cast<uint32_t>(count));
+    split(0, 0, build_items);
+}
+
+void Bvh::clear() {
+    nodes.clear();
+    parents.clear();
+    subtree_items.clear();
+    items.clear();
+    item_leaves.clear();
+    item_boxes.clear();
+}
+
+void Bvh::split(uint32_t node, int depth, std::vector<BuildItem>& build_items) {
+    const uint32_t first = nodes[node].first, count = nodes[node].count;
+    AABB bounds = emptyBox(), centroid_bounds = emptyBox();
+    for (uint32_t i = first; i < first + count; ++i) {
+        bounds = merge(bounds, build_items[i].box);
+        centroid_bounds.min = glm::min(centroid_bounds.min, build_items[i].centroid);
+        centroid_bounds.max = glm::max(centroid_bounds.max, build_items[i].centroid);
+    }
+    nodes[node].bounds = bounds;
+    if (count <= BVH_MAX_LEAF_ITEMS) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            items[i] = build_items[i].item;
+            item_leaves[items[i]] = node;
+        }
+        return;
+    }
+
+    const glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    uint32_t middle = first + count / 2;
+    // A denormal extent would make the bin scale infinite
+    const float scale = BVH_BINS / extent[axis];
+    const bool binned = extent[axis] > 0.0f && std::isfinite(scale) && depth < BVH_SAH_DEPTH;
+    if (binned) {
+        // Items per bin of the centroid range, then the cost of splitting after every bin
+        auto binOf = [&](const BuildItem& build_item) {
+            return std::min(BVH_BINS - 1, static_cast<int>((build_item.centroid[axis] - centroid_bounds.min[axis]) * scale));
+        };
+        AABB bin_bounds[BVH_BINS];
+        uint32_t bin_counts[BVH_BINS] = {};
+        std::fill(bin_bounds, bin_bounds + BVH_BINS, emptyBox());
+        for (uint32_t i = first; i < first + count; ++i) {
+            const int bin = binOf(build_items[i]);
+            bin_bounds[bin] = merge(bin_bounds[bin], build_items[i].box);
+            ++bin_counts[bin];
+        }
+        float right_area[BVH_BINS];
+        uint32_t right_count[BVH_BINS];
+        AABB right = emptyBox();
+        uint32_t right_items = 0;
+        for (int bin = BVH_BINS - 1; bin > 0; --bin) {
+            right = merge(right, bin_bounds[bin]);
+            right_items += bin_counts[bin];
+            right_area[bin] = right_items > 0 ? halfArea(right) : 0.0f;
+            right_count[bin] = right_items;
+        }
+        float best_cost = FLT_MAX;
+        int best_bin = -1;
+        AABB left = emptyBox();
+        uint32_t left_items = 0;
+        for (int bin = 0; bin < BVH_BINS - 1; ++bin) {
+            left = merge(left, bin_bounds[bin]);
+            left_items += bin_counts[bin];
+            if (left_items == 0 || right_count[bin + 1] == 0) {
+                continue;
+            }
+            const float cost = halfArea(left) * left_items + right_area[bin + 1] * right_count[bin + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_bin = bin;
+            }
+        }
+        if (best_bin >= 0) {
+            middle = static_cast<uint32_t>(std::partition(build_items.begin() + first, build_items.begin() + first + count,
+                [&](const BuildItem& build_item) { return binOf(build_item) <= best_bin; }) - build_items.begin());
+        }
+    }
+    if (middle == first || middle == first + count || !binned) {
+        // All centroids in one bin (or in one point), or too deep for the SAH: halves by count
+        middle = first + count / 2;
+        std::nth_element(build_items.begin() + first, build_items.begin() + middle, build_items.begin() + first + count,
+            [&](const BuildItem& a, const BuildItem& b) { return a.centroid[axis] < b.centroid[axis]; });
+    }
+
+    const uint32_t left_child = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(Node{ AABB{}, first, middle - first });
+    nodes.push_back(Node{ AABB{}, middle, first + count - middle });
+    parents.push_back(node);
+    parents.push_back(node);
+    subtree_items.emplace_back(first, middle);
+    subtree_items.emplace_back(middle, first + count);
+    nodes[node].first = left_child;
+    nodes[node].count = 0;
+    split(left_child, depth + 1, build_items);
+    split(left_child + 1, depth + 1, build_items);
+}
+
+void Bvh::update(uint32_t item, const AABB& box) {
+    item_boxes[item] = box;
+    refit(item_leaves[item]);
+}
+
+void Bvh::refit(uint32_t node) {
+    for (;;) {
+        Node& n = nodes[node];
+        AABB bounds;
+        if (n.count > 0) {
+            bounds = emptyBox();
+            for (uint32_t i = n.first; i < n.first + n.count; ++i) {
+                bounds = merge(bounds, item_boxes[items[i]]);
+            }
+        }
+        else {
+            bounds = merge(nodes[n.first].bounds, nodes[n.first + 1].bounds);
+        }
+        // Nothing above changes if this box did not
+        if (bounds.min == n.bounds.min && bounds.max == n.bounds.max) {
+            return;
+        }
+        n.bounds = bounds;
+        if (node == 0) {
+            return;
+        }
+        node = parents[node];
+    }
+}
+
+void Bvh::frustum(const Frustum& frustum, std::vector<uint32_t>& result) const {
+    if (nodes.empty()) {
+        return;
+    }
+    std::pair<uint32_t, uint8_t> stack[STACK_SIZE];
+    int size = 0;
+    stack[size++] = { 0u, ALL_PLANES };
+    while (size > 0) {
+        const auto [index, mask] = stack[--size];
+        const Node& node = nodes[index];
+        const uint8_t planes = straddledPlanes(frustum, node.bounds, mask);
+        if (planes == OUTSIDE) {
+            continue;
+        }
+        if (planes == 0) {
+            // Every object below is inside, split() left them next to each other in items
+            result.insert(result.end(), items.begin() + subtree_items[index].first, items.begin() + subtree_items[index].second);
+            continue;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (straddledPlanes(frustum, item_boxes[items[i]], planes) != OUTSIDE) {
+                    result.push_back(items[i]);
+                }
+            }
+        }
+        else {
+            stack[size++] = { node.first, planes };
+            stack[size++] = { node.first + 1, planes };
+        }
+    }
+}
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float max_t, uint32_t& item, float& t) const {
+    float root_t;
+    if (nodes.empty() || !intersectRayBox(origin, direction, nodes[0].bounds, max_t, root_t)) {
+        return false;
+    }
+    std::pair<uint32_t, float> stack[STACK_SIZE];
+    int size = 0;
+    stack[size++] = { 0u, root_t };
+    bool found = false;
+    float best = max_t;
+    while (size > 0) {
+        const auto [index, entry] = stack[--size];
+        if (found && entry >= best) {
+            continue;
+        }
+        const Node& node = nodes[index];
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                float hit;
+                if (intersectRayBox(origin, direction, item_boxes[items[i]], best, hit) && (!found || hit < best)) {
+                    best = hit;
+                    item = items[i];
+                    found = true;
+                }
+            }
+            continue;
+        }
+        // Nearer child on top of the stack
+        float near_t, far_t;
+        uint32_t near_child = node.first, far_child = node.first + 1;
+        bool near_hit = intersectRayBox(origin, direction, nodes[near_child].bounds, best, near_t);
+        bool far_hit = intersectRayBox(origin, direction, nodes[far_child].bounds, best, far_t);
+        if (near_hit && far_hit && far_t < near_t) {
+            std::swap(near_child, far_child);
+            std::swap(near_t, far_t);
+        }
+        else if (!near_hit) {
+            std::swap(near_child, far_child);
+            std::swap(near_t, far_t);
+            std::swap(near_hit, far_hit);
+        }
+        if (far_hit) {
+            stack[size++] = { far_child, far_t };
+        }
+        if (near_hit) {
+            stack[size++] = { near_child, near_t };
+        }
+    }
+    if (found) {
+        t = best;
+    }
+    return found;
+}
+
+void Bvh::overlapSphere(const glm::vec3& center, float radius, std::vector<uint32_t>& result) const {
+    if (nodes.empty()) {
+        return;
+    }
+    uint32_t stack[STACK_SIZE];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const Node& node = nodes[stack[--size]];
+        if (node.bounds.distance(center) > radius) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (item_boxes[items[i]].distance(center) <= radius) {
+                    result.push_back(items[i]);
+                }
+            }
+        }
+        else {
+            stack[size++] = node.first;
+            stack[size++] = node.first + 1;
+        }
+    }
+}
+
+int Bvh::depth() const {
+    if (nodes.empty()) {
+        return 0;
+    }
+    int deepest = 0;
+    std::pair<uint32_t, int> stack[STACK_SIZE];
+    int size = 0;
+    stack[size++] = { 0u, 1 };
+    while (size > 0) {
+        const auto [index, level] = stack[--size];
+        deepest = std::max(deepest, level);
+        if (nodes[index].count == 0) {
+            stack[size++] = { nodes[index].first, level + 1 };
+            stack[size++] = { nodes[index].first + 1, level + 1 };
+        }
+    }
+    return deepest;
+}
@@ -0,0 +1,76 @@
+﻿#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "Frustum.hpp"
+
+// Bounding volume hierarchy over the world boxes of the scene objects (EntityStore dense
+// indices, any ids 0..count-1 work). build() splits by the surface area heuristic evaluated at
+// BVH_BINS bins per node along the longest centroid axis (Wald 2007), leaves hold up to
+// BVH_MAX_LEAF_ITEMS objects. When objects move, update() refits the boxes of their leaf and the
+// nodes above it without restructuring; the tree stays correct, it only gets looser, rebuild
+// after large movements or when objects are added or removed.
+//
+// Queries visit only the nodes their volume touches:
+//  - frustum(): objects whose box Frustum::intersects, the same set as testing every box;
+//    nodes completely inside the frustum hand over their objects without further tests
+//  - raycast(): nearest box hit by a ray (picking), near child first, farther nodes skipped
+//  - overlapSphere(): objects whose box is within a radius of a point
+
+constexpr int BVH_BINS = 16;
+constexpr int BVH_MAX_LEAF_ITEMS = 4;
+// The SAH does not bound the depth (nested or clustered boxes can split off one item per level),
+// below this depth nodes are halved by count, which ends any uint32_t item count within 32 levels
+constexpr int BVH_SAH_DEPTH = 48;
+constexpr int BVH_MAX_DEPTH = BVH_SAH_DEPTH + 32;
+
+class Bvh {
+public:
+    Bvh() = default;
+
+    // boxes[i] is the box of item i
+    void build(const AABB* boxes, size_t count);
+    void clear();
+    // New box of a moved item, refits the nodes above it
+    void update(uint32_t item, const AABB& box);
+
+    void frustum(const Frustum& frustum, std::vector<uint32_t>& items) const;
+    // Nearest item whose box origin + t * direction enters for 0 <= t <= max_t, t = entry
+    // distance (0 if origin is inside the box)
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float max_t, uint32_t& item, float& t) const;
+    void overlapSphere(const glm::vec3& center, float radius, std::vector<uint32_t>& items) const;
+
+    size_t itemCount() const { return item_boxes.size(); }
+    size_t nodeCount() const { return nodes.size(); }
+    int depth() const;
+    const AABB& bounds() const { return nodes.front().bounds; }
+
+private:
+    struct Node {
+        AABB bounds;
+        uint32_t first{ 0 };  // first child (the second follows it) or first entry in items
+        uint32_t count{ 0 };  // items in a leaf, 0 for an inner node
+    };
+
+    std::vector<Node> nodes;             // root first
+    std::vector<uint32_t> parents;       // by node, root's is itself
+    std::vector<std::pair<uint32_t, uint32_t>> subtree_items;  // by node: its subtree's items are items[first, second)
+    std::vector<uint32_t> items;         // leaf item lists
+    std::vector<uint32_t> item_leaves;   // leaf node of every item
+    std::vector<AABB> item_boxes;        // current box of every item
+
+    // Boxes and centroids move along with the items while splitting, in tree order
+    struct BuildItem {
+        AABB box;
+        glm::vec3 centroid;
+        uint32_t item;
+    };
+
+    void split(uint32_t node, int depth, std::vector<BuildItem>& build_items);
+    void refit(uint32_t node);
+};
+
+// Ray entry distance into box clipped to [0, max_t], false if the ray misses it
+bool intersectRayBox(const glm::vec3& origin, const glm::vec3& direction, const AABB& box, float max_t, float& t);
@@ -4,7 +4,9 @@
 #include <glm/glm.hpp>  
 #include <glm/gtc/matrix_transform.hpp>  
 #include <algorithm> // For std::max and std::clamp  
+#include <cmath>
 #include <opencv2/opencv.hpp> // For cv::Mat  
+#include "TerrainHeightField.hpp"
 
 class Camera {  
 public:  
@@ -86,36 +88,12 @@ public:
    }  
 
    // Move camera  
-   void Move(const glm::vec3& direction, cv::Mat& maze_map, float speed, cv::Mat& heightmap, float maxHeight, float deltaTime) {
-       float tileSizeGL = 1.0f;  
-       int width = heightmap.cols;  
-       int height = heightmap.rows;  
-
+   void Move(const glm::vec3& direction, cv::Mat& maze_map, float speed, const TerrainHeightField& terrain, float deltaTime) {
        glm::vec3 newPos = Position + direction * speed;
        newPos.y += VerticalVelocity * deltaTime;
        VerticalVelocity += Gravity * deltaTime;
-       float newX = newPos.x;
-       float newZ = newPos.z;  
-
-       int hm_x0 = static_cast<int>(newX / (15.0f * tileSizeGL) * (width - 1));  
-       int hm_z0 = static_cast<int>(newZ / (15.0f * tileSizeGL) * (height - 1));  
-       hm_x0 = std::clamp(hm_x0, 0, width - 2);  
-       hm_z0 = std::clamp(hm_z0, 0, height - 2);  
-
-       float fx = (newX / (15.0f * tileSizeGL) * (width - 1)) - hm_x0;  
-       float fz = (newZ / (15.0f * tileSizeGL) * (height - 1)) - hm_z0;  
-       fx = std::clamp(fx, 0.0f, 1.0f);  
-       fz = std::clamp(fz, 0.0f, 1.0f);  
 
-       float h00 = static_cast<float>(heightmap.at<uchar>(hm_z0, hm_x0)) / 255.0f * maxHeight;  
-       float h01 = static_cast<float>(heightmap.at<uchar>(hm_z0, hm_x0 + 1)) / 255.0f * maxHeight;  
-       float h10 = static_cast<float>(heightmap.at<uchar>(hm_z0 + 1, hm_x0)) / 255.0f * maxHeight;  
-       float h11 = static_cast<float>(heightmap.at<uchar>(hm_z0 + 1, hm_x0 + 1)) / 255.0f * maxHeight;  
-
-       float terrainHeight = h00 * (1 - fx) * (1 - fz) +  
-           h01 * fx * (1 - fz) +  
-           h10 * (1 - fx) * fz +  
-           h11 * fx * fz;  
+       float terrainHeight = terrain.heightAt(newPos.x, newPos.z);  
 
        if (newPos.y < terrainHeight + 0.5f) {
            newPos.y = terrainHeight + 0.5f; // Offset 0.5 nad terénem
@@ -150,6 +128,18 @@ public:
        updateCameraVectors();  
    }  
 
+   // Place the camera and aim it at target (scripted camera paths), roll is kept
+   void LookAt(const glm::vec3& position, const glm::vec3& target) {
+       Position = position;
+       glm::vec3 front = target - position;
+       if (glm::length(front) < 1e-6f)
+           return;
+       front = glm::normalize(front);
+       Yaw = glm::degrees(std::atan2(front.z, front.x));
+       Pitch = std::clamp(glm::degrees(std::asin(front.y)), -89.0f, 89.0f);
+       updateCameraVectors();
+   }
+
 private:  
    void updateCameraVectors() {  
        glm::vec3 front;  
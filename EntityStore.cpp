@@ -0,0 +1,135 @@
+﻿#include "EntityStore.hpp"
+#include <stdexcept>
+
+EntityHandle EntityStore::create(const SceneGraph& scene, SceneNodeId node, uint32_t model, const glm::vec4& tint, uint8_t flags) {
+    uint32_t slot = free_slot;
+    if (slot != NO_ENTITY) {
+        free_slot = slots[slot].dense;
+    }
+    else {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+    }
+    const uint32_t index = static_cast<uint32_t>(models.size());
+    slots[slot].dense = index;
+    slots[slot].alive = true;
+
+    models.push_back(model);
+    nodes.push_back(node);
+    tints.push_back(tint);
+    flag_bits.push_back(flags);
+    world_matrices.emplace_back(1.0f);
+    min_x.push_back(0.0f);
+    min_y.push_back(0.0f);
+    min_z.push_back(0.0f);
+    max_x.push_back(0.0f);
+    max_y.push_back(0.0f);
+    max_z.push_back(0.0f);
+    dense_slots.push_back(slot);
+    setTransform(index, scene.worldMatrix(node), scene.worldBounds(node));
+
+    if (node >= node_entities.size()) {
+        node_entities.resize(static_cast<size_t>(node) + 1, NO_ENTITY);
+    }
+    node_entities[node] = index;
+    ++layout_version;
+    return EntityHandle{ slot, slots[slot].generation };
+}
+
+void EntityStore::destroy(EntityHandle entity) {
+    if (!alive(entity)) {
+        return;
+    }
+    Slot& slot = slots[entity.index];
+    const uint32_t index = slot.dense;
+    const uint32_t last = static_cast<uint32_t>(models.size()) - 1;
+    node_entities[nodes[index]] = NO_ENTITY;
+
+    // The last entity fills the gap
+    if (index != last) {
+        models[index] = models[last];
+        nodes[index] = nodes[last];
+        tints[index] = tints[last];
+        flag_bits[index] = flag_bits[last];
+        world_matrices[index] = world_matrices[last];
+        min_x[index] = min_x[last];
+        min_y[index] = min_y[last];
+        min_z[index] = min_z[last];
+        max_x[index] = max_x[last];
+        max_y[index] = max_y[last];
+        max_z[index] = max_z[last];
+        dense_slots[index] = dense_slots[last];
+        slots[dense_slots[index]].dense = index;
+        node_entities[nodes[index]] = index;
+    }
+    models.pop_back();
+    nodes.pop_back();
+    tints.pop_back();
+    flag_bits.pop_back();
+    world_matrices.pop_back();
+    min_x.pop_back();
+    min_y.pop_back();
+    min_z.pop_back();
+    max_x.pop_back();
+    max_y.pop_back();
+    max_z.pop_back();
+    dense_slots.pop_back();
+
+    ++layout_version;
+    slot.alive = false;
+    ++slot.generation;
+    slot.dense = free_slot;
+    free_slot = entity.index;
+}
+
+bool EntityStore::alive(EntityHandle entity) const {
+    return entity.index < slots.size() && slots[entity.index].alive && slots[entity.index].generation == entity.generation;
+}
+
+void EntityStore::clear() {
+    // Slots keep counting their generations, handles from before stay stale
+    while (!dense_slots.empty()) {
+        destroy(handleAt(static_cast<uint32_t>(dense_slots.size()) - 1));
+    }
+}
+
+void EntityStore::reserve(size_t count) {
+    models.reserve(count);
+    nodes.reserve(count);
+    tints.reserve(count);
+    flag_bits.reserve(count);
+    world_matrices.reserve(count);
+    for (auto* column : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z }) {
+        column->reserve(count);
+    }
+    dense_slots.reserve(count);
+    slots.reserve(count);
+}
+
+uint32_t EntityStore::indexOf(EntityHandle entity) const {
+    if (!alive(entity)) {
+        throw std::runtime_error("EntityStore: stale entity handle");
+    }
+    return slots[entity.index].dense;
+}
+
+void EntityStore::syncTransforms(const SceneGraph& scene, const std::vector<SceneNodeId>& changed, std::vector<uint32_t>* moved) {
+    for (const SceneNodeId node : changed) {
+        if (node < node_entities.size() && node_entities[node] != NO_ENTITY) {
+            setTransform(node_entities[node], scene.worldMatrix(node), scene.worldBounds(node));
+            if (moved) {
+                moved->push_back(node_entities[node]);
+            }
+        }
+    }
+}
+
+void EntityStore::setTransform(uint32_t index, const glm::mat4& world, const AABB& bounds) {
+    world_matrices[index] = world;
+    min_x[index] = bounds.min.x;
+    min_y[index] = bounds.min.y;
+    min_z[index] = bounds.min.z;
+    max_x[index] = bounds.max.x;
+    max_y[index] = bounds.max.y;
+    max_z[index] = bounds.max.z;
+}
@@ -0,0 +1,99 @@
+﻿#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "Frustum.hpp"
+#include "SceneGraph.hpp"
+
+// Entity of the EntityStore. The generation changes every time the slot is reused, so a handle
+// kept after destroy() is recognised as stale instead of naming the next entity in the slot.
+struct EntityHandle {
+    uint32_t index{ 0xFFFFFFFFu };
+    uint32_t generation{ 0 };
+
+    bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+enum EntityFlag : uint8_t {
+    ENTITY_VISIBLE = 1,
+    ENTITY_TRANSPARENT = 2   // drawn back to front after the opaque pass
+};
+
+// Placed renderable objects as a structure of arrays: every column holds one property of all
+// entities, packed without gaps, so a pass reads only the columns it needs from contiguous
+// memory. Destroying an entity moves the last one into its place, the dense order is not stable
+// but handles are: a slot table maps the handle to the current dense index.
+//
+// Entities share their model (an index into the caller's model table) instead of owning one,
+// placing another object appends to every column and allocates nothing once the columns have
+// grown. The transform is a SceneGraph node, syncTransforms() copies the world matrices
+// and boxes of the nodes the graph recomputed into the dense columns.
+class EntityStore {
+public:
+    EntityStore() = default;
+
+    // The transform starts as the node's current one in scene
+    EntityHandle create(const SceneGraph& scene, SceneNodeId node, uint32_t model, const glm::vec4& tint = glm::vec4(1.0f),
+        uint8_t flags = ENTITY_VISIBLE);
+    // Does nothing for a stale handle, the scene node is left to the caller
+    void destroy(EntityHandle entity);
+    bool alive(EntityHandle entity) const;
+    void clear();
+    void reserve(size_t count);
+    // Changes with every create() and destroy(), which move entities to other dense indices.
+    // Anything kept by dense index (Bvh items) is stale once it differs from the value it saw.
+    uint64_t layoutVersion() const { return layout_version; }
+
+    // Dense index of a live entity, throws std::runtime_error for a stale handle
+    uint32_t indexOf(EntityHandle entity) const;
+    EntityHandle handleAt(uint32_t index) const { return EntityHandle{ dense_slots[index], slots[dense_slots[index]].generation }; }
+
+    void setTint(EntityHandle entity, const glm::vec4& tint) { tints[indexOf(entity)] = tint; }
+    void setFlags(EntityHandle entity, uint8_t flags) { flag_bits[indexOf(entity)] = flags; }
+
+    // After SceneGraph::update(&changed). moved (if given) gets the dense index of every entity
+    // whose transform was copied appended.
+    void syncTransforms(const SceneGraph& scene, const std::vector<SceneNodeId>& changed, std::vector<uint32_t>* moved = nullptr);
+
+    // Columns, size() entries each
+    size_t size() const { return models.size(); }
+    const uint32_t* modelColumn() const { return models.data(); }
+    const SceneNodeId* nodeColumn() const { return nodes.data(); }
+    const glm::vec4* tintColumn() const { return tints.data(); }
+    const uint8_t* flagColumn() const { return flag_bits.data(); }
+    const glm::mat4* worldMatrixColumn() const { return world_matrices.data(); }
+    // World boxes, one float column per coordinate (4 boxes per SSE register)
+    const float* minXColumn() const { return min_x.data(); }
+    const float* minYColumn() const { return min_y.data(); }
+    const float* minZColumn() const { return min_z.data(); }
+    const float* maxXColumn() const { return max_x.data(); }
+    const float* maxYColumn() const { return max_y.data(); }
+    const float* maxZColumn() const { return max_z.data(); }
+    AABB worldBounds(uint32_t index) const {
+        return AABB{ glm::vec3(min_x[index], min_y[index], min_z[index]), glm::vec3(max_x[index], max_y[index], max_z[index]) };
+    }
+
+private:
+    struct Slot {
+        uint32_t dense{ 0 };       // index into the columns while alive, next free slot otherwise
+        uint32_t generation{ 0 };
+        bool alive{ false };
+    };
+    static constexpr uint32_t NO_ENTITY = 0xFFFFFFFFu;
+
+    std::vector<uint32_t> models;
+    std::vector<SceneNodeId> nodes;
+    std::vector<glm::vec4> tints;
+    std::vector<uint8_t> flag_bits;
+    std::vector<glm::mat4> world_matrices;
+    std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+    std::vector<uint32_t> dense_slots;  // slot of every dense index
+
+    std::vector<Slot> slots;
+    uint32_t free_slot{ NO_ENTITY };             // head of the free slot list
+    uint64_t layout_version{ 0 };
+    std::vector<uint32_t> node_entities;         // dense index by SceneNodeId, NO_ENTITY if none
+
+    void setTransform(uint32_t index, const glm::mat4& world, const AABB& bounds);
+};
@@ -0,0 +1,44 @@
+﻿#include "Frustum.hpp"
+#include <emmintrin.h>
+
+void Frustum::cullBoxes(const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y,
+    const float* max_z, size_t count, uint8_t* visible) const {
+    // The corner furthest along a plane normal takes the same column for every box
+    const float* corner_x[6];
+    const float* corner_y[6];
+    const float* corner_z[6];
+    __m128 normal_x[6], normal_y[6], normal_z[6], distance[6];
+    for (int p = 0; p < 6; ++p) {
+        corner_x[p] = planes[p].x >= 0.0f ? max_x : min_x;
+        corner_y[p] = planes[p].y >= 0.0f ? max_y : min_y;
+        corner_z[p] = planes[p].z >= 0.0f ? max_z : min_z;
+        normal_x[p] = _mm_set1_ps(planes[p].x);
+        normal_y[p] = _mm_set1_ps(planes[p].y);
+        normal_z[p] = _mm_set1_ps(planes[p].z);
+        distance[p] = _mm_set1_ps(planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; ++p) {
+            const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal_x[p], _mm_loadu_ps(corner_x[p] + i)),
+                _mm_mul_ps(normal_y[p], _mm_loadu_ps(corner_y[p] + i))), _mm_mul_ps(normal_z[p], _mm_loadu_ps(corner_z[p] + i)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dot, distance[p]), zero));
+        }
+        const int mask = _mm_movemask_ps(outside);
+        visible[i] = (mask & 1) == 0;
+        visible[i + 1] = (mask & 2) == 0;
+        visible[i + 2] = (mask & 4) == 0;
+        visible[i + 3] = (mask & 8) == 0;
+    }
+    cullBoxesScalar(min_x + i, min_y + i, min_z + i, max_x + i, max_y + i, max_z + i, count - i, visible + i);
+}
+
+void Frustum::cullBoxesScalar(const float* min_x, const float* min_y, const float* min_z, const float* max_x,
+    const float* max_y, const float* max_z, size_t count, uint8_t* visible) const {
+    for (size_t i = 0; i < count; ++i) {
+        const AABB box{ glm::vec3(min_x[i], min_y[i], min_z[i]), glm::vec3(max_x[i], max_y[i], max_z[i]) };
+        visible[i] = intersects(box);
+    }
+}
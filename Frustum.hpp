@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <glm/glm.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Axis aligned bounding box in world space
+struct AABB {
+    glm::vec3 min{ 0.0f };
+    glm::vec3 max{ 0.0f };
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    // Euclidean distance from point to the box, 0 inside
+    float distance(const glm::vec3& point) const {
+        return glm::length(glm::max(glm::max(min - point, point - max), glm::vec3(0.0f)));
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center{ 0.0f };
+    float radius{ 0.0f };
+};
+
+// View frustum planes extracted from a projection * view matrix (Gribb, Hartmann 2001).
+// Plane normals point inside, a point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0.
+class Frustum {
+public:
+    Frustum() = default;
+    explicit Frustum(const glm::mat4& view_projection) {
+        const glm::mat4& m = view_projection;
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+            const glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+            planes[2 * i] = w + row;      // left, bottom, near
+            planes[2 * i + 1] = w - row;  // right, top, far
+        }
+        for (auto& plane : planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+    }
+
+    // Conservative: false only if the box is completely outside one of the planes
+    bool intersects(const AABB& box) const {
+        for (const auto& plane : planes) {
+            // the box corner furthest along the plane normal
+            const glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x,
+                plane.y >= 0.0f ? box.max.y : box.min.y,
+                plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // visible[i] = intersects(box i) for boxes given as one column per coordinate (EntityStore),
+    // 4 boxes per SSE instruction with the same float operations, so the results are identical
+    void cullBoxes(const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y,
+        const float* max_z, size_t count, uint8_t* visible) const;
+    // Same result one box at a time (reference for the benchmark)
+    void cullBoxesScalar(const float* min_x, const float* min_y, const float* min_z, const float* max_x, const float* max_y,
+        const float* max_z, size_t count, uint8_t* visible) const;
+
+    const std::array<glm::vec4, 6>& getPlanes() const { return planes; }
+
+private:
+    std::array<glm::vec4, 6> planes{};
+};
@@ -0,0 +1,38 @@
+﻿#include "InstanceBatches.hpp"
+
+void InstanceBatches::build(const EntityStore& entities, const uint8_t* visible, uint8_t flag_mask, uint8_t flag_value,
+    size_t model_count) {
+    const size_t count = entities.size();
+    const uint8_t* flags = entities.flagColumn();
+    const uint32_t* models = entities.modelColumn();
+    auto selected = [&](size_t i) {
+        return (flags[i] & flag_mask) == flag_value && (visible == nullptr || visible[i]);
+    };
+
+    // Instances per model, then where every model's run starts
+    model_offsets.assign(model_count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (selected(i)) {
+            ++model_offsets[models[i]];
+        }
+    }
+    batch_list.clear();
+    uint32_t total = 0;
+    for (size_t model = 0; model < model_count; ++model) {
+        const uint32_t instances = model_offsets[model];
+        model_offsets[model] = total;
+        if (instances > 0) {
+            batch_list.push_back(InstanceBatch{ static_cast<uint32_t>(model), total, instances });
+            total += instances;
+        }
+    }
+
+    instance_data.resize(total);
+    const glm::mat4* world_matrices = entities.worldMatrixColumn();
+    const glm::vec4* tints = entities.tintColumn();
+    for (size_t i = 0; i < count; ++i) {
+        if (selected(i)) {
+            instance_data[model_offsets[models[i]]++] = GpuInstance{ world_matrices[i], tints[i] };
+        }
+    }
+}
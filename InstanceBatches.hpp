@@ -0,0 +1,33 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include "EntityStore.hpp"
+#include "ShaderBlocks.hpp"
+
+// Placed objects drawing the same model, as a run of the instance buffer
+struct InstanceBatch {
+    uint32_t model;   // EntityStore model column value
+    uint32_t first;   // first GpuInstance of the run
+    uint32_t count;
+};
+
+// Groups the entities of a pass by their model: one GpuInstance per entity, the instances of a
+// model next to each other, so that every model is drawn with one instanced call per mesh no
+// matter how often it was placed. A counting sort over the model column, linear in the number of
+// entities, in model order (fewer material and buffer changes between the draws).
+class InstanceBatches {
+public:
+    InstanceBatches() = default;
+
+    // Entities with (flags & flag_mask) == flag_value and visible[i] != 0 (all if visible is
+    // nullptr), model_count bounds the model column
+    void build(const EntityStore& entities, const uint8_t* visible, uint8_t flag_mask, uint8_t flag_value, size_t model_count);
+
+    const std::vector<GpuInstance>& instances() const { return instance_data; }
+    const std::vector<InstanceBatch>& batches() const { return batch_list; }
+
+private:
+    std::vector<GpuInstance> instance_data;
+    std::vector<InstanceBatch> batch_list;
+    std::vector<uint32_t> model_offsets;  // next free instance of every model while filling
+};
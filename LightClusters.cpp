@@ -0,0 +1,271 @@
+﻿#include "LightClusters.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <emmintrin.h>
+#include <future>
+
+namespace {
+    // Below this many lights the binning is cheaper than waking the pool
+    constexpr size_t PARALLEL_LIGHT_COUNT = 256;
+
+    float maxComponent(const glm::vec3& v) {
+        return std::max(v.x, std::max(v.y, v.z));
+    }
+}
+
+float lightRadius(const GpuLight& light, float cutoff) {
+    // Solve constant + linear * d + quadratic * d^2 = peak / cutoff for the distance d
+    const float peak = maxComponent(light.ambient + light.diffuse + light.specular);
+    const float k = peak / cutoff;
+    if (k <= light.constant) {
+        return 0.0f;
+    }
+    if (light.quadratic > 0.0f) {
+        const float discriminant = light.linear * light.linear - 4.0f * light.quadratic * (light.constant - k);
+        return (std::sqrt(discriminant) - light.linear) / (2.0f * light.quadratic);
+    }
+    if (light.linear > 0.0f) {
+        return (k - light.constant) / light.linear;
+    }
+    return FLT_MAX;
+}
+
+LightClusterGrid::LightClusterGrid()
+    : slice_indices(CLUSTER_GRID_Z),
+    slice_counts(CLUSTER_GRID_Z, std::vector<GLuint>(CLUSTER_GRID_X * CLUSTER_GRID_Y)),
+    ranges(CLUSTER_COUNT, ClusterRange{ 0, 0 }) {
+    // Slice 0 ends at CLUSTER_NEAR, slice CLUSTER_GRID_Z - 1 starts at CLUSTER_FAR
+    slice_scale = (CLUSTER_GRID_Z - 2) / std::log(CLUSTER_FAR / CLUSTER_NEAR);
+    slice_bias = 1.0f - std::log(CLUSTER_NEAR) * slice_scale;
+    setProjection(glm::radians(60.0f), 4.0f / 3.0f);
+}
+
+void LightClusterGrid::setProjection(float fov_y, float aspect) {
+    // Plane k goes through the eye and the tile edge at NDC -1 + 2k / n, normals point to +x (+y)
+    const float tan_y = std::tan(fov_y * 0.5f);
+    const float tan_x = tan_y * aspect;
+    auto edgePlanes = [](GLuint n, float tan_half) {
+        std::vector<glm::vec2> planes(n + 1);
+        for (GLuint k = 0; k <= n; ++k) {
+            const float a = (-1.0f + 2.0f * k / n) * tan_half;
+            const float inv_length = 1.0f / std::sqrt(1.0f + a * a);
+            planes[k] = glm::vec2(inv_length, a * inv_length);
+        }
+        return planes;
+    };
+    planes_x = edgePlanes(CLUSTER_GRID_X, tan_x);
+    planes_y = edgePlanes(CLUSTER_GRID_Y, tan_y);
+}
+
+glm::vec4 LightClusterGrid::shaderScale(int framebuffer_width, int framebuffer_height) const {
+    return glm::vec4(static_cast<float>(CLUSTER_GRID_X) / std::max(framebuffer_width, 1),
+        static_cast<float>(CLUSTER_GRID_Y) / std::max(framebuffer_height, 1),
+        slice_scale, slice_bias);
+}
+
+GLuint LightClusterGrid::slice(float depth) const {
+    // Same mapping as clusterIndex() in tex.frag
+    const float s = std::log(std::max(depth, 1e-6f)) * slice_scale + slice_bias;
+    return static_cast<GLuint>(std::clamp(s, 0.0f, static_cast<float>(CLUSTER_GRID_Z - 1)));
+}
+
+ClusterBounds LightClusterGrid::finishBounds(float depth, float radius, int right_of, int left_of,
+    int above, int below, bool outside) const {
+    ClusterBounds b{ 0, CLUSTER_GRID_X - 1, 0, CLUSTER_GRID_Y - 1, 1, 0 };
+    if (depth + radius <= 0.0f || (depth > 0.0f && outside)) {
+        return b; // behind the eye or beside the frustum
+    }
+    // The plane distances of the center only grow monotonically with the tile index in front
+    // of the eye, a sphere centered behind it keeps the whole screen
+    if (depth > 0.0f) {
+        b.x0 = static_cast<uint16_t>(right_of);
+        b.x1 = static_cast<uint16_t>(std::max<int>(CLUSTER_GRID_X - 1 - left_of, right_of));
+        b.y0 = static_cast<uint16_t>(above);
+        b.y1 = static_cast<uint16_t>(std::max<int>(CLUSTER_GRID_Y - 1 - below, above));
+    }
+    b.z0 = static_cast<uint16_t>(slice(depth - radius));
+    b.z1 = static_cast<uint16_t>(slice(depth + radius));
+    return b;
+}
+
+ClusterBounds LightClusterGrid::lightBounds(const glm::mat4& view, const GpuLight& light) const {
+    const glm::vec3& p = light.position;
+    const float r = light.radius;
+    const float cx = view[0][0] * p.x + view[1][0] * p.y + view[2][0] * p.z + view[3][0];
+    const float cy = view[0][1] * p.x + view[1][1] * p.y + view[2][1] * p.z + view[3][1];
+    const float cz = view[0][2] * p.x + view[1][2] * p.y + view[2][2] * p.z + view[3][2];
+
+    // Count the inner tile planes the sphere lies completely on one side of
+    int right_of = 0, left_of = 0, above = 0, below = 0;
+    for (GLuint k = 1; k < CLUSTER_GRID_X; ++k) {
+        const float d = planes_x[k].x * cx + planes_x[k].y * cz;
+        right_of += d >= r;
+        left_of += d <= -r;
+    }
+    for (GLuint k = 1; k < CLUSTER_GRID_Y; ++k) {
+        const float d = planes_y[k].x * cy + planes_y[k].y * cz;
+        above += d >= r;
+        below += d <= -r;
+    }
+    const bool outside = planes_x[0].x * cx + planes_x[0].y * cz <= -r
+        || planes_x[CLUSTER_GRID_X].x * cx + planes_x[CLUSTER_GRID_X].y * cz >= r
+        || planes_y[0].x * cy + planes_y[0].y * cz <= -r
+        || planes_y[CLUSTER_GRID_Y].x * cy + planes_y[CLUSTER_GRID_Y].y * cz >= r;
+    return finishBounds(-cz, r, right_of, left_of, above, below, outside);
+}
+
+void LightClusterGrid::lightBounds4(const glm::mat4& view, const GpuLight* lights, ClusterBounds* out) const {
+    // SoA: lane i holds light i, the arithmetic is the same as in lightBounds() so the results match
+    const __m128 px = _mm_setr_ps(lights[0].position.x, lights[1].position.x, lights[2].position.x, lights[3].position.x);
+    const __m128 py = _mm_setr_ps(lights[0].position.y, lights[1].position.y, lights[2].position.y, lights[3].position.y);
+    const __m128 pz = _mm_setr_ps(lights[0].position.z, lights[1].position.z, lights[2].position.z, lights[3].position.z);
+    const __m128 r = _mm_setr_ps(lights[0].radius, lights[1].radius, lights[2].radius, lights[3].radius);
+    const __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+
+    auto row = [&](int i) {
+        return _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_set1_ps(view[0][i]), px), _mm_mul_ps(_mm_set1_ps(view[1][i]), py)),
+            _mm_mul_ps(_mm_set1_ps(view[2][i]), pz)), _mm_set1_ps(view[3][i]));
+    };
+    const __m128 cx = row(0);
+    const __m128 cy = row(1);
+    const __m128 cz = row(2);
+
+    auto distance = [](const glm::vec2& plane, __m128 c, __m128 z) {
+        return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), c), _mm_mul_ps(_mm_set1_ps(plane.y), z));
+    };
+    // Comparison masks are all ones (-1), subtracting them counts the true lanes
+    __m128i right_of = _mm_setzero_si128(), left_of = _mm_setzero_si128();
+    __m128i above = _mm_setzero_si128(), below = _mm_setzero_si128();
+    for (GLuint k = 1; k < CLUSTER_GRID_X; ++k) {
+        const __m128 d = distance(planes_x[k], cx, cz);
+        right_of = _mm_sub_epi32(right_of, _mm_castps_si128(_mm_cmpge_ps(d, r)));
+        left_of = _mm_sub_epi32(left_of, _mm_castps_si128(_mm_cmple_ps(d, neg_r)));
+    }
+    for (GLuint k = 1; k < CLUSTER_GRID_Y; ++k) {
+        const __m128 d = distance(planes_y[k], cy, cz);
+        above = _mm_sub_epi32(above, _mm_castps_si128(_mm_cmpge_ps(d, r)));
+        below = _mm_sub_epi32(below, _mm_castps_si128(_mm_cmple_ps(d, neg_r)));
+    }
+    const __m128 outside = _mm_or_ps(
+        _mm_or_ps(_mm_cmple_ps(distance(planes_x[0], cx, cz), neg_r),
+            _mm_cmpge_ps(distance(planes_x[CLUSTER_GRID_X], cx, cz), r)),
+        _mm_or_ps(_mm_cmple_ps(distance(planes_y[0], cy, cz), neg_r),
+            _mm_cmpge_ps(distance(planes_y[CLUSTER_GRID_Y], cy, cz), r)));
+
+    alignas(16) float depth[4], radius[4];
+    alignas(16) int counts[4][4];
+    _mm_store_ps(depth, _mm_sub_ps(_mm_setzero_ps(), cz));
+    _mm_store_ps(radius, r);
+    _mm_store_si128(reinterpret_cast<__m128i*>(counts[0]), right_of);
+    _mm_store_si128(reinterpret_cast<__m128i*>(counts[1]), left_of);
+    _mm_store_si128(reinterpret_cast<__m128i*>(counts[2]), above);
+    _mm_store_si128(reinterpret_cast<__m128i*>(counts[3]), below);
+    const int outside_mask = _mm_movemask_ps(outside);
+    for (int i = 0; i < 4; ++i) {
+        out[i] = finishBounds(depth[i], radius[i], counts[0][i], counts[1][i], counts[2][i], counts[3][i],
+            (outside_mask >> i) & 1);
+    }
+}
+
+void LightClusterGrid::binSlices(GLuint z_begin, GLuint z_end) {
+    // Counting sort of the light references of each slice, lights keep their index order
+    constexpr GLuint slice_size = CLUSTER_GRID_X * CLUSTER_GRID_Y;
+    for (GLuint z = z_begin; z < z_end; ++z) {
+        std::vector<GLuint>& counts = slice_counts[z];
+        std::fill(counts.begin(), counts.end(), 0);
+        for (const ClusterBounds& b : bounds) {
+            if (b.z0 > z || b.z1 < z) {
+                continue;
+            }
+            for (GLuint y = b.y0; y <= b.y1; ++y) {
+                for (GLuint x = b.x0; x <= b.x1; ++x) {
+                    ++counts[y * CLUSTER_GRID_X + x];
+                }
+            }
+        }
+
+        ClusterRange* slice_ranges = &ranges[z * slice_size];
+        GLuint total = 0;
+        for (GLuint c = 0; c < slice_size; ++c) {
+            slice_ranges[c] = ClusterRange{ total, counts[c] };
+            counts[c] = total; // from now on the write cursor of the cluster
+            total += slice_ranges[c].count;
+        }
+
+        std::vector<GLuint>& list = slice_indices[z];
+        list.resize(total);
+        for (GLuint i = 0; i < static_cast<GLuint>(bounds.size()); ++i) {
+            const ClusterBounds& b = bounds[i];
+            if (b.z0 > z || b.z1 < z) {
+                continue;
+            }
+            for (GLuint y = b.y0; y <= b.y1; ++y) {
+                for (GLuint x = b.x0; x <= b.x1; ++x) {
+                    list[counts[y * CLUSTER_GRID_X + x]++] = i;
+                }
+            }
+        }
+    }
+}
+
+void LightClusterGrid::merge() {
+    // Slice lists were built independently, rebase them into one index array
+    constexpr GLuint slice_size = CLUSTER_GRID_X * CLUSTER_GRID_Y;
+    size_t total = 0;
+    for (const auto& list : slice_indices) {
+        total += list.size();
+    }
+    indices.resize(total);
+
+    GLuint base = 0;
+    for (GLuint z = 0; z < CLUSTER_GRID_Z; ++z) {
+        for (GLuint c = 0; c < slice_size; ++c) {
+            ranges[z * slice_size + c].offset += base;
+        }
+        std::copy(slice_indices[z].begin(), slice_indices[z].end(), indices.begin() + base);
+        base += static_cast<GLuint>(slice_indices[z].size());
+    }
+}
+
+void LightClusterGrid::assign(const glm::mat4& view, const std::vector<GpuLight>& lights, ThreadPool* pool) {
+    const size_t count = lights.size();
+    bounds.resize(count);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        lightBounds4(view, &lights[i], &bounds[i]);
+    }
+    for (; i < count; ++i) {
+        bounds[i] = lightBounds(view, lights[i]);
+    }
+
+    if (pool != nullptr && pool->size() > 1 && count >= PARALLEL_LIGHT_COUNT) {
+        // Slices are independent, each job bins a contiguous block of them
+        const GLuint job_count = std::min<GLuint>(static_cast<GLuint>(pool->size()), CLUSTER_GRID_Z);
+        std::vector<std::future<void>> jobs;
+        jobs.reserve(job_count);
+        for (GLuint j = 0; j < job_count; ++j) {
+            const GLuint z_begin = j * CLUSTER_GRID_Z / job_count;
+            const GLuint z_end = (j + 1) * CLUSTER_GRID_Z / job_count;
+            jobs.push_back(pool->submit([this, z_begin, z_end]() { binSlices(z_begin, z_end); }));
+        }
+        for (auto& job : jobs) {
+            job.get();
+        }
+    }
+    else {
+        binSlices(0, CLUSTER_GRID_Z);
+    }
+    merge();
+}
+
+void LightClusterGrid::assignScalar(const glm::mat4& view, const std::vector<GpuLight>& lights) {
+    bounds.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        bounds[i] = lightBounds(view, lights[i]);
+    }
+    binSlices(0, CLUSTER_GRID_Z);
+    merge();
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "ShaderBlocks.hpp"
+
+class ThreadPool;
+
+// Clustered forward lighting (Olsson, Billeter, Assarsson 2012). The view frustum is cut into
+// CLUSTER_GRID_X x CLUSTER_GRID_Y screen tiles and CLUSTER_GRID_Z depth slices, spaced
+// exponentially between CLUSTER_NEAR and CLUSTER_FAR (the first and the last slice are open ended).
+// Every frame each light's bounding sphere is assigned to the clusters it touches, tex.frag
+// then loops only over the light list of the cluster its fragment falls into.
+
+constexpr GLuint CLUSTER_GRID_X = 16;
+constexpr GLuint CLUSTER_GRID_Y = 9;
+constexpr GLuint CLUSTER_GRID_Z = 24;
+constexpr GLuint CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+constexpr float CLUSTER_NEAR = 1.0f;           // end of the first depth slice
+constexpr float CLUSTER_FAR = 1000.0f;         // start of the last depth slice
+constexpr float LIGHT_CUTOFF = 1.0f / 256.0f;  // attenuated intensity below one 8 bit step is dark
+
+// Distance at which the attenuated intensity of the light drops below cutoff,
+// FLT_MAX for lights without attenuation
+float lightRadius(const GpuLight& light, float cutoff = LIGHT_CUTOFF);
+
+// layout(std430) buffer LightClusters { uvec2 clusters[]; }, a range of lightIndices
+struct ClusterRange {
+    GLuint offset;
+    GLuint count;
+};
+
+// Tiles and slices touched by one light (inclusive), z0 > z1 if the light is not visible
+struct ClusterBounds {
+    uint16_t x0, x1, y0, y1, z0, z1;
+};
+
+class LightClusterGrid {
+public:
+    LightClusterGrid();
+
+    // Tile planes of a perspective projection, call again when the fov or the aspect ratio changes
+    void setProjection(float fov_y, float aspect);
+
+    // Assigns lights (world space position + radius) to the clusters of the view.
+    // Light bounds are computed with SSE four lights at a time, the depth slices
+    // are binned in parallel on pool (if given)
+    void assign(const glm::mat4& view, const std::vector<GpuLight>& lights, ThreadPool* pool = nullptr);
+    // Same result computed one light at a time on the calling thread (reference for the benchmark)
+    void assignScalar(const glm::mat4& view, const std::vector<GpuLight>& lights);
+
+    // Cluster (x, y, z) is at index (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x
+    const std::vector<ClusterRange>& clusterRanges() const { return ranges; }
+    const std::vector<GLuint>& lightIndices() const { return indices; }
+
+    // LightsBlock::clusterScale for a framebuffer of the given size
+    glm::vec4 shaderScale(int framebuffer_width, int framebuffer_height) const;
+
+private:
+    std::vector<glm::vec2> planes_x;  // (n.x, n.z) of the CLUSTER_GRID_X + 1 view space planes between tile columns
+    std::vector<glm::vec2> planes_y;  // (n.y, n.z) of the planes between tile rows
+    float slice_scale{ 0.0f };        // slice = log(depth) * slice_scale + slice_bias
+    float slice_bias{ 0.0f };
+
+    std::vector<ClusterBounds> bounds;
+    std::vector<std::vector<GLuint>> slice_indices;  // light lists of one depth slice, merged into indices
+    std::vector<std::vector<GLuint>> slice_counts;
+    std::vector<ClusterRange> ranges;
+    std::vector<GLuint> indices;
+
+    GLuint slice(float depth) const;
+    ClusterBounds finishBounds(float depth, float radius, int right_of, int left_of, int above, int below,
+        bool outside) const;
+    ClusterBounds lightBounds(const glm::mat4& view, const GpuLight& light) const;
+    void lightBounds4(const glm::mat4& view, const GpuLight* lights, ClusterBounds* out) const;
+    void binSlices(GLuint z_begin, GLuint z_end);
+    void merge();
+};
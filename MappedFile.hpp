@@ -0,0 +1,27 @@
+﻿#pragma once
+#include <cstddef>
+#include <filesystem>
+
+// Read-only memory mapping of a whole file (Win32 file mapping / POSIX mmap)
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return data_ != nullptr; }
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const unsigned char* data_{ nullptr };
+    size_t size_{ 0 };
+#ifdef _WIN32
+    void* file_handle{ nullptr };
+    void* mapping_handle{ nullptr };
+#endif
+    void close();
+};
@@ -2,11 +2,16 @@
 #include <GLFW/glfw3.h>
 
 #include "Mesh.hpp"
+#include "VertexPacking.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 
 Mesh::Mesh(GLenum primitive_type, ShaderProgram shader, std::vector<vertex> const& vertices,
     std::vector<GLuint> const& indices, glm::vec3 const& origin,
-    glm::vec3 const& orientation, GLuint texture_id)
+    glm::vec3 const& orientation, GLuint texture_id, VertexFormat vertex_format)
     : primitive_type(primitive_type),
     shader(shader),
     vertices(vertices),
@@ -14,25 +19,68 @@ Mesh::Mesh(GLenum primitive_type, ShaderProgram shader, std::vector<vertex> cons
     origin(origin),
     orientation(orientation),
     texture_id(texture_id),
-    diffuse_material(1.0f, 1.0f, 1.0f, 1.0f) { // Výchozí bílá barva s plnou opacitou
+    diffuse_material(1.0f, 1.0f, 1.0f, 1.0f), // Výchozí bílá barva s plnou opacitou
+    index_count(static_cast<GLuint>(indices.size())),
+    vertex_format(vertex_format) {
+    upload(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+    updateBounds();
+}
+
+Mesh::Mesh(GLenum primitive_type, ShaderProgram shader, const vertex* vertices, size_t vertex_count,
+    const GLuint* indices, size_t index_count, VertexFormat vertex_format)
+    : primitive_type(primitive_type),
+    shader(shader),
+    origin(0.0f),
+    orientation(0.0f),
+    index_count(static_cast<GLuint>(index_count)),
+    vertex_format(vertex_format) {
+    upload(vertices, vertex_count, indices, index_count);
+    updateBounds(vertices, indices, index_count);
+}
+
+void Mesh::upload(const vertex* vertices, size_t vertex_count, const GLuint* indices, size_t index_count) {
+    // Uniforms set by draw(), resolved once instead of on every draw call
+    tex0_location = shader.getUniformLocation("tex0");
+    diffuse_color_location = shader.getUniformLocation("u_diffuse_color");
+    pos_offset_location = shader.getUniformLocation("uPosOffset");
+    pos_scale_location = shader.getUniformLocation("uPosScale");
+
     // Create VAO
     glCreateVertexArrays(1, &VAO);
 
     // Create VBO and upload vertex data
     glCreateBuffers(1, &VBO);
-    glNamedBufferData(VBO, vertices.size() * sizeof(vertex), vertices.data(), GL_STATIC_DRAW);
+    GLsizei stride = sizeof(vertex);
+    if (vertex_format == VertexFormat::Packed) {
+        const PositionQuantization quantization = computePositionQuantization(vertices, vertex_count);
+        position_offset = quantization.offset;
+        position_scale = quantization.scale;
+        const std::vector<packed_vertex> packed = packVertices(vertices, vertex_count, quantization);
+        glNamedBufferData(VBO, packed.size() * sizeof(packed_vertex), packed.data(), GL_STATIC_DRAW);
+        stride = sizeof(packed_vertex);
+    }
+    else {
+        glNamedBufferData(VBO, vertex_count * sizeof(vertex), vertices, GL_STATIC_DRAW);
+    }
+    const bool packed = (vertex_format == VertexFormat::Packed);
 
     // Create EBO and upload index data
     glCreateBuffers(1, &EBO);
-    glNamedBufferData(EBO, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glNamedBufferData(EBO, index_count * sizeof(GLuint), indices, GL_STATIC_DRAW);
 
     // Set up attributes
     // Vertex position
     GLint position_attrib_location = glGetAttribLocation(shader.getID(), "aPos");
     if (position_attrib_location >= 0) {
         glEnableVertexArrayAttrib(VAO, position_attrib_location);
-        glVertexArrayAttribFormat(VAO, position_attrib_location, 3, GL_FLOAT, GL_FALSE,
-            offsetof(vertex, position));
+        if (packed) {
+            glVertexArrayAttribFormat(VAO, position_attrib_location, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                offsetof(packed_vertex, position));
+        }
+        else {
+            glVertexArrayAttribFormat(VAO, position_attrib_location, 3, GL_FLOAT, GL_FALSE,
+                offsetof(vertex, position));
+        }
         glVertexArrayAttribBinding(VAO, position_attrib_location, 0);
     }
 
@@ -40,8 +88,14 @@ Mesh::Mesh(GLenum primitive_type, ShaderProgram shader, std::vector<vertex> cons
     GLint normal_attrib_location = glGetAttribLocation(shader.getID(), "aNorm");
     if (normal_attrib_location >= 0) {
         glEnableVertexArrayAttrib(VAO, normal_attrib_location);
-        glVertexArrayAttribFormat(VAO, normal_attrib_location, 3, GL_FLOAT, GL_FALSE,
-            offsetof(vertex, normal));
+        if (packed) {
+            glVertexArrayAttribFormat(VAO, normal_attrib_location, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                offsetof(packed_vertex, normal));
+        }
+        else {
+            glVertexArrayAttribFormat(VAO, normal_attrib_location, 3, GL_FLOAT, GL_FALSE,
+                offsetof(vertex, normal));
+        }
         glVertexArrayAttribBinding(VAO, normal_attrib_location, 0);
     }
 
@@ -49,42 +103,171 @@ Mesh::Mesh(GLenum primitive_type, ShaderProgram shader, std::vector<vertex> cons
     GLint tex_attrib_location = glGetAttribLocation(shader.getID(), "aTex");
     if (tex_attrib_location >= 0) {
         glEnableVertexArrayAttrib(VAO, tex_attrib_location);
-        glVertexArrayAttribFormat(VAO, tex_attrib_location, 2, GL_FLOAT, GL_FALSE,
-            offsetof(vertex, texCoord));
+        if (packed) {
+            glVertexArrayAttribFormat(VAO, tex_attrib_location, 2, GL_HALF_FLOAT, GL_FALSE,
+                offsetof(packed_vertex, texCoord));
+        }
+        else {
+            glVertexArrayAttribFormat(VAO, tex_attrib_location, 2, GL_FLOAT, GL_FALSE,
+                offsetof(vertex, texCoord));
+        }
         glVertexArrayAttribBinding(VAO, tex_attrib_location, 0);
     }
 
     // Link VAO with VBO and EBO
-    glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(vertex));
+    glVertexArrayVertexBuffer(VAO, 0, VBO, 0, stride);
     glVertexArrayElementBuffer(VAO, EBO);
 }
 
+void Mesh::updateBounds() {
+    if (vertices.empty()) {
+        return;
+    }
+    if (indices.empty()) {
+        AABB box{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+        for (const auto& v : vertices) {
+            box.min = glm::min(box.min, v.position);
+            box.max = glm::max(box.max, v.position);
+        }
+        float radius2 = 0.0f;
+        for (const auto& v : vertices) {
+            const glm::vec3 d = v.position - box.center();
+            radius2 = std::max(radius2, glm::dot(d, d));
+        }
+        bounds = box;
+        bounding_sphere = BoundingSphere{ box.center(), std::sqrt(radius2) };
+        has_bounds = true;
+        return;
+    }
+    updateBounds(vertices.data(), indices.data(), indices.size());
+}
+
+void Mesh::updateBounds(const vertex* vertices, const GLuint* indices, size_t index_total) {
+    AABB box{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+    const size_t end = std::min(static_cast<size_t>(first_index) + index_count, index_total);
+    for (size_t k = first_index; k < end; ++k) {
+        box.min = glm::min(box.min, vertices[indices[k]].position);
+        box.max = glm::max(box.max, vertices[indices[k]].position);
+    }
+    if (box.min.x > box.max.x) {
+        return;
+    }
+    // Sphere around the box centre, tighter than the box's own circumsphere
+    const glm::vec3 center = box.center();
+    float radius2 = 0.0f;
+    for (size_t k = first_index; k < end; ++k) {
+        const glm::vec3 d = vertices[indices[k]].position - center;
+        radius2 = std::max(radius2, glm::dot(d, d));
+    }
+    bounds = box;
+    bounding_sphere = BoundingSphere{ center, std::sqrt(radius2) };
+    has_bounds = true;
+}
+
+void Mesh::bindMaterial(const glm::vec4& tint) const {
+    // Activate texture if it exists (0 unbinds, so a previous mesh's texture does not leak in)
+    glBindTextureUnit(0, texture_id);
+    if (texture_id != 0 && tex0_location >= 0) {
+        shader.setUniform(tex0_location, 0);
+    }
+
+    // Position dequantization (identity for float vertices)
+    if (pos_offset_location >= 0) {
+        shader.setUniform(pos_offset_location, position_offset);
+    }
+    if (pos_scale_location >= 0) {
+        shader.setUniform(pos_scale_location, position_scale);
+    }
+
+    // Set diffuse_material in shader
+    if (diffuse_color_location >= 0) {
+        shader.setUniform(diffuse_color_location, diffuse_material * tint);
+    }
+}
+
 void Mesh::draw(glm::vec3 const& offset, glm::vec3 const& rotation) const {
+    drawTinted(glm::vec4(1.0f));
+}
+
+void Mesh::drawTinted(const glm::vec4& tint) const {
     if (VAO == 0) {
         std::cerr << "VAO not initialized!\n";
         return;
     }
+    bindMaterial(tint);
 
-    // Activate texture if it exists
-    if (texture_id != 0) {
-        glBindTextureUnit(0, texture_id);
-        GLint tex_loc = glGetUniformLocation(shader.getID(), "tex0");
-        if (tex_loc >= 0) {
-            glUniform1i(tex_loc, 0);
-        }
+    // Draw the mesh
+    glBindVertexArray(VAO);
+    glDrawElements(primitive_type, static_cast<GLsizei>(index_count), GL_UNSIGNED_INT,
+        reinterpret_cast<const void*>(static_cast<uintptr_t>(first_index) * sizeof(GLuint)));
+    glBindVertexArray(0);
+
+    ++stats.draw_calls;
+    if (primitive_type == GL_TRIANGLES) {
+        stats.triangles += index_count / 3;
+    }
+    else if ((primitive_type == GL_TRIANGLE_STRIP || primitive_type == GL_TRIANGLE_FAN) && index_count > 2) {
+        stats.triangles += index_count - 2;
     }
+}
 
-    // Set diffuse_material in shader
-    GLint diffuse_color_loc = glGetUniformLocation(shader.getID(), "u_diffuse_color");
-    if (diffuse_color_loc >= 0) {
-        glUniform4fv(diffuse_color_loc, 1, glm::value_ptr(diffuse_material));
+void Mesh::drawInstanced(GLsizei instance_count) const {
+    if (VAO == 0) {
+        std::cerr << "VAO not initialized!\n";
+        return;
+    }
+    if (instance_count <= 0) {
+        return;
     }
+    bindMaterial();
+
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(primitive_type, static_cast<GLsizei>(index_count), GL_UNSIGNED_INT,
+        reinterpret_cast<const void*>(static_cast<uintptr_t>(first_index) * sizeof(GLuint)), instance_count);
+    glBindVertexArray(0);
+
+    ++stats.draw_calls;
+    if (primitive_type == GL_TRIANGLES) {
+        stats.triangles += static_cast<uint64_t>(index_count / 3) * instance_count;
+    }
+    else if ((primitive_type == GL_TRIANGLE_STRIP || primitive_type == GL_TRIANGLE_FAN) && index_count > 2) {
+        stats.triangles += static_cast<uint64_t>(index_count - 2) * instance_count;
+    }
+}
+
+void Mesh::drawMulti(const GLsizei* counts, const void* const* offsets, const GLint* base_vertices, GLsizei draw_count) const {
+    if (VAO == 0) {
+        std::cerr << "VAO not initialized!\n";
+        return;
+    }
+    if (draw_count <= 0) {
+        return;
+    }
+    bindMaterial();
 
-    // Draw the mesh
     glBindVertexArray(VAO);
-    glDrawElements(primitive_type, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
+    glMultiDrawElementsBaseVertex(primitive_type, counts, GL_UNSIGNED_INT, offsets, draw_count, base_vertices);
     glBindVertexArray(0);
+
+    ++stats.draw_calls;
+    if (primitive_type == GL_TRIANGLES) {
+        for (GLsizei i = 0; i < draw_count; ++i) {
+            stats.triangles += counts[i] / 3;
+        }
+    }
 }
+
+Mesh Mesh::submesh(GLuint first, GLuint count) const {
+    Mesh part = *this;
+    part.first_index = first_index + first;
+    part.index_count = count;
+    part.updateBounds();
+    part.vertices.clear();
+    part.indices.clear();
+    part.owns_buffers = false;
+    return part;
+}
+
 void Mesh::clear() {
     if (texture_id != 0) {
         glDeleteTextures(1, &texture_id);
@@ -96,7 +279,16 @@ void Mesh::clear() {
     indices.clear();
     origin = glm::vec3(0.0f);
     orientation = glm::vec3(0.0f);
+    first_index = 0;
+    index_count = 0;
+    vertex_format = VertexFormat::Float;
+    position_offset = glm::vec3(0.0f);
+    position_scale = glm::vec3(1.0f);
 
+    if (!owns_buffers) {
+        VAO = VBO = EBO = 0; // buffers belong to the mesh this one was split from
+        return;
+    }
     if (VAO != 0) {
         glDeleteVertexArrays(1, &VAO);
         VAO = 0;
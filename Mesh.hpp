@@ -1,21 +1,56 @@
 #pragma once
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <vector>
+#include "Frustum.hpp"
 #include "ShaderProgram.hpp"
 #include "assets.hpp"
 
+// Work submitted by Mesh::draw since the last reset, the benchmark resets it every frame
+struct DrawStats {
+    uint64_t draw_calls{ 0 };
+    uint64_t triangles{ 0 };
+};
+
 class Mesh {
 public:
-    // Full constructor with all parameters
+    static inline DrawStats stats{};
+
+    Mesh() = default; // empty, no GL buffers
+
+    // Full constructor with all parameters. With VertexFormat::Packed the GPU copy uses
+    // packed_vertex (CPU side vertices stay float) and the shader dequantizes positions.
     Mesh(GLenum primitive_type, ShaderProgram shader, std::vector<vertex> const& vertices,
         std::vector<GLuint> const& indices, glm::vec3 const& origin,
-        glm::vec3 const& orientation, GLuint texture_id = 0);
+        glm::vec3 const& orientation, GLuint texture_id = 0,
+        VertexFormat vertex_format = VertexFormat::Float);
+    // Uploads the arrays without keeping CPU side copies (e.g. straight from a mapped mesh
+    // cache, MeshData::mapping); bounds are computed from them before the constructor returns
+    Mesh(GLenum primitive_type, ShaderProgram shader, const vertex* vertices, size_t vertex_count,
+        const GLuint* indices, size_t index_count, VertexFormat vertex_format = VertexFormat::Float);
 
     // Methods
     void draw(glm::vec3 const& offset = glm::vec3(0.0f), glm::vec3 const& rotation = glm::vec3(0.0f)) const;
+    // With diffuse_material * tint, one placed copy of a shared mesh in its own colour
+    void drawTinted(const glm::vec4& tint) const;
+    // instance_count copies in one glDrawElementsInstanced call, the shader takes their model
+    // matrices and tints from the instance buffer (tex.vert, uInstanced)
+    void drawInstanced(GLsizei instance_count) const;
+    // Several index ranges of this mesh's buffers in one glMultiDrawElementsBaseVertex call
+    // (terrain chunks): offsets in bytes into the index buffer, base_vertices added to the indices
+    void drawMulti(const GLsizei* counts, const void* const* offsets, const GLint* base_vertices, GLsizei draw_count) const;
     void clear();
 
+    // Mesh drawing index range [first, first + count) of this mesh's buffers. The copy shares
+    // the VAO/VBO/EBO, keeps no CPU side arrays and does not delete the buffers in clear().
+    Mesh submesh(GLuint first, GLuint count) const;
+    // bounds and bounding_sphere of the vertices the drawn index range uses. Needs the CPU side
+    // arrays, the constructor and submesh() call it, without them the bounds stay as they are.
+    void updateBounds();
+    // Same from arrays equal to the uploaded ones, for meshes that keep no CPU side copy
+    void updateBounds(const vertex* vertices, const GLuint* indices, size_t index_total);
+
     // Public members (for OBJLoader to set material)
     std::vector<vertex> vertices;
     std::vector<GLuint> indices;
@@ -31,7 +66,26 @@ public:
     glm::vec4 specular_material{ 1.0f };
     float reflectivity{ 1.0f };
 
+    // Model space bounds of the drawn vertices, the zero box until updateBounds() finds any
+    AABB bounds;
+    BoundingSphere bounding_sphere;
+    bool has_bounds{ false };
+
+    // Drawn part of the index buffer (whole buffer unless created by submesh())
+    GLuint first_index{ 0 };
+    GLuint index_count{ 0 };
+
+    // GPU vertex layout, positions decode as uPosOffset + aPos * uPosScale
+    VertexFormat vertex_format{ VertexFormat::Float };
+    glm::vec3 position_offset{ 0.0f };
+    glm::vec3 position_scale{ 1.0f };
+
 private:
     // OpenGL buffer IDs
     unsigned int VAO{ 0 }, VBO{ 0 }, EBO{ 0 };
+    bool owns_buffers{ true };
+    void upload(const vertex* vertices, size_t vertex_count, const GLuint* indices, size_t index_count);
+    void bindMaterial(const glm::vec4& tint = glm::vec4(1.0f)) const;
+    // Uniform locations in shader
+    GLint tex0_location{ -1 }, diffuse_color_location{ -1 }, pos_offset_location{ -1 }, pos_scale_location{ -1 };
 };
\ No newline at end of file
@@ -0,0 +1,285 @@
+﻿#include "MeshCache.hpp"
+#include "MappedFile.hpp"
+#include "MeshOptimizer.hpp"
+#include "OBJloader.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace {
+    constexpr char CACHE_MAGIC[4] = { 'G', 'M', 'S', 'H' };
+    constexpr uint32_t CACHE_VERSION = 3;
+
+    struct MeshCacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t vertex_stride;  // sizeof(vertex) of the writer, guards against layout changes
+        uint32_t submesh_stride;
+        uint64_t source_size;
+        int64_t source_mtime;
+        uint32_t vertex_count;
+        uint32_t index_count;
+        uint32_t submesh_count;
+        uint32_t material_count;
+        uint32_t flags;           // MeshCacheFlags the data was produced with
+        uint32_t reserved;
+    };
+
+    // Fixed part of a material record, followed by the name and the diffuse map path
+    // (both uint32 length + UTF-8 bytes)
+    struct MaterialRecord {
+        float ambient[4];
+        float diffuse[4];
+        float specular[4];
+        float shininess;
+    };
+    static_assert(sizeof(MaterialRecord) == 52, "material record must stay packed");
+    static_assert(sizeof(MeshCacheHeader) == 56, "mesh cache header must stay packed");
+
+    bool sourceStamp(const std::filesystem::path& source, uint64_t& size, int64_t& mtime) {
+        std::error_code ec;
+        size = std::filesystem::file_size(source, ec);
+        if (ec) {
+            return false;
+        }
+        auto time = std::filesystem::last_write_time(source, ec);
+        if (ec) {
+            return false;
+        }
+        mtime = static_cast<int64_t>(time.time_since_epoch().count());
+        return true;
+    }
+
+    // Bounds checked reader over the variable length tail of the cache file
+    struct TailReader {
+        const unsigned char* ptr;
+        const unsigned char* end;
+
+        bool read(void* dst, size_t bytes) {
+            if (static_cast<size_t>(end - ptr) < bytes) {
+                return false;
+            }
+            std::memcpy(dst, ptr, bytes);
+            ptr += bytes;
+            return true;
+        }
+        bool readString(std::string& str) {
+            uint32_t length;
+            if (!read(&length, sizeof(length)) || static_cast<size_t>(end - ptr) < length) {
+                return false;
+            }
+            str.assign(reinterpret_cast<const char*>(ptr), length);
+            ptr += length;
+            return true;
+        }
+    };
+
+    void writeString(std::ofstream& file, const std::string& str) {
+        const uint32_t length = static_cast<uint32_t>(str.size());
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(str.data(), str.size());
+    }
+}
+
+std::filesystem::path meshCachePath(const std::filesystem::path& source) {
+    std::filesystem::path cache = source;
+    cache += ".meshcache";
+    return cache;
+}
+
+bool readMeshCache(const std::filesystem::path& source, MeshData& out, uint32_t flags) {
+    uint64_t source_size;
+    int64_t source_mtime;
+    if (!sourceStamp(source, source_size, source_mtime)) {
+        return false;
+    }
+
+    auto mapping = std::make_shared<MappedFile>(meshCachePath(source));
+    const MappedFile& file = *mapping;
+    if (!file.isOpen() || file.size() < sizeof(MeshCacheHeader)) {
+        return false;
+    }
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION ||
+        header.vertex_stride != sizeof(vertex) ||
+        header.submesh_stride != sizeof(SubmeshRange) ||
+        header.source_size != source_size ||
+        header.source_mtime != source_mtime ||
+        header.flags != flags) {
+        return false; // stale or foreign cache, caller falls back to the OBJ
+    }
+
+    const size_t vertex_bytes = static_cast<size_t>(header.vertex_count) * sizeof(vertex);
+    const size_t index_bytes = static_cast<size_t>(header.index_count) * sizeof(GLuint);
+    const size_t submesh_bytes = static_cast<size_t>(header.submesh_count) * sizeof(SubmeshRange);
+    if (file.size() < sizeof(header) + vertex_bytes + index_bytes + submesh_bytes) {
+        return false;
+    }
+
+    // Vertices and indices are not copied out, the uploads read them from the mapping. Both
+    // start at a multiple of 4 bytes from the page aligned mapping (header and vertex sizes).
+    const unsigned char* ptr = file.data() + sizeof(header);
+    out.vertices.clear();
+    out.indices.clear();
+    out.mapped_vertices = reinterpret_cast<const vertex*>(ptr);
+    out.mapped_vertex_count = header.vertex_count;
+    ptr += vertex_bytes;
+    out.mapped_indices = reinterpret_cast<const GLuint*>(ptr);
+    out.mapped_index_count = header.index_count;
+    ptr += index_bytes;
+    out.submeshes.resize(header.submesh_count);
+    std::memcpy(out.submeshes.data(), ptr, submesh_bytes);
+    ptr += submesh_bytes;
+
+    TailReader tail{ ptr, file.data() + file.size() };
+    out.materials.resize(header.material_count);
+    for (Material& material : out.materials) {
+        MaterialRecord record;
+        std::string map;
+        if (!tail.read(&record, sizeof(record)) || !tail.readString(material.name) || !tail.readString(map)) {
+            return false;
+        }
+        material.ambient = glm::make_vec4(record.ambient);
+        material.diffuse = glm::make_vec4(record.diffuse);
+        material.specular = glm::make_vec4(record.specular);
+        material.shininess = record.shininess;
+        material.diffuse_map = std::filesystem::u8path(map);
+    }
+
+    // Material libraries are dependencies too, an edited .mtl invalidates the cache
+    uint32_t library_count;
+    if (!tail.read(&library_count, sizeof(library_count))) {
+        return false;
+    }
+    out.material_libraries.resize(library_count);
+    for (auto& library : out.material_libraries) {
+        std::string path;
+        uint64_t stored_size;
+        int64_t stored_mtime;
+        if (!tail.readString(path) || !tail.read(&stored_size, sizeof(stored_size)) || !tail.read(&stored_mtime, sizeof(stored_mtime))) {
+            return false;
+        }
+        library = std::filesystem::u8path(path);
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        sourceStamp(library, size, mtime); // missing library is stored as 0/0
+        if (size != stored_size || mtime != stored_mtime) {
+            return false;
+        }
+    }
+    if (tail.ptr != tail.end) {
+        return false;
+    }
+    out.mapping = std::move(mapping);
+    return true;
+}
+
+bool writeMeshCache(const std::filesystem::path& source, const MeshData& data, uint32_t flags) {
+    MeshCacheHeader header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.flags = flags;
+    header.vertex_stride = sizeof(vertex);
+    header.submesh_stride = sizeof(SubmeshRange);
+    if (!sourceStamp(source, header.source_size, header.source_mtime)) {
+        return false;
+    }
+    header.vertex_count = static_cast<uint32_t>(data.vertexCount());
+    header.index_count = static_cast<uint32_t>(data.indexCount());
+    header.submesh_count = static_cast<uint32_t>(data.submeshes.size());
+    header.material_count = static_cast<uint32_t>(data.materials.size());
+
+    // Write to a temporary file first, a crashed write must never look like a valid cache
+    const std::filesystem::path cache = meshCachePath(source);
+    std::filesystem::path temp = cache;
+    temp += ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(data.vertexData()), data.vertexCount() * sizeof(vertex));
+        file.write(reinterpret_cast<const char*>(data.indexData()), data.indexCount() * sizeof(GLuint));
+        file.write(reinterpret_cast<const char*>(data.submeshes.data()), data.submeshes.size() * sizeof(SubmeshRange));
+        for (const Material& material : data.materials) {
+            MaterialRecord record;
+            std::memcpy(record.ambient, glm::value_ptr(material.ambient), sizeof(record.ambient));
+            std::memcpy(record.diffuse, glm::value_ptr(material.diffuse), sizeof(record.diffuse));
+            std::memcpy(record.specular, glm::value_ptr(material.specular), sizeof(record.specular));
+            record.shininess = material.shininess;
+            file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+            writeString(file, material.name);
+            writeString(file, material.diffuse_map.u8string());
+        }
+        const uint32_t library_count = static_cast<uint32_t>(data.material_libraries.size());
+        file.write(reinterpret_cast<const char*>(&library_count), sizeof(library_count));
+        for (const auto& library : data.material_libraries) {
+            uint64_t size = 0;
+            int64_t mtime = 0;
+            sourceStamp(library, size, mtime);
+            writeString(file, library.u8string());
+            file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            file.write(reinterpret_cast<const char*>(&mtime), sizeof(mtime));
+        }
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp, cache, ec);
+    if (ec) {
+        std::filesystem::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool loadMeshData(const std::filesystem::path& source, MeshData& out, bool optimize, unsigned int thread_count,
+    MeshLoadReport* report) {
+    MeshLoadReport ignored;
+    MeshLoadReport& result = report ? *report : ignored;
+    result = MeshLoadReport{};
+    const uint32_t flags = optimize ? MESH_CACHE_OPTIMIZED : 0;
+    if (readMeshCache(source, out, flags)) {
+        result.cache_hit = true;
+        return true;
+    }
+
+    if (!loadOBJMesh(source.string(), out, thread_count)) {
+        return false;
+    }
+    if (optimize) {
+        result.optimization = optimizeMesh(out);
+        result.optimized = true;
+    }
+    result.cache_write_failed = !writeMeshCache(source, out, flags);
+    return true;
+}
+
+void printMeshLoadReport(const std::filesystem::path& source, const MeshData& data, const MeshLoadReport& report) {
+    if (report.cache_hit) {
+        std::cout << "Mesh cache hit: " << meshCachePath(source).string() << " ("
+            << data.vertexCount() << " vertices, " << data.indexCount() << " indices, "
+            << data.submeshes.size() << " submeshes)" << std::endl;
+        return;
+    }
+    if (report.optimized) {
+        const MeshOptimizationStats& stats = report.optimization;
+        std::cout << "Mesh optimized: ACMR " << std::fixed << std::setprecision(3) << stats.acmr_before
+            << " -> " << stats.acmr_after << ", ATVR " << stats.atvr_before << " -> " << stats.atvr_after
+            << std::defaultfloat << std::endl;
+    }
+    if (report.cache_write_failed) {
+        std::cerr << "Warning: could not write mesh cache " << meshCachePath(source).string() << std::endl;
+    }
+}
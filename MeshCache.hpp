@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <cstdint>
+#include <filesystem>
+#include "assets.hpp"
+#include "MeshOptimizer.hpp"
+
+// Binary mesh cache stored next to the source model as <name>.obj.meshcache
+// Layout: header | vertex[vertex_count] | GLuint[index_count] | SubmeshRange[submesh_count]
+//         | materials[material_count] | material library stamps
+// Size and modification time of the source and of its .mtl files are recorded,
+// changing any of them invalidates the cache. So does a different set of flags.
+enum MeshCacheFlags : uint32_t {
+    MESH_CACHE_OPTIMIZED = 1, // indices and vertices went through optimizeMesh()
+};
+
+std::filesystem::path meshCachePath(const std::filesystem::path& source);
+bool readMeshCache(const std::filesystem::path& source, MeshData& out, uint32_t flags = 0);
+bool writeMeshCache(const std::filesystem::path& source, const MeshData& data, uint32_t flags = 0);
+
+// What loadMeshData() did. It prints nothing itself (AssetLoader runs it on worker threads),
+// the thread that takes the mesh prints the report.
+struct MeshLoadReport {
+    bool cache_hit{ false };
+    bool optimized{ false };
+    MeshOptimizationStats optimization;
+    bool cache_write_failed{ false };
+};
+
+// Loads a model through the cache: a valid cache file is mapped and its vertex and index arrays
+// are used in place (MeshData::mapping, uploaded straight from the mapping by Model),
+// otherwise the OBJ is parsed (and optimized for the vertex cache) and the cache
+// is (re)written for the next start. thread_count is passed to the OBJ parser (0 = all cores).
+bool loadMeshData(const std::filesystem::path& source, MeshData& out, bool optimize = true, unsigned int thread_count = 0,
+    MeshLoadReport* report = nullptr);
+// Cache hit or optimization result on std::cout, a failed cache write on std::cerr
+void printMeshLoadReport(const std::filesystem::path& source, const MeshData& data, const MeshLoadReport& report);
@@ -0,0 +1,320 @@
+﻿#include "MeshOptimizer.hpp"
+#include <algorithm>
+
+namespace {
+    // FIFO post-transform cache with O(1) reset: a vertex is cached while fewer than
+    // cache_size other vertices were inserted after it
+    class FifoCache {
+    public:
+        FifoCache(size_t vertex_count, unsigned int cache_size)
+            : stamps(vertex_count, 0), time(cache_size + 1), size(cache_size) {
+        }
+
+        // Returns true on a miss (the vertex had to be transformed)
+        bool access(GLuint v) {
+            if (time - stamps[v] > size) {
+                stamps[v] = time++;
+                return true;
+            }
+            return false;
+        }
+
+        void reset() {
+            time += size + 1;
+        }
+
+    private:
+        std::vector<unsigned int> stamps;
+        unsigned int time;
+        unsigned int size;
+    };
+
+    // Vertex -> triangles adjacency of one index range (compressed rows)
+    struct Adjacency {
+        std::vector<unsigned int> offsets;   // vertex_count + 1
+        std::vector<unsigned int> triangles;
+    };
+
+    void buildAdjacency(const GLuint* indices, size_t triangle_count, size_t vertex_count, Adjacency& adj) {
+        adj.offsets.assign(vertex_count + 1, 0);
+        for (size_t i = 0; i < triangle_count * 3; ++i) {
+            ++adj.offsets[indices[i] + 1];
+        }
+        for (size_t v = 0; v < vertex_count; ++v) {
+            adj.offsets[v + 1] += adj.offsets[v];
+        }
+        adj.triangles.resize(triangle_count * 3);
+        std::vector<unsigned int> fill(adj.offsets.begin(), adj.offsets.end() - 1);
+        for (size_t t = 0; t < triangle_count; ++t) {
+            for (size_t k = 0; k < 3; ++k) {
+                adj.triangles[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+            }
+        }
+    }
+
+    // Tipsify triangle order. cluster_starts receives the output positions where the
+    // algorithm had to jump to a vertex outside the cache (hard cluster boundaries).
+    std::vector<unsigned int> tipsify(const GLuint* indices, size_t triangle_count, size_t vertex_count,
+        unsigned int cache_size, std::vector<size_t>& cluster_starts) {
+        std::vector<unsigned int> order;
+        cluster_starts.clear();
+        if (triangle_count == 0) {
+            return order;
+        }
+        order.reserve(triangle_count);
+
+        Adjacency adj;
+        buildAdjacency(indices, triangle_count, vertex_count, adj);
+
+        std::vector<unsigned int> live(vertex_count);
+        for (size_t v = 0; v < vertex_count; ++v) {
+            live[v] = adj.offsets[v + 1] - adj.offsets[v];
+        }
+        std::vector<unsigned int> cache_time(vertex_count, 0);
+        std::vector<char> emitted(triangle_count, 0);
+        std::vector<GLuint> dead_end;
+        std::vector<GLuint> candidates;
+        unsigned int timestamp = cache_size + 1;
+        size_t cursor = 0;
+
+        long long fanning = indices[0];
+        cluster_starts.push_back(0);
+        while (fanning >= 0) {
+            const GLuint f = static_cast<GLuint>(fanning);
+            candidates.clear();
+            for (unsigned int a = adj.offsets[f]; a < adj.offsets[f + 1]; ++a) {
+                const unsigned int t = adj.triangles[a];
+                if (emitted[t]) {
+                    continue;
+                }
+                for (size_t k = 0; k < 3; ++k) {
+                    const GLuint v = indices[t * 3 + k];
+                    dead_end.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if (timestamp - cache_time[v] > cache_size) {
+                        cache_time[v] = timestamp++;
+                    }
+                }
+                emitted[t] = 1;
+                order.push_back(t);
+            }
+
+            // Next fanning vertex: the one staying longest in the cache after its remaining
+            // triangles are emitted, vertices that would be evicted meanwhile get priority 0
+            long long best = -1;
+            long long best_priority = -1;
+            for (GLuint v : candidates) {
+                if (live[v] == 0) {
+                    continue;
+                }
+                long long priority = 0;
+                const long long age = static_cast<long long>(timestamp) - cache_time[v];
+                if (age + 2 * static_cast<long long>(live[v]) <= cache_size) {
+                    priority = age;
+                }
+                if (priority > best_priority) {
+                    best_priority = priority;
+                    best = v;
+                }
+            }
+
+            if (best < 0) {
+                // Dead end: recently used vertices first, then a sweep over all vertices
+                while (!dead_end.empty() && best < 0) {
+                    const GLuint v = dead_end.back();
+                    dead_end.pop_back();
+                    if (live[v] > 0) {
+                        best = v;
+                    }
+                }
+                while (best < 0 && cursor < vertex_count) {
+                    if (live[cursor] > 0) {
+                        best = static_cast<long long>(cursor);
+                    }
+                    ++cursor;
+                }
+                if (best >= 0) {
+                    cluster_starts.push_back(order.size());
+                }
+            }
+            fanning = best;
+        }
+        return order;
+    }
+
+    // Splits hard clusters further where the running miss ratio of the cluster drops to its
+    // overall ratio, the cache is assumed cold at every boundary (Tipsify, section 4)
+    std::vector<size_t> softClusterStarts(const GLuint* indices, size_t triangle_count, size_t vertex_count,
+        const std::vector<size_t>& hard_starts, unsigned int cache_size, float threshold) {
+        std::vector<size_t> starts;
+        FifoCache cache(vertex_count, cache_size);
+        for (size_t c = 0; c < hard_starts.size(); ++c) {
+            const size_t begin = hard_starts[c];
+            const size_t end = (c + 1 < hard_starts.size()) ? hard_starts[c + 1] : triangle_count;
+            cache.reset();
+            size_t cluster_misses = 0;
+            for (size_t i = begin * 3; i < end * 3; ++i) {
+                cluster_misses += cache.access(indices[i]) ? 1 : 0;
+            }
+            const float cluster_acmr = static_cast<float>(cluster_misses) / static_cast<float>(end - begin);
+
+            cache.reset();
+            starts.push_back(begin);
+            size_t start = begin;
+            size_t misses = 0;
+            for (size_t t = begin; t < end; ++t) {
+                for (size_t k = 0; k < 3; ++k) {
+                    misses += cache.access(indices[t * 3 + k]) ? 1 : 0;
+                }
+                const float acmr = static_cast<float>(misses) / static_cast<float>(t + 1 - start);
+                if (t + 1 < end && acmr <= cluster_acmr * threshold) {
+                    cache.reset();
+                    start = t + 1;
+                    misses = 0;
+                    starts.push_back(start);
+                }
+            }
+        }
+        return starts;
+    }
+
+    // Sorts clusters so that the ones facing away from the mesh centre come first,
+    // they tend to occlude the rest of the model
+    void sortClusters(GLuint* indices, size_t triangle_count, const std::vector<vertex>& vertices,
+        const std::vector<size_t>& starts) {
+        glm::vec3 mesh_centroid(0.0f);
+        for (size_t i = 0; i < triangle_count * 3; ++i) {
+            mesh_centroid += vertices[indices[i]].position;
+        }
+        mesh_centroid /= static_cast<float>(triangle_count * 3);
+
+        struct Cluster {
+            size_t begin, end;
+            float key;
+        };
+        std::vector<Cluster> clusters;
+        clusters.reserve(starts.size());
+        for (size_t c = 0; c < starts.size(); ++c) {
+            const size_t begin = starts[c];
+            const size_t end = (c + 1 < starts.size()) ? starts[c + 1] : triangle_count;
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area_sum = 0.0f;
+            for (size_t t = begin; t < end; ++t) {
+                const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+                const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                const float area = glm::length(n);
+                centroid += (p0 + p1 + p2) * (area / 3.0f);
+                normal += n;
+                area_sum += area;
+            }
+            if (area_sum > 0.0f) {
+                centroid /= area_sum;
+            }
+            const float normal_length = glm::length(normal);
+            if (normal_length > 0.0f) {
+                normal /= normal_length;
+            }
+            clusters.push_back(Cluster{ begin, end, glm::dot(centroid - mesh_centroid, normal) });
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+            return a.key > b.key;
+        });
+
+        std::vector<GLuint> sorted;
+        sorted.reserve(triangle_count * 3);
+        for (const auto& cluster : clusters) {
+            sorted.insert(sorted.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+        }
+        std::copy(sorted.begin(), sorted.end(), indices);
+    }
+
+    void applyTriangleOrder(GLuint* indices, const std::vector<unsigned int>& order) {
+        std::vector<GLuint> reordered(order.size() * 3);
+        for (size_t i = 0; i < order.size(); ++i) {
+            for (size_t k = 0; k < 3; ++k) {
+                reordered[i * 3 + k] = indices[order[i] * 3 + k];
+            }
+        }
+        std::copy(reordered.begin(), reordered.end(), indices);
+    }
+}
+
+float computeACMR(const GLuint* indices, size_t index_count, size_t vertex_count,
+    unsigned int cache_size, float* atvr) {
+    FifoCache cache(vertex_count, cache_size);
+    std::vector<char> used(vertex_count, 0);
+    size_t misses = 0, unique = 0;
+    for (size_t i = 0; i < index_count; ++i) {
+        misses += cache.access(indices[i]) ? 1 : 0;
+        if (!used[indices[i]]) {
+            used[indices[i]] = 1;
+            ++unique;
+        }
+    }
+    if (atvr != nullptr) {
+        *atvr = unique > 0 ? static_cast<float>(misses) / static_cast<float>(unique) : 0.0f;
+    }
+    const size_t triangle_count = index_count / 3;
+    return triangle_count > 0 ? static_cast<float>(misses) / static_cast<float>(triangle_count) : 0.0f;
+}
+
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t first, size_t count, size_t vertex_count,
+    unsigned int cache_size) {
+    GLuint* range = indices.data() + first;
+    std::vector<size_t> cluster_starts;
+    applyTriangleOrder(range, tipsify(range, count / 3, vertex_count, cache_size, cluster_starts));
+}
+
+void optimizeVertexCacheAndOverdraw(std::vector<GLuint>& indices, size_t first, size_t count,
+    const std::vector<vertex>& vertices, unsigned int cache_size) {
+    const size_t triangle_count = count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+    GLuint* range = indices.data() + first;
+    std::vector<size_t> hard_starts;
+    applyTriangleOrder(range, tipsify(range, triangle_count, vertices.size(), cache_size, hard_starts));
+
+    // Cluster sort on a copy, it is only kept if the cache efficiency does not suffer
+    const float tipsify_acmr = computeACMR(range, count, vertices.size(), cache_size);
+    std::vector<GLuint> sorted(range, range + count);
+    const std::vector<size_t> starts = softClusterStarts(sorted.data(), triangle_count, vertices.size(),
+        hard_starts, cache_size, OVERDRAW_THRESHOLD);
+    sortClusters(sorted.data(), triangle_count, vertices, starts);
+    if (computeACMR(sorted.data(), count, vertices.size(), cache_size) <= tipsify_acmr * OVERDRAW_THRESHOLD) {
+        std::copy(sorted.begin(), sorted.end(), range);
+    }
+}
+
+void optimizeVertexFetch(std::vector<vertex>& vertices, std::vector<GLuint>& indices) {
+    constexpr GLuint UNUSED = 0xFFFFFFFFu;
+    std::vector<GLuint> remap(vertices.size(), UNUSED);
+    std::vector<vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (GLuint& index : indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = static_cast<GLuint>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+MeshOptimizationStats optimizeMesh(MeshData& data) {
+    MeshOptimizationStats stats;
+    stats.acmr_before = computeACMR(data.indices.data(), data.indices.size(), data.vertices.size(),
+        VERTEX_CACHE_SIZE, &stats.atvr_before);
+
+    for (const SubmeshRange& range : data.submeshes) {
+        optimizeVertexCacheAndOverdraw(data.indices, range.first_index, range.index_count, data.vertices);
+    }
+    optimizeVertexFetch(data.vertices, data.indices);
+
+    stats.acmr_after = computeACMR(data.indices.data(), data.indices.size(), data.vertices.size(),
+        VERTEX_CACHE_SIZE, &stats.atvr_after);
+    return stats;
+}
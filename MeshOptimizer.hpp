@@ -0,0 +1,39 @@
+﻿#pragma once
+#include <cstddef>
+#include <vector>
+#include "assets.hpp"
+
+// Post-load mesh optimisation (CPU only, deterministic: same input gives the same output).
+// 1. vertex cache: triangles of every submesh are reordered with Tipsify (Sander et al. 2007)
+// 2. overdraw: Tipsify clusters are sorted so outward facing parts are drawn first,
+//    kept only if the cache efficiency stays within OVERDRAW_THRESHOLD
+// 3. vertex fetch: vertices are renumbered in first-use order, so the VBO is read linearly
+// Submesh ranges and materials are preserved, only the order inside the ranges changes.
+
+constexpr unsigned int VERTEX_CACHE_SIZE = 16;  // simulated post-transform FIFO cache
+constexpr float OVERDRAW_THRESHOLD = 1.05f;     // allowed ACMR increase for the overdraw sort
+
+struct MeshOptimizationStats {
+    float acmr_before{ 0.0f };  // average cache miss ratio: transformed vertices per triangle
+    float acmr_after{ 0.0f };
+    float atvr_before{ 0.0f };  // average transform to vertex ratio: transformed / unique vertices
+    float atvr_after{ 0.0f };
+};
+
+// FIFO cache simulation over a triangle list, returns misses per triangle (0 for no triangles)
+float computeACMR(const GLuint* indices, size_t index_count, size_t vertex_count,
+    unsigned int cache_size = VERTEX_CACHE_SIZE, float* atvr = nullptr);
+
+// Reorders the triangles of indices[first, first + count) for the post-transform cache
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t first, size_t count, size_t vertex_count,
+    unsigned int cache_size = VERTEX_CACHE_SIZE);
+
+// Tipsify + cluster sort of indices[first, first + count), positions are needed for the sort
+void optimizeVertexCacheAndOverdraw(std::vector<GLuint>& indices, size_t first, size_t count,
+    const std::vector<vertex>& vertices, unsigned int cache_size = VERTEX_CACHE_SIZE);
+
+// Renumbers vertices in order of first use and drops unreferenced ones
+void optimizeVertexFetch(std::vector<vertex>& vertices, std::vector<GLuint>& indices);
+
+// Runs all stages on every submesh of data
+MeshOptimizationStats optimizeMesh(MeshData& data);
@@ -1,87 +1,123 @@
 ﻿#include "Model.hpp"
+#include "MeshCache.hpp"
 #include "OBJloader.hpp"
+#include "Texture.hpp"
+#include <algorithm>
+#include <cfloat>
 #include <stdexcept>
 
-Model::Model(const std::filesystem::path& filename, ShaderProgram shader) {
+Model::Model(const std::filesystem::path& filename, ShaderProgram shader, VertexFormat vertex_format) {
     this->shader = shader;
     this->name = filename.stem().string();
-    local_model_matrix = glm::mat4(1.0f); // Inicializace transformační matice
 
     // Pokud je název souboru prázdný, přeskoč načítání .obj souboru
     if (filename.empty() || filename.string().empty()) {
         return; // Nebo nastavte výchozí hodnoty pro meshes, pokud je potřeba
     }
 
-    // Load OBJ file
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec2> uvs;
-    std::vector<glm::vec3> normals;
-    bool res = loadOBJ(filename.string(), vertices, uvs, normals);
-    if (!res) {
+    // Load OBJ file as an indexed mesh, warm starts read the binary mesh cache instead
+    MeshData data;
+    MeshLoadReport report;
+    if (!loadMeshData(filename, data, true, 0, &report)) {
         throw std::runtime_error("Failed to load OBJ file: " + filename.string());
     }
+    printMeshLoadReport(filename, data, report);
 
-    // Convert loaded data into our vertex structure format
-    std::vector<vertex> mesh_vertices;
-    for (size_t i = 0; i < vertices.size(); i++) {
-        vertex v;
-        v.position = vertices[i];
-        if (i < uvs.size()) {
-            v.texCoord = uvs[i];
-        }
-        else {
-            v.texCoord = glm::vec2(0.0f);
-        }
-        if (i < normals.size()) {
-            v.normal = normals[i];
+    std::vector<cv::Mat> material_images;
+    for (const auto& material : data.materials) {
+        material_images.push_back(material.diffuse_map.empty() ? cv::Mat() : decodeTexture(material.diffuse_map));
+    }
+    createMeshes(data, material_images, vertex_format);
+}
+
+Model::Model(const std::string& name, const MeshData& data, ShaderProgram shader,
+    const std::vector<cv::Mat>& material_images, VertexFormat vertex_format) {
+    this->shader = shader;
+    this->name = name;
+    createMeshes(data, material_images, vertex_format);
+}
+
+void Model::createMeshes(const MeshData& data, const std::vector<cv::Mat>& material_images, VertexFormat vertex_format) {
+    // Upload vertices and indices once (GL upload, must run on the context thread), straight
+    // from the loaded arrays or the mapped cache; the meshes keep no CPU side copies.
+    // Every submesh becomes a Mesh drawing its own index range of the shared buffers
+    Mesh whole(GL_TRIANGLES, shader, data.vertexData(), data.vertexCount(), data.indexData(), data.indexCount(),
+        vertex_format);
+
+    std::vector<GLuint> material_textures(data.materials.size(), 0);
+    for (size_t i = 0; i < material_images.size() && i < material_textures.size(); i++) {
+        material_textures[i] = uploadTexture(material_images[i]);
+    }
+
+    for (size_t i = 0; i < data.submeshes.size(); i++) {
+        const SubmeshRange& range = data.submeshes[i];
+        // First mesh keeps the buffers, the others only reference them
+        Mesh mesh = (i == 0) ? whole : whole.submesh(range.first_index, range.index_count);
+        if (i == 0) {
+            mesh.first_index = range.first_index;
+            mesh.index_count = range.index_count;
         }
-        else {
-            v.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        mesh.updateBounds(data.vertexData(), data.indexData(), data.indexCount());
+        if (range.material < data.materials.size()) {
+            const Material& material = data.materials[range.material];
+            mesh.ambient_material = material.ambient;
+            mesh.diffuse_material = material.diffuse;
+            mesh.specular_material = material.specular;
+            mesh.reflectivity = material.shininess;
+            mesh.texture_id = material_textures[range.material];
         }
-        mesh_vertices.push_back(v);
+        meshes.push_back(mesh);
     }
-
-    // Create indices - simple sequential indexing
-    std::vector<GLuint> indices;
-    for (GLuint i = 0; i < mesh_vertices.size(); i++) {
-        indices.push_back(i);
+    if (data.submeshes.empty()) {
+        meshes.push_back(whole);
     }
 
-    // Create mesh
-    Mesh mesh(GL_TRIANGLES, shader, mesh_vertices, indices, glm::vec3(0.0f), glm::vec3(0.0f));
-    meshes.push_back(mesh);
-}
+    // Draw order grouped by texture, so consecutive submeshes do not rebind it
+    std::stable_sort(meshes.begin(), meshes.end(), [](const Mesh& a, const Mesh& b) {
+        return a.texture_id < b.texture_id;
+    });
 
-void Model::update(const float delta_t) {
-    // Here you can implement automatic animations
-    // Example: orientation.y += 1.0f * delta_t; // rotation around Y axis
+    // The boxes of the meshes that have any (a mesh without CPU side arrays keeps the zero box,
+    // which would stretch the model's box to the origin)
+    bounds = AABB{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+    for (const auto& mesh : meshes) {
+        if (mesh.has_bounds) {
+            bounds.min = glm::min(bounds.min, mesh.bounds.min);
+            bounds.max = glm::max(bounds.max, mesh.bounds.max);
+        }
+    }
+    if (bounds.min.x > bounds.max.x) {
+        bounds = AABB{};
+    }
+    // Sphere around the merged box's centre reaching every mesh sphere, never looser than the box's circumsphere
+    bounding_sphere = BoundingSphere{ bounds.center(), 0.0f };
+    for (const auto& mesh : meshes) {
+        if (mesh.has_bounds) {
+            bounding_sphere.radius = std::max(bounding_sphere.radius,
+                glm::length(mesh.bounding_sphere.center - bounding_sphere.center) + mesh.bounding_sphere.radius);
+        }
+    }
+    bounding_sphere.radius = std::min(bounding_sphere.radius, glm::length(bounds.max - bounds.min) * 0.5f);
 }
 
-glm::mat4 Model::getModelMatrix() const {
-    // Compute the complete transformation matrix
-    glm::mat4 t = glm::translate(glm::mat4(1.0f), origin);
-    glm::mat4 rx = glm::rotate(glm::mat4(1.0f), orientation.x, glm::vec3(1.0f, 0.0f, 0.0f));
-    glm::mat4 ry = glm::rotate(glm::mat4(1.0f), orientation.y, glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 rz = glm::rotate(glm::mat4(1.0f), orientation.z, glm::vec3(0.0f, 0.0f, 1.0f));
-    glm::mat4 s = glm::scale(glm::mat4(1.0f), scale);
-
-    return local_model_matrix * s * rz * ry * rx * t;
+void Model::draw() {
+    shader.activate();
+    for (auto& mesh : meshes) {
+        mesh.draw();
+    }
 }
 
-void Model::draw(glm::vec3 const& offset, glm::vec3 const& rotation, glm::vec3 const& scale_change) {
-    // Activate shader
+void Model::drawTinted(const glm::vec4& tint) {
     shader.activate();
-
-    // Draw all meshes
     for (auto& mesh : meshes) {
-        mesh.draw();
+        mesh.drawTinted(tint);
     }
 }
 
-void Model::draw(glm::mat4 const& model_matrix) {
+void Model::drawInstanced(GLsizei instance_count) {
     shader.activate();
     for (auto& mesh : meshes) {
-        mesh.draw();
+        mesh.drawInstanced(instance_count);
     }
 }
 
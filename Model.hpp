@@ -4,6 +4,7 @@
 #include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <opencv2/opencv.hpp>
 #include "assets.hpp"
 #include "Mesh.hpp"
 #include "ShaderProgram.hpp"
@@ -15,26 +16,34 @@ public:
     std::vector<Mesh> meshes;
     std::string name;
 
-    // Transform properties
-    glm::vec3 origin{ 0.0f, 0.0f, 0.0f };
-    glm::vec3 orientation{ 0.0f, 0.0f, 0.0f }; // in radians
-    glm::vec3 scale{ 1.0f, 1.0f, 1.0f };
-    glm::mat4 local_model_matrix{ 1.0f }; // identity (no transformation)
-
     // Transparency flag - ADDED FOR TASK 1
     bool transparent{ false };
 
+    // Model space bounds of all meshes, computed at load time (zero box if no mesh has bounds).
+    // The sphere's centre orders transparent objects for drawing.
+    AABB bounds;
+    BoundingSphere bounding_sphere;
+
     ShaderProgram shader;
 
-    // Constructor
-    Model() : shader(), name(""), origin(0.0f), scale(1.0f), orientation(0.0f), local_model_matrix(1.0f), meshes() {}
-    Model(const std::filesystem::path& filename, ShaderProgram shader);
+    // A model has no placement of its own: the entities drawing it are scene graph nodes
+    // (SceneGraph, EntityStore) and the passes upload their world matrices
+    Model() : shader(), name(""), meshes() {}
+    Model(const std::filesystem::path& filename, ShaderProgram shader,
+        VertexFormat vertex_format = VertexFormat::Packed);
+    // From mesh data already loaded elsewhere (e.g. by AssetLoader on a worker thread).
+    // material_images are the decoded map_Kd textures, one per data.materials entry (may be empty).
+    Model(const std::string& name, const MeshData& data, ShaderProgram shader,
+        const std::vector<cv::Mat>& material_images = {}, VertexFormat vertex_format = VertexFormat::Packed);
 
     // Methods
-    void update(const float delta_t);
-    glm::mat4 getModelMatrix() const;
-    void draw(glm::vec3 const& offset = glm::vec3(0.0f),
-        glm::vec3 const& rotation = glm::vec3(0.0f),
-        glm::vec3 const& scale_change = glm::vec3(1.0f));
-    void draw(glm::mat4 const& model_matrix);
+    // Every mesh with the model matrix uniform already set by the caller
+    void draw();
+    // Every mesh with diffuse_material * tint (EntityStore tint column)
+    void drawTinted(const glm::vec4& tint);
+    // Every mesh once for instance_count placed copies (Mesh::drawInstanced)
+    void drawInstanced(GLsizei instance_count);
+
+private:
+    void createMeshes(const MeshData& data, const std::vector<cv::Mat>& material_images, VertexFormat vertex_format);
 };
\ No newline at end of file
@@ -1,11 +1,685 @@
 ﻿#include "OBJloader.hpp"
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <emmintrin.h>
+#include <filesystem>
+#include <limits>
+#include <thread>
+
+namespace {
+    // Reads the whole file into a single buffer, the parser then only walks pointers over it
+    bool readWholeFile(const std::string& path, std::string& buffer) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::streamsize size = file.tellg();
+        if (size < 0) {
+            return false;
+        }
+        buffer.resize(static_cast<size_t>(size));
+        file.seekg(0, std::ios::beg);
+        return size == 0 || static_cast<bool>(file.read(buffer.data(), size));
+    }
+
+    inline bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char* skipBlanks(const char* p, const char* end) {
+        while (p < end && isBlank(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    inline const char* findLineEnd(const char* p, const char* end) {
+        const void* nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+        return nl ? static_cast<const char*>(nl) : end;
+    }
+
+    inline bool parseFloat(const char*& p, const char* end, float& out) {
+        p = skipBlanks(p, end);
+        if (p < end && *p == '+') {
+            ++p;
+        }
+        auto [ptr, ec] = std::from_chars(p, end, out);
+        if (ec != std::errc()) {
+            return false;
+        }
+        p = ptr;
+        return true;
+    }
+
+    // Parses up to count floats, missing trailing components are left untouched
+    inline void parseFloats(const char*& p, const char* end, float* out, int count) {
+        for (int i = 0; i < count; ++i) {
+            if (!parseFloat(p, end, out[i])) {
+                return;
+            }
+        }
+    }
+
+    inline bool parseIndex(const char*& p, const char* end, int& out) {
+        auto [ptr, ec] = std::from_chars(p, end, out);
+        if (ec != std::errc()) {
+            return false;
+        }
+        p = ptr;
+        return true;
+    }
+
+    // Face corner component that is not present in the file ("v", "v/vt" and "v//vn" forms)
+    constexpr int ABSENT_INDEX = std::numeric_limits<int>::min();
+
+    // Parses one face corner in any of the "v", "v/vt", "v//vn" and "v/vt/vn" forms,
+    // p points at the first digit or minus sign. Missing components are set to ABSENT_INDEX.
+    inline bool parseFaceCorner(const char*& p, const char* end, int& vi, int& uvi, int& ni) {
+        uvi = ni = ABSENT_INDEX;
+        if (!parseIndex(p, end, vi)) return false;
+        if (p < end && *p == '/') {
+            ++p;
+            if (p < end && *p != '/' && !isBlank(*p) && !parseIndex(p, end, uvi)) return false;
+            if (p < end && *p == '/') {
+                ++p;
+                if (p < end && !isBlank(*p) && !parseIndex(p, end, ni)) return false;
+            }
+        }
+        return p == end || isBlank(*p);
+    }
+
+    // Cheap pre-pass so that all arrays are allocated once, before the actual parse
+    void countElements(const char* p, const char* end, size_t& v, size_t& vt, size_t& vn, size_t& f) {
+        v = vt = vn = f = 0;
+        while (p < end) {
+            const char* eol = findLineEnd(p, end);
+            if (eol - p >= 2) {
+                if (p[0] == 'v') {
+                    if (isBlank(p[1])) ++v;
+                    else if (p[1] == 't') ++vt;
+                    else if (p[1] == 'n') ++vn;
+                }
+                else if (p[0] == 'f' && isBlank(p[1])) {
+                    ++f;
+                }
+            }
+            p = (eol < end) ? eol + 1 : end;
+        }
+    }
+
+    // Rest of the line without surrounding blanks, used for names and file paths
+    inline std::string parseRestOfLine(const char* p, const char* eol) {
+        p = skipBlanks(p, eol);
+        while (eol > p && isBlank(eol[-1])) {
+            --eol;
+        }
+        return std::string(p, eol);
+    }
+
+    // Skips the options of a texture statement ("-s 1 1 1", "-clamp on", ...): the file name is
+    // the rest of the line after them and may contain blanks
+    const char* skipTextureOptions(const char* p, const char* eol) {
+        for (p = skipBlanks(p, eol); p < eol && *p == '-'; p = skipBlanks(p, eol)) {
+            const char* option = p;
+            while (p < eol && !isBlank(*p)) {
+                ++p;
+            }
+            const std::string name(option, p);
+            if (name == "-o" || name == "-s" || name == "-t") {
+                // 1 to 3 numbers
+                float value;
+                for (int i = 0; i < 3; ++i) {
+                    const char* next = p;
+                    if (!parseFloat(next, eol, value) || (next < eol && !isBlank(*next))) {
+                        break;
+                    }
+                    p = next;
+                }
+            }
+            else {
+                // -mm base gain, every other option one word ("-blendu on", "-bm 0.5", "-imfchan l")
+                const int words = name == "-mm" ? 2 : 1;
+                for (int i = 0; i < words; ++i) {
+                    p = skipBlanks(p, eol);
+                    while (p < eol && !isBlank(*p)) {
+                        ++p;
+                    }
+                }
+            }
+        }
+        return p;
+    }
+
+    // "usemtl" seen before the given triangle corner
+    struct MaterialSwitch {
+        size_t corner;
+        std::string name;
+    };
+
+    // Raw OBJ content: attribute pools plus one (v, vt, vn) index triple per triangle corner
+    struct ObjData {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+        std::vector<MaterialSwitch> material_switches;
+        std::vector<std::string> material_libraries;
+    };
+
+    enum RelativeMask : unsigned char { REL_V = 1, REL_VT = 2, REL_VN = 4 };
+
+    // Corner whose indices were negative (relative to the end of the pools at that line).
+    // Inside a chunk they are resolved against the chunk's own pools, the merge then adds
+    // the number of elements defined by all previous chunks.
+    struct RelativeCorner {
+        size_t corner;
+        unsigned char mask;
+    };
+
+    // Parse result of one line-aligned piece of the file, indices are chunk-local for
+    // relative corners and already global (0-based) for absolute ones
+    struct ObjChunk {
+        ObjData data;
+        std::vector<RelativeCorner> relative;
+        size_t small_faces{ 0 };
+        bool bad_face{ false };
+    };
+
+    // Resolved index of an absent vt/vn component, filled in by fillMissingAttributes()
+    constexpr unsigned int MISSING_INDEX = 0xFFFFFFFEu;
+
+    // OBJ indices are 1-based, negative values count back from the current pool size
+    inline unsigned int resolveIndex(int index, size_t local_count, unsigned char bit, unsigned char& mask) {
+        if (index == ABSENT_INDEX) {
+            return MISSING_INDEX;
+        }
+        if (index > 0) {
+            return static_cast<unsigned int>(index - 1);
+        }
+        if (index < 0) {
+            mask |= bit;
+            return static_cast<unsigned int>(static_cast<long long>(local_count) + index);
+        }
+        return 0xFFFFFFFFu; // index 0 does not exist, rejected by the validation
+    }
+
+    void parseChunk(const char* begin, const char* end, ObjChunk& chunk) {
+        ObjData& data = chunk.data;
+        size_t num_v, num_vt, num_vn, num_f;
+        countElements(begin, end, num_v, num_vt, num_vn, num_f);
+
+        data.positions.reserve(num_v);
+        data.uvs.reserve(num_vt);
+        data.normals.reserve(num_vn);
+        data.vertexIndices.reserve(num_f * 3);
+        data.uvIndices.reserve(num_f * 3);
+        data.normalIndices.reserve(num_f * 3);
+
+        // Reused for every face, so polygons do not allocate once the capacity is reached
+        std::vector<unsigned int> v_idx, uv_idx, n_idx;
+        std::vector<unsigned char> rel_idx;
+
+        for (const char* p = begin; p < end; ) {
+            const char* eol = findLineEnd(p, end);
+            const char* cur = skipBlanks(p, eol);
+            p = (eol < end) ? eol + 1 : end;
+
+            const char* keyword = cur;
+            while (cur < eol && !isBlank(*cur)) {
+                ++cur;
+            }
+            const size_t keyword_len = static_cast<size_t>(cur - keyword);
+
+            if (keyword_len == 1 && keyword[0] == 'v') {
+                glm::vec3 vertex(0.0f);
+                parseFloats(cur, eol, glm::value_ptr(vertex), 3);
+                data.positions.push_back(vertex);
+            }
+            else if (keyword_len == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+                glm::vec2 uv(0.0f);
+                parseFloats(cur, eol, glm::value_ptr(uv), 2);
+                data.uvs.push_back(uv);
+            }
+            else if (keyword_len == 2 && keyword[0] == 'v' && keyword[1] == 'n') {
+                glm::vec3 normal(0.0f);
+                parseFloats(cur, eol, glm::value_ptr(normal), 3);
+                data.normals.push_back(normal);
+            }
+            else if (keyword_len == 6 && std::memcmp(keyword, "usemtl", 6) == 0) {
+                data.material_switches.push_back(MaterialSwitch{ data.vertexIndices.size(), parseRestOfLine(cur, eol) });
+            }
+            else if (keyword_len == 6 && std::memcmp(keyword, "mtllib", 6) == 0) {
+                data.material_libraries.push_back(parseRestOfLine(cur, eol));
+            }
+            else if (keyword_len == 1 && keyword[0] == 'f') {
+                v_idx.clear();
+                uv_idx.clear();
+                n_idx.clear();
+                rel_idx.clear();
+                for (cur = skipBlanks(cur, eol); cur < eol; cur = skipBlanks(cur, eol)) {
+                    int vi = 0, uvi = 0, ni = 0;
+                    if (!parseFaceCorner(cur, eol, vi, uvi, ni)) {
+                        chunk.bad_face = true;
+                        return;
+                    }
+                    unsigned char mask = 0;
+                    v_idx.push_back(resolveIndex(vi, data.positions.size(), REL_V, mask));
+                    uv_idx.push_back(resolveIndex(uvi, data.uvs.size(), REL_VT, mask));
+                    n_idx.push_back(resolveIndex(ni, data.normals.size(), REL_VN, mask));
+                    rel_idx.push_back(mask);
+                }
+
+                if (v_idx.size() < 3) {
+                    ++chunk.small_faces;
+                    continue;
+                }
+
+                for (size_t i = 1; i + 1 < v_idx.size(); ++i) {
+                    const size_t fan[3] = { 0, i, i + 1 };
+                    for (size_t k : fan) {
+                        if (rel_idx[k] != 0) {
+                            chunk.relative.push_back(RelativeCorner{ data.vertexIndices.size(), rel_idx[k] });
+                        }
+                        data.vertexIndices.push_back(v_idx[k]);
+                        data.uvIndices.push_back(uv_idx[k]);
+                        data.normalIndices.push_back(n_idx[k]);
+                    }
+                }
+            }
+        }
+    }
+
+    // Splits [begin, end) into up to max_chunks pieces that start at line boundaries
+    std::vector<std::pair<const char*, const char*>> splitLines(const char* begin, const char* end, size_t max_chunks) {
+        constexpr size_t MIN_CHUNK_BYTES = 256 * 1024; // below this, thread start-up costs more than it saves
+        const size_t size = static_cast<size_t>(end - begin);
+        const size_t chunk_count = std::max<size_t>(1, std::min(max_chunks, size / MIN_CHUNK_BYTES));
+
+        std::vector<std::pair<const char*, const char*>> chunks;
+        const char* start = begin;
+        for (size_t i = 1; i < chunk_count && start < end; ++i) {
+            const char* split = std::max(start, begin + size * i / chunk_count);
+            split = findLineEnd(split, end);
+            split = (split < end) ? split + 1 : end;
+            chunks.emplace_back(start, split);
+            start = split;
+        }
+        if (start < end || chunks.empty()) {
+            chunks.emplace_back(start, end);
+        }
+        return chunks;
+    }
+
+    // Concatenates the chunks; element counts are prefix-summed so that
+    // relative indices of later chunks land on the right global element
+    void mergeChunks(std::vector<ObjChunk>& chunks, ObjData& data) {
+        if (chunks.size() == 1) {
+            data = std::move(chunks[0].data);
+            return;
+        }
+
+        size_t v = 0, vt = 0, vn = 0, corners = 0;
+        for (const auto& chunk : chunks) {
+            v += chunk.data.positions.size();
+            vt += chunk.data.uvs.size();
+            vn += chunk.data.normals.size();
+            corners += chunk.data.vertexIndices.size();
+        }
+        data.positions.reserve(v);
+        data.uvs.reserve(vt);
+        data.normals.reserve(vn);
+        data.vertexIndices.reserve(corners);
+        data.uvIndices.reserve(corners);
+        data.normalIndices.reserve(corners);
+
+        for (const auto& chunk : chunks) {
+            const unsigned int v_base = static_cast<unsigned int>(data.positions.size());
+            const unsigned int vt_base = static_cast<unsigned int>(data.uvs.size());
+            const unsigned int vn_base = static_cast<unsigned int>(data.normals.size());
+            const size_t corner_base = data.vertexIndices.size();
+
+            const ObjData& src = chunk.data;
+            data.positions.insert(data.positions.end(), src.positions.begin(), src.positions.end());
+            data.uvs.insert(data.uvs.end(), src.uvs.begin(), src.uvs.end());
+            data.normals.insert(data.normals.end(), src.normals.begin(), src.normals.end());
+            data.vertexIndices.insert(data.vertexIndices.end(), src.vertexIndices.begin(), src.vertexIndices.end());
+            data.uvIndices.insert(data.uvIndices.end(), src.uvIndices.begin(), src.uvIndices.end());
+            data.normalIndices.insert(data.normalIndices.end(), src.normalIndices.begin(), src.normalIndices.end());
+            for (const auto& change : src.material_switches) {
+                data.material_switches.push_back(MaterialSwitch{ corner_base + change.corner, change.name });
+            }
+            data.material_libraries.insert(data.material_libraries.end(), src.material_libraries.begin(), src.material_libraries.end());
+
+            for (const auto& rel : chunk.relative) {
+                const size_t corner = corner_base + rel.corner;
+                if (rel.mask & REL_V) data.vertexIndices[corner] += v_base;
+                if (rel.mask & REL_VT) data.uvIndices[corner] += vt_base;
+                if (rel.mask & REL_VN) data.normalIndices[corner] += vn_base;
+            }
+        }
+    }
+
+    // Smooth vertex normals for the corners without "vn": every face adds its unnormalised
+    // cross product (length = twice its area) to its positions, so large faces weigh more.
+    // Face normals are computed over structure-of-arrays copies of the triangle corners, 4 cross
+    // products per SSE instruction; gathering the corners and the scatter-add stay scalar.
+    void generateNormals(ObjData& data) {
+        std::vector<size_t> triangles;
+        for (size_t t = 0; t * 3 < data.normalIndices.size(); ++t) {
+            const unsigned int* n = &data.normalIndices[t * 3];
+            if (n[0] == MISSING_INDEX || n[1] == MISSING_INDEX || n[2] == MISSING_INDEX) {
+                triangles.push_back(t);
+            }
+        }
+        if (triangles.empty()) {
+            return;
+        }
+
+        const size_t count = triangles.size();
+        std::vector<float> e1[3], e2[3], face[3];
+        for (int c = 0; c < 3; ++c) {
+            e1[c].resize(count);
+            e2[c].resize(count);
+            face[c].resize(count);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            const unsigned int* v = &data.vertexIndices[triangles[i] * 3];
+            const glm::vec3& p0 = data.positions[v[0]];
+            const glm::vec3 a = data.positions[v[1]] - p0;
+            const glm::vec3 b = data.positions[v[2]] - p0;
+            for (int c = 0; c < 3; ++c) {
+                e1[c][i] = a[c];
+                e2[c][i] = b[c];
+            }
+        }
+        {
+            const float* ax = e1[0].data(); const float* ay = e1[1].data(); const float* az = e1[2].data();
+            const float* bx = e2[0].data(); const float* by = e2[1].data(); const float* bz = e2[2].data();
+            float* nx = face[0].data(); float* ny = face[1].data(); float* nz = face[2].data();
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                const __m128 ax4 = _mm_loadu_ps(ax + i), ay4 = _mm_loadu_ps(ay + i), az4 = _mm_loadu_ps(az + i);
+                const __m128 bx4 = _mm_loadu_ps(bx + i), by4 = _mm_loadu_ps(by + i), bz4 = _mm_loadu_ps(bz + i);
+                _mm_storeu_ps(nx + i, _mm_sub_ps(_mm_mul_ps(ay4, bz4), _mm_mul_ps(az4, by4)));
+                _mm_storeu_ps(ny + i, _mm_sub_ps(_mm_mul_ps(az4, bx4), _mm_mul_ps(ax4, bz4)));
+                _mm_storeu_ps(nz + i, _mm_sub_ps(_mm_mul_ps(ax4, by4), _mm_mul_ps(ay4, bx4)));
+            }
+            for (; i < count; ++i) {
+                nx[i] = ay[i] * bz[i] - az[i] * by[i];
+                ny[i] = az[i] * bx[i] - ax[i] * bz[i];
+                nz[i] = ax[i] * by[i] - ay[i] * bx[i];
+            }
+        }
+
+        // One generated normal per position, appended after the normals read from the file
+        std::vector<glm::vec3> smooth(data.positions.size(), glm::vec3(0.0f));
+        for (size_t i = 0; i < count; ++i) {
+            const glm::vec3 n(face[0][i], face[1][i], face[2][i]);
+            const unsigned int* v = &data.vertexIndices[triangles[i] * 3];
+            smooth[v[0]] += n;
+            smooth[v[1]] += n;
+            smooth[v[2]] += n;
+        }
+        const unsigned int base = static_cast<unsigned int>(data.normals.size());
+        data.normals.reserve(data.normals.size() + smooth.size());
+        for (const glm::vec3& n : smooth) {
+            const float len = glm::length(n);
+            data.normals.push_back(len > 0.0f ? n / len : glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+        for (size_t i = 0; i < data.normalIndices.size(); ++i) {
+            if (data.normalIndices[i] == MISSING_INDEX) {
+                data.normalIndices[i] = base + data.vertexIndices[i];
+            }
+        }
+    }
+
+    // Corners without "vt" share one (0, 0) texture coordinate, missing normals are generated
+    void fillMissingAttributes(ObjData& data) {
+        if (std::find(data.uvIndices.begin(), data.uvIndices.end(), MISSING_INDEX) != data.uvIndices.end()) {
+            const unsigned int zero_uv = static_cast<unsigned int>(data.uvs.size());
+            data.uvs.emplace_back(0.0f);
+            std::replace(data.uvIndices.begin(), data.uvIndices.end(), MISSING_INDEX, zero_uv);
+        }
+        generateNormals(data);
+    }
+
+    bool parseOBJ(const std::string& path, ObjData& data, unsigned int thread_count) {
+        std::string buffer;
+        if (!readWholeFile(path, buffer)) {
+            std::cerr << "Impossible to open the file: " << path << std::endl;
+            return false;
+        }
+        const char* const begin = buffer.data();
+        const char* const end = begin + buffer.size();
+
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        const auto ranges = splitLines(begin, end, thread_count);
+        std::vector<ObjChunk> chunks(ranges.size());
+        if (ranges.size() == 1) {
+            parseChunk(ranges[0].first, ranges[0].second, chunks[0]);
+        }
+        else {
+            std::vector<std::thread> workers;
+            workers.reserve(ranges.size() - 1);
+            for (size_t i = 1; i < ranges.size(); ++i) {
+                workers.emplace_back(parseChunk, ranges[i].first, ranges[i].second, std::ref(chunks[i]));
+            }
+            parseChunk(ranges[0].first, ranges[0].second, chunks[0]);
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        size_t small_faces = 0;
+        for (const auto& chunk : chunks) {
+            if (chunk.bad_face) {
+                std::cerr << "Invalid face format in OBJ file: " << path << std::endl;
+                return false;
+            }
+            small_faces += chunk.small_faces;
+        }
+        if (small_faces > 0) {
+            std::cerr << "Face with less than 3 vertices in OBJ file: " << path
+                << " (" << small_faces << " skipped)" << std::endl;
+        }
+
+        mergeChunks(chunks, data);
+
+        // Validate all corners once, so the output stages can index without checks
+        for (size_t i = 0; i < data.vertexIndices.size(); i++) {
+            if (data.vertexIndices[i] >= data.positions.size() ||
+                (data.uvIndices[i] >= data.uvs.size() && data.uvIndices[i] != MISSING_INDEX) ||
+                (data.normalIndices[i] >= data.normals.size() && data.normalIndices[i] != MISSING_INDEX)) {
+                std::cerr << "Invalid index in OBJ file: " << path << std::endl;
+                return false;
+            }
+        }
+        fillMissingAttributes(data);
+        return true;
+    }
+
+    // Open addressing table mapping a (v, vt, vn) triple to its output vertex index
+    class CornerTable {
+    public:
+        explicit CornerTable(size_t expected) {
+            size_t capacity = 16;
+            while (capacity < expected * 2) {
+                capacity <<= 1;
+            }
+            mask = capacity - 1;
+            slots.assign(capacity, Slot{ 0, 0, 0, EMPTY });
+        }
+
+        // Returns the stored index, or inserts next_index and returns it
+        GLuint findOrInsert(unsigned int v, unsigned int vt, unsigned int vn, GLuint next_index) {
+            size_t h = (v * 73856093u) ^ (vt * 19349663u) ^ (vn * 83492791u);
+            for (size_t i = h & mask; ; i = (i + 1) & mask) {
+                Slot& slot = slots[i];
+                if (slot.index == EMPTY) {
+                    slot = Slot{ v, vt, vn, next_index };
+                    return next_index;
+                }
+                if (slot.v == v && slot.vt == vt && slot.vn == vn) {
+                    return slot.index;
+                }
+            }
+        }
+
+    private:
+        static constexpr GLuint EMPTY = 0xFFFFFFFFu;
+        struct Slot {
+            unsigned int v, vt, vn;
+            GLuint index;
+        };
+        std::vector<Slot> slots;
+        size_t mask;
+    };
+}
+
+namespace {
+    // Assigns every triangle the material of the last preceding "usemtl" and returns the
+    // triangle order grouped by material (stable, so file order is kept inside a group).
+    // Materials are numbered in order of first use; faces before any usemtl get a default one.
+    std::vector<size_t> groupTrianglesByMaterial(const ObjData& data, std::vector<std::string>& material_names,
+        std::vector<GLuint>& triangle_material) {
+        const size_t triangle_count = data.vertexIndices.size() / 3;
+        triangle_material.assign(triangle_count, 0);
+        material_names.clear();
+
+        auto materialId = [&material_names](const std::string& name) {
+            auto it = std::find(material_names.begin(), material_names.end(), name);
+            if (it != material_names.end()) {
+                return static_cast<GLuint>(it - material_names.begin());
+            }
+            material_names.push_back(name);
+            return static_cast<GLuint>(material_names.size() - 1);
+        };
+
+        size_t next_switch = 0;
+        GLuint current = 0;
+        bool has_current = false;
+        for (size_t t = 0; t < triangle_count; ++t) {
+            while (next_switch < data.material_switches.size() && data.material_switches[next_switch].corner <= t * 3) {
+                current = materialId(data.material_switches[next_switch++].name);
+                has_current = true;
+            }
+            if (!has_current) {
+                current = materialId("");
+                has_current = true;
+            }
+            triangle_material[t] = current;
+        }
+
+        // Counting sort by material id
+        std::vector<size_t> offsets(material_names.size() + 1, 0);
+        for (GLuint m : triangle_material) {
+            ++offsets[m + 1];
+        }
+        for (size_t m = 1; m < offsets.size(); ++m) {
+            offsets[m] += offsets[m - 1];
+        }
+        std::vector<size_t> order(triangle_count);
+        for (size_t t = 0; t < triangle_count; ++t) {
+            order[offsets[triangle_material[t]]++] = t;
+        }
+        return order;
+    }
+
+    std::vector<Material> resolveMaterials(const std::filesystem::path& obj_path, const std::vector<std::string>& libraries,
+        const std::vector<std::string>& names, std::vector<std::filesystem::path>& library_paths) {
+        std::vector<Material> library;
+        library_paths.clear();
+        for (const auto& lib : libraries) {
+            std::filesystem::path lib_path = obj_path.parent_path() / lib;
+            library_paths.push_back(lib_path);
+            if (!loadMTL(lib_path.string(), library)) {
+                std::cerr << "Warning: material library not found: " << lib_path.string() << std::endl;
+            }
+        }
+
+        std::vector<Material> materials;
+        materials.reserve(names.size());
+        for (const auto& name : names) {
+            auto it = std::find_if(library.begin(), library.end(), [&name](const Material& m) { return m.name == name; });
+            if (it != library.end()) {
+                materials.push_back(*it);
+            }
+            else {
+                Material fallback;
+                fallback.name = name;
+                materials.push_back(fallback);
+            }
+        }
+        return materials;
+    }
+}
+
+bool loadMTL(const std::string& path, std::vector<Material>& out_materials) {
+    std::string buffer;
+    if (!readWholeFile(path, buffer)) {
+        return false;
+    }
+    const char* const begin = buffer.data();
+    const char* const end = begin + buffer.size();
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+    Material* current = nullptr;
+    for (const char* p = begin; p < end; ) {
+        const char* eol = findLineEnd(p, end);
+        const char* cur = skipBlanks(p, eol);
+        p = (eol < end) ? eol + 1 : end;
+
+        const char* keyword = cur;
+        while (cur < eol && !isBlank(*cur)) {
+            ++cur;
+        }
+        const std::string key(keyword, cur);
+
+        if (key == "newmtl") {
+            out_materials.emplace_back();
+            current = &out_materials.back();
+            current->name = parseRestOfLine(cur, eol);
+        }
+        else if (current == nullptr) {
+            continue;
+        }
+        else if (key == "Ka") {
+            parseFloats(cur, eol, glm::value_ptr(current->ambient), 3);
+        }
+        else if (key == "Kd") {
+            parseFloats(cur, eol, glm::value_ptr(current->diffuse), 3);
+        }
+        else if (key == "Ks") {
+            parseFloats(cur, eol, glm::value_ptr(current->specular), 3);
+        }
+        else if (key == "Ns") {
+            parseFloats(cur, eol, &current->shininess, 1);
+        }
+        else if (key == "d") {
+            parseFloats(cur, eol, &current->diffuse.w, 1);
+        }
+        else if (key == "Tr") {
+            float transparency = 0.0f;
+            parseFloats(cur, eol, &transparency, 1);
+            current->diffuse.w = 1.0f - transparency;
+        }
+        else if (key == "map_Kd") {
+            // Options like "-s 1 1 1" may precede the file name, which is the rest of the line
+            current->diffuse_map = directory / parseRestOfLine(skipTextureOptions(cur, eol), eol);
+        }
+    }
+    return true;
+}
 
 bool loadOBJ(
     const std::string& path,
     std::vector<glm::vec3>& out_vertices,
     std::vector<glm::vec2>& out_uvs,
-    std::vector<glm::vec3>& out_normals
+    std::vector<glm::vec3>& out_normals,
+    unsigned int thread_count
 ) {
     std::cout << "Loading OBJ file: " << path << std::endl;
 
@@ -13,95 +687,91 @@ bool loadOBJ(
     out_uvs.clear();
     out_normals.clear();
 
-    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<glm::vec3> temp_vertices;
-    std::vector<glm::vec2> temp_uvs;
-    std::vector<glm::vec3> temp_normals;
-
-    std::ifstream file(path);
-    if (!file.is_open()) {
-        std::cerr << "Impossible to open the file: " << path << std::endl;
+    ObjData data;
+    if (!parseOBJ(path, data, thread_count)) {
         return false;
     }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        std::string prefix;
-        iss >> prefix;
-
-        if (prefix == "v") {
-            glm::vec3 vertex;
-            iss >> vertex.x >> vertex.y >> vertex.z;
-            temp_vertices.push_back(vertex);
-        }
-        else if (prefix == "vt") {
-            glm::vec2 uv;
-            iss >> uv.x >> uv.y;
-            temp_uvs.push_back(uv);
-        }
-        else if (prefix == "vn") {
-            glm::vec3 normal;
-            iss >> normal.x >> normal.y >> normal.z;
-            temp_normals.push_back(normal);
-        }
-        else if (prefix == "f") {
-            std::vector<unsigned int> v_idx, uv_idx, n_idx;
-            std::string token;
-            while (iss >> token) {
-                std::replace(token.begin(), token.end(), '/', ' ');
-                std::istringstream vss(token);
-                unsigned int vi = 0, uvi = 0, ni = 0;
-                if (!(vss >> vi >> uvi >> ni)) {
-                    std::cerr << "Invalid face format in OBJ file: " << path << std::endl;
-                    file.close();
-                    return false;
-                }
-                v_idx.push_back(vi - 1);
-                uv_idx.push_back(uvi - 1);
-                n_idx.push_back(ni - 1);
-            }
+    // Převod indexů na výstupní vektory
+    out_vertices.reserve(data.vertexIndices.size());
+    out_uvs.reserve(data.vertexIndices.size());
+    out_normals.reserve(data.vertexIndices.size());
+    for (size_t i = 0; i < data.vertexIndices.size(); i++) {
+        out_vertices.push_back(data.positions[data.vertexIndices[i]]);
+        out_uvs.push_back(data.uvs[data.uvIndices[i]]);
+        out_normals.push_back(data.normals[data.normalIndices[i]]);
+    }
 
-            if (v_idx.size() < 3) {
-                std::cerr << "Face with less than 3 vertices in OBJ file: " << path << std::endl;
-                continue;
-            }
+    std::cout << "OBJ loaded successfully: " << out_vertices.size() << " vertices" << std::endl;
+    return true;
+}
 
-            for (size_t i = 1; i + 1 < v_idx.size(); ++i) {
-                vertexIndices.push_back(v_idx[0]);
-                vertexIndices.push_back(v_idx[i]);
-                vertexIndices.push_back(v_idx[i + 1]);
+bool loadOBJMesh(
+    const std::string& path,
+    MeshData& out,
+    unsigned int thread_count
+) {
+    std::cout << "Loading OBJ file: " << path << std::endl;
 
-                uvIndices.push_back(uv_idx[0]);
-                uvIndices.push_back(uv_idx[i]);
-                uvIndices.push_back(uv_idx[i + 1]);
+    out = MeshData{};
+
+    ObjData data;
+    if (!parseOBJ(path, data, thread_count)) {
+        return false;
+    }
 
-                normalIndices.push_back(n_idx[0]);
-                normalIndices.push_back(n_idx[i]);
-                normalIndices.push_back(n_idx[i + 1]);
+    std::vector<std::string> material_names;
+    std::vector<GLuint> triangle_material;
+    const std::vector<size_t> order = groupTrianglesByMaterial(data, material_names, triangle_material);
+
+    // Deduplicate corners while walking the triangles grouped by material, every group
+    // becomes one contiguous range of the shared index buffer
+    const size_t corner_count = data.vertexIndices.size();
+    CornerTable table(corner_count);
+    out.vertices.reserve(std::max(data.positions.size(), data.normals.size()));
+    out.indices.reserve(corner_count);
+    for (size_t t : order) {
+        const GLuint material = triangle_material[t];
+        if (out.submeshes.empty() || out.submeshes.back().material != material) {
+            out.submeshes.push_back(SubmeshRange{ static_cast<GLuint>(out.indices.size()), 0, material });
+        }
+        for (size_t i = t * 3; i < t * 3 + 3; i++) {
+            const unsigned int vi = data.vertexIndices[i];
+            const unsigned int uvi = data.uvIndices[i];
+            const unsigned int ni = data.normalIndices[i];
+            const GLuint next_index = static_cast<GLuint>(out.vertices.size());
+            const GLuint index = table.findOrInsert(vi, uvi, ni, next_index);
+            if (index == next_index) {
+                out.vertices.emplace_back(data.positions[vi], data.uvs[uvi], data.normals[ni]);
             }
+            out.indices.push_back(index);
         }
+        out.submeshes.back().index_count += 3;
+    }
+    if (out.submeshes.empty()) {
+        material_names.assign(1, "");
+        out.submeshes.push_back(SubmeshRange{ 0, 0, 0 });
     }
-    file.close(); // Explicitní zavření souboru
+    out.materials = resolveMaterials(path, data.material_libraries, material_names, out.material_libraries);
 
-    // Převod indexů na výstupní vektory
-    for (size_t i = 0; i < vertexIndices.size(); i++) {
-        unsigned int vertexIndex = vertexIndices[i];
-        unsigned int uvIndex = uvIndices[i];
-        unsigned int normalIndex = normalIndices[i];
-
-        if (vertexIndex >= temp_vertices.size() ||
-            uvIndex >= temp_uvs.size() ||
-            normalIndex >= temp_normals.size()) {
-            std::cerr << "Invalid index in OBJ file: " << path << std::endl;
-            return false;
-        }
+    std::cout << "OBJ loaded successfully: " << out.vertices.size() << " unique vertices, "
+        << out.indices.size() << " indices, " << out.submeshes.size() << " submeshes" << std::endl;
+    return true;
+}
 
-        out_vertices.push_back(temp_vertices[vertexIndex]);
-        out_uvs.push_back(temp_uvs[uvIndex]);
-        out_normals.push_back(temp_normals[normalIndex]);
+bool loadOBJIndexed(
+    const std::string& path,
+    std::vector<vertex>& out_vertices,
+    std::vector<GLuint>& out_indices,
+    unsigned int thread_count
+) {
+    MeshData data;
+    if (!loadOBJMesh(path, data, thread_count)) {
+        out_vertices.clear();
+        out_indices.clear();
+        return false;
     }
-
-    std::cout << "OBJ loaded successfully: " << out_vertices.size() << " vertices" << std::endl;
+    out_vertices = std::move(data.vertices);
+    out_indices = std::move(data.indices);
     return true;
-}
\ No newline at end of file
+}
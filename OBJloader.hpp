@@ -12,5 +12,27 @@ bool loadOBJ(
     const std::string& path,
     std::vector<glm::vec3>& out_vertices,
     std::vector<glm::vec2>& out_uvs,
-    std::vector<glm::vec3>& out_normals
-);
\ No newline at end of file
+    std::vector<glm::vec3>& out_normals,
+    unsigned int thread_count = 0
+);
+
+// Indexed variant: one vertex per unique (v, vt, vn) triple plus a triangle index list,
+// ready to be uploaded as VBO/EBO without expanding shared corners.
+// Large files are split at line boundaries and parsed by thread_count threads (0 = all cores).
+// Faces are grouped by "usemtl" into submeshes, materials come from the "mtllib" files.
+bool loadOBJMesh(
+    const std::string& path,
+    MeshData& out,
+    unsigned int thread_count = 0
+);
+
+// Same as loadOBJMesh, without the submesh and material information
+bool loadOBJIndexed(
+    const std::string& path,
+    std::vector<vertex>& out_vertices,
+    std::vector<GLuint>& out_indices,
+    unsigned int thread_count = 0
+);
+
+// Appends all materials of a .mtl file, returns false if the file cannot be read
+bool loadMTL(const std::string& path, std::vector<Material>& out_materials);
\ No newline at end of file
@@ -0,0 +1,256 @@
+﻿#include "Profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+#include "imgui.h"
+
+namespace {
+    constexpr int CPU_TRACK = 1;  // Chrome trace thread ids
+    constexpr int GPU_TRACK = 2;
+}
+
+double Profiler::sinceOrigin(Clock::time_point t) const {
+    return std::chrono::duration<double, std::micro>(t - origin).count();
+}
+
+size_t Profiler::retainedFrames() const {
+    // Completed frames only, the slot of frame_number belongs to the frame in progress
+    return static_cast<size_t>(std::min<uint64_t>(frame_number, PROFILE_HISTORY - 1));
+}
+
+uint32_t Profiler::sectionIndex(const char* name) {
+    for (uint32_t i = 0; i < sections.size(); ++i) {
+        if (sections[i].name == name || std::strcmp(sections[i].name, name) == 0) {
+            return i;
+        }
+    }
+    Section section;
+    section.name = name;
+    section.cpu_ms.fill(-1.0f);
+    section.gpu_ms.fill(-1.0f);
+    section.query_frame.fill(NO_FRAME);
+    sections.push_back(section);
+    return static_cast<uint32_t>(sections.size() - 1);
+}
+
+void Profiler::beginFrame() {
+    frame_start = Clock::now();
+    if (!started) {
+        origin = frame_start;
+        started = true;
+    }
+    const size_t slot = frame_number % PROFILE_HISTORY;
+    Frame& frame = frames[slot];
+    frame.start_us = sinceOrigin(frame_start);
+    frame.duration_ms = 0.0f;
+    frame.events.clear();
+    for (auto& section : sections) {
+        section.cpu_ms[slot] = -1.0f;
+        section.gpu_ms[slot] = -1.0f;
+    }
+}
+
+void Profiler::endFrame() {
+    frames[frame_number % PROFILE_HISTORY].duration_ms =
+        std::chrono::duration<float, std::milli>(Clock::now() - frame_start).count();
+    for (auto& section : sections) {
+        for (size_t q = 0; q < PROFILE_QUERY_FRAMES; ++q) {
+            resolve(section, q);
+        }
+    }
+    ++frame_number;
+}
+
+void Profiler::beginCpu(const char* name) {
+    const uint32_t section = sectionIndex(name);
+    auto& events = frames[frame_number % PROFILE_HISTORY].events;
+    const Clock::time_point now = Clock::now();
+    events.push_back(Event{ section, static_cast<uint32_t>(cpu_stack.size()), false, sinceOrigin(now), 0.0 });
+    cpu_stack.push_back(OpenScope{ section, events.size() - 1, now });
+}
+
+void Profiler::endCpu() {
+    if (cpu_stack.empty()) {
+        return;
+    }
+    const OpenScope scope = cpu_stack.back();
+    cpu_stack.pop_back();
+    const size_t slot = frame_number % PROFILE_HISTORY;
+    const double us = std::chrono::duration<double, std::micro>(Clock::now() - scope.start).count();
+    auto& events = frames[slot].events;
+    if (scope.event < events.size()) { // a scope spanning endFrame/beginFrame is dropped
+        events[scope.event].duration_us = us;
+        float& total = sections[scope.section].cpu_ms[slot];
+        total = std::max(total, 0.0f) + static_cast<float>(us / 1000.0);
+    }
+}
+
+bool Profiler::resolve(Section& section, size_t q) {
+    const uint64_t frame = section.query_frame[q];
+    if (frame == NO_FRAME) {
+        return true;
+    }
+    GLint available = 0;
+    glGetQueryObjectiv(section.queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return false;
+    }
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(section.queries[q], GL_QUERY_RESULT, &ns);
+    if (frame_number - frame < PROFILE_HISTORY) { // the frame is still in the history
+        const size_t slot = frame % PROFILE_HISTORY;
+        section.gpu_ms[slot] = static_cast<float>(ns / 1e6);
+        auto& events = frames[slot].events;
+        if (section.query_event[q] < events.size()) {
+            events[section.query_event[q]].duration_us = ns / 1e3;
+        }
+    }
+    section.query_frame[q] = NO_FRAME;
+    return true;
+}
+
+void Profiler::beginGpu(const char* name) {
+    const uint32_t index = sectionIndex(name);
+    Section& section = sections[index];
+    const size_t q = frame_number % PROFILE_QUERY_FRAMES;
+    bool measure = gpu_open < 0 && section.query_frame[q] != frame_number;
+    if (measure && !resolve(section, q)) {
+        ++skipped_gpu; // the query from PROFILE_QUERY_FRAMES ago is still in flight, do not wait for it
+        measure = false;
+    }
+    gpu_stack.push_back(measure);
+    if (!measure) {
+        return;
+    }
+
+    if (section.queries[q] == 0) {
+        glCreateQueries(GL_TIME_ELAPSED, 1, &section.queries[q]);
+    }
+    auto& events = frames[frame_number % PROFILE_HISTORY].events;
+    events.push_back(Event{ index, static_cast<uint32_t>(cpu_stack.size()), true, sinceOrigin(Clock::now()), -1.0 });
+    section.query_frame[q] = frame_number;
+    section.query_event[q] = events.size() - 1;
+    glBeginQuery(GL_TIME_ELAPSED, section.queries[q]);
+    gpu_open = static_cast<int>(index);
+}
+
+void Profiler::endGpu() {
+    if (gpu_stack.empty()) {
+        return;
+    }
+    const bool measured = gpu_stack.back();
+    gpu_stack.pop_back();
+    if (measured) {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpu_open = -1;
+    }
+}
+
+Profiler::Percentiles Profiler::frameTimePercentiles() const {
+    Percentiles result;
+    const size_t n = retainedFrames();
+    if (n == 0) {
+        return result;
+    }
+    std::vector<float> times(n);
+    for (size_t i = 0; i < n; ++i) {
+        times[i] = frames[(frame_number - n + i) % PROFILE_HISTORY].duration_ms;
+    }
+    std::sort(times.begin(), times.end());
+    // Nearest rank: the smallest value with at least p of the samples at or below it
+    auto rank = [&](float p) {
+        const size_t index = static_cast<size_t>(std::ceil(p * n));
+        return times[std::clamp<size_t>(index, 1, n) - 1];
+    };
+    result.p50 = rank(0.50f);
+    result.p95 = rank(0.95f);
+    result.p99 = rank(0.99f);
+    result.max = times.back();
+    return result;
+}
+
+void Profiler::drawImGui() const {
+    const size_t n = retainedFrames();
+    if (n == 0) {
+        return;
+    }
+    const Percentiles p = frameTimePercentiles();
+    ImGui::Text("Frame ms  p50 %.2f  p95 %.2f  p99 %.2f", p.p50, p.p95, p.p99);
+
+    // Oldest frame first
+    std::array<float, PROFILE_HISTORY> history;
+    for (size_t i = 0; i < n; ++i) {
+        history[i] = frames[(frame_number - n + i) % PROFILE_HISTORY].duration_ms;
+    }
+    ImGui::PlotLines("##frame_ms", history.data(), static_cast<int>(n), 0, nullptr, 0.0f, p.max * 1.1f, ImVec2(0, 50));
+
+    for (const auto& section : sections) {
+        float cpu = 0.0f, gpu = 0.0f;
+        int cpu_count = 0, gpu_count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const size_t slot = (frame_number - n + i) % PROFILE_HISTORY;
+            if (section.cpu_ms[slot] >= 0.0f) {
+                cpu += section.cpu_ms[slot];
+                ++cpu_count;
+            }
+            if (section.gpu_ms[slot] >= 0.0f) {
+                gpu += section.gpu_ms[slot];
+                ++gpu_count;
+            }
+        }
+        if (gpu_count > 0) {
+            ImGui::Text("%-16s CPU %5.2f  GPU %5.2f", section.name, cpu_count ? cpu / cpu_count : 0.0f, gpu / gpu_count);
+        }
+        else {
+            ImGui::Text("%-16s CPU %5.2f", section.name, cpu_count ? cpu / cpu_count : 0.0f);
+        }
+    }
+    if (skipped_gpu > 0) {
+        ImGui::TextDisabled("%llu GPU samples skipped (in flight)", static_cast<unsigned long long>(skipped_gpu));
+    }
+}
+
+bool Profiler::writeChromeTrace(const std::filesystem::path& path) const {
+    // Trace Event Format, complete ("X") events in microseconds. GPU passes are placed at the
+    // time they were submitted, with the duration measured by their GL_TIME_ELAPSED query.
+    nlohmann::json events = nlohmann::json::array();
+    events.push_back({ {"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", CPU_TRACK}, {"args", {{"name", "CPU (render thread)"}}} });
+    events.push_back({ {"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", GPU_TRACK}, {"args", {{"name", "GPU"}}} });
+
+    const size_t n = retainedFrames();
+    for (size_t i = 0; i < n; ++i) {
+        const Frame& frame = frames[(frame_number - n + i) % PROFILE_HISTORY];
+        events.push_back({ {"name", "Frame"}, {"ph", "X"}, {"pid", 1}, {"tid", CPU_TRACK},
+            {"ts", frame.start_us}, {"dur", frame.duration_ms * 1000.0}, {"args", {{"frame", frame_number - n + i}}} });
+        for (const Event& event : frame.events) {
+            if (event.duration_us < 0.0) {
+                continue; // GPU result never arrived
+            }
+            events.push_back({ {"name", sections[event.section].name}, {"ph", "X"}, {"pid", 1},
+                {"tid", event.gpu ? GPU_TRACK : CPU_TRACK}, {"cat", event.gpu ? "gpu" : "cpu"},
+                {"ts", event.start_us}, {"dur", event.duration_us} });
+        }
+    }
+
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << nlohmann::json{ {"traceEvents", events}, {"displayTimeUnit", "ms"} }.dump();
+    return file.good();
+}
+
+void Profiler::clear() {
+    for (auto& section : sections) {
+        for (GLuint& query : section.queries) {
+            if (query != 0) {
+                glDeleteQueries(1, &query);
+                query = 0;
+            }
+        }
+    }
+    sections.clear();
+}
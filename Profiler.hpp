@@ -0,0 +1,110 @@
+﻿#pragma once
+#include <GL/glew.h>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Frame profiler. CPU sections are timed with RAII ProfileScope markers, GPU passes with
+// GL_TIME_ELAPSED queries (GpuProfileScope). Every section rotates through PROFILE_QUERY_FRAMES
+// queries and a result is only read once the driver reports it available, so the CPU never
+// waits for the GPU; the GPU columns lag a frame or two behind.
+// The last PROFILE_HISTORY frames feed the ImGui graph, the frame time percentiles and the
+// Chrome trace dump (open in chrome://tracing or ui.perfetto.dev).
+
+constexpr size_t PROFILE_HISTORY = 240;     // frame slots (the one in progress included)
+constexpr size_t PROFILE_QUERY_FRAMES = 3;  // GPU results in flight per section
+
+class Profiler {
+public:
+    struct Percentiles {
+        float p50{ 0.0f };
+        float p95{ 0.0f };
+        float p99{ 0.0f };
+        float max{ 0.0f };
+    };
+
+    void beginFrame();
+    void endFrame();  // also collects the GPU results that became available
+
+    // Prefer ProfileScope / GpuProfileScope. Names must be string literals (stored as pointers).
+    void beginCpu(const char* name);
+    void endCpu();
+    void beginGpu(const char* name);  // GL_TIME_ELAPSED queries cannot nest
+    void endGpu();
+
+    Percentiles frameTimePercentiles() const;  // over the retained history, milliseconds
+    void drawImGui() const;                    // into the current ImGui window
+    bool writeChromeTrace(const std::filesystem::path& path) const;
+    uint64_t frameNumber() const { return frame_number; }
+
+    void clear();  // deletes the GL queries
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t NO_FRAME = SIZE_MAX;
+
+    struct Event {
+        uint32_t section;
+        uint32_t depth;
+        bool gpu;
+        double start_us;     // since the first frame
+        double duration_us;  // negative while a GPU result is pending
+    };
+    struct Frame {
+        double start_us{ 0.0 };
+        float duration_ms{ 0.0f };
+        std::vector<Event> events;
+    };
+    struct Section {
+        const char* name;
+        std::array<float, PROFILE_HISTORY> cpu_ms;  // per history slot, negative = not run that frame
+        std::array<float, PROFILE_HISTORY> gpu_ms;
+        std::array<GLuint, PROFILE_QUERY_FRAMES> queries{};
+        std::array<uint64_t, PROFILE_QUERY_FRAMES> query_frame;  // frame the query measures, or NO_FRAME
+        std::array<size_t, PROFILE_QUERY_FRAMES> query_event{};
+    };
+    struct OpenScope {
+        uint32_t section;
+        size_t event;
+        Clock::time_point start;
+    };
+
+    Clock::time_point origin;
+    Clock::time_point frame_start;
+    uint64_t frame_number{ 0 };
+    bool started{ false };
+    std::array<Frame, PROFILE_HISTORY> frames;
+    std::vector<Section> sections;
+    std::vector<OpenScope> cpu_stack;
+    std::vector<bool> gpu_stack;  // per open GpuProfileScope: whether it started a query
+    int gpu_open{ -1 };           // section with a running query
+    uint64_t skipped_gpu{ 0 }; // measurements skipped because the query was still in flight
+
+    uint32_t sectionIndex(const char* name);
+    double sinceOrigin(Clock::time_point t) const;
+    bool resolve(Section& section, size_t slot); // true if the query slot is free afterwards
+    size_t retainedFrames() const;
+};
+
+class ProfileScope {
+public:
+    ProfileScope(Profiler& profiler, const char* name) : profiler(profiler) { profiler.beginCpu(name); }
+    ~ProfileScope() { profiler.endCpu(); }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+    Profiler& profiler;
+};
+
+class GpuProfileScope {
+public:
+    GpuProfileScope(Profiler& profiler, const char* name) : profiler(profiler) { profiler.beginGpu(name); }
+    ~GpuProfileScope() { profiler.endGpu(); }
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+private:
+    Profiler& profiler;
+};
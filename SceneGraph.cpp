@@ -0,0 +1,165 @@
+﻿#include "SceneGraph.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <stdexcept>
+
+glm::mat4 composeTransform(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale) {
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), position);
+    m = glm::rotate(m, rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+    m = glm::rotate(m, rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
+    m = glm::rotate(m, rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+    return glm::scale(m, scale);
+}
+
+AABB transformBounds(const glm::mat4& matrix, const AABB& box) {
+    const glm::vec3 center = box.center();
+    const glm::vec3 extent = (box.max - box.min) * 0.5f;
+    glm::vec3 new_center(matrix[3]);
+    glm::vec3 new_extent(0.0f);
+    for (int column = 0; column < 3; ++column) {
+        for (int row = 0; row < 3; ++row) {
+            new_center[row] += matrix[column][row] * center[column];
+            new_extent[row] += std::abs(matrix[column][row]) * extent[column];
+        }
+    }
+    return AABB{ new_center - new_extent, new_center + new_extent };
+}
+
+SceneNodeId SceneGraph::create(SceneNodeId parent, Model* model) {
+    SceneNodeId node;
+    if (!free_slots.empty()) {
+        node = free_slots.back();
+        free_slots.pop_back();
+        nodes[node] = Node{};
+    }
+    else {
+        node = static_cast<SceneNodeId>(nodes.size());
+        nodes.emplace_back();
+    }
+    nodes[node].alive = true;
+    nodes[node].model = model;
+    link(node, parent);
+    markDirty(node);
+    return node;
+}
+
+void SceneGraph::destroy(SceneNodeId node) {
+    while (nodes[node].first_child != NO_SCENE_NODE) {
+        destroy(nodes[node].first_child);
+    }
+    unlink(node);
+    nodes[node] = Node{};
+    free_slots.push_back(node);
+}
+
+void SceneGraph::setParent(SceneNodeId node, SceneNodeId parent) {
+    for (SceneNodeId ancestor = parent; ancestor != NO_SCENE_NODE; ancestor = nodes[ancestor].parent) {
+        if (ancestor == node) {
+            throw std::runtime_error("SceneGraph: a node cannot become a child of its own subtree");
+        }
+    }
+    unlink(node);
+    link(node, parent);
+    markDirty(node);
+}
+
+void SceneGraph::clear() {
+    nodes.clear();
+    free_slots.clear();
+    dirty_nodes.clear();
+}
+
+void SceneGraph::setPosition(SceneNodeId node, const glm::vec3& position) {
+    nodes[node].position = position;
+    markDirty(node);
+}
+
+void SceneGraph::setRotation(SceneNodeId node, const glm::vec3& rotation) {
+    nodes[node].rotation = rotation;
+    markDirty(node);
+}
+
+void SceneGraph::setScale(SceneNodeId node, const glm::vec3& scale) {
+    nodes[node].scale = scale;
+    markDirty(node);
+}
+
+void SceneGraph::setTransform(SceneNodeId node, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale) {
+    Node& n = nodes[node];
+    n.position = position;
+    n.rotation = rotation;
+    n.scale = scale;
+    markDirty(node);
+}
+
+void SceneGraph::setLocalBounds(SceneNodeId node, const AABB& bounds) {
+    nodes[node].local_bounds = bounds;
+    markDirty(node);
+}
+
+size_t SceneGraph::update(std::vector<SceneNodeId>* changed) {
+    size_t computed = 0;
+    for (const SceneNodeId node : dirty_nodes) {
+        // Destroyed since, or already done with the subtree of a dirty ancestor
+        if (!nodes[node].alive || !nodes[node].dirty) {
+            continue;
+        }
+        // The highest dirty ancestor's subtree contains this one, do it once from there
+        SceneNodeId top = node;
+        for (SceneNodeId ancestor = nodes[node].parent; ancestor != NO_SCENE_NODE; ancestor = nodes[ancestor].parent) {
+            if (nodes[ancestor].dirty) {
+                top = ancestor;
+            }
+        }
+        computed += updateSubtree(top, changed);
+    }
+    dirty_nodes.clear();
+    return computed;
+}
+
+void SceneGraph::markDirty(SceneNodeId node) {
+    if (!nodes[node].dirty) {
+        nodes[node].dirty = true;
+        dirty_nodes.push_back(node);
+    }
+}
+
+void SceneGraph::link(SceneNodeId node, SceneNodeId parent) {
+    nodes[node].parent = parent;
+    if (parent != NO_SCENE_NODE) {
+        nodes[node].next_sibling = nodes[parent].first_child;
+        nodes[parent].first_child = node;
+    }
+}
+
+void SceneGraph::unlink(SceneNodeId node) {
+    const SceneNodeId parent = nodes[node].parent;
+    if (parent != NO_SCENE_NODE) {
+        SceneNodeId* link = &nodes[parent].first_child;
+        while (*link != node) {
+            link = &nodes[*link].next_sibling;
+        }
+        *link = nodes[node].next_sibling;
+    }
+    nodes[node].parent = NO_SCENE_NODE;
+    nodes[node].next_sibling = NO_SCENE_NODE;
+}
+
+size_t SceneGraph::updateSubtree(SceneNodeId node, std::vector<SceneNodeId>* changed) {
+    Node& n = nodes[node];
+    // Children below a changed node keep their local matrix, only their world one moves
+    if (n.dirty) {
+        n.local = composeTransform(n.position, n.rotation, n.scale);
+        n.dirty = false;
+    }
+    n.world = n.parent != NO_SCENE_NODE ? nodes[n.parent].world * n.local : n.local;
+    n.world_bounds = transformBounds(n.world, n.local_bounds);
+    if (changed != nullptr) {
+        changed->push_back(node);
+    }
+    size_t computed = 1;
+    for (SceneNodeId child = n.first_child; child != NO_SCENE_NODE; child = nodes[child].next_sibling) {
+        computed += updateSubtree(child, changed);
+    }
+    return computed;
+}
@@ -0,0 +1,85 @@
+﻿#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "Frustum.hpp"
+
+class Model;
+
+using SceneNodeId = uint32_t;
+constexpr SceneNodeId NO_SCENE_NODE = 0xFFFFFFFFu;
+
+// Local transform of a node: scale, then rotation about x, y, z (radians), then translation
+glm::mat4 composeTransform(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale);
+// Box around the box transformed by matrix (Arvo 1990)
+AABB transformBounds(const glm::mat4& matrix, const AABB& box);
+
+// Transform hierarchy of the scene. Every node caches its local matrix, its world matrix
+// (parent world * local) and the world box of its local bounds. Changing a node only marks it
+// dirty, update() recomputes the changed nodes and their subtrees once per frame, so static
+// scenery costs nothing after the first frame. worldMatrix() and worldBounds() are valid after
+// update(), until the next change.
+//
+// Nodes live in one vector and are referred to by index, destroyed slots are reused. A node may
+// carry the Model drawn with its world matrix, the graph does not own it.
+class SceneGraph {
+public:
+    SceneGraph() = default;
+
+    SceneNodeId create(SceneNodeId parent = NO_SCENE_NODE, Model* model = nullptr);
+    // The node and its whole subtree
+    void destroy(SceneNodeId node);
+    // NO_SCENE_NODE makes it a root, throws std::runtime_error if parent is in node's subtree
+    void setParent(SceneNodeId node, SceneNodeId parent);
+    void clear();
+
+    void setPosition(SceneNodeId node, const glm::vec3& position);
+    void setRotation(SceneNodeId node, const glm::vec3& rotation);
+    void setScale(SceneNodeId node, const glm::vec3& scale);
+    void setTransform(SceneNodeId node, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale);
+    // Bounds in the node's own space (e.g. of its model's vertices)
+    void setLocalBounds(SceneNodeId node, const AABB& bounds);
+
+    const glm::vec3& position(SceneNodeId node) const { return nodes[node].position; }
+    const glm::vec3& rotation(SceneNodeId node) const { return nodes[node].rotation; }
+    const glm::vec3& scale(SceneNodeId node) const { return nodes[node].scale; }
+    SceneNodeId parent(SceneNodeId node) const { return nodes[node].parent; }
+    Model* model(SceneNodeId node) const { return nodes[node].model; }
+    bool valid(SceneNodeId node) const { return node < nodes.size() && nodes[node].alive; }
+
+    const glm::mat4& localMatrix(SceneNodeId node) const { return nodes[node].local; }
+    const glm::mat4& worldMatrix(SceneNodeId node) const { return nodes[node].world; }
+    const AABB& worldBounds(SceneNodeId node) const { return nodes[node].world_bounds; }
+    glm::vec3 worldPosition(SceneNodeId node) const { return glm::vec3(nodes[node].world[3]); }
+
+    // Recomputes the nodes changed since the last call, returns how many matrices it computed.
+    // changed (if given) gets every recomputed node appended.
+    size_t update(std::vector<SceneNodeId>* changed = nullptr);
+    size_t size() const { return nodes.size() - free_slots.size(); }
+
+private:
+    struct Node {
+        glm::vec3 position{ 0.0f };
+        glm::vec3 rotation{ 0.0f };
+        glm::vec3 scale{ 1.0f };
+        glm::mat4 local{ 1.0f };
+        glm::mat4 world{ 1.0f };
+        AABB local_bounds;
+        AABB world_bounds;
+        Model* model{ nullptr };
+        SceneNodeId parent{ NO_SCENE_NODE };
+        SceneNodeId first_child{ NO_SCENE_NODE };
+        SceneNodeId next_sibling{ NO_SCENE_NODE };
+        bool dirty{ false };
+        bool alive{ false };
+    };
+
+    std::vector<Node> nodes;
+    std::vector<SceneNodeId> free_slots;
+    std::vector<SceneNodeId> dirty_nodes;  // marked since the last update(), each once
+
+    void markDirty(SceneNodeId node);
+    void link(SceneNodeId node, SceneNodeId parent);
+    void unlink(SceneNodeId node);
+    size_t updateSubtree(SceneNodeId node, std::vector<SceneNodeId>* changed);
+};
@@ -0,0 +1,63 @@
+﻿#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// C++ mirrors of the interface blocks in tex.vert and tex.frag. The offsets follow the GLSL layout rules
+// (std140 for the uniform block, std430 for the storage block), the asserts below catch
+// accidental changes; ShaderProgram::bind*Block checks the size the driver reports.
+
+constexpr GLuint LIGHTS_UBO_BINDING = 0;         // uniform Lights
+constexpr GLuint POINT_LIGHTS_SSBO_BINDING = 1;  // buffer PointLights
+constexpr GLuint LIGHT_CLUSTERS_SSBO_BINDING = 2; // buffer LightClusters (ClusterRange per cluster)
+constexpr GLuint LIGHT_INDICES_SSBO_BINDING = 3;  // buffer LightIndices
+constexpr GLuint INSTANCES_SSBO_BINDING = 4;      // buffer Instances (tex.vert)
+
+// struct Light: vec3 + float pairs share one 16 byte slot in both layouts
+struct GpuLight {
+    glm::vec3 position;  float constant;
+    glm::vec3 direction; float linear;
+    glm::vec3 ambient;   float quadratic;
+    glm::vec3 diffuse;   float cutOff;
+    glm::vec3 specular;  float outerCutOff;
+    float flicker;       // angular frequency of the 0.7 + 0.3 * sin(time * flicker) intensity, 0 = steady
+    float radius;        // bounding sphere for the light clusters, see lightRadius()
+    float padding[2];    // struct size is rounded up to 16 bytes
+};
+static_assert(offsetof(GpuLight, constant) == 12, "GpuLight layout");
+static_assert(offsetof(GpuLight, direction) == 16, "GpuLight layout");
+static_assert(offsetof(GpuLight, outerCutOff) == 76, "GpuLight layout");
+static_assert(offsetof(GpuLight, flicker) == 80, "GpuLight layout");
+static_assert(offsetof(GpuLight, radius) == 84, "GpuLight layout");
+static_assert(sizeof(GpuLight) == 96, "GpuLight must match the std140/std430 struct size");
+
+// layout(std140) uniform Lights, updated once per frame
+struct LightsBlock {
+    glm::vec4 ambientColor;
+    GpuLight dirLight;
+    GpuLight spotLight;
+    float time;
+    GLint numPointLights;
+    GLint numSpotLights;
+    GLint padding;
+    glm::vec4 clusterScale;  // tiles per pixel (x, y), depth slice = log(depth) * z + w
+    GLuint clusterGrid[4];   // uvec4: tiles x, tiles y, depth slices, unused
+};
+static_assert(offsetof(LightsBlock, dirLight) == 16, "LightsBlock layout");
+static_assert(offsetof(LightsBlock, spotLight) == 112, "LightsBlock layout");
+static_assert(offsetof(LightsBlock, time) == 208, "LightsBlock layout");
+static_assert(offsetof(LightsBlock, numSpotLights) == 216, "LightsBlock layout");
+static_assert(offsetof(LightsBlock, clusterScale) == 224, "LightsBlock layout");
+static_assert(offsetof(LightsBlock, clusterGrid) == 240, "LightsBlock layout");
+static_assert(sizeof(LightsBlock) == 256, "LightsBlock must match the std140 block size");
+
+// layout(std430) buffer PointLights { Light pointLights[]; }, the array stride is sizeof(GpuLight).
+// The clustered light lists (LightClusters, LightIndices) are described in LightClusters.hpp
+
+// layout(std430) buffer Instances { Instance instances[]; }, one placed object of an instanced draw
+struct GpuInstance {
+    glm::mat4 model;  // world matrix, uM_m of the draw
+    glm::vec4 tint;   // multiplies u_diffuse_color (EntityStore tint column)
+};
+static_assert(offsetof(GpuInstance, tint) == 64, "GpuInstance layout");
+static_assert(sizeof(GpuInstance) == 80, "GpuInstance must match the std430 struct size");
@@ -0,0 +1,43 @@
+﻿#include "ShaderBuffer.hpp"
+#include <algorithm>
+
+ShaderBuffer::ShaderBuffer(GLenum target, GLuint binding, size_t size)
+    : target(target), binding(binding) {
+    allocate(size);
+}
+
+void ShaderBuffer::allocate(size_t size, size_t keep) {
+    const GLuint old = ID;
+    keep = std::min(keep, capacity);
+    capacity = std::max<size_t>(size, 16); // zero sized buffers cannot be bound
+    glCreateBuffers(1, &ID);
+    glNamedBufferStorage(ID, capacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    if (old != 0) {
+        if (keep > 0) {
+            glCopyNamedBufferSubData(old, ID, 0, 0, keep);
+        }
+        glDeleteBuffers(1, &old);
+    }
+    bind();
+}
+
+void ShaderBuffer::upload(const void* data, size_t size, size_t offset) {
+    if (offset + size > capacity) {
+        allocate((offset + size) * 2, offset); // storage buffers whose element count grows
+    }
+    if (size > 0) {
+        glNamedBufferSubData(ID, offset, size, data);
+    }
+}
+
+void ShaderBuffer::bind() const {
+    glBindBufferBase(target, binding, ID);
+}
+
+void ShaderBuffer::clear() {
+    if (ID != 0) {
+        glDeleteBuffers(1, &ID);
+        ID = 0;
+    }
+    capacity = 0;
+}
@@ -0,0 +1,35 @@
+﻿#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+
+// Buffer object behind a uniform block (GL_UNIFORM_BUFFER) or a shader storage block
+// (GL_SHADER_STORAGE_BUFFER), attached to a fixed binding point. Like Mesh and
+// ShaderProgram it is a plain handle, clear() releases the GL buffer.
+class ShaderBuffer {
+public:
+    ShaderBuffer() = default;
+    ShaderBuffer(GLenum target, GLuint binding, size_t size);
+
+    // Uploads with a single glNamedBufferSubData. Grows the buffer if needed, the contents before
+    // offset are copied into the new one.
+    void upload(const void* data, size_t size, size_t offset = 0);
+    template <typename T>
+    void update(const T& block) { upload(&block, sizeof(T)); }
+    template <typename T>
+    void update(const std::vector<T>& elements) { upload(elements.data(), elements.size() * sizeof(T)); }
+
+    void bind() const;   // glBindBufferBase to the binding point
+    void clear();
+
+    GLuint getID() const { return ID; }
+    size_t size() const { return capacity; }
+
+private:
+    GLuint ID{ 0 };
+    GLenum target{ GL_UNIFORM_BUFFER };
+    GLuint binding{ 0 };
+    size_t capacity{ 0 };
+
+    void allocate(size_t size, size_t keep = 0);  // keep: leading bytes copied from the old buffer
+};
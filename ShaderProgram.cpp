@@ -1,4 +1,5 @@
 ﻿#include "ShaderProgram.hpp"
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
@@ -14,9 +15,25 @@ std::string ShaderProgram::textFileRead(const std::filesystem::path& filename) {
     return buffer.str();
 }
 
+int ShaderProgram::contextGlslVersion() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return std::min(major * 100 + minor * 10, 460);
+}
+
+std::string ShaderProgram::matchGlslVersion(std::string source) {
+    const int version = contextGlslVersion();
+    const size_t directive = source.find("#version 460");
+    if (directive != std::string::npos && version < 460) {
+        source.replace(directive + 9, 3, std::to_string(version));
+    }
+    return source;
+}
+
 // Compiles a shader from source
 GLuint ShaderProgram::compile_shader(const std::filesystem::path& source_file, const GLenum type) {
-    std::string source = textFileRead(source_file);
+    std::string source = matchGlslVersion(textFileRead(source_file));
     const char* source_cstr = source.c_str();
 
     GLuint shader = glCreateShader(type);
@@ -64,6 +81,84 @@ ShaderProgram::ShaderProgram(const std::filesystem::path& VS_file, const std::fi
     GLuint vertexShader = compile_shader(VS_file, GL_VERTEX_SHADER);
     GLuint fragmentShader = compile_shader(FS_file, GL_FRAGMENT_SHADER);
     ID = link_shader({ vertexShader, fragmentShader });
+    load_uniform_locations();
+}
+
+// Enumerates the active uniforms once after link. Arrays of basic types are reported only
+// as "name[0]", so all their elements (and the bare "name") are added explicitly.
+void ShaderProgram::load_uniform_locations() {
+    auto locations = std::make_shared<std::unordered_map<std::string, GLint>>();
+
+    GLint uniform_count = 0, max_name_length = 0;
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniform_count);
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_MAX_NAME_LENGTH, &max_name_length);
+    std::string name_buffer(static_cast<size_t>(std::max(max_name_length, 1)), '\0');
+
+    const GLenum properties[] = { GL_LOCATION, GL_ARRAY_SIZE };
+    for (GLint i = 0; i < uniform_count; ++i) {
+        GLint values[2];
+        glGetProgramResourceiv(ID, GL_UNIFORM, i, 2, properties, 2, nullptr, values);
+        const GLint location = values[0];
+        const GLint array_size = values[1];
+        if (location < 0) {
+            continue; // member of a uniform block
+        }
+        GLsizei length = 0;
+        glGetProgramResourceName(ID, GL_UNIFORM, i, max_name_length, &length, name_buffer.data());
+        std::string name(name_buffer.data(), length);
+        (*locations)[name] = location;
+
+        const size_t bracket = name.size() > 3 ? name.rfind("[0]") : std::string::npos;
+        if (bracket != std::string::npos && bracket + 3 == name.size()) {
+            const std::string base = name.substr(0, bracket);
+            (*locations)[base] = location;
+            for (GLint element = 1; element < array_size; ++element) {
+                (*locations)[base + "[" + std::to_string(element) + "]"] = location + element;
+            }
+        }
+    }
+    uniform_locations = std::move(locations);
+}
+
+GLuint ShaderProgram::checked_block_index(const GLenum interface, const std::string& name, const size_t expected_size) const {
+    const GLuint index = glGetProgramResourceIndex(ID, interface, name.c_str());
+    if (index == GL_INVALID_INDEX || expected_size == 0) {
+        return index;
+    }
+    const GLenum property = GL_BUFFER_DATA_SIZE;
+    GLint size = 0;
+    glGetProgramResourceiv(ID, interface, index, 1, &property, 1, nullptr, &size);
+    if (static_cast<size_t>(size) != expected_size) {
+        throw std::runtime_error("Layout mismatch of block " + name + ": shader has " + std::to_string(size)
+            + " bytes, C++ struct " + std::to_string(expected_size) + " bytes");
+    }
+    return index;
+}
+
+bool ShaderProgram::bindUniformBlock(const std::string& name, const GLuint binding, const size_t expected_size) const {
+    const GLuint index = checked_block_index(GL_UNIFORM_BLOCK, name, expected_size);
+    if (index == GL_INVALID_INDEX) {
+        return false;
+    }
+    glUniformBlockBinding(ID, index, binding);
+    return true;
+}
+
+bool ShaderProgram::bindStorageBlock(const std::string& name, const GLuint binding, const size_t expected_size) const {
+    const GLuint index = checked_block_index(GL_SHADER_STORAGE_BLOCK, name, expected_size);
+    if (index == GL_INVALID_INDEX) {
+        return false;
+    }
+    glShaderStorageBlockBinding(ID, index, binding);
+    return true;
+}
+
+GLint ShaderProgram::getUniformLocation(const std::string& name) const {
+    if (!uniform_locations) {
+        return -1;
+    }
+    auto it = uniform_locations->find(name);
+    return it != uniform_locations->end() ? it->second : -1;
 }
 
 // Error log helpers
@@ -85,36 +180,36 @@ std::string ShaderProgram::getProgramInfoLog(const GLuint obj) {
 
 // Uniform setters (example for float, others follow similarly)
 void ShaderProgram::setUniform(const std::string& name, const float val) {
-    GLint loc = glGetUniformLocation(ID, name.c_str());
+    GLint loc = getUniformLocation(name);
     if (loc != -1) glUniform1f(loc, val);
 }
 // ... (Implement other setUniform methods similarly)
 // int
 void ShaderProgram::setUniform(const std::string& name, const int val) {
-    GLint loc = glGetUniformLocation(ID, name.c_str());
+    GLint loc = getUniformLocation(name);
     if (loc != -1) glUniform1i(loc, val);
 }
 
 // vec3
 void ShaderProgram::setUniform(const std::string& name, const glm::vec3 val) {
-    GLint loc = glGetUniformLocation(ID, name.c_str());
+    GLint loc = getUniformLocation(name);
     if (loc != -1) glUniform3f(loc, val.x, val.y, val.z);
 }
 
 // vec4
 void ShaderProgram::setUniform(const std::string& name, const glm::vec4 val) {
-    GLint loc = glGetUniformLocation(ID, name.c_str());
+    GLint loc = getUniformLocation(name);
     if (loc != -1) glUniform4f(loc, val.x, val.y, val.z, val.w);
 }
 
 // mat3
 void ShaderProgram::setUniform(const std::string& name, const glm::mat3 val) {
-    GLint loc = glGetUniformLocation(ID, name.c_str());
+    GLint loc = getUniformLocation(name);
     if (loc != -1) glUniformMatrix3fv(loc, 1, GL_FALSE, glm::value_ptr(val));
 }
 
 // mat4
 void ShaderProgram::setUniform(const std::string& name, const glm::mat4 val) {
-    GLint loc = glGetUniformLocation(ID, name.c_str());
+    GLint loc = getUniformLocation(name);
     if (loc != -1) glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(val));
 }
\ No newline at end of file
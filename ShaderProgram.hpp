@@ -3,6 +3,8 @@
 #include <GLFW/glfw3.h>
 #include <string>
 #include <filesystem>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include <GL/glew.h>
 #include <glm/glm.hpp>  // Pøidáváme include pro glm
@@ -20,9 +22,14 @@ public:
         deactivate();
         glDeleteProgram(ID);
         ID = 0;
+        uniform_locations.reset();
     }
     // Getter pro ID
     GLuint getID() const { return ID; }
+    // Location of an active uniform from the table built after link (no GL call), -1 if
+    // the uniform does not exist or was optimised out. Resolve once, then use the handle setters.
+    GLint getUniformLocation(const std::string& name) const;
+
     // set uniform according to name 
     // https://docs.gl/gl4/glUniform
     void setUniform(const std::string& name, const float val);
@@ -31,8 +38,34 @@ public:
     void setUniform(const std::string& name, const glm::vec4 val);
     void setUniform(const std::string& name, const glm::mat3 val);
     void setUniform(const std::string& name, const glm::mat4 val);
+
+    // set uniform by a location from getUniformLocation(), -1 is ignored like in glUniform*
+    void setUniform(const GLint location, const float val) const { glUniform1f(location, val); }
+    void setUniform(const GLint location, const int val) const { glUniform1i(location, val); }
+    void setUniform(const GLint location, const glm::vec2 val) const { glUniform2fv(location, 1, glm::value_ptr(val)); }
+    void setUniform(const GLint location, const glm::vec3 val) const { glUniform3fv(location, 1, glm::value_ptr(val)); }
+    void setUniform(const GLint location, const glm::vec4 val) const { glUniform4fv(location, 1, glm::value_ptr(val)); }
+    void setUniform(const GLint location, const glm::mat3 val) const { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(val)); }
+    void setUniform(const GLint location, const glm::mat4 val) const { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(val)); }
+
+    // Interface blocks: assign the binding point of a uniform block (UBO) or shader storage
+    // block (SSBO). If expected_size is given, the block size reported by the driver must match
+    // the C++ mirror struct (for SSBOs ending in an unsized array: the size with one element),
+    // otherwise std::runtime_error is thrown. Returns false if the block is not active.
+    bool bindUniformBlock(const std::string& name, const GLuint binding, const size_t expected_size = 0) const;
+    bool bindStorageBlock(const std::string& name, const GLuint binding, const size_t expected_size = 0) const;
+
+    // GLSL version of the current context (460 for GL 4.6, 450 for 4.5). The shaders are written
+    // as #version 460 but use nothing newer than 4.5, on a 4.5 context (Mesa llvmpipe) the
+    // directive is rewritten by matchGlslVersion() before compiling.
+    static int contextGlslVersion();
+    static std::string matchGlslVersion(std::string source);
 private:
     GLuint ID{ 0 }; // default = 0, empty shader
+    // name -> location of all active uniforms, shared by the copies of this program
+    std::shared_ptr<const std::unordered_map<std::string, GLint>> uniform_locations;
+    void load_uniform_locations();
+    GLuint checked_block_index(const GLenum interface, const std::string& name, const size_t expected_size) const;
     std::string getShaderInfoLog(const GLuint obj);
     std::string getProgramInfoLog(const GLuint obj);
     GLuint compile_shader(const std::filesystem::path& source_file, const GLenum type);
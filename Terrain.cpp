@@ -0,0 +1,468 @@
+﻿#include "Terrain.hpp"
+#include "TerrainBuilder.hpp"
+#include "TerrainTiles.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+void Terrain::build(const cv::Mat& heightmap, float max_height, float tile_size, TerrainMode mode, ThreadPool* pool) {
+    if (heightmap.empty() || heightmap.cols < 2 || heightmap.rows < 2) {
+        throw std::runtime_error("Terrain: the heightmap has to be at least 2x2 pixels");
+    }
+    if (heightmap.type() != CV_8UC1 && heightmap.type() != CV_16UC1) {
+        throw std::runtime_error("Terrain: the heightmap has to be 8 or 16 bit grayscale");
+    }
+    this->mode = mode;
+    this->max_height = max_height;
+    this->tile_size = tile_size;
+    columns = heightmap.cols;
+    rows = heightmap.rows;
+    // Heightmap mode: the patch holds one chunk, the index lists address it instead of the full grid
+    index_stride = (mode == TerrainMode::Mesh) ? columns : TERRAIN_CHUNK_SIZE + 1;
+    const bool wide = heightmap.depth() == CV_16U;
+    auto heightAt = [&](int x, int z) {
+        x = std::clamp(x, 0, columns - 1);
+        z = std::clamp(z, 0, rows - 1);
+        return wide ? heightmap.at<ushort>(z, x) / 65535.0f * max_height : heightmap.at<uchar>(z, x) / 255.0f * max_height;
+    };
+
+    vertices.clear();
+    heights.release();
+    atlas = nullptr;
+    if (mode == TerrainMode::Mesh) {
+        // One vertex per pixel, normals from the neighbouring heights
+        buildTerrainVertices(heightmap, max_height, tile_size, vertices, pool);
+    }
+    else {
+        // Same samples, terrain.vert computes positions and normals like buildTerrainVertices
+        heights = heightmap.isContinuous() ? heightmap : heightmap.clone();
+    }
+
+    buildChunks([&](const Chunk& chunk, int cells_x, int cells_z) {
+        float low = max_height, high = 0.0f;
+        for (int z = chunk.z0; z <= chunk.z0 + cells_z; ++z) {
+            for (int x = chunk.x0; x <= chunk.x0 + cells_x; ++x) {
+                const float h = heightAt(x, z);
+                low = std::min(low, h);
+                high = std::max(high, h);
+            }
+        }
+        return glm::vec2(low, high);
+    });
+    buildIndexLists();
+}
+
+void Terrain::build(const TerrainTileFile& tiles, const TerrainTileAtlas& atlas, float max_height, float tile_size) {
+    if (!tiles.isOpen()) {
+        throw std::runtime_error("Terrain: the tile file is not open");
+    }
+    mode = TerrainMode::Streamed;
+    this->max_height = max_height;
+    this->tile_size = tile_size;
+    this->atlas = &atlas;
+    tiles_x = tiles.tilesX();
+    columns = tiles.width();
+    rows = tiles.height();
+    index_stride = TERRAIN_CHUNK_SIZE + 1;
+    vertices.clear();
+    heights.release();
+
+    // Bounds from the chunk heights stored in the file, no tile is read
+    buildChunks([&](const Chunk& chunk, int, int) {
+        const int cx = chunk.x0 / TERRAIN_CHUNK_SIZE, cz = chunk.z0 / TERRAIN_CHUNK_SIZE;
+        return glm::vec2(tiles.chunkMin(cx, cz), tiles.chunkMax(cx, cz)) / 65535.0f * max_height;
+    });
+    buildIndexLists();
+
+    // Overview from the corner heights in the file: normals by central differences and texture
+    // coordinates like terrain.vert computes them for the full grid, the diagonals like the patch
+    auto cornerX = [&](int cx) { return std::min(std::clamp(cx, 0, chunks_x) * TERRAIN_CHUNK_SIZE, columns - 1); };
+    auto cornerZ = [&](int cz) { return std::min(std::clamp(cz, 0, chunks_z) * TERRAIN_CHUNK_SIZE, rows - 1); };
+    auto cornerHeight = [&](int cx, int cz) {
+        return tiles.chunkCorner(std::clamp(cx, 0, chunks_x), std::clamp(cz, 0, chunks_z)) / 65535.0f * max_height;
+    };
+    vertices.reserve(static_cast<size_t>(chunks_x + 1) * (chunks_z + 1));
+    for (int cz = 0; cz <= chunks_z; ++cz) {
+        for (int cx = 0; cx <= chunks_x; ++cx) {
+            const int x = cornerX(cx), z = cornerZ(cz);
+            const float slope_x = (cornerHeight(cx + 1, cz) - cornerHeight(cx - 1, cz))
+                / std::max(cornerX(cx + 1) - cornerX(cx - 1), 1);
+            const float slope_z = (cornerHeight(cx, cz + 1) - cornerHeight(cx, cz - 1))
+                / std::max(cornerZ(cz + 1) - cornerZ(cz - 1), 1);
+            vertices.push_back(vertex{ glm::vec3(x * tile_size, cornerHeight(cx, cz), z * tile_size),
+                glm::vec2(static_cast<float>(x) / (columns - 1), static_cast<float>(z) / (rows - 1)),
+                glm::normalize(glm::vec3(-slope_x, 1.0f, -slope_z)) });
+        }
+    }
+    overview_indices.clear();
+    overview_indices.reserve(6 * chunks.size());
+    for (int cz = 0; cz < chunks_z; ++cz) {
+        for (int cx = 0; cx < chunks_x; ++cx) {
+            const GLuint topLeft = static_cast<GLuint>(cz * (chunks_x + 1) + cx);
+            const GLuint topRight = topLeft + 1;
+            const GLuint bottomLeft = topLeft + chunks_x + 1;
+            const GLuint bottomRight = bottomLeft + 1;
+            overview_indices.insert(overview_indices.end(), { topLeft, bottomLeft, topRight, topRight, bottomLeft, bottomRight });
+        }
+    }
+}
+
+template <typename HeightRange>
+void Terrain::buildChunks(HeightRange height_range) {
+    // Chunks, the last column and row of chunks may be smaller
+    chunks_x = (columns - 1 + TERRAIN_CHUNK_SIZE - 1) / TERRAIN_CHUNK_SIZE;
+    chunks_z = (rows - 1 + TERRAIN_CHUNK_SIZE - 1) / TERRAIN_CHUNK_SIZE;
+    chunks.clear();
+    size_classes.clear();
+    for (int cz = 0; cz < chunks_z; ++cz) {
+        for (int cx = 0; cx < chunks_x; ++cx) {
+            Chunk chunk{};
+            chunk.x0 = cx * TERRAIN_CHUNK_SIZE;
+            chunk.z0 = cz * TERRAIN_CHUNK_SIZE;
+            const int cells_x = std::min(TERRAIN_CHUNK_SIZE, columns - 1 - chunk.x0);
+            const int cells_z = std::min(TERRAIN_CHUNK_SIZE, rows - 1 - chunk.z0);
+            auto size_class = std::find_if(size_classes.begin(), size_classes.end(),
+                [&](const SizeClass& c) { return c.cells_x == cells_x && c.cells_z == cells_z; });
+            if (size_class == size_classes.end()) {
+                size_classes.push_back(SizeClass{ cells_x, cells_z, {} });
+                size_class = size_classes.end() - 1;
+            }
+            chunk.size_class = static_cast<int>(size_class - size_classes.begin());
+
+            const glm::vec2 low_high = height_range(chunk, cells_x, cells_z);
+            chunk.bounds.min = glm::vec3(chunk.x0 * tile_size, low_high.x, chunk.z0 * tile_size);
+            chunk.bounds.max = glm::vec3((chunk.x0 + cells_x) * tile_size, low_high.y, (chunk.z0 + cells_z) * tile_size);
+            chunk.base_vertex = (mode == TerrainMode::Mesh) ? chunk.z0 * columns + chunk.x0 : 0;
+            chunks.push_back(chunk);
+        }
+    }
+}
+
+void Terrain::buildIndexLists() {
+    indices.clear();
+    for (auto& size_class : size_classes) {
+        for (int lod = 0; lod < TERRAIN_LOD_COUNT; ++lod) {
+            for (unsigned edges = 0; edges < TERRAIN_EDGE_VARIANTS; ++edges) {
+                // Edges that are never stitched: nothing is coarser than the last level and the smaller
+                // chunks of the last column and row have no neighbour east and south
+                unsigned reachable = lod + 1 < TERRAIN_LOD_COUNT ? edges : 0;
+                if (size_class.cells_x < TERRAIN_CHUNK_SIZE) reachable &= ~TERRAIN_EDGE_EAST;
+                if (size_class.cells_z < TERRAIN_CHUNK_SIZE) reachable &= ~TERRAIN_EDGE_SOUTH;
+                if (reachable == edges) {
+                    buildVariant(size_class, lod, edges);
+                }
+                else {
+                    size_class.variants[lod][edges] = size_class.variants[lod][reachable];
+                }
+            }
+        }
+    }
+    lods.assign(chunks.size(), 0);
+}
+
+void Terrain::buildVariant(SizeClass& size_class, int lod, unsigned edges) {
+    const int step = 1 << lod;
+    const int cells_x = size_class.cells_x;
+    const int cells_z = size_class.cells_z;
+    auto coordinates = [step](int cells) {
+        std::vector<int> result;
+        for (int c = 0; c < cells; c += step) {
+            result.push_back(c);
+        }
+        result.push_back(cells);
+        return result;
+    };
+    const std::vector<int> xs = coordinates(cells_x);
+    const std::vector<int> zs = coordinates(cells_z);
+
+    // The coarser neighbour has the vertices at multiples of 2 * step and the chunk corners
+    auto snap = [step](int c, int cells) { return c == cells ? cells : c / (2 * step) * (2 * step); };
+    auto index = [&](int x, int z) {
+        if ((x == 0 && (edges & TERRAIN_EDGE_WEST)) || (x == cells_x && (edges & TERRAIN_EDGE_EAST))) {
+            z = snap(z, cells_z);
+        }
+        if ((z == 0 && (edges & TERRAIN_EDGE_NORTH)) || (z == cells_z && (edges & TERRAIN_EDGE_SOUTH))) {
+            x = snap(x, cells_x);
+        }
+        return static_cast<GLuint>(z * index_stride + x); // relative to the chunk's first vertex
+    };
+    auto triangle = [&](GLuint a, GLuint b, GLuint c) {
+        if (a != b && b != c && a != c) { // collapsed by the stitching
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+        }
+    };
+
+    IndexRange& range = size_class.variants[lod][edges];
+    range.first = static_cast<GLuint>(indices.size());
+    for (size_t j = 0; j + 1 < zs.size(); ++j) {
+        for (size_t i = 0; i + 1 < xs.size(); ++i) {
+            const GLuint topLeft = index(xs[i], zs[j]);
+            const GLuint topRight = index(xs[i + 1], zs[j]);
+            const GLuint bottomLeft = index(xs[i], zs[j + 1]);
+            const GLuint bottomRight = index(xs[i + 1], zs[j + 1]);
+            triangle(topLeft, bottomLeft, topRight);
+            triangle(topRight, bottomLeft, bottomRight);
+        }
+    }
+    range.count = static_cast<GLuint>(indices.size()) - range.first;
+}
+
+void Terrain::upload(ShaderProgram& shader, GLuint texture_id, ShaderProgram* overview_shader) {
+    if (mode != TerrainMode::Mesh) {
+        uploadHeightmap(shader, texture_id);
+        if (mode == TerrainMode::Streamed) {
+            if (!overview_shader) {
+                throw std::runtime_error("Terrain: Streamed mode needs the overview shader");
+            }
+            mesh = Mesh(GL_TRIANGLES, *overview_shader, vertices, overview_indices, glm::vec3(0.0f), glm::vec3(0.0f),
+                texture_id);
+            mesh.diffuse_material = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+        }
+    }
+    else {
+        mesh = Mesh(GL_TRIANGLES, shader, vertices, indices, glm::vec3(0.0f), glm::vec3(0.0f), texture_id);
+        mesh.diffuse_material = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+    uploaded = true;
+}
+
+void Terrain::uploadHeightmap(ShaderProgram& shader, GLuint texture_id) {
+    this->shader = shader;
+    this->texture_id = texture_id;
+    tex0_location = shader.getUniformLocation("tex0");
+    heightmap_location = shader.getUniformLocation("uHeightmap");
+    max_height_location = shader.getUniformLocation("uMaxHeight");
+    tile_size_location = shader.getUniformLocation("uTileSize");
+    tile_cells_location = shader.getUniformLocation("uTileCells");
+    tile_border_location = shader.getUniformLocation("uTileBorder");
+    texcoord_scale_location = shader.getUniformLocation("uTexCoordScale");
+
+    // Heights, read with texelFetch: no filtering, no mipmaps. Streamed mode reads the atlas texture.
+    if (mode == TerrainMode::Heightmap) {
+        const bool wide = heights.depth() == CV_16U;
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &height_texture);
+        glTextureStorage3D(height_texture, 1, wide ? GL_R16 : GL_R8, columns, rows, 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTextureSubImage3D(height_texture, 0, 0, 0, 0, columns, rows, 1, GL_RED,
+            wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, heights.data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTextureParameteri(height_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(height_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTextureParameteri(height_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(height_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    // Grid patch: cell coordinates (x, z) of one chunk, 2 bytes per vertex
+    std::vector<uint8_t> patch;
+    patch.reserve(2 * static_cast<size_t>(index_stride) * index_stride);
+    for (int z = 0; z < index_stride; ++z) {
+        for (int x = 0; x < index_stride; ++x) {
+            patch.push_back(static_cast<uint8_t>(x));
+            patch.push_back(static_cast<uint8_t>(z));
+        }
+    }
+
+    glCreateBuffers(1, &patch_vbo);
+    glNamedBufferStorage(patch_vbo, patch.size(), patch.data(), 0);
+    // The patch has (TERRAIN_CHUNK_SIZE + 1)^2 vertices, 16 bit indices are enough
+    const std::vector<GLushort> patch_indices(indices.begin(), indices.end());
+    glCreateBuffers(1, &patch_ebo);
+    glNamedBufferStorage(patch_ebo, patch_indices.size() * sizeof(GLushort), patch_indices.data(), 0);
+    // Written by every draw(), at most one command and instance per chunk
+    glCreateBuffers(1, &commands_buffer);
+    glNamedBufferData(commands_buffer, chunks.size() * sizeof(DrawCommand), nullptr, GL_STREAM_DRAW);
+    glCreateBuffers(1, &instances_buffer);
+    glNamedBufferData(instances_buffer, chunks.size() * sizeof(DrawInstance), nullptr, GL_STREAM_DRAW);
+
+    // layout(location = 0) uvec2 aCell, layout(location = 1) ivec3 aChunk in terrain.vert
+    glCreateVertexArrays(1, &patch_vao);
+    glEnableVertexArrayAttrib(patch_vao, 0);
+    glVertexArrayAttribIFormat(patch_vao, 0, 2, GL_UNSIGNED_BYTE, 0);
+    glVertexArrayAttribBinding(patch_vao, 0, 0);
+    glVertexArrayVertexBuffer(patch_vao, 0, patch_vbo, 0, 2);
+    glEnableVertexArrayAttrib(patch_vao, 1);
+    glVertexArrayAttribIFormat(patch_vao, 1, 3, GL_INT, 0);
+    glVertexArrayAttribBinding(patch_vao, 1, 1);
+    glVertexArrayVertexBuffer(patch_vao, 1, instances_buffer, 0, sizeof(DrawInstance));
+    glVertexArrayBindingDivisor(patch_vao, 1, 1);
+    glVertexArrayElementBuffer(patch_vao, patch_ebo);
+}
+
+size_t Terrain::gpuMemory() const {
+    if (mode == TerrainMode::Mesh) {
+        return static_cast<size_t>(columns) * rows * sizeof(vertex) + indices.size() * sizeof(GLuint);
+    }
+    const size_t heights_bytes = (mode == TerrainMode::Streamed)
+        ? atlas->layerCount() * TERRAIN_TILE_BYTES + TERRAIN_TILE_STAGING_SLOTS * TERRAIN_TILE_BYTES
+            + vertices.size() * sizeof(vertex) + overview_indices.size() * sizeof(GLuint)
+        : static_cast<size_t>(columns) * rows * (heights.depth() == CV_16U ? 2 : 1);
+    return heights_bytes + 2 * static_cast<size_t>(index_stride) * index_stride
+        + chunks.size() * (sizeof(DrawInstance) + sizeof(DrawCommand)) + indices.size() * sizeof(GLushort);
+}
+
+void Terrain::select(const glm::mat4& view_projection, const glm::vec3& eye) {
+    // Level by the distance from the eye to the chunk box: 0 up to TERRAIN_LOD_DISTANCE, then +1 per doubling
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const float distance = chunks[i].bounds.distance(eye);
+        int lod = 0;
+        if (distance >= TERRAIN_LOD_DISTANCE) {
+            lod = 1 + static_cast<int>(std::log2(distance / TERRAIN_LOD_DISTANCE));
+        }
+        lods[i] = static_cast<uint8_t>(std::min(lod, TERRAIN_LOD_COUNT - 1));
+    }
+
+    // Stitching handles one level of difference, refine chunks next to much finer ones
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int cz = 0; cz < chunks_z; ++cz) {
+            for (int cx = 0; cx < chunks_x; ++cx) {
+                uint8_t& lod = lods[cz * chunks_x + cx];
+                uint8_t finest = lod;
+                if (cx > 0) finest = std::min(finest, lods[cz * chunks_x + cx - 1]);
+                if (cx + 1 < chunks_x) finest = std::min(finest, lods[cz * chunks_x + cx + 1]);
+                if (cz > 0) finest = std::min(finest, lods[(cz - 1) * chunks_x + cx]);
+                if (cz + 1 < chunks_z) finest = std::min(finest, lods[(cz + 1) * chunks_x + cx]);
+                if (lod > finest + 1) {
+                    lod = static_cast<uint8_t>(finest + 1);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    const Frustum frustum(view_projection);
+    draw_counts.clear();
+    draw_offsets.clear();
+    draw_base_vertices.clear();
+    draw_commands.clear();
+    draw_instances.clear();
+    stats = Stats{};
+    for (int cz = 0; cz < chunks_z; ++cz) {
+        for (int cx = 0; cx < chunks_x; ++cx) {
+            const size_t i = static_cast<size_t>(cz) * chunks_x + cx;
+            const Chunk& chunk = chunks[i];
+            if (!frustum.intersects(chunk.bounds)) {
+                continue;
+            }
+            int layer = 0;
+            if (mode == TerrainMode::Streamed) {
+                layer = atlas->layer(chunk.z0 / TERRAIN_TILE_CELLS * tiles_x + chunk.x0 / TERRAIN_TILE_CELLS);
+                if (layer < 0) { // not streamed in yet, the overview's two triangles instead
+                    draw_counts.push_back(6);
+                    draw_offsets.push_back(reinterpret_cast<const void*>(static_cast<uintptr_t>(6 * i) * sizeof(GLuint)));
+                    draw_base_vertices.push_back(0);
+                    ++stats.overview_chunks;
+                    continue;
+                }
+            }
+            const IndexRange& range = chunkIndices(cx, cz);
+            if (mode == TerrainMode::Mesh) {
+                draw_counts.push_back(static_cast<GLsizei>(range.count));
+                draw_offsets.push_back(reinterpret_cast<const void*>(static_cast<uintptr_t>(range.first) * sizeof(GLuint)));
+                draw_base_vertices.push_back(chunk.base_vertex);
+            }
+            else {
+                draw_commands.push_back(DrawCommand{ range.count, 1, range.first, 0,
+                    static_cast<GLuint>(draw_instances.size()) });
+                draw_instances.push_back(DrawInstance{ chunk.x0, chunk.z0, layer });
+            }
+            ++stats.visible_chunks;
+            stats.triangles += range.count / 3;
+        }
+    }
+}
+
+const Terrain::IndexRange& Terrain::chunkIndices(int cx, int cz) const {
+    const size_t i = static_cast<size_t>(cz) * chunks_x + cx;
+    const uint8_t lod = lods[i];
+    unsigned edges = 0;
+    if (cx > 0 && lods[i - 1] > lod) edges |= TERRAIN_EDGE_WEST;
+    if (cx + 1 < chunks_x && lods[i + 1] > lod) edges |= TERRAIN_EDGE_EAST;
+    if (cz > 0 && lods[i - chunks_x] > lod) edges |= TERRAIN_EDGE_NORTH;
+    if (cz + 1 < chunks_z && lods[i + chunks_x] > lod) edges |= TERRAIN_EDGE_SOUTH;
+    return size_classes[chunks[i].size_class].variants[lod][edges];
+}
+
+void Terrain::draw() const {
+    if (!uploaded) {
+        return;
+    }
+    if (mode != TerrainMode::Mesh) {
+        drawHeightmap();
+    }
+    else {
+        mesh.drawMulti(draw_counts.data(), draw_offsets.data(), draw_base_vertices.data(),
+            static_cast<GLsizei>(draw_counts.size()));
+    }
+}
+
+void Terrain::drawOverview() const {
+    if (uploaded && mode == TerrainMode::Streamed) {
+        mesh.drawMulti(draw_counts.data(), draw_offsets.data(), draw_base_vertices.data(),
+            static_cast<GLsizei>(draw_counts.size()));
+    }
+}
+
+void Terrain::drawHeightmap() const {
+    if (draw_commands.empty()) {
+        return;
+    }
+    glBindTextureUnit(0, texture_id);
+    glBindTextureUnit(1, mode == TerrainMode::Streamed ? atlas->getTexture() : height_texture);
+    shader.setUniform(tex0_location, 0);
+    shader.setUniform(heightmap_location, 1);
+    shader.setUniform(max_height_location, max_height);
+    shader.setUniform(tile_size_location, tile_size);
+    const bool tiled = mode == TerrainMode::Streamed;
+    shader.setUniform(tile_cells_location, tiled ? TERRAIN_TILE_CELLS : std::max(columns, rows));
+    shader.setUniform(tile_border_location, tiled ? TERRAIN_TILE_BORDER : 0);
+    shader.setUniform(texcoord_scale_location, glm::vec2(1.0f / (columns - 1), 1.0f / (rows - 1)));
+
+    glNamedBufferSubData(commands_buffer, 0, draw_commands.size() * sizeof(DrawCommand), draw_commands.data());
+    glNamedBufferSubData(instances_buffer, 0, draw_instances.size() * sizeof(DrawInstance), draw_instances.data());
+    glBindVertexArray(patch_vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands_buffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, static_cast<GLsizei>(draw_commands.size()), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+
+    ++Mesh::stats.draw_calls;
+    Mesh::stats.triangles += stats.triangles;
+}
+
+void Terrain::clear() {
+    if (uploaded && mode == TerrainMode::Mesh) {
+        mesh.clear(); // also deletes the texture
+    }
+    else if (uploaded) {
+        if (mode == TerrainMode::Streamed) {
+            mesh.texture_id = 0;  // deleted with the patch textures below
+            mesh.clear();
+        }
+        glDeleteVertexArrays(1, &patch_vao);
+        const GLuint buffers[] = { patch_vbo, patch_ebo, instances_buffer, commands_buffer };
+        glDeleteBuffers(4, buffers);
+        const GLuint textures[] = { height_texture, texture_id };
+        glDeleteTextures(2, textures);  // the atlas texture belongs to the atlas
+        patch_vao = patch_vbo = patch_ebo = instances_buffer = commands_buffer = 0;
+        height_texture = texture_id = 0;
+    }
+    uploaded = false;
+    vertices.clear();
+    overview_indices.clear();
+    heights.release();
+    indices.clear();
+    chunks.clear();
+    size_classes.clear();
+    lods.clear();
+    draw_counts.clear();
+    draw_offsets.clear();
+    draw_base_vertices.clear();
+    draw_commands.clear();
+    draw_instances.clear();
+    atlas = nullptr;
+}
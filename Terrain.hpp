@@ -0,0 +1,173 @@
+﻿#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "Frustum.hpp"
+#include "Mesh.hpp"
+#include "ShaderProgram.hpp"
+#include "assets.hpp"
+
+// Heightmap terrain split into square chunks of TERRAIN_CHUNK_SIZE cells. Every chunk is drawn at
+// one of TERRAIN_LOD_COUNT levels of detail, level k taking every 2^k-th heightmap sample. Chunks
+// outside the view frustum are skipped, the rest go to the GPU in a single multi-draw call.
+//
+// TerrainMode::Mesh keeps one vertex per heightmap pixel in a vertex buffer shared by all chunks
+// (32 bytes per sample, tex.vert). TerrainMode::Heightmap uploads only the heightmap as an R8/R16
+// texture and one flat (TERRAIN_CHUNK_SIZE + 1)^2 grid patch: every chunk draws the patch and
+// terrain.vert fetches its heights and normals from the texture (about 1 byte per sample).
+// TerrainMode::Streamed draws the same patch over a tiled heightmap of any size (TerrainTiles.hpp):
+// only the tiles around the camera are in memory and on the GPU. Chunks whose tile is not there
+// yet are drawn from an overview mesh with one vertex per chunk corner (two triangles per chunk,
+// tex.vert), coarse but without holes until the tile arrives.
+//
+// Neighbouring chunks differ by at most one level. On an edge towards a coarser neighbour the
+// vertices the neighbour does not have are snapped to the previous one it does have, so both
+// chunks meet in the same edge segments (no cracks). The collapsed triangles are dropped.
+// Index lists depend only on chunk size, level and which edges are stitched, they are built once
+// relative to the chunk's first vertex and placed by its base vertex (Mesh) or origin attribute
+// (Heightmap and Streamed, the patch is the base vertex of every chunk).
+
+constexpr int TERRAIN_CHUNK_SIZE = 32;           // cells per chunk side
+static_assert(TERRAIN_CHUNK_SIZE < 256, "the Heightmap mode patch has 8 bit coordinates and 16 bit indices");
+constexpr int TERRAIN_LOD_COUNT = 5;             // vertex steps 1, 2, 4, 8, 16
+constexpr float TERRAIN_LOD_DISTANCE = 64.0f;    // level 0 closer than this, +1 level per doubling
+
+// Edges stitched to a coarser neighbour, bit set of the variant index
+enum TerrainEdge : unsigned {
+    TERRAIN_EDGE_WEST = 1,   // -x
+    TERRAIN_EDGE_EAST = 2,   // +x
+    TERRAIN_EDGE_NORTH = 4,  // -z
+    TERRAIN_EDGE_SOUTH = 8   // +z
+};
+constexpr unsigned TERRAIN_EDGE_VARIANTS = 16;
+
+enum class TerrainMode {
+    Mesh,       // CPU built vertex grid
+    Heightmap,  // heightmap texture + grid patch, displaced in terrain.vert
+    Streamed    // tile file + texture array of the tiles around the camera, displaced in terrain.vert
+};
+
+class TerrainTileFile;
+class TerrainTileAtlas;
+class ThreadPool;
+
+class Terrain {
+public:
+    struct Chunk {
+        int x0, z0;        // first cell
+        int size_class;    // index into size_classes
+        AABB bounds;
+        GLint base_vertex;  // first vertex in Mesh mode, 0 (the patch) in the other modes
+    };
+    struct IndexRange {
+        GLuint first;
+        GLuint count;
+    };
+    struct SizeClass {
+        int cells_x, cells_z;
+        std::array<std::array<IndexRange, TERRAIN_EDGE_VARIANTS>, TERRAIN_LOD_COUNT> variants;
+    };
+    struct Stats {
+        size_t visible_chunks{ 0 };
+        size_t triangles{ 0 };
+        size_t overview_chunks{ 0 };  // Streamed mode, visible chunks drawn from the overview
+    };
+
+    Terrain() = default;
+
+    // Chunks and index lists from a grayscale 8 or 16 bit heightmap, vertices too in Mesh mode (CPU only,
+    // TerrainBuilder.hpp, rows split over pool if given)
+    void build(const cv::Mat& heightmap, float max_height, float tile_size = 1.0f, TerrainMode mode = TerrainMode::Mesh,
+        ThreadPool* pool = nullptr);
+    // Streamed mode: chunks of a tile file, drawn from the tiles the atlas has. Both have to outlive the terrain.
+    void build(const TerrainTileFile& tiles, const TerrainTileAtlas& atlas, float max_height, float tile_size = 1.0f);
+    // GL buffers, textured with texture_id. The shader has to be tex.vert for Mesh mode and
+    // terrain.vert for the other modes, both with tex.frag. Streamed mode also needs
+    // overview_shader, tex.vert + tex.frag, for the overview.
+    void upload(ShaderProgram& shader, GLuint texture_id, ShaderProgram* overview_shader = nullptr);
+
+    // Visible chunks and their levels for this view (CPU only, draw() uses the result).
+    // Streamed mode leaves the chunks whose tile is not in the atlas to drawOverview().
+    void select(const glm::mat4& view_projection, const glm::vec3& eye);
+    // Expects the upload() shader to be active
+    void draw() const;
+    // Streamed mode, expects the overview shader to be active with an identity model matrix
+    void drawOverview() const;
+
+    const std::vector<Chunk>& getChunks() const { return chunks; }
+    const std::vector<SizeClass>& getSizeClasses() const { return size_classes; }
+    const std::vector<GLuint>& getIndices() const { return indices; }
+    const std::vector<uint8_t>& getLods() const { return lods; }  // per chunk, from the last select()
+    // Index list of chunk (cx, cz) for the levels of the last select(), stitched to coarser neighbours
+    const IndexRange& chunkIndices(int cx, int cz) const;
+    int chunksX() const { return chunks_x; }
+    int chunksZ() const { return chunks_z; }
+    int rowStride() const { return index_stride; }  // index distance of two vertex rows in the index lists
+    TerrainMode getMode() const { return mode; }
+    size_t fullTriangles() const { return static_cast<size_t>(columns - 1) * (rows - 1) * 2; }
+    size_t gpuMemory() const;  // bytes of vertex, height and index data upload() puts on the GPU
+    const Stats& lastStats() const { return stats; }
+
+    void clear();
+
+private:
+    // glMultiDrawElementsIndirect command
+    struct DrawCommand {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;  // draw index, selects the DrawInstance attribute
+    };
+    // Per draw attribute aChunk of terrain.vert
+    struct DrawInstance {
+        GLint x0, z0;  // first cell of the chunk
+        GLint layer;   // texture array layer with its heights
+    };
+
+    TerrainMode mode{ TerrainMode::Mesh };
+    int columns{ 0 }, rows{ 0 };
+    int index_stride{ 0 };
+    float max_height{ 0.0f };
+    float tile_size{ 1.0f };
+    int chunks_x{ 0 }, chunks_z{ 0 };
+    std::vector<vertex> vertices;  // Mesh mode, the overview in Streamed mode
+    std::vector<GLuint> overview_indices;  // Streamed mode, 6 per chunk
+    cv::Mat heights;               // Heightmap mode, uploaded as the height texture
+    const TerrainTileAtlas* atlas{ nullptr };  // Streamed mode
+    int tiles_x{ 0 };
+    std::vector<GLuint> indices;
+    std::vector<Chunk> chunks;
+    std::vector<SizeClass> size_classes;
+    std::vector<uint8_t> lods;
+    Mesh mesh;  // Mesh mode, the overview in Streamed mode
+    bool uploaded{ false };
+
+    // Heightmap and Streamed mode GL objects, the grass texture is texture_id. The heights are a
+    // texture array in both modes, Heightmap mode has one layer with the whole heightmap.
+    GLuint patch_vao{ 0 }, patch_vbo{ 0 }, patch_ebo{ 0 }, instances_buffer{ 0 }, commands_buffer{ 0 };
+    GLuint height_texture{ 0 }, texture_id{ 0 };
+    ShaderProgram shader;
+    GLint tex0_location{ -1 }, heightmap_location{ -1 }, max_height_location{ -1 }, tile_size_location{ -1 };
+    GLint tile_cells_location{ -1 }, tile_border_location{ -1 }, texcoord_scale_location{ -1 };
+
+    // Draw list of the last select(), in the layout glMultiDrawElementsBaseVertex (Mesh, the
+    // overview in Streamed mode) or glMultiDrawElementsIndirect (Heightmap, Streamed) takes
+    std::vector<GLsizei> draw_counts;
+    std::vector<const void*> draw_offsets;
+    std::vector<GLint> draw_base_vertices;
+    std::vector<DrawCommand> draw_commands;
+    std::vector<DrawInstance> draw_instances;
+    Stats stats;
+
+    // height_range(chunk, cells_x, cells_z) gives the lowest and highest height of a chunk
+    template <typename HeightRange>
+    void buildChunks(HeightRange height_range);
+    void buildIndexLists();
+    void buildVariant(SizeClass& size_class, int lod, unsigned edges);
+    void uploadHeightmap(ShaderProgram& shader, GLuint texture_id);
+    void drawHeightmap() const;
+};
@@ -0,0 +1,185 @@
+﻿#include "TerrainBuilder.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <emmintrin.h>
+#include <future>
+#include <stdexcept>
+
+namespace {
+    // Below this many rows per job waking the pool costs more than it saves
+    constexpr int PARALLEL_ROWS = 64;
+
+    static_assert(sizeof(vertex) == 8 * sizeof(float), "vertex is written as position, normal, texCoord floats");
+
+    void checkHeightmap(const cv::Mat& heightmap) {
+        if (heightmap.empty() || heightmap.cols < 2 || heightmap.rows < 2) {
+            throw std::runtime_error("TerrainBuilder: the heightmap has to be at least 2x2 pixels");
+        }
+        if (heightmap.type() != CV_8UC1 && heightmap.type() != CV_16UC1) {
+            throw std::runtime_error("TerrainBuilder: the heightmap has to be 8 or 16 bit grayscale");
+        }
+    }
+
+    // rows(begin, end) over all rows, split into blocks on the pool if there are enough of them
+    template <typename Rows>
+    void forRows(int row_count, ThreadPool* pool, Rows rows) {
+        const int job_count = pool != nullptr ? std::min(static_cast<int>(pool->size()), row_count / PARALLEL_ROWS) : 1;
+        if (job_count <= 1) {
+            rows(0, row_count);
+            return;
+        }
+        std::vector<std::future<void>> jobs;
+        jobs.reserve(job_count);
+        for (int j = 0; j < job_count; ++j) {
+            const int begin = j * row_count / job_count;
+            const int end = (j + 1) * row_count / job_count;
+            jobs.push_back(pool->submit([&rows, begin, end]() { rows(begin, end); }));
+        }
+        for (auto& job : jobs) {
+            job.get();
+        }
+    }
+
+    // v / 255 * max_height, 16 samples per iteration
+    void convertRow(const uchar* in, int count, float max_height, float* out) {
+        const __m128 range = _mm_set1_ps(255.0f), scale = _mm_set1_ps(max_height);
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+        for (; x + 16 <= count; x += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+            const __m128i low = _mm_unpacklo_epi8(bytes, zero), high = _mm_unpackhi_epi8(bytes, zero);
+            const __m128i words[4] = { _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+                _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero) };
+            for (int i = 0; i < 4; ++i) {
+                _mm_storeu_ps(out + x + 4 * i, _mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(words[i]), range), scale));
+            }
+        }
+        for (; x < count; ++x) {
+            out[x] = in[x] / 255.0f * max_height;
+        }
+    }
+
+    // v / 65535 * max_height, 8 samples per iteration
+    void convertRow(const ushort* in, int count, float max_height, float* out) {
+        const __m128 range = _mm_set1_ps(65535.0f), scale = _mm_set1_ps(max_height);
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+        for (; x + 8 <= count; x += 8) {
+            const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+            const __m128i words[2] = { _mm_unpacklo_epi16(samples, zero), _mm_unpackhi_epi16(samples, zero) };
+            for (int i = 0; i < 2; ++i) {
+                _mm_storeu_ps(out + x + 4 * i, _mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(words[i]), range), scale));
+            }
+        }
+        for (; x < count; ++x) {
+            out[x] = in[x] / 65535.0f * max_height;
+        }
+    }
+
+    // Vertices of row z from the float heights, 4 per iteration between the first and the last column
+    void vertexRow(const float* heights, int columns, int rows, int z, float tile_size, vertex* out) {
+        const float* row = heights + static_cast<size_t>(z) * columns;
+        const float* up = heights + static_cast<size_t>(std::max(z - 1, 0)) * columns;
+        const float* down = heights + static_cast<size_t>(std::min(z + 1, rows - 1)) * columns;
+        const float position_z = z * tile_size;
+        const float texcoord_v = static_cast<float>(z) / (rows - 1);
+
+        auto one = [&](int x) {
+            const int left = std::max(x - 1, 0), right = std::min(x + 1, columns - 1);
+            out[x] = vertex{ glm::vec3(x * tile_size, row[x], position_z),
+                glm::vec2(static_cast<float>(x) / (columns - 1), texcoord_v),
+                glm::normalize(glm::vec3(row[left] - row[right], 2.0f, up[x] - down[x])) };
+        };
+
+        one(0);
+        const __m128 size = _mm_set1_ps(tile_size), u_range = _mm_set1_ps(static_cast<float>(columns - 1));
+        const __m128 two = _mm_set1_ps(2.0f), one_ps = _mm_set1_ps(1.0f);
+        int x = 1;
+        for (; x + 4 <= columns - 1; x += 4) {
+            const __m128 xs = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3)));
+            __m128 px = _mm_mul_ps(xs, size);
+            __m128 py = _mm_loadu_ps(row + x);
+            __m128 pz = _mm_set1_ps(position_z);
+            // normalize(v) = v * (1 / sqrt(dot(v, v))), dot summed x, y, z like glm
+            __m128 nx = _mm_sub_ps(_mm_loadu_ps(row + x - 1), _mm_loadu_ps(row + x + 1));
+            __m128 nz = _mm_sub_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x));
+            const __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(two, two)), _mm_mul_ps(nz, nz));
+            const __m128 inverse = _mm_div_ps(one_ps, _mm_sqrt_ps(length2));
+            nx = _mm_mul_ps(nx, inverse);
+            __m128 ny = _mm_mul_ps(two, inverse);
+            nz = _mm_mul_ps(nz, inverse);
+            __m128 u = _mm_div_ps(xs, u_range);
+            __m128 v = _mm_set1_ps(texcoord_v);
+
+            // Lanes to vertices: (px, py, pz, nx) and (ny, nz, u, v) of each
+            _MM_TRANSPOSE4_PS(px, py, pz, nx);
+            _MM_TRANSPOSE4_PS(ny, nz, u, v);
+            float* dst = reinterpret_cast<float*>(out + x);
+            _mm_storeu_ps(dst, px);
+            _mm_storeu_ps(dst + 4, ny);
+            _mm_storeu_ps(dst + 8, py);
+            _mm_storeu_ps(dst + 12, nz);
+            _mm_storeu_ps(dst + 16, pz);
+            _mm_storeu_ps(dst + 20, u);
+            _mm_storeu_ps(dst + 24, nx);
+            _mm_storeu_ps(dst + 28, v);
+        }
+        for (; x < columns; ++x) {
+            one(x);
+        }
+    }
+}
+
+std::vector<float> terrainHeights(const cv::Mat& heightmap, float max_height, ThreadPool* pool) {
+    checkHeightmap(heightmap);
+    const int columns = heightmap.cols;
+    std::vector<float> heights(static_cast<size_t>(columns) * heightmap.rows);
+    const bool wide = heightmap.depth() == CV_16U;
+    forRows(heightmap.rows, pool, [&](int begin, int end) {
+        for (int z = begin; z < end; ++z) {
+            float* out = heights.data() + static_cast<size_t>(z) * columns;
+            if (wide) {
+                convertRow(heightmap.ptr<ushort>(z), columns, max_height, out);
+            }
+            else {
+                convertRow(heightmap.ptr<uchar>(z), columns, max_height, out);
+            }
+        }
+    });
+    return heights;
+}
+
+void buildTerrainVertices(const cv::Mat& heightmap, float max_height, float tile_size, std::vector<vertex>& vertices,
+    ThreadPool* pool) {
+    const std::vector<float> heights = terrainHeights(heightmap, max_height, pool);
+    const int columns = heightmap.cols, rows = heightmap.rows;
+    vertices.resize(static_cast<size_t>(columns) * rows);
+    forRows(rows, pool, [&](int begin, int end) {
+        for (int z = begin; z < end; ++z) {
+            vertexRow(heights.data(), columns, rows, z, tile_size, vertices.data() + static_cast<size_t>(z) * columns);
+        }
+    });
+}
+
+void buildTerrainVerticesScalar(const cv::Mat& heightmap, float max_height, float tile_size, std::vector<vertex>& vertices) {
+    checkHeightmap(heightmap);
+    const int columns = heightmap.cols, rows = heightmap.rows;
+    const bool wide = heightmap.depth() == CV_16U;
+    auto heightAt = [&](int x, int z) {
+        x = std::clamp(x, 0, columns - 1);
+        z = std::clamp(z, 0, rows - 1);
+        return wide ? heightmap.at<ushort>(z, x) / 65535.0f * max_height : heightmap.at<uchar>(z, x) / 255.0f * max_height;
+    };
+
+    vertices.clear();
+    vertices.reserve(static_cast<size_t>(columns) * rows);
+    for (int z = 0; z < rows; ++z) {
+        for (int x = 0; x < columns; ++x) {
+            const glm::vec3 position(x * tile_size, heightAt(x, z), z * tile_size);
+            const glm::vec2 texCoord(static_cast<float>(x) / (columns - 1), static_cast<float>(z) / (rows - 1));
+            const glm::vec3 normal = glm::normalize(glm::vec3(heightAt(x - 1, z) - heightAt(x + 1, z), 2.0f,
+                heightAt(x, z - 1) - heightAt(x, z + 1)));
+            vertices.push_back(vertex{ position, texCoord, normal });
+        }
+    }
+}
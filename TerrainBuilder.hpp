@@ -0,0 +1,23 @@
+﻿#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "assets.hpp"
+
+class ThreadPool;
+
+// Vertex grid of TerrainMode::Mesh, one vertex per heightmap sample: position (x * tile_size,
+// height, z * tile_size), texture coordinates 0..1 over the whole heightmap and the normal from
+// central differences of the neighbouring heights (clamped at the border).
+//
+// The heights are converted to float once, 4 samples per SSE instruction, then the vertices are
+// computed 4 at a time in SSE lanes and written in place into the pre-sized vector. Both passes
+// split the rows over the pool (if given). The result is bit for bit the one of the scalar loop:
+// every lane does the same float operations in the same order.
+
+// Heights of a grayscale 8 or 16 bit heightmap scaled to 0..max_height, row major
+std::vector<float> terrainHeights(const cv::Mat& heightmap, float max_height, ThreadPool* pool = nullptr);
+
+void buildTerrainVertices(const cv::Mat& heightmap, float max_height, float tile_size, std::vector<vertex>& vertices,
+    ThreadPool* pool = nullptr);
+// Same result one sample at a time on the calling thread (reference for the benchmark)
+void buildTerrainVerticesScalar(const cv::Mat& heightmap, float max_height, float tile_size, std::vector<vertex>& vertices);
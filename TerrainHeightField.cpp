@@ -0,0 +1,397 @@
+﻿#include "TerrainHeightField.hpp"
+#include "TerrainBuilder.hpp"
+#include "TerrainTiles.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <emmintrin.h>
+#include <utility>
+
+namespace {
+    // Clips [t0, t1] to the part of the ray between lo and hi on one axis
+    bool clipSlab(float origin, float direction, float lo, float hi, float& t0, float& t1) {
+        if (direction == 0.0f) {
+            return origin >= lo && origin <= hi;
+        }
+        float near_t = (lo - origin) / direction, far_t = (hi - origin) / direction;
+        if (near_t > far_t) {
+            std::swap(near_t, far_t);
+        }
+        t0 = std::max(t0, near_t);
+        t1 = std::min(t1, far_t);
+        return t0 <= t1;
+    }
+
+    // Height at (fx, fz) inside a cell with corner heights s00 (x, z), s10 (x + 1, z), s01 (x, z + 1)
+    // and s11: triangle (s00, s01, s10) up to the diagonal fx + fz = 1, (s10, s01, s11) beyond it.
+    // heightsAt() repeats these operations in SSE lanes.
+    float cellHeight(float s00, float s10, float s01, float s11, float fx, float fz) {
+        if (fx + fz <= 1.0f) {
+            return s00 + fx * (s10 - s00) + fz * (s01 - s00);
+        }
+        return s11 + (1.0f - fx) * (s01 - s11) + (1.0f - fz) * (s10 - s11);
+    }
+}
+
+void TerrainHeightField::build(const cv::Mat& heightmap, float max_height, float tile_size, ThreadPool* pool) {
+    heights = terrainHeights(heightmap, max_height, pool);
+    samples_x = heightmap.cols;
+    samples_z = heightmap.rows;
+    this->tile_size = tile_size;
+    tiles = nullptr;
+    node_cells = 1;
+
+    // Pyramid: the corners bound the two triangles of a cell, then 2x2 nodes per level up to a single one
+    levels.clear();
+    Level cells;
+    cells.width = samples_x - 1;
+    cells.height = samples_z - 1;
+    cells.min_max.resize(static_cast<size_t>(cells.width) * cells.height);
+    for (int z = 0; z < cells.height; ++z) {
+        const float* row = heights.data() + static_cast<size_t>(z) * samples_x;
+        const float* next = row + samples_x;
+        for (int x = 0; x < cells.width; ++x) {
+            cells.min_max[static_cast<size_t>(z) * cells.width + x] = glm::vec2(
+                std::min({ row[x], row[x + 1], next[x], next[x + 1] }), std::max({ row[x], row[x + 1], next[x], next[x + 1] }));
+        }
+    }
+    levels.push_back(std::move(cells));
+    buildLevels();
+}
+
+void TerrainHeightField::build(const TerrainTileCache& cache, float max_height, float tile_size) {
+    const TerrainTileFile& tiles = cache.getFile();
+    heights = std::vector<float>();
+    samples_x = tiles.width();
+    samples_z = tiles.height();
+    this->tile_size = tile_size;
+    this->tiles = &cache;
+    tile_height_scale = max_height / 65535.0f;
+    node_cells = TERRAIN_CHUNK_SIZE;
+
+    // Pyramid from the chunk heights of the file, no tile is read
+    levels.clear();
+    Level chunks;
+    chunks.width = tiles.chunksX();
+    chunks.height = tiles.chunksZ();
+    chunks.min_max.reserve(static_cast<size_t>(chunks.width) * chunks.height);
+    for (int z = 0; z < chunks.height; ++z) {
+        for (int x = 0; x < chunks.width; ++x) {
+            chunks.min_max.push_back(glm::vec2(tiles.chunkMin(x, z), tiles.chunkMax(x, z)) * tile_height_scale);
+        }
+    }
+    levels.push_back(std::move(chunks));
+    buildLevels();
+}
+
+void TerrainHeightField::buildLevels() {
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const Level& below = levels.back();
+        Level level;
+        level.width = (below.width + 1) / 2;
+        level.height = (below.height + 1) / 2;
+        level.min_max.assign(static_cast<size_t>(level.width) * level.height, glm::vec2(FLT_MAX, -FLT_MAX));
+        for (int z = 0; z < below.height; ++z) {
+            for (int x = 0; x < below.width; ++x) {
+                glm::vec2& node = level.min_max[static_cast<size_t>(z / 2) * level.width + x / 2];
+                const glm::vec2& child = below.min_max[static_cast<size_t>(z) * below.width + x];
+                node = glm::vec2(std::min(node.x, child.x), std::max(node.y, child.y));
+            }
+        }
+        levels.push_back(std::move(level));
+    }
+}
+
+float TerrainHeightField::sample(int x, int z) const {
+    x = std::clamp(x, 0, samples_x - 1);
+    z = std::clamp(z, 0, samples_z - 1);
+    if (tiles) {
+        // The last sample of a row or column is the far corner of the last cell
+        float s00, s10, s01, s11;
+        corners(std::min(x, samples_x - 2), std::min(z, samples_z - 2), s00, s10, s01, s11);
+        return x == samples_x - 1 ? (z == samples_z - 1 ? s11 : s10) : (z == samples_z - 1 ? s01 : s00);
+    }
+    return heights[static_cast<size_t>(z) * samples_x + x];
+}
+
+void TerrainHeightField::corners(int x0, int z0, float& s00, float& s10, float& s01, float& s11) const {
+    if (tiles) {
+        // The tile border holds the samples past the tile's last cell
+        const TerrainTileFile& file = tiles->getFile();
+        const int tx = x0 / TERRAIN_TILE_CELLS, tz = z0 / TERRAIN_TILE_CELLS;
+        if (const uint16_t* tile = tiles->tile(tz * file.tilesX() + tx)) {
+            const uint16_t* h = tile
+                + static_cast<size_t>(z0 - tz * TERRAIN_TILE_CELLS + TERRAIN_TILE_BORDER) * TERRAIN_TILE_SAMPLES
+                + (x0 - tx * TERRAIN_TILE_CELLS + TERRAIN_TILE_BORDER);
+            s00 = h[0] * tile_height_scale;
+            s10 = h[1] * tile_height_scale;
+            s01 = h[TERRAIN_TILE_SAMPLES] * tile_height_scale;
+            s11 = h[TERRAIN_TILE_SAMPLES + 1] * tile_height_scale;
+            return;
+        }
+
+        // Tile not in memory: the coarse overview Terrain draws instead, the two triangles through
+        // the chunk's corner heights (the last chunk of a row or column may be narrower)
+        const int cx = x0 / TERRAIN_CHUNK_SIZE, cz = z0 / TERRAIN_CHUNK_SIZE;
+        const int x_begin = cx * TERRAIN_CHUNK_SIZE, z_begin = cz * TERRAIN_CHUNK_SIZE;
+        const float width = static_cast<float>(std::min(x_begin + TERRAIN_CHUNK_SIZE, samples_x - 1) - x_begin);
+        const float depth = static_cast<float>(std::min(z_begin + TERRAIN_CHUNK_SIZE, samples_z - 1) - z_begin);
+        const float c00 = file.chunkCorner(cx, cz) * tile_height_scale;
+        const float c10 = file.chunkCorner(cx + 1, cz) * tile_height_scale;
+        const float c01 = file.chunkCorner(cx, cz + 1) * tile_height_scale;
+        const float c11 = file.chunkCorner(cx + 1, cz + 1) * tile_height_scale;
+        auto coarse = [&](int x, int z) {
+            return cellHeight(c00, c10, c01, c11, (x - x_begin) / width, (z - z_begin) / depth);
+        };
+        s00 = coarse(x0, z0);
+        s10 = coarse(x0 + 1, z0);
+        s01 = coarse(x0, z0 + 1);
+        s11 = coarse(x0 + 1, z0 + 1);
+        return;
+    }
+    const float* h = heights.data() + static_cast<size_t>(z0) * samples_x + x0;
+    s00 = h[0];
+    s10 = h[1];
+    s01 = h[samples_x];
+    s11 = h[samples_x + 1];
+}
+
+void TerrainHeightField::locate(float x, float z, int& x0, int& z0, float& fx, float& fz) const {
+    // Written like the SSE lanes of heightsAt(): clamp, truncate below the last cell, fraction
+    const float gx = std::clamp(x / tile_size, 0.0f, static_cast<float>(samples_x - 1));
+    const float gz = std::clamp(z / tile_size, 0.0f, static_cast<float>(samples_z - 1));
+    x0 = static_cast<int>(std::min(gx, static_cast<float>(samples_x - 2)));
+    z0 = static_cast<int>(std::min(gz, static_cast<float>(samples_z - 2)));
+    fx = gx - static_cast<float>(x0);
+    fz = gz - static_cast<float>(z0);
+}
+
+float TerrainHeightField::heightAt(float x, float z) const {
+    int x0, z0;
+    float fx, fz;
+    locate(x, z, x0, z0, fx, fz);
+    float s00, s10, s01, s11;
+    corners(x0, z0, s00, s10, s01, s11);
+    return cellHeight(s00, s10, s01, s11, fx, fz);
+}
+
+glm::vec3 TerrainHeightField::normalAt(float x, float z) const {
+    int x0, z0;
+    float fx, fz;
+    locate(x, z, x0, z0, fx, fz);
+    float s00, s10, s01, s11;
+    corners(x0, z0, s00, s10, s01, s11);
+    const bool first_triangle = fx + fz <= 1.0f;
+    const float slope_x = (first_triangle ? s10 - s00 : s11 - s01) / tile_size;
+    const float slope_z = (first_triangle ? s01 - s00 : s11 - s10) / tile_size;
+    return glm::normalize(glm::vec3(-slope_x, 1.0f, -slope_z));
+}
+
+void TerrainHeightField::heightsAt(const glm::vec2* positions, float* out, size_t count) const {
+    if (tiles) {
+        heightsAtScalar(positions, out, count);
+        return;
+    }
+    const __m128 size = _mm_set1_ps(tile_size), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 last_x = _mm_set1_ps(static_cast<float>(samples_x - 1));
+    const __m128 last_z = _mm_set1_ps(static_cast<float>(samples_z - 1));
+    const __m128 cell_x = _mm_set1_ps(static_cast<float>(samples_x - 2));
+    const __m128 cell_z = _mm_set1_ps(static_cast<float>(samples_z - 2));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // (x, z) pairs to 4 x and 4 z
+        const float* p = &positions[i].x;
+        const __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4);
+        const __m128 gx = _mm_min_ps(_mm_max_ps(_mm_div_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), size), zero), last_x);
+        const __m128 gz = _mm_min_ps(_mm_max_ps(_mm_div_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), size), zero), last_z);
+        const __m128i x0 = _mm_cvttps_epi32(_mm_min_ps(gx, cell_x));
+        const __m128i z0 = _mm_cvttps_epi32(_mm_min_ps(gz, cell_z));
+        const __m128 fx = _mm_sub_ps(gx, _mm_cvtepi32_ps(x0));
+        const __m128 fz = _mm_sub_ps(gz, _mm_cvtepi32_ps(z0));
+
+        // No gather in SSE2: corners through memory
+        alignas(16) int xs[4], zs[4];
+        alignas(16) float c00[4], c10[4], c01[4], c11[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(xs), x0);
+        _mm_store_si128(reinterpret_cast<__m128i*>(zs), z0);
+        for (int k = 0; k < 4; ++k) {
+            const float* h = heights.data() + static_cast<size_t>(zs[k]) * samples_x + xs[k];
+            c00[k] = h[0];
+            c10[k] = h[1];
+            c01[k] = h[samples_x];
+            c11[k] = h[samples_x + 1];
+        }
+        // Both triangles of cellHeight(), then the one on each lane's side of the diagonal
+        const __m128 s00 = _mm_load_ps(c00), s10 = _mm_load_ps(c10), s01 = _mm_load_ps(c01), s11 = _mm_load_ps(c11);
+        const __m128 first = _mm_add_ps(_mm_add_ps(s00, _mm_mul_ps(fx, _mm_sub_ps(s10, s00))), _mm_mul_ps(fz, _mm_sub_ps(s01, s00)));
+        const __m128 second = _mm_add_ps(_mm_add_ps(s11, _mm_mul_ps(_mm_sub_ps(one, fx), _mm_sub_ps(s01, s11))),
+            _mm_mul_ps(_mm_sub_ps(one, fz), _mm_sub_ps(s10, s11)));
+        const __m128 in_first = _mm_cmple_ps(_mm_add_ps(fx, fz), one);
+        _mm_storeu_ps(out + i, _mm_or_ps(_mm_and_ps(in_first, first), _mm_andnot_ps(in_first, second)));
+    }
+    for (; i < count; ++i) {
+        out[i] = heightAt(positions[i].x, positions[i].y);
+    }
+}
+
+void TerrainHeightField::heightsAtScalar(const glm::vec2* positions, float* out, size_t count) const {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = heightAt(positions[i].x, positions[i].y);
+    }
+}
+
+bool TerrainHeightField::intersectCell(int cx, int cz, const glm::vec3& origin, const glm::vec3& direction,
+    float t0, float t1, float& t) const {
+    float s00, s10, s01, s11;
+    corners(cx, cz, s00, s10, s01, s11);
+    // Position in the cell fx = ax + bx * t, fz = az + bz * t
+    const float ax = origin.x / tile_size - cx, bx = direction.x / tile_size;
+    const float az = origin.z / tile_size - cz, bz = direction.z / tile_size;
+    auto above = [&](float s) {
+        return origin.y + direction.y * s - cellHeight(s00, s10, s01, s11, ax + bx * s, az + bz * s);
+    };
+
+    // Ray height minus surface is linear in t on either side of the diagonal fx + fz = 1
+    float ends[3] = { t0, t1, t1 };
+    int end_count = 2;
+    const float diagonal_rate = bx + bz;
+    if (diagonal_rate != 0.0f) {
+        const float crossing = (1.0f - ax - az) / diagonal_rate;
+        if (crossing > t0 && crossing < t1) {
+            ends[1] = crossing;
+            end_count = 3;
+        }
+    }
+    float start_above = above(t0);
+    for (int k = 0; k + 1 < end_count; ++k) {
+        if (start_above <= 0.0f) {
+            t = ends[k];
+            return true;
+        }
+        const float end_above = above(ends[k + 1]);
+        if (end_above <= 0.0f) {
+            t = ends[k] + (ends[k + 1] - ends[k]) * (start_above / (start_above - end_above));
+            return true;
+        }
+        start_above = end_above;
+    }
+    return false;
+}
+
+bool TerrainHeightField::raycast(const glm::vec3& origin, const glm::vec3& direction, float max_t, float& t) const {
+    if (levels.empty()) {
+        return false;
+    }
+    const int cells_x = samples_x - 1, cells_z = samples_z - 1;
+    // Node box: the node's cells, from below everything up to its highest point
+    auto clipNode = [&](int level, int x, int z, float& t0, float& t1) {
+        const int span = node_cells << level;
+        const float top = levels[level].min_max[static_cast<size_t>(z) * levels[level].width + x].y;
+        t0 = 0.0f;
+        t1 = max_t;
+        return clipSlab(origin.x, direction.x, x * span * tile_size, std::min((x + 1) * span, cells_x) * tile_size, t0, t1)
+            && clipSlab(origin.z, direction.z, z * span * tile_size, std::min((z + 1) * span, cells_z) * tile_size, t0, t1)
+            && clipSlab(origin.y, direction.y, -FLT_MAX, top, t0, t1);
+    };
+
+    struct Node {
+        int level, x, z;
+        float t0, t1;
+    };
+    Node stack[4 * 32];  // at most 4 children per level on the stack
+    int size = 0;
+    const int top_level = static_cast<int>(levels.size()) - 1;
+    float t0, t1;
+    if (!clipNode(top_level, 0, 0, t0, t1)) {
+        return false;
+    }
+    stack[size++] = Node{ top_level, 0, 0, t0, t1 };
+    while (size > 0) {
+        const Node node = stack[--size];
+        const Level& level = levels[node.level];
+        // Below the lowest point of the node where the ray enters it: under the terrain there
+        if (origin.y + direction.y * node.t0 <= level.min_max[static_cast<size_t>(node.z) * level.width + node.x].x) {
+            t = node.t0;
+            return true;
+        }
+        if (node.level == 0) {
+            const bool hit = node_cells == 1
+                ? intersectCell(node.x, node.z, origin, direction, node.t0, node.t1, t)
+                : walkCells(origin, direction, node.t0, node.t1, node.x * node_cells, node.z * node_cells,
+                    std::min((node.x + 1) * node_cells, cells_x), std::min((node.z + 1) * node_cells, cells_z), t);
+            if (hit) {
+                return true;
+            }
+            continue;
+        }
+        // Children hit by the ray, the nearest one on top of the stack. Their spans along the ray
+        // do not overlap, so the first hit found is the nearest one.
+        Node children[4];
+        int child_count = 0;
+        const Level& below = levels[node.level - 1];
+        for (int dz = 0; dz < 2; ++dz) {
+            for (int dx = 0; dx < 2; ++dx) {
+                const int x = 2 * node.x + dx, z = 2 * node.z + dz;
+                if (x < below.width && z < below.height && clipNode(node.level - 1, x, z, t0, t1)) {
+                    children[child_count++] = Node{ node.level - 1, x, z, t0, t1 };
+                }
+            }
+        }
+        std::sort(children, children + child_count, [](const Node& a, const Node& b) { return a.t0 > b.t0; });
+        for (int k = 0; k < child_count; ++k) {
+            stack[size++] = children[k];
+        }
+    }
+    return false;
+}
+
+bool TerrainHeightField::raycastCells(const glm::vec3& origin, const glm::vec3& direction, float max_t, float& t) const {
+    if (empty()) {
+        return false;
+    }
+    const int cells_x = samples_x - 1, cells_z = samples_z - 1;
+    float t0 = 0.0f, t1 = max_t;
+    if (!clipSlab(origin.x, direction.x, 0.0f, cells_x * tile_size, t0, t1) ||
+        !clipSlab(origin.z, direction.z, 0.0f, cells_z * tile_size, t0, t1)) {
+        return false;
+    }
+    return walkCells(origin, direction, t0, t1, 0, 0, cells_x, cells_z, t);
+}
+
+bool TerrainHeightField::walkCells(const glm::vec3& origin, const glm::vec3& direction, float t0, float t1,
+    int x_begin, int z_begin, int x_end, int z_end, float& t) const {
+    // Cells along the ray (Amanatides, Woo 1987)
+    const glm::vec3 start = origin + direction * t0;
+    int cx = std::clamp(static_cast<int>(std::floor(start.x / tile_size)), x_begin, x_end - 1);
+    int cz = std::clamp(static_cast<int>(std::floor(start.z / tile_size)), z_begin, z_end - 1);
+    const int step_x = direction.x > 0.0f ? 1 : -1, step_z = direction.z > 0.0f ? 1 : -1;
+    auto next = [&](int c, float o, float d) {
+        return d != 0.0f ? ((c + (d > 0.0f ? 1 : 0)) * tile_size - o) / d : FLT_MAX;
+    };
+    float next_x = next(cx, origin.x, direction.x), next_z = next(cz, origin.z, direction.z);
+    const float delta_x = direction.x != 0.0f ? tile_size / std::abs(direction.x) : FLT_MAX;
+    const float delta_z = direction.z != 0.0f ? tile_size / std::abs(direction.z) : FLT_MAX;
+    float enter = t0;
+    for (;;) {
+        const float exit = std::min({ next_x, next_z, t1 });
+        if (intersectCell(cx, cz, origin, direction, enter, exit, t)) {
+            return true;
+        }
+        if (exit >= t1) {
+            return false;
+        }
+        if (next_x < next_z) {
+            cx += step_x;
+            enter = next_x;
+            next_x += delta_x;
+        }
+        else {
+            cz += step_z;
+            enter = next_z;
+            next_z += delta_z;
+        }
+        if (cx < x_begin || cx >= x_end || cz < z_begin || cz >= z_end) {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+﻿#pragma once
+#include <glm/glm.hpp>
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <vector>
+
+class TerrainTileCache;
+class ThreadPool;
+
+// Height queries against the terrain for everything that is not drawn: camera collision, object
+// placement, picking. Sample (x, z) of the heightmap is at world (x * tile_size, z * tile_size)
+// like in Terrain, and every cell is the two triangles Terrain's index buffer draws at full
+// detail: split along the diagonal from corner (x + 1, z) to (x, z + 1). Coarser levels of detail
+// drop vertices, there the drawn ground departs from this surface by their geometric error.
+//
+// Heights are kept as pre-scaled floats, row major, so a query reads two neighbouring pairs of
+// floats and does no conversions. heightsAt() evaluates 4 positions per SSE instruction with the
+// same operations as heightAt(), the results are identical.
+//
+// raycast() walks a min/max pyramid: level 0 holds the lowest and highest corner of every cell,
+// every further level the range of 2x2 nodes of the previous one. Nodes whose box the ray misses are
+// skipped with all their cells, the remaining cells are intersected exactly (the ray's height over
+// the cell is linear on either side of the diagonal).
+//
+// Built from a tile cache (TerrainMode::Streamed) the field keeps no heights and never touches the
+// disk: a query reads the corners of its cell from the tile if the cache holds it, otherwise from
+// the coarse overview Terrain draws until the tile arrives (two triangles per chunk through the
+// file's chunk corner heights). Level 0 of the pyramid is the file's chunk height table, which
+// bounds both, the cells of a chunk the ray enters are walked one by one, and heightsAt() is the
+// scalar loop.
+class TerrainHeightField {
+public:
+    TerrainHeightField() = default;
+
+    // Grayscale 8 or 16 bit heightmap, at least 2x2 (converted by terrainHeights, TerrainBuilder.hpp)
+    void build(const cv::Mat& heightmap, float max_height, float tile_size = 1.0f, ThreadPool* pool = nullptr);
+    // The tiles the cache holds in memory, read in place; the cache has to outlive the field
+    void build(const TerrainTileCache& cache, float max_height, float tile_size = 1.0f);
+
+    bool empty() const { return levels.empty(); }
+    int columns() const { return samples_x; }
+    int rows() const { return samples_z; }
+    float tileSize() const { return tile_size; }
+    float sample(int x, int z) const;  // clamped to the heightmap
+
+    // World position (x, z), clamped to the terrain border
+    float heightAt(float x, float z) const;
+    // Upward unit normal of the triangle under (x, z)
+    glm::vec3 normalAt(float x, float z) const;
+    // heights[i] = heightAt(positions[i].x, positions[i].y), 4 at a time with SSE
+    void heightsAt(const glm::vec2* positions, float* heights, size_t count) const;
+    // Same result one position at a time (reference for the benchmark)
+    void heightsAtScalar(const glm::vec2* positions, float* heights, size_t count) const;
+
+    // First point of origin + t * direction, 0 <= t <= max_t, on or under the terrain surface
+    // (t = 0 if origin itself is under it). Only the terrain's extent is tested.
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float max_t, float& t) const;
+    // Same result visiting every cell under the ray in order (reference for the benchmark)
+    bool raycastCells(const glm::vec3& origin, const glm::vec3& direction, float max_t, float& t) const;
+    int pyramidLevels() const { return static_cast<int>(levels.size()); }
+
+private:
+    struct Level {
+        int width{ 0 }, height{ 0 };        // nodes
+        std::vector<glm::vec2> min_max;     // lowest and highest height under each node
+    };
+
+    int samples_x{ 0 }, samples_z{ 0 };
+    float tile_size{ 1.0f };
+    std::vector<float> heights;  // samples_x * samples_z, row major (empty when built from tiles)
+    const TerrainTileCache* tiles{ nullptr };
+    float tile_height_scale{ 0.0f };  // max_height / 65535, tile samples to heights
+    int node_cells{ 1 };              // cells per level 0 node side: 1, TERRAIN_CHUNK_SIZE from tiles
+    std::vector<Level> levels;   // 0: one node per cell (chunk) ... last: one node for everything
+
+    void buildLevels();  // levels 1.. from level 0
+    // Cell (x0, z0) and the position inside it, both in cell units
+    void locate(float x, float z, int& x0, int& z0, float& fx, float& fz) const;
+    // Heights of (x0, z0), (x0 + 1, z0), (x0, z0 + 1), (x0 + 1, z0 + 1)
+    void corners(int x0, int z0, float& s00, float& s10, float& s01, float& s11) const;
+    // Cells along the ray from t0 to t1 (already clipped to the range), nearest first
+    bool walkCells(const glm::vec3& origin, const glm::vec3& direction, float t0, float t1, int x_begin, int z_begin,
+        int x_end, int z_end, float& t) const;
+    // Ray against the two triangles of cell (cx, cz) for t in [t0, t1]
+    bool intersectCell(int cx, int cz, const glm::vec3& origin, const glm::vec3& direction, float t0, float t1,
+        float& t) const;
+};
@@ -0,0 +1,420 @@
+﻿#include "TerrainTiles.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+namespace {
+    constexpr char TILES_MAGIC[4] = { 'G', 'T', 'E', 'R' };
+    constexpr uint32_t TILES_VERSION = 2;  // 2: chunk corner heights
+    constexpr size_t TILES_ALIGNMENT = 4096;
+    constexpr size_t TILE_STRIDE = (TERRAIN_TILE_BYTES + TILES_ALIGNMENT - 1) / TILES_ALIGNMENT * TILES_ALIGNMENT;
+
+    struct TerrainTilesHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t samples_x, samples_z;
+        uint32_t tile_cells;
+        uint32_t tile_border;
+        uint32_t chunk_size;
+        uint32_t tiles_x, tiles_z;
+        uint32_t chunks_x, chunks_z;
+        uint32_t reserved;
+        uint64_t tiles_offset;
+    };
+    static_assert(sizeof(TerrainTilesHeader) == 56, "terrain tiles header must stay packed");
+
+    int cellsToCount(int samples, int cells_per_unit) { return (samples - 2) / cells_per_unit + 1; }
+}
+
+bool writeTerrainTiles(const cv::Mat& heightmap, const std::filesystem::path& path, int scale) {
+    if (heightmap.empty() || heightmap.cols < 2 || heightmap.rows < 2 ||
+        (heightmap.type() != CV_8UC1 && heightmap.type() != CV_16UC1)) {
+        std::cerr << "Terrain tiles: the heightmap has to be 8 or 16 bit grayscale, at least 2x2" << std::endl;
+        return false;
+    }
+    scale = std::max(scale, 1);
+    const int samples_x = (heightmap.cols - 1) * scale + 1;
+    const int samples_z = (heightmap.rows - 1) * scale + 1;
+    const int tiles_x = cellsToCount(samples_x, TERRAIN_TILE_CELLS);
+    const int tiles_z = cellsToCount(samples_z, TERRAIN_TILE_CELLS);
+    const int chunks_x = cellsToCount(samples_x, TERRAIN_CHUNK_SIZE);
+    const int chunks_z = cellsToCount(samples_z, TERRAIN_CHUNK_SIZE);
+
+    // 16 bit heights, 8 bit ones are scaled so that v / 255 == v * 257 / 65535
+    const bool wide = heightmap.depth() == CV_16U;
+    auto source = [&](int x, int z) {
+        x = std::min(x, heightmap.cols - 1);
+        z = std::min(z, heightmap.rows - 1);
+        return wide ? static_cast<float>(heightmap.at<ushort>(z, x)) : heightmap.at<uchar>(z, x) * 257.0f;
+    };
+    auto sample = [&](int x, int z) {
+        x = std::clamp(x, 0, samples_x - 1);
+        z = std::clamp(z, 0, samples_z - 1);
+        if (scale == 1) {
+            return static_cast<uint16_t>(source(x, z));
+        }
+        const int x0 = x / scale, z0 = z / scale;
+        const float fx = static_cast<float>(x % scale) / scale, fz = static_cast<float>(z % scale) / scale;
+        const float top = source(x0, z0) * (1.0f - fx) + source(x0 + 1, z0) * fx;
+        const float bottom = source(x0, z0 + 1) * (1.0f - fx) + source(x0 + 1, z0 + 1) * fx;
+        return static_cast<uint16_t>(std::lround(top * (1.0f - fz) + bottom * fz));
+    };
+
+    std::error_code ec;
+    if (path.has_parent_path()) {
+        std::filesystem::create_directories(path.parent_path(), ec);
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Terrain tiles: cannot write " << path.string() << std::endl;
+        return false;
+    }
+
+    std::vector<uint16_t> chunk_heights(2 * static_cast<size_t>(chunks_x) * chunks_z, 0);
+    std::vector<uint16_t> chunk_corners;
+    chunk_corners.reserve(static_cast<size_t>(chunks_x + 1) * (chunks_z + 1));
+    for (int cz = 0; cz <= chunks_z; ++cz) {
+        for (int cx = 0; cx <= chunks_x; ++cx) {
+            chunk_corners.push_back(sample(std::min(cx * TERRAIN_CHUNK_SIZE, samples_x - 1),
+                std::min(cz * TERRAIN_CHUNK_SIZE, samples_z - 1)));
+        }
+    }
+    TerrainTilesHeader header{};
+    std::memcpy(header.magic, TILES_MAGIC, sizeof(TILES_MAGIC));
+    header.version = TILES_VERSION;
+    header.samples_x = samples_x;
+    header.samples_z = samples_z;
+    header.tile_cells = TERRAIN_TILE_CELLS;
+    header.tile_border = TERRAIN_TILE_BORDER;
+    header.chunk_size = TERRAIN_CHUNK_SIZE;
+    header.tiles_x = tiles_x;
+    header.tiles_z = tiles_z;
+    header.chunks_x = chunks_x;
+    header.chunks_z = chunks_z;
+    const size_t tables_bytes = (chunk_heights.size() + chunk_corners.size()) * sizeof(uint16_t);
+    header.tiles_offset = (sizeof(header) + tables_bytes + TILES_ALIGNMENT - 1) / TILES_ALIGNMENT * TILES_ALIGNMENT;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    // Chunk heights are known after the tiles, this reserves their place
+    file.write(reinterpret_cast<const char*>(chunk_heights.data()), chunk_heights.size() * sizeof(uint16_t));
+    file.write(reinterpret_cast<const char*>(chunk_corners.data()), chunk_corners.size() * sizeof(uint16_t));
+    const std::vector<char> padding(TILES_ALIGNMENT, 0);
+    file.write(padding.data(), header.tiles_offset - sizeof(header) - tables_bytes);
+
+    std::vector<uint16_t> tile(static_cast<size_t>(TERRAIN_TILE_SAMPLES) * TERRAIN_TILE_SAMPLES);
+    for (int tz = 0; tz < tiles_z; ++tz) {
+        for (int tx = 0; tx < tiles_x; ++tx) {
+            const int x0 = tx * TERRAIN_TILE_CELLS - TERRAIN_TILE_BORDER;
+            const int z0 = tz * TERRAIN_TILE_CELLS - TERRAIN_TILE_BORDER;
+            for (int j = 0; j < TERRAIN_TILE_SAMPLES; ++j) {
+                for (int i = 0; i < TERRAIN_TILE_SAMPLES; ++i) {
+                    tile[static_cast<size_t>(j) * TERRAIN_TILE_SAMPLES + i] = sample(x0 + i, z0 + j);
+                }
+            }
+
+            // Height range of the chunks inside this tile
+            const int tile_chunks = TERRAIN_TILE_CELLS / TERRAIN_CHUNK_SIZE;
+            for (int cz = tz * tile_chunks; cz < std::min(chunks_z, (tz + 1) * tile_chunks); ++cz) {
+                for (int cx = tx * tile_chunks; cx < std::min(chunks_x, (tx + 1) * tile_chunks); ++cx) {
+                    const int first_x = cx * TERRAIN_CHUNK_SIZE, first_z = cz * TERRAIN_CHUNK_SIZE;
+                    const int last_x = std::min(first_x + TERRAIN_CHUNK_SIZE, samples_x - 1);
+                    const int last_z = std::min(first_z + TERRAIN_CHUNK_SIZE, samples_z - 1);
+                    uint16_t low = UINT16_MAX, high = 0;
+                    for (int z = first_z; z <= last_z; ++z) {
+                        for (int x = first_x; x <= last_x; ++x) {
+                            const uint16_t h = tile[static_cast<size_t>(z - z0) * TERRAIN_TILE_SAMPLES + (x - x0)];
+                            low = std::min(low, h);
+                            high = std::max(high, h);
+                        }
+                    }
+                    chunk_heights[2 * (static_cast<size_t>(cz) * chunks_x + cx)] = low;
+                    chunk_heights[2 * (static_cast<size_t>(cz) * chunks_x + cx) + 1] = high;
+                }
+            }
+
+            file.write(reinterpret_cast<const char*>(tile.data()), TERRAIN_TILE_BYTES);
+            file.write(padding.data(), TILE_STRIDE - TERRAIN_TILE_BYTES);
+        }
+    }
+
+    file.seekp(sizeof(header));
+    file.write(reinterpret_cast<const char*>(chunk_heights.data()), chunk_heights.size() * sizeof(uint16_t));
+    if (!file) {
+        std::cerr << "Terrain tiles: writing " << path.string() << " failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool TerrainTileFile::open(const std::filesystem::path& path) {
+    file.reset();
+    auto mapped = std::make_unique<MappedFile>(path);
+    TerrainTilesHeader header{};
+    if (!mapped->isOpen() || mapped->size() < sizeof(header)) {
+        std::cerr << "Terrain tiles: cannot read " << path.string() << std::endl;
+        return false;
+    }
+    std::memcpy(&header, mapped->data(), sizeof(header));
+    if (std::memcmp(header.magic, TILES_MAGIC, sizeof(TILES_MAGIC)) != 0) {
+        std::cerr << "Terrain tiles: " << path.string() << " is not a terrain tile file" << std::endl;
+        return false;
+    }
+    if (header.version != TILES_VERSION || header.tile_cells != TERRAIN_TILE_CELLS ||
+        header.tile_border != TERRAIN_TILE_BORDER || header.chunk_size != TERRAIN_CHUNK_SIZE) {
+        std::cerr << "Terrain tiles: " << path.string() << " was made by another version or with other tile or chunk sizes, "
+            << "convert the heightmap again (--make-terrain-tiles)" << std::endl;
+        return false;
+    }
+    const int width = static_cast<int>(header.samples_x), height = static_cast<int>(header.samples_z);
+    const size_t chunk_count = static_cast<size_t>(header.chunks_x) * header.chunks_z;
+    const size_t corner_count = static_cast<size_t>(header.chunks_x + 1) * (header.chunks_z + 1);
+    const size_t tile_count = static_cast<size_t>(header.tiles_x) * header.tiles_z;
+    if (width < 2 || height < 2 ||
+        static_cast<int>(header.tiles_x) != cellsToCount(width, TERRAIN_TILE_CELLS) ||
+        static_cast<int>(header.tiles_z) != cellsToCount(height, TERRAIN_TILE_CELLS) ||
+        static_cast<int>(header.chunks_x) != cellsToCount(width, TERRAIN_CHUNK_SIZE) ||
+        static_cast<int>(header.chunks_z) != cellsToCount(height, TERRAIN_CHUNK_SIZE) ||
+        header.tiles_offset < sizeof(header) + (2 * chunk_count + corner_count) * sizeof(uint16_t) ||
+        mapped->size() < header.tiles_offset + tile_count * TILE_STRIDE) {
+        std::cerr << "Terrain tiles: " << path.string() << " is truncated or damaged" << std::endl;
+        return false;
+    }
+
+    samples_x = width;
+    samples_z = height;
+    tiles_x = static_cast<int>(header.tiles_x);
+    tiles_z = static_cast<int>(header.tiles_z);
+    chunks_x = static_cast<int>(header.chunks_x);
+    chunks_z = static_cast<int>(header.chunks_z);
+    chunk_heights = reinterpret_cast<const uint16_t*>(mapped->data() + sizeof(header));
+    chunk_corners = chunk_heights + 2 * chunk_count;
+    tiles = mapped->data() + header.tiles_offset;
+    file = std::move(mapped);
+    return true;
+}
+
+const uint16_t* TerrainTileFile::tile(int index) const {
+    return reinterpret_cast<const uint16_t*>(tiles + static_cast<size_t>(index) * TILE_STRIDE);
+}
+
+TerrainTileCache::TerrainTileCache(const TerrainTileFile& file, size_t memory_budget, size_t thread_count)
+    : file(file),
+    budget(std::max(memory_budget, TERRAIN_TILE_BYTES)),
+    tiles(static_cast<size_t>(file.tileCount())),
+    pool(thread_count) {
+}
+
+void TerrainTileCache::update(const glm::vec2& position, float radius, size_t max_tiles) {
+    ++frame;
+
+    // Finished loads
+    for (Tile& tile : tiles) {
+        if (tile.loading.valid() && tile.loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            tile.samples = tile.loading.get();
+            resident.push_back(static_cast<int>(&tile - tiles.data()));
+            --stats.loading_tiles;
+        }
+    }
+
+    // Tiles whose cells come within radius of the position, nearest first, as many as fit
+    std::vector<std::pair<float, int>> candidates;
+    const int first_x = std::max(static_cast<int>(std::floor((position.x - radius) / TERRAIN_TILE_CELLS)), 0);
+    const int last_x = std::min(static_cast<int>(std::floor((position.x + radius) / TERRAIN_TILE_CELLS)), file.tilesX() - 1);
+    const int first_z = std::max(static_cast<int>(std::floor((position.y - radius) / TERRAIN_TILE_CELLS)), 0);
+    const int last_z = std::min(static_cast<int>(std::floor((position.y + radius) / TERRAIN_TILE_CELLS)), file.tilesZ() - 1);
+    for (int tz = first_z; tz <= last_z; ++tz) {
+        for (int tx = first_x; tx <= last_x; ++tx) {
+            const glm::vec2 low(static_cast<float>(tx * TERRAIN_TILE_CELLS), static_cast<float>(tz * TERRAIN_TILE_CELLS));
+            const glm::vec2 high = low + glm::vec2(static_cast<float>(TERRAIN_TILE_CELLS));
+            const float distance = glm::length(glm::max(glm::max(low - position, position - high), glm::vec2(0.0f)));
+            if (distance <= radius) {
+                candidates.emplace_back(distance, tz * file.tilesX() + tx);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.resize(std::min({ candidates.size(), max_tiles, budget / TERRAIN_TILE_BYTES }));
+    wanted.clear();
+    for (const auto& candidate : candidates) {
+        wanted.push_back(candidate.second);
+        tiles[candidate.second].last_used = frame;
+    }
+
+    // Queue the missing ones. Only a few loads wait in the pool, so a moving camera gets the
+    // tiles it needs now before those it wanted a second ago.
+    for (int index : wanted) {
+        Tile& tile = tiles[index];
+        if (tile.samples || tile.loading.valid()) {
+            continue;
+        }
+        if (stats.loading_tiles >= TERRAIN_TILE_LOADS_IN_FLIGHT || !evictFor(TERRAIN_TILE_BYTES)) {
+            break;
+        }
+        tile.loading = pool.submit([this, index]() {
+            auto samples = std::make_unique<Samples>(static_cast<size_t>(TERRAIN_TILE_SAMPLES) * TERRAIN_TILE_SAMPLES);
+            std::memcpy(samples->data(), file.tile(index), TERRAIN_TILE_BYTES);
+            return samples;
+        });
+        stats.used_bytes += TERRAIN_TILE_BYTES;
+        ++stats.loading_tiles;
+        ++stats.loads;
+    }
+    stats.resident_tiles = resident.size();
+    stats.wanted_tiles = wanted.size();
+}
+
+bool TerrainTileCache::evictFor(size_t bytes) {
+    while (stats.used_bytes + bytes > budget) {
+        // Wanted tiles were used in this update(), anything older may go
+        auto victim = std::min_element(resident.begin(), resident.end(),
+            [this](int a, int b) { return tiles[a].last_used < tiles[b].last_used; });
+        if (victim == resident.end() || tiles[*victim].last_used == frame) {
+            return false;
+        }
+        tiles[*victim].samples.reset();
+        *victim = resident.back();
+        resident.pop_back();
+        stats.used_bytes -= TERRAIN_TILE_BYTES;
+        ++stats.evictions;
+    }
+    return true;
+}
+
+const uint16_t* TerrainTileCache::tile(int index) const {
+    const Tile& tile = tiles[index];
+    return tile.samples ? tile.samples->data() : nullptr;
+}
+
+void TerrainTileAtlas::create(const TerrainTileFile& file, int layers) {
+    clear();
+    GLint max_layers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    layers = std::clamp(layers, 1, std::min(file.tileCount(), std::max(max_layers, 1)));
+
+    // Heights are read with texelFetch: no filtering, no mipmaps
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+    glTextureStorage3D(texture, 1, GL_R16, TERRAIN_TILE_SAMPLES, TERRAIN_TILE_SAMPLES, layers);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Persistently mapped staging buffer, the upload is a memcpy and a copy command the GPU runs later
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &staging);
+    glNamedBufferStorage(staging, TERRAIN_TILE_STAGING_SLOTS * TERRAIN_TILE_BYTES, nullptr, flags);
+    staging_data = static_cast<unsigned char*>(glMapNamedBufferRange(staging, 0,
+        TERRAIN_TILE_STAGING_SLOTS * TERRAIN_TILE_BYTES, flags));
+
+    tile_layers.assign(static_cast<size_t>(file.tileCount()), -1);
+    layer_tiles.assign(static_cast<size_t>(layers), -1);
+    layer_used.assign(static_cast<size_t>(layers), 0);
+    wanted_flags.assign(static_cast<size_t>(file.tileCount()), 0);
+}
+
+void TerrainTileAtlas::update(const TerrainTileCache& cache) {
+    ++frame;
+    uploads = 0;
+    if (texture == 0 || staging_data == nullptr) {
+        return;
+    }
+
+    const std::vector<int>& wanted = cache.wantedTiles();
+    for (int tile : wanted) {
+        wanted_flags[tile] = 1;
+        if (tile_layers[tile] >= 0) {
+            layer_used[tile_layers[tile]] = frame;
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2); // rows of TERRAIN_TILE_SAMPLES 16 bit samples
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+    for (int tile : wanted) {
+        if (uploads == TERRAIN_TILE_UPLOADS_PER_FRAME) {
+            break;
+        }
+        const uint16_t* samples = cache.tile(tile);
+        if (tile_layers[tile] >= 0 || samples == nullptr) {
+            continue; // on the GPU already or still loading
+        }
+        GLsync& fence = fences[next_slot];
+        if (fence != nullptr) {
+            const GLenum state = glClientWaitSync(fence, 0, 0);
+            if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) {
+                break; // the GPU still copies out of this slot, try again next frame
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        const int layer = freeLayer();
+        if (layer < 0) {
+            break; // every layer holds a wanted tile
+        }
+        if (layer_tiles[layer] >= 0) {
+            tile_layers[layer_tiles[layer]] = -1;
+            --resident;
+        }
+
+        const size_t offset = static_cast<size_t>(next_slot) * TERRAIN_TILE_BYTES;
+        std::memcpy(staging_data + offset, samples, TERRAIN_TILE_BYTES);
+        glTextureSubImage3D(texture, 0, 0, 0, layer, TERRAIN_TILE_SAMPLES, TERRAIN_TILE_SAMPLES, 1, GL_RED,
+            GL_UNSIGNED_SHORT, reinterpret_cast<const void*>(offset));
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next_slot = (next_slot + 1) % TERRAIN_TILE_STAGING_SLOTS;
+
+        layer_tiles[layer] = tile;
+        tile_layers[tile] = layer;
+        layer_used[layer] = frame;
+        ++resident;
+        ++uploads;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    for (int tile : wanted) {
+        wanted_flags[tile] = 0;
+    }
+}
+
+int TerrainTileAtlas::freeLayer() const {
+    int best = -1;
+    for (int layer = 0; layer < layerCount(); ++layer) {
+        const int tile = layer_tiles[layer];
+        if (tile < 0) {
+            return layer;
+        }
+        if (!wanted_flags[tile] && (best < 0 || layer_used[layer] < layer_used[best])) {
+            best = layer;
+        }
+    }
+    return best;
+}
+
+void TerrainTileAtlas::clear() {
+    for (GLsync& fence : fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (staging != 0) {
+        glUnmapNamedBuffer(staging);
+        glDeleteBuffers(1, &staging);
+        staging = 0;
+        staging_data = nullptr;
+    }
+    if (texture != 0) {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+    next_slot = 0;
+    tile_layers.clear();
+    layer_tiles.clear();
+    layer_used.clear();
+    wanted_flags.clear();
+    resident = 0;
+    uploads = 0;
+}
@@ -0,0 +1,169 @@
+﻿#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <vector>
+#include "MappedFile.hpp"
+#include "Terrain.hpp"
+#include "ThreadPool.hpp"
+
+// Paged terrain for heightmaps that do not fit in memory (TerrainMode::Streamed).
+//
+// The heightmap is converted once (my_app --make-terrain-tiles) into a tile file, <name>.terrain:
+//     header | uint16 min, max height of every chunk | uint16 height at every chunk corner | tiles
+// A tile covers TERRAIN_TILE_CELLS x TERRAIN_TILE_CELLS cells and stores its samples with a border of
+// TERRAIN_TILE_BORDER samples copied from the neighbours, so normals can be computed inside one tile.
+// Heights are 16 bit, row major, the tiles row major, every tile starts at a 4 KB boundary. The
+// chunk heights give Terrain its culling bounds and TerrainHeightField its coarsest ray tests
+// without reading any tile; the corner heights are a heightmap with one sample per chunk corner,
+// drawn where the tile of a chunk is not on the GPU yet.
+//
+// TerrainTileFile maps the file, TerrainTileCache copies the tiles around the camera out of it on
+// worker threads (the page faults, i.e. the disk reads, happen there) and evicts the least recently
+// used ones beyond its memory budget. TerrainTileAtlas keeps the nearest loaded tiles in the layers
+// of a texture array, uploading a few per frame through a fenced staging buffer: the frame never
+// waits for the disk or for the GPU.
+
+constexpr int TERRAIN_TILE_CELLS = 256;   // cells per tile side
+constexpr int TERRAIN_TILE_BORDER = 1;    // samples from the neighbouring tiles on every side
+constexpr int TERRAIN_TILE_SAMPLES = TERRAIN_TILE_CELLS + 1 + 2 * TERRAIN_TILE_BORDER; // per tile side
+constexpr size_t TERRAIN_TILE_BYTES = sizeof(uint16_t) * TERRAIN_TILE_SAMPLES * TERRAIN_TILE_SAMPLES;
+static_assert(TERRAIN_TILE_CELLS % TERRAIN_CHUNK_SIZE == 0, "a chunk must not cross tiles");
+
+constexpr int TERRAIN_TILE_UPLOADS_PER_FRAME = 4;  // TerrainTileAtlas: tiles copied to the GPU per frame
+constexpr int TERRAIN_TILE_STAGING_SLOTS = 12;     // staging buffer slots, 3 frames of uploads in flight
+constexpr int TERRAIN_TILE_LOADS_IN_FLIGHT = 8;    // TerrainTileCache: queued disk reads, nearest tiles first
+
+// Converts a grayscale 8 or 16 bit heightmap, scale > 1 resamples it (bilinear) to
+// (cols - 1) * scale + 1 samples per row, which makes large test terrains out of small images.
+// Only one tile is held in memory at a time. Prints the error and returns false on failure.
+bool writeTerrainTiles(const cv::Mat& heightmap, const std::filesystem::path& path, int scale = 1);
+
+class TerrainTileFile {
+public:
+    TerrainTileFile() = default;
+
+    // Maps the file, false (and a message on std::cerr) if it is missing, truncated or made for
+    // other TERRAIN_TILE_CELLS / TERRAIN_CHUNK_SIZE values
+    bool open(const std::filesystem::path& path);
+    bool isOpen() const { return file != nullptr; }
+
+    int width() const { return samples_x; }   // heightmap samples per row
+    int height() const { return samples_z; }
+    int tilesX() const { return tiles_x; }
+    int tilesZ() const { return tiles_z; }
+    int tileCount() const { return tiles_x * tiles_z; }
+    int chunksX() const { return chunks_x; }
+    int chunksZ() const { return chunks_z; }
+    // Lowest and highest sample of a chunk, 0..65535
+    uint16_t chunkMin(int cx, int cz) const { return chunk_heights[2 * (static_cast<size_t>(cz) * chunks_x + cx)]; }
+    uint16_t chunkMax(int cx, int cz) const { return chunk_heights[2 * (static_cast<size_t>(cz) * chunks_x + cx) + 1]; }
+    // Sample at the first corner of chunk (cx, cz), cx = chunksX() and cz = chunksZ() give the far
+    // border of the heightmap
+    uint16_t chunkCorner(int cx, int cz) const { return chunk_corners[static_cast<size_t>(cz) * (chunks_x + 1) + cx]; }
+    // TERRAIN_TILE_SAMPLES^2 samples, the first one TERRAIN_TILE_BORDER samples before the tile's
+    // first cell in x and z. Points into the mapping, reading it may hit the disk.
+    const uint16_t* tile(int index) const;
+
+private:
+    std::unique_ptr<MappedFile> file;
+    int samples_x{ 0 }, samples_z{ 0 };
+    int tiles_x{ 0 }, tiles_z{ 0 };
+    int chunks_x{ 0 }, chunks_z{ 0 };
+    const uint16_t* chunk_heights{ nullptr };
+    const uint16_t* chunk_corners{ nullptr };
+    const unsigned char* tiles{ nullptr };
+};
+
+// CPU side tiles, loaded asynchronously around a position, LRU eviction under a memory budget
+class TerrainTileCache {
+public:
+    struct Stats {
+        size_t resident_tiles{ 0 };
+        size_t loading_tiles{ 0 };
+        size_t used_bytes{ 0 };       // resident and loading tiles, never above the budget
+        size_t wanted_tiles{ 0 };
+        uint64_t loads{ 0 };          // since creation
+        uint64_t evictions{ 0 };
+    };
+
+    // The file has to outlive the cache. Memory for at least one tile is always granted.
+    TerrainTileCache(const TerrainTileFile& file, size_t memory_budget, size_t thread_count = 2);
+    ~TerrainTileCache() = default;  // the pool finishes the loads in flight first
+
+    TerrainTileCache(const TerrainTileCache&) = delete;
+    TerrainTileCache& operator=(const TerrainTileCache&) = delete;
+
+    // Once per frame: takes the finished loads, wants the tiles within radius cells of position
+    // (cell coordinates x, z), at most max_tiles of them, nearest first, and queues the missing ones,
+    // evicting least recently used tiles that are not wanted to make room. Never waits for a load.
+    void update(const glm::vec2& position, float radius, size_t max_tiles);
+
+    // Samples of a loaded tile (layout of TerrainTileFile::tile), nullptr if it is not in memory
+    const uint16_t* tile(int index) const;
+    const std::vector<int>& wantedTiles() const { return wanted; }  // by distance, from the last update()
+    const TerrainTileFile& getFile() const { return file; }
+    size_t memoryBudget() const { return budget; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    using Samples = std::vector<uint16_t>;
+    struct Tile {
+        std::unique_ptr<Samples> samples;
+        std::future<std::unique_ptr<Samples>> loading;
+        uint64_t last_used{ 0 };  // update() counter
+    };
+
+    const TerrainTileFile& file;
+    size_t budget;
+    std::vector<Tile> tiles;
+    std::vector<int> wanted;
+    std::vector<int> resident;  // tiles with samples, eviction candidates
+    uint64_t frame{ 0 };
+    Stats stats;
+    ThreadPool pool;  // last member: joined before the tiles are destroyed
+
+    bool evictFor(size_t bytes);
+};
+
+// GPU side tiles: GL_R16 texture array, one tile per layer
+class TerrainTileAtlas {
+public:
+    TerrainTileAtlas() = default;
+
+    // Texture array with the given number of layers (TERRAIN_TILE_BYTES each) and the staging buffer
+    void create(const TerrainTileFile& file, int layers);
+    // GL thread, after TerrainTileCache::update: uploads loaded wanted tiles that are not on the GPU
+    // yet, nearest first, replacing layers of tiles that are no longer wanted (least recently wanted
+    // first). Stops early when the staging slot it would write to is still read by the GPU.
+    void update(const TerrainTileCache& cache);
+
+    int layer(int tile) const { return tile_layers.empty() ? -1 : tile_layers[tile]; }  // -1: not on the GPU
+    GLuint getTexture() const { return texture; }
+    int layerCount() const { return static_cast<int>(layer_tiles.size()); }
+    int residentTiles() const { return resident; }
+    int uploadsLastFrame() const { return uploads; }
+    void clear();
+
+private:
+    GLuint texture{ 0 };
+    GLuint staging{ 0 };
+    unsigned char* staging_data{ nullptr };  // persistently mapped
+    std::array<GLsync, TERRAIN_TILE_STAGING_SLOTS> fences{};
+    int next_slot{ 0 };
+    std::vector<int> tile_layers;       // per tile
+    std::vector<int> layer_tiles;       // per layer, -1 free
+    std::vector<uint64_t> layer_used;   // update() counter when the layer's tile was last wanted
+    std::vector<char> wanted_flags;     // per tile, set during update()
+    uint64_t frame{ 0 };
+    int resident{ 0 };
+    int uploads{ 0 };
+
+    int freeLayer() const;  // free or least recently wanted layer whose tile is not wanted now, -1 if none
+};
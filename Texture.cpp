@@ -0,0 +1,30 @@
+﻿#include "Texture.hpp"
+
+cv::Mat decodeTexture(const std::filesystem::path& filepath) {
+    cv::Mat image = cv::imread(filepath.string(), cv::IMREAD_COLOR);
+    if (!image.empty()) {
+        cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
+    }
+    return image;
+}
+
+GLuint uploadTexture(const cv::Mat& rgb_image) {
+    if (rgb_image.empty()) {
+        return 0;
+    }
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, rgb_image.cols, rgb_image.rows, 0, GL_RGB, GL_UNSIGNED_BYTE, rgb_image.data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return textureID;
+}
@@ -0,0 +1,9 @@
+﻿#pragma once
+#include <GL/glew.h>
+#include <filesystem>
+#include <opencv2/opencv.hpp>
+
+// Texture loading is split in two so that decoding can run on a worker thread:
+// decodeTexture() is CPU only (thread safe), uploadTexture() needs the GL context thread.
+cv::Mat decodeTexture(const std::filesystem::path& filepath); // RGB, empty on failure
+GLuint uploadTexture(const cv::Mat& rgb_image);                // returns 0 for an empty image
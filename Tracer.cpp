@@ -0,0 +1,115 @@
+﻿#include "Tracer.hpp"
+#include <cstring>
+#include <iostream>
+
+namespace {
+    // The drain thread polls, producers never touch a mutex or a condition variable
+    constexpr auto DRAIN_INTERVAL = std::chrono::milliseconds(10);
+
+    const char* levelName(TraceLevel level) {
+        switch (level) {
+        case TraceLevel::Debug: return "debug";
+        case TraceLevel::Info: return "info";
+        case TraceLevel::Warning: return "warning";
+        case TraceLevel::Error: return "error";
+        }
+        return "?";
+    }
+}
+
+std::atomic<int> Tracer::min_level{ static_cast<int>(TraceLevel::Info) };
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() : start(std::chrono::steady_clock::now()) {
+    for (size_t i = 0; i < TRACE_RING_SIZE; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    drain_thread = std::thread(&Tracer::drainLoop, this);
+}
+
+Tracer::~Tracer() {
+    stopping.store(true, std::memory_order_release);
+    if (drain_thread.joinable()) {
+        drain_thread.join();
+    }
+}
+
+void Tracer::push(TraceLevel level, const char* text) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots[pos & (TRACE_RING_SIZE - 1)];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (difference == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (difference < 0) {
+            dropped_records.fetch_add(1, std::memory_order_relaxed); // full, the drain thread is behind
+            return;
+        }
+        else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    Record& record = slot->record;
+    record.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    record.level = level;
+    std::strncpy(record.text, text, TRACE_MESSAGE_SIZE - 1);
+    record.text[TRACE_MESSAGE_SIZE - 1] = '\0';
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+size_t Tracer::drain() {
+    size_t count = 0;
+    for (;;) {
+        Slot& slot = slots[dequeue_pos & (TRACE_RING_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+            break; // empty, or the producer of this slot is still writing
+        }
+        const Record& record = slot.record;
+        char line[TRACE_MESSAGE_SIZE + 32];
+        std::snprintf(line, sizeof(line), "[%9.3f] %-7s %s\n", record.time, levelName(record.level), record.text);
+        std::cout << line;
+        slot.sequence.store(dequeue_pos + TRACE_RING_SIZE, std::memory_order_release);
+        ++dequeue_pos;
+        ++count;
+    }
+
+    const uint64_t dropped_now = dropped_records.load(std::memory_order_relaxed);
+    if (dropped_now != reported_drops) {
+        std::cout << "[trace] " << dropped_now - reported_drops << " records dropped (ring buffer full)\n";
+        reported_drops = dropped_now;
+    }
+    if (count > 0) {
+        std::cout.flush(); // one flush per batch instead of one per line
+        drained.fetch_add(count, std::memory_order_release);
+    }
+    return count;
+}
+
+void Tracer::drainLoop() {
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (drain() == 0) {
+            std::this_thread::sleep_for(DRAIN_INTERVAL);
+        }
+    }
+    drain();
+}
+
+void Tracer::flush() {
+    // Records claimed before this call get printed, dropped ones never claimed a slot
+    const size_t target = enqueue_pos.load(std::memory_order_acquire);
+    while (drained.load(std::memory_order_acquire) < target) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
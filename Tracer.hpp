@@ -0,0 +1,104 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+// Low overhead logging for the render loop. TRACE() formats the message into a small stack
+// buffer and pushes it into a lock-free ring buffer, a background thread drains the buffer
+// to std::cout. The caller never waits for the console: when the ring is full the record
+// is dropped and counted.
+//
+// Compile with TRACE_ENABLED=0 to strip every TRACE* call including its arguments.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+enum class TraceLevel : int {
+    Debug = 0,
+    Info,
+    Warning,
+    Error
+};
+
+constexpr size_t TRACE_RING_SIZE = 1024;    // records, power of two
+constexpr size_t TRACE_MESSAGE_SIZE = 112;  // longer messages are truncated
+
+class Tracer {
+public:
+    static Tracer& instance();
+
+    // Records below the level are rejected before formatting (default Info)
+    static void setLevel(TraceLevel level) { min_level.store(static_cast<int>(level), std::memory_order_relaxed); }
+    static TraceLevel level() { return static_cast<TraceLevel>(min_level.load(std::memory_order_relaxed)); }
+    static bool enabled(TraceLevel level) { return static_cast<int>(level) >= min_level.load(std::memory_order_relaxed); }
+
+    // printf style, safe to call from any thread
+    template <typename... Args>
+    void write(TraceLevel level, const char* format, Args... args) {
+        char text[TRACE_MESSAGE_SIZE];
+        std::snprintf(text, sizeof(text), format, args...);
+        push(level, text);
+    }
+    void write(TraceLevel level, const char* text) { push(level, text); }
+
+    // Blocks until everything written so far is printed (shutdown, tests)
+    void flush();
+    uint64_t dropped() const { return dropped_records.load(std::memory_order_relaxed); }
+
+    ~Tracer();
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+private:
+    struct Record {
+        double time;  // seconds since the tracer started
+        TraceLevel level;
+        char text[TRACE_MESSAGE_SIZE];
+    };
+    // Bounded multi-producer queue (D. Vyukov): the sequence number tells whose turn the slot is
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    Tracer();
+    void push(TraceLevel level, const char* text);
+    size_t drain();   // prints the ready records, returns how many
+    void drainLoop();
+
+    static std::atomic<int> min_level;
+
+    Slot slots[TRACE_RING_SIZE];
+    alignas(64) std::atomic<size_t> enqueue_pos{ 0 };
+    alignas(64) size_t dequeue_pos{ 0 };     // drain thread only
+    std::atomic<size_t> drained{ 0 };        // records printed so far, for flush()
+    std::atomic<uint64_t> dropped_records{ 0 };
+    uint64_t reported_drops{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::chrono::steady_clock::time_point start;
+    std::thread drain_thread;
+};
+
+#if TRACE_ENABLED
+#define TRACE(level, ...) \
+    do { \
+        if (Tracer::enabled(level)) { \
+            Tracer::instance().write(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+// Only every n-th pass through this call site is traced (per-frame state)
+#define TRACE_EVERY_N(level, n, ...) \
+    do { \
+        static std::atomic<unsigned int> trace_hits{ 0 }; \
+        if (Tracer::enabled(level) && trace_hits.fetch_add(1, std::memory_order_relaxed) % (n) == 0) { \
+            Tracer::instance().write(level, __VA_ARGS__); \
+        } \
+    } while (0)
+#else
+#define TRACE(level, ...) do {} while (0)
+#define TRACE_EVERY_N(level, n, ...) do {} while (0)
+#endif
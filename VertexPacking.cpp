@@ -0,0 +1,57 @@
+﻿#include "VertexPacking.hpp"
+#include <algorithm>
+#include <glm/gtc/packing.hpp>
+
+PositionQuantization computePositionQuantization(const vertex* vertices, size_t count) {
+    PositionQuantization q;
+    if (count == 0) {
+        return q;
+    }
+    glm::vec3 lo = vertices[0].position, hi = vertices[0].position;
+    for (size_t i = 0; i < count; ++i) {
+        lo = glm::min(lo, vertices[i].position);
+        hi = glm::max(hi, vertices[i].position);
+    }
+    q.offset = lo;
+    q.scale = hi - lo;
+    for (int c = 0; c < 3; ++c) {
+        if (q.scale[c] <= 0.0f) {
+            q.scale[c] = 1.0f; // flat axis, every vertex quantizes to 0 anyway
+        }
+    }
+    return q;
+}
+
+packed_vertex packVertex(const vertex& v, const PositionQuantization& quantization) {
+    packed_vertex p;
+    for (int c = 0; c < 3; ++c) {
+        p.position[c] = glm::packUnorm1x16((v.position[c] - quantization.offset[c]) / quantization.scale[c]);
+    }
+    p.position[3] = 0;
+
+    // Renormalise first, packSnorm clamps and a slightly long normal would lose direction
+    const float length = glm::length(v.normal);
+    const glm::vec3 n = length > 0.0f ? v.normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    p.normal = glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+
+    p.texCoord[0] = glm::packHalf1x16(v.texCoord.x);
+    p.texCoord[1] = glm::packHalf1x16(v.texCoord.y);
+    return p;
+}
+
+vertex unpackVertex(const packed_vertex& v, const PositionQuantization& quantization) {
+    vertex out;
+    for (int c = 0; c < 3; ++c) {
+        out.position[c] = quantization.offset[c] + glm::unpackUnorm1x16(v.position[c]) * quantization.scale[c];
+    }
+    out.normal = glm::vec3(glm::unpackSnorm3x10_1x2(v.normal));
+    out.texCoord = glm::vec2(glm::unpackHalf1x16(v.texCoord[0]), glm::unpackHalf1x16(v.texCoord[1]));
+    return out;
+}
+
+std::vector<packed_vertex> packVertices(const vertex* vertices, size_t count, const PositionQuantization& quantization) {
+    std::vector<packed_vertex> packed(count);
+    std::transform(vertices, vertices + count, packed.begin(),
+        [&quantization](const vertex& v) { return packVertex(v, quantization); });
+    return packed;
+}
@@ -0,0 +1,25 @@
+﻿#pragma once
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "assets.hpp"
+
+// Positions are stored as unorm16 inside the mesh AABB: p = offset + q * scale,
+// the shader gets offset/scale as uPosOffset/uPosScale
+struct PositionQuantization {
+    glm::vec3 offset{ 0.0f };  // AABB min
+    glm::vec3 scale{ 1.0f };   // AABB extent
+};
+
+PositionQuantization computePositionQuantization(const vertex* vertices, size_t count);
+inline PositionQuantization computePositionQuantization(const std::vector<vertex>& vertices) {
+    return computePositionQuantization(vertices.data(), vertices.size());
+}
+
+packed_vertex packVertex(const vertex& v, const PositionQuantization& quantization);
+vertex unpackVertex(const packed_vertex& v, const PositionQuantization& quantization);
+
+std::vector<packed_vertex> packVertices(const vertex* vertices, size_t count, const PositionQuantization& quantization);
+inline std::vector<packed_vertex> packVertices(const std::vector<vertex>& vertices, const PositionQuantization& quantization) {
+    return packVertices(vertices.data(), vertices.size(), quantization);
+}
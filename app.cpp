@@ -8,6 +8,11 @@
 #include <fstream>
 #include <random>
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <thread>
+
+#include "Texture.hpp"
 
 // Vertex shader for the simple triangle
 const char* vertexShaderSource = R"(
@@ -28,6 +33,31 @@ const char* fragmentShaderSource = R"(
     }
 )";
 
+// Below this many objects one SSE pass over all boxes is cheaper than walking the BVH
+static constexpr size_t BVH_CULLING_OBJECTS = 1024;
+// Reach of the "Looking at" ray and radius of the "Objects within" query in the info window
+static constexpr float PICK_DISTANCE = 1000.0f;
+static constexpr float NEARBY_RADIUS = 50.0f;
+
+// Assets placed by createTransparentObjects() and createModels(). They are listed here so that
+// init_assets() can queue all of them on the loader before the first one is needed.
+static const std::vector<std::string> transparentModelPaths = {
+    "resources/models/Tree.obj",
+    "resources/models/bunny_tri_vnt.obj",
+    "resources/models/house.obj"
+};
+static const std::string transparentTexturePath = "resources/textures/kralik.jpg";
+static const std::vector<std::string> modelPaths = {
+    "resources/models/cube.obj",
+    "resources/models/cat.obj",
+    "resources/models/Tractor.obj"
+};
+static const std::vector<std::string> modelTexturePaths = {
+    "resources/textures/krabice.jpg", // Pro krychli
+    "resources/textures/Cat.jpg",     // Pro kočku
+    "resources/textures/Tractor.jpg"  // Pro traktor
+};
+
 // Utility function to check for OpenGL errors
 void checkGLError(const std::string& context) {
     GLenum err;
@@ -36,44 +66,8 @@ void checkGLError(const std::string& context) {
     }
 }
 
-App::App() : lastX(400.0), lastY(300.0), firstMouse(true), fov(DEFAULT_FOV) {
-    try {
-        heightmap = loadHeightmap("resources/textures/heightmap.png");
-        std::cout << "Heightmap loaded: " << heightmap.cols << "x" << heightmap.rows << std::endl;
-    }
-    catch (const std::exception& e) {
-        std::cerr << "Failed to load heightmap in App constructor: " << e.what() << std::endl;
-        heightmap = cv::Mat(15, 15, CV_8U, cv::Scalar(128));
-        std::cout << "Using default heightmap: 15x15" << std::endl;
-    }
-
-    float tileSizeGL = 1.0f;
-    float maxHeight = 20.0f;
-    int width = heightmap.cols;
-    int height = heightmap.rows;
-
-    uchar maxValue = 0;
-    int max_hm_x = 0;
-    int max_hm_z = 0;
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            uchar value = heightmap.at<uchar>(y, x);
-            if (value > maxValue) {
-                maxValue = value;
-                max_hm_x = x;
-                max_hm_z = y;
-            }
-        }
-    }
-    std::cout << "Max heightmap value: " << (int)maxValue << " at (" << max_hm_x << ", " << max_hm_z << ")" << std::endl;
-
-
-    maxTerrainHeight = maxValue / 255.0f * maxHeight;
-    std::cout << "Max terrain height: " << maxTerrainHeight << std::endl;
-
-    float bunnyHeight = heightmap.at<uchar>(200, 200) / 255.0f * maxHeight;
-    camera = Camera(glm::vec3(200.0f * tileSizeGL, bunnyHeight + 5.0f, 195.0f * tileSizeGL));
-
+App::App(size_t demo_light_count) : lastX(400.0), lastY(300.0), firstMouse(true), fov(DEFAULT_FOV),
+    demo_light_count(demo_light_count) {
     // Initialize directional light (sun)
     directionalLight = Light{
         glm::vec3(200.0f, 100.0f, 200.0f), // Position (unused for directional)
@@ -126,26 +120,123 @@ App::App() : lastX(400.0), lastY(300.0), firstMouse(true), fov(DEFAULT_FOV) {
         cos(glm::radians(20.0f)),          // Wider cutoff
         cos(glm::radians(25.0f))           // Wider outer cutoff
     };
+
+    // Point lights pulse with different rates (animated in the shader)
+    for (size_t i = 0; i < pointLights.size(); i++) {
+        pointLights[i].flicker = static_cast<float>(i + 1);
+    }
+}
+
+void App::init_terrain_heights() {
+    // Runs after init_glfw() read the terrain mode. Streamed mode answers the height queries from
+    // the tile file and reads heightmap.png only to write a missing or outdated one.
+    float tileSizeGL = 1.0f;
+    float maxHeight = 20.0f;
+    auto load_heightmap = [&]() {
+        try {
+            heightmap = loadHeightmap("resources/textures/heightmap.png");
+            std::cout << "Heightmap loaded: " << heightmap.cols << "x" << heightmap.rows << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Failed to load heightmap: " << e.what() << std::endl;
+            heightmap = cv::Mat(15, 15, CV_8U, cv::Scalar(128));
+            std::cout << "Using default heightmap: 15x15" << std::endl;
+        }
+    };
+
+    if (terrain_mode == TerrainMode::Streamed) {
+        if (!std::filesystem::exists(terrain_tiles_path) || !terrain_tiles.open(terrain_tiles_path)) {
+            load_heightmap();
+            std::cout << "Writing terrain tiles: " << terrain_tiles_path << std::endl;
+            if (!writeTerrainTiles(heightmap, terrain_tiles_path)) {
+                throw std::runtime_error("Failed to write terrain tiles: " + terrain_tiles_path.string());
+            }
+            heightmap.release();  // the tile file is the terrain from here on
+            if (!terrain_tiles.open(terrain_tiles_path)) {
+                throw std::runtime_error("Failed to open terrain tiles: " + terrain_tiles_path.string());
+            }
+        }
+        std::cout << "Terrain tiles: " << terrain_tiles.width() << "x" << terrain_tiles.height() << " samples, "
+            << terrain_tiles.tileCount() << " tiles" << std::endl;
+        uint16_t highest = 0;
+        for (int cz = 0; cz < terrain_tiles.chunksZ(); ++cz) {
+            for (int cx = 0; cx < terrain_tiles.chunksX(); ++cx) {
+                highest = std::max(highest, terrain_tiles.chunkMax(cx, cz));
+            }
+        }
+        maxTerrainHeight = highest / 65535.0f * maxHeight;
+        // Queries read the tiles the cache holds and the coarse chunk surface elsewhere: the camera
+        // starts on the coarse surface and the frame never waits for the disk
+        terrain_cache = std::make_unique<TerrainTileCache>(terrain_tiles, terrain_memory_mb << 20);
+        terrain_heights.build(*terrain_cache, maxHeight, tileSizeGL);
+
+        // Startup is not a frame: the tiles around the camera start are loaded before the camera and
+        // the objects are placed (objects further away stand on the coarse surface)
+        const glm::vec2 start(200.0f * tileSizeGL, 195.0f * tileSizeGL);
+        auto tiles_missing = [&]() {
+            return std::any_of(terrain_cache->wantedTiles().begin(), terrain_cache->wantedTiles().end(),
+                [&](int tile) { return terrain_cache->tile(tile) == nullptr; });
+        };
+        const auto loading = std::chrono::steady_clock::now();
+        do {
+            terrain_cache->update(start, terrain_view_distance, static_cast<size_t>(std::max(terrain_gpu_tiles, 1)));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        } while (tiles_missing() && std::chrono::steady_clock::now() - loading < std::chrono::seconds(10));
+    }
+    else {
+        load_heightmap();
+        int width = heightmap.cols;
+        int height = heightmap.rows;
+
+        uchar maxValue = 0;
+        int max_hm_x = 0;
+        int max_hm_z = 0;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                uchar value = heightmap.at<uchar>(y, x);
+                if (value > maxValue) {
+                    maxValue = value;
+                    max_hm_x = x;
+                    max_hm_z = y;
+                }
+            }
+        }
+        std::cout << "Max heightmap value: " << (int)maxValue << " at (" << max_hm_x << ", " << max_hm_z << ")" << std::endl;
+        maxTerrainHeight = maxValue / 255.0f * maxHeight;
+        terrain_heights.build(heightmap, maxHeight, tileSizeGL, &frame_pool);
+    }
+    std::cout << "Max terrain height: " << maxTerrainHeight << std::endl;
+
+    camera = Camera(glm::vec3(200.0f * tileSizeGL, terrain_heights.heightAt(200.0f * tileSizeGL, 195.0f * tileSizeGL) + 5.0f,
+        195.0f * tileSizeGL));
+    spotLight.position = camera.Position;
+    spotLight.direction = camera.Front;
+    add_demo_lights(demo_light_count);
 }
 
 App::~App() {
     shader.clear();
+    terrain_shader.clear();
+    terrain.clear();
+    terrain_atlas.clear();
+    terrain_cache.reset();
+    lights_ubo.clear();
+    profiler.clear();
+    point_lights_ssbo.clear();
+    light_clusters_ssbo.clear();
+    light_indices_ssbo.clear();
+    instances_ssbo.clear();
     if (triangle) {
         delete triangle;
         triangle = nullptr;
     }
-    for (auto& wall : maze_walls) {
-        delete wall;
-    }
-    maze_walls.clear();
-    for (auto& obj : transparent_objects) {
-        delete obj;
-    }
-    transparent_objects.clear();
-    for (auto& model : models) {
+    entities.clear();
+    scene.clear();
+    for (auto* model : model_assets) {
         delete model;
     }
-    models.clear();
+    model_assets.clear();
+    model_asset_ids.clear();
 
     glDeleteTextures(1, &myTexture);
     glDeleteTextures(transparent_textures.size(), transparent_textures.data());
@@ -162,7 +253,7 @@ App::~App() {
     ImGui::DestroyContext();
 }
 
-void App::init_glfw() {
+void App::init_glfw(bool hidden_window) {
     json config = load_config();
     bool antialiasing_enabled;
     int samples;
@@ -175,6 +266,7 @@ void App::init_glfw() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, hidden_window ? GLFW_FALSE : GLFW_TRUE); // benchmark renders offscreen
 
     if (antialiasing_enabled) {
         glfwWindowHint(GLFW_SAMPLES, samples);
@@ -183,11 +275,32 @@ void App::init_glfw() {
         glfwWindowHint(GLFW_SAMPLES, 0);
     }
 
+    if (config.contains("graphics")) {
+        const json& graphics = config["graphics"];
+        const std::string mode = graphics.value("terrain", std::string("heightmap"));
+        terrain_mode = (mode == "mesh") ? TerrainMode::Mesh
+            : (mode == "streamed") ? TerrainMode::Streamed : TerrainMode::Heightmap;
+        terrain_tiles_path = graphics.value("terrain_tiles", terrain_tiles_path.string());
+        terrain_memory_mb = graphics.value("terrain_memory_mb", terrain_memory_mb);
+        terrain_gpu_tiles = graphics.value("terrain_gpu_tiles", terrain_gpu_tiles);
+        terrain_view_distance = graphics.value("terrain_view_distance", terrain_view_distance);
+        scatter_objects = graphics.value("scatter_objects", scatter_objects);
+    }
+
     int window_width = config["window"]["width"].get<int>();
     int window_height = config["window"]["height"].get<int>();
     std::string window_title = config["window"]["title"].get<std::string>();
 
     window = glfwCreateWindow(window_width, window_height, window_title.c_str(), nullptr, nullptr);
+    if (!window) {
+        // Mesa llvmpipe (machines without a GPU) stops at OpenGL 4.5, the shaders are
+        // compiled as #version 450 there (ShaderProgram::matchGlslVersion)
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+        window = glfwCreateWindow(window_width, window_height, window_title.c_str(), nullptr, nullptr);
+        if (window) {
+            std::cout << "OpenGL 4.6 not available, using an OpenGL 4.5 context" << std::endl;
+        }
+    }
     if (!window) {
         glfwTerminate();
         throw std::runtime_error("GLFW window can not be created.");
@@ -232,8 +345,10 @@ bool App::init() {
     ImGuiIO& io = ImGui::GetIO(); (void)io;
     ImGui::StyleColorsDark();
     ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 460");
+    const std::string glsl_version = "#version " + std::to_string(ShaderProgram::contextGlslVersion());
+    ImGui_ImplOpenGL3_Init(glsl_version.c_str());
 
+    init_terrain_heights();
     init_assets();
     init_triangle();
     update_projection_matrix();
@@ -247,7 +362,22 @@ bool App::init() {
 }
 
 void App::init_assets() {
-    myTexture = textureInit("resources/textures/grass.png");
+    // Start decoding every model and texture on the worker pool right away,
+    // the GL thread below only waits for results and uploads them
+    AssetLoader loader;
+    loader.requestTexture("resources/textures/grass.png");
+    loader.requestTexture(transparentTexturePath);
+    for (const auto& path : transparentModelPaths) {
+        loader.requestModel(path);
+    }
+    for (const auto& path : modelTexturePaths) {
+        loader.requestTexture(path);
+    }
+    for (const auto& path : modelPaths) {
+        loader.requestModel(path);
+    }
+
+    myTexture = loader.createTexture("resources/textures/grass.png");
     if (myTexture == 0) {
         std::cerr << "Failed to load texture for ImGUI" << std::endl;
     }
@@ -258,6 +388,19 @@ void App::init_assets() {
     try {
         std::cout << "Loading shaders..." << std::endl;
         shader = ShaderProgram("resources/shaders/tex.vert", "resources/shaders/tex.frag");
+        view_matrix_loc = shader.getUniformLocation("uV_m");
+        view_pos_loc = shader.getUniformLocation("viewPos");
+        model_matrix_loc = shader.getUniformLocation("uM_m");
+        instanced_loc = shader.getUniformLocation("uInstanced");
+        first_instance_loc = shader.getUniformLocation("uFirstInstance");
+        if (terrain_mode != TerrainMode::Mesh) {
+            terrain_shader = ShaderProgram("resources/shaders/terrain.vert", "resources/shaders/tex.frag");
+            terrain_view_matrix_loc = terrain_shader.getUniformLocation("uV_m");
+            terrain_view_pos_loc = terrain_shader.getUniformLocation("viewPos");
+        }
+        init_light_buffers();
+        shader.bindStorageBlock("Instances", INSTANCES_SSBO_BINDING, sizeof(GpuInstance));
+        instances_ssbo = ShaderBuffer(GL_SHADER_STORAGE_BUFFER, INSTANCES_SSBO_BINDING, sizeof(GpuInstance));
         std::cout << "Shaders loaded successfully" << std::endl;
     }
     catch (const std::exception& e) {
@@ -277,7 +420,7 @@ void App::init_assets() {
 
     try {
         std::cout << "Creating transparent objects..." << std::endl;
-        createTransparentObjects();
+        createTransparentObjects(loader);
         std::cout << "Transparent objects created successfully" << std::endl;
     }
     catch (const std::exception& e) {
@@ -287,13 +430,15 @@ void App::init_assets() {
 
     try {
         std::cout << "Creating models..." << std::endl;
-        createModels();
+        createModels(loader);
         std::cout << "Models created successfully" << std::endl;
     }
     catch (const std::exception& e) {
         std::cerr << "Models creation error: " << e.what() << std::endl;
         throw;
     }
+
+    loader.printTimings(std::cout);
 }
 
 void App::init_triangle() {
@@ -333,16 +478,11 @@ void App::init_triangle() {
     glBindVertexArray(0);
 }
 
-void App::createTransparentObjects() {
-    // Clear previous transparent objects and textures
-    for (auto& obj : transparent_objects) {
-        delete obj;
-    }
-    transparent_objects.clear();
+void App::createTransparentObjects(AssetLoader& loader) {
     transparent_textures.clear();
 
     // Načtení textury kralik.jpg
-    GLuint objectTexture = textureInit("resources/textures/kralik.jpg");
+    GLuint objectTexture = loader.createTexture(transparentTexturePath);
     if (objectTexture == 0) {
         std::cerr << "Failed to load texture kralik.jpg for transparent objects" << std::endl;
     }
@@ -350,17 +490,11 @@ void App::createTransparentObjects() {
         transparent_textures.push_back(objectTexture);
     }
 
-    // Terrain dimensions
-    int width = heightmap.cols;
-    int height = heightmap.rows;
-    float tileSizeGL = 1.0f;
-    float maxHeight = 20.0f;
-
-    // Fixed positions for three objects
+    // Fixed positions for three objects, standing on the terrain
     std::vector<glm::vec3> positions = {
-        glm::vec3(100.0f * tileSizeGL, heightmap.at<uchar>(100, 100) / 255.0f * maxHeight + 1.0f, 100.0f * tileSizeGL), // Tree
-        glm::vec3(200.0f * tileSizeGL, heightmap.at<uchar>(200, 200) / 255.0f * maxHeight + 2.0f, 200.0f * tileSizeGL), // Bunny
-        glm::vec3(300.0f * tileSizeGL, heightmap.at<uchar>(300, 300) / 255.0f * maxHeight + 1.0f, 300.0f * tileSizeGL)  // House
+        glm::vec3(100.0f, terrain_heights.heightAt(100.0f, 100.0f) + 1.0f, 100.0f), // Tree
+        glm::vec3(200.0f, terrain_heights.heightAt(200.0f, 200.0f) + 2.0f, 200.0f), // Bunny
+        glm::vec3(300.0f, terrain_heights.heightAt(300.0f, 300.0f) + 1.0f, 300.0f)  // House
     };
 
     // Colors with alpha for transparency
@@ -370,13 +504,6 @@ void App::createTransparentObjects() {
         glm::vec4(0.3f, 0.3f, 1.0f, 0.4f)  // House - modrý
     };
 
-    // Model paths
-    std::vector<std::string> modelPaths = {
-        "resources/models/tree.obj",
-        "resources/models/bunny_tri_vnt.obj",
-        "resources/models/house.obj"
-    };
-
     // Scales for each object
     std::vector<glm::vec3> scales = {
         glm::vec3(1.0f, 1.0f, 1.0f), // Tree
@@ -386,57 +513,41 @@ void App::createTransparentObjects() {
 
     // Create models with fixed scale and apply texture
     for (int i = 0; i < 3; i++) {
-        Model* model = new Model(modelPaths[i], shader);
-        if (!model->meshes.empty()) {
-            model->meshes[0].texture_id = objectTexture; // Použití textury
-            model->meshes[0].diffuse_material = colors[i];
-        }
-        model->origin = positions[i];
-        model->scale = scales[i];
-        model->transparent = true;
-        transparent_objects.push_back(model);
+        uint32_t model = 0;
+        try {
+            model = load_model_asset(loader, transparentModelPaths[i], objectTexture, true);
+        }
+        catch (const std::exception& e) {
+            // A missing asset leaves a gap in the scene, the app and the benchmark still run
+            std::cerr << "Skipping transparent object " << i << ": " << e.what() << std::endl;
+            continue;
+        }
+        place_object(model, positions[i], glm::vec3(0.0f), scales[i], colors[i], ENTITY_VISIBLE | ENTITY_TRANSPARENT);
         std::cout << "Placed transparent object " << i << " at position ("
             << positions[i].x << ", " << positions[i].y << ", " << positions[i].z << ")\n";
     }
 }
 
-void App::createModels() {
-    // Clear previous models and textures
-    for (auto* model : models) {
-        delete model;
-    }
-    models.clear();
+void App::createModels(AssetLoader& loader) {
     model_textures.clear();
 
     // Načtení textur
-    std::vector<std::string> texturePaths = {
-        "resources/textures/krabice.jpg", // Pro krychli
-        "resources/textures/Cat.jpg",     // Pro kočku
-        "resources/textures/Tractor.jpg"  // Pro traktor
-    };
-
-    for (const auto& path : texturePaths) {
-        GLuint modelTexture = textureInit(path);
+    for (const auto& path : modelTexturePaths) {
+        GLuint modelTexture = loader.createTexture(path);
+        model_textures.push_back(modelTexture); // 0 if missing, indices match modelPaths
         if (modelTexture == 0) {
             std::cerr << "Failed to load texture " << path << " for models" << std::endl;
         }
         else {
-            model_textures.push_back(modelTexture);
             std::cout << "Successfully loaded texture: " << path << std::endl;
         }
     }
 
-    // Terrain dimensions
-    int width = heightmap.cols;
-    int height = heightmap.rows;
-    float tileSizeGL = 1.0f;
-    float maxHeight = 20.0f;
-
-    // Fixed positions for three models, all at x = 150, varying z
+    // Fixed positions for three models, all at x = 150, varying z, standing on the terrain
     std::vector<glm::vec3> positions = {
-        glm::vec3(150.0f * tileSizeGL, heightmap.at<uchar>(150, 150) / 255.0f * maxHeight + 1.0f, 150.0f * tileSizeGL), // Cube
-        glm::vec3(150.0f * tileSizeGL, heightmap.at<uchar>(150, 160) / 255.0f * maxHeight + 1.0f, 160.0f * tileSizeGL), // Cat
-        glm::vec3(150.0f * tileSizeGL, heightmap.at<uchar>(150, 170) / 255.0f * maxHeight + 1.0f, 170.0f * tileSizeGL)  // Tractor
+        glm::vec3(150.0f, terrain_heights.heightAt(150.0f, 150.0f) + 1.0f, 150.0f), // Cube
+        glm::vec3(150.0f, terrain_heights.heightAt(150.0f, 160.0f) + 1.0f, 160.0f), // Cat
+        glm::vec3(150.0f, terrain_heights.heightAt(150.0f, 170.0f) + 1.0f, 170.0f)  // Tractor
     };
 
     // Colors with alpha = 1.0 for opacity, neutral for all to use only texture
@@ -446,13 +557,6 @@ void App::createModels() {
         glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)  // Tractor - neutrální barva, pouze textura
     };
 
-    // Model paths
-    std::vector<std::string> modelPaths = {
-        "resources/models/cube.obj",
-        "resources/models/cat.obj",
-        "resources/models/Tractor.obj"
-    };
-
     // Scales for each model, smaller for cat and tractor
     std::vector<glm::vec3> scales = {
         glm::vec3(1.0f, 1.0f, 1.0f),  // Cube
@@ -461,55 +565,99 @@ void App::createModels() {
     };
 
     // Create models with fixed scale and apply texture
+    std::vector<uint32_t> model_ids;
     for (int i = 0; i < 3; i++) {
-        Model* model = new Model(modelPaths[i], shader);
-        if (!model->meshes.empty()) {
-            model->meshes[0].texture_id = model_textures[i]; // Použití odpovídající textury
-            model->meshes[0].diffuse_material = colors[i];
+        uint32_t model = 0;
+        try {
+            model = load_model_asset(loader, modelPaths[i], model_textures[i], false); // Neprůhledné modely
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Skipping model " << i << ": " << e.what() << std::endl;
+            continue;
         }
-        model->origin = positions[i];
-        model->scale = scales[i];
-        model->transparent = false; // Neprůhledné modely
 
         // Převrátit kočku kolem osy y (rotace o 180 stupňů)
+        glm::vec3 rotation(0.0f);
         if (i == 1) { // Cat je druhý model (index 1)
-            model->orientation = glm::vec3(0.0f, glm::radians(180.0f), 0.0f);
+            rotation = glm::vec3(0.0f, glm::radians(180.0f), 0.0f);
         }
 
-        models.push_back(model);
+        model_ids.push_back(model);
+        place_object(model, positions[i], rotation, scales[i], colors[i], ENTITY_VISIBLE);
         std::cout << "Placed model " << i << " at position ("
             << positions[i].x << ", " << positions[i].y << ", " << positions[i].z << ")\n";
     }
+    scatter_models(model_ids, scatter_objects);
 }
 
-GLuint App::textureInit(const std::filesystem::path& filepath) {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    checkGLError("After glBindTexture in textureInit");
-
-    cv::Mat image = cv::imread(filepath.string(), cv::IMREAD_COLOR);
-    if (image.empty()) {
-        std::cerr << "Failed to load texture: " << filepath << std::endl;
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glDeleteTextures(1, &textureID);
-        return 0;
+uint32_t App::load_model_asset(AssetLoader& loader, const std::filesystem::path& path, GLuint texture, bool transparent) {
+    const auto key = std::make_tuple(path.lexically_normal().generic_string(), texture, transparent);
+    const auto found = model_asset_ids.find(key);
+    if (found != model_asset_ids.end()) {
+        return found->second;
+    }
+    Model* model = loader.createModel(path, shader);
+    for (auto& mesh : model->meshes) {
+        if (mesh.texture_id == 0) {
+            mesh.texture_id = texture; // Použití textury, pokud materiál nemá vlastní
+        }
     }
+    model->transparent = transparent;
+    const uint32_t id = add_model_asset(model);
+    model_asset_ids.emplace(key, id);
+    return id;
+}
 
-    cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
+uint32_t App::add_model_asset(Model* model) {
+    model_assets.push_back(model);
+    return static_cast<uint32_t>(model_assets.size() - 1);
+}
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.cols, image.rows, 0, GL_RGB, GL_UNSIGNED_BYTE, image.data);
-    checkGLError("After glTexImage2D in textureInit");
+EntityHandle App::place_object(uint32_t model, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale,
+    const glm::vec4& tint, uint8_t flags) {
+    const SceneNodeId node = scene.create();
+    scene.setTransform(node, position, rotation, scale);
+    scene.setLocalBounds(node, model_assets[model]->bounds);
+    return entities.create(scene, node, model, tint, flags);
+}
 
-    glGenerateMipmap(GL_TEXTURE_2D);
-    checkGLError("After glGenerateMipmap in textureInit");
+void App::scatter_models(const std::vector<uint32_t>& model_ids, size_t count) {
+    // Stress scene: copies of the models all over the terrain, fixed seed, same scene on every run
+    if (model_ids.empty() || count == 0) {
+        return;
+    }
+    std::mt19937 rng(2022);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float size_x = (terrain_heights.columns() - 1) * terrain_heights.tileSize();
+    const float size_z = (terrain_heights.rows() - 1) * terrain_heights.tileSize();
+    std::vector<glm::vec2> spots(count);
+    for (auto& spot : spots) {
+        spot = glm::vec2(unit(rng) * size_x, unit(rng) * size_z);
+    }
+    std::vector<float> heights(count);
+    terrain_heights.heightsAt(spots.data(), heights.data(), count);
+
+    entities.reserve(entities.size() + count);
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t model = model_ids[i % model_ids.size()];
+        const float scale = 0.3f + 0.5f * unit(rng);
+        // Lowest point of the model on the ground
+        const float lift = -model_assets[model]->bounds.min.y * scale;
+        place_object(model, glm::vec3(spots[i].x, heights[i] + lift, spots[i].y),
+            glm::vec3(0.0f, unit(rng) * glm::radians(360.0f), 0.0f), glm::vec3(scale), glm::vec4(1.0f), ENTITY_VISIBLE);
+    }
+    std::cout << "Scattered " << count << " models over the terrain" << std::endl;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+GLuint App::textureInit(const std::filesystem::path& filepath) {
+    cv::Mat image = decodeTexture(filepath);
+    if (image.empty()) {
+        std::cerr << "Failed to load texture: " << filepath << std::endl;
+        return 0;
+    }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLuint textureID = uploadTexture(image);
+    checkGLError("After uploadTexture in textureInit");
     return textureID;
 }
 
@@ -546,76 +694,137 @@ cv::Mat App::loadHeightmap(const std::filesystem::path& filepath) {
 }
 
 void App::createTerrainModel() {
-    if (heightmap.empty()) {
-        throw std::runtime_error("Heightmap is empty in createTerrainModel");
+    if (terrain_mode == TerrainMode::Streamed ? !terrain_tiles.isOpen() : heightmap.empty()) {
+        throw std::runtime_error("Terrain heights are not loaded in createTerrainModel");
     }
-    int width = heightmap.cols;
-    int height = heightmap.rows;
     float tileSizeGL = 1.0f;
     float maxHeight = 20.0f;
 
     GLuint terrainTexture = textureInit("resources/textures/grass.png");
 
-    std::vector<vertex> vertices;
-    std::vector<GLuint> indices;
+    // Chunks with their LOD index lists, drawn by render_scene() with an identity model matrix
+    if (terrain_mode == TerrainMode::Streamed) {
+        // Tile file and cache opened by init_terrain_heights()
+        terrain_atlas.create(terrain_tiles, terrain_gpu_tiles);
+        terrain.build(terrain_tiles, terrain_atlas, maxHeight, tileSizeGL);
+    }
+    else {
+        terrain.build(heightmap, maxHeight, tileSizeGL, terrain_mode, &frame_pool);
+    }
+    terrain.upload(terrain_mode == TerrainMode::Mesh ? shader : terrain_shader, terrainTexture, &shader);
+    std::cout << "Terrain: " << terrain.chunksX() << "x" << terrain.chunksZ() << " chunks, "
+        << terrain.fullTriangles() << " triangles at full detail, "
+        << (terrain_mode == TerrainMode::Heightmap ? "heightmap texture"
+            : terrain_mode == TerrainMode::Streamed ? "streamed tiles" : "vertex grid") << " "
+        << terrain.gpuMemory() / 1024 << " KB" << std::endl;
+}
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            float heightValue = heightmap.at<uchar>(y, x) / 255.0f * maxHeight;
-            glm::vec3 position(x * tileSizeGL, heightValue, y * tileSizeGL);
-            glm::vec2 texCoord(static_cast<float>(x) / (width - 1), static_cast<float>(y) / (height - 1));
-            glm::vec3 normal(0.0f, 1.0f, 0.0f);
-            vertices.push_back(vertex{ position, texCoord, normal });
-        }
+void App::createMazeModel() {
+    createTerrainModel();
+
+    const int width = 15;
+    const int height = 15;
+    maze_map = cv::Mat(height, width, CV_8U, cv::Scalar('.'));
+}
+
+GpuLight App::toGpuLight(const Light& light) {
+    GpuLight gpu{};
+    gpu.position = light.position;
+    gpu.constant = light.constant;
+    gpu.direction = light.direction;
+    gpu.linear = light.linear;
+    gpu.ambient = light.ambient;
+    gpu.quadratic = light.quadratic;
+    gpu.diffuse = light.diffuse;
+    gpu.cutOff = light.cutOff;
+    gpu.specular = light.specular;
+    gpu.outerCutOff = light.outerCutOff;
+    gpu.flicker = light.flicker;
+    gpu.radius = lightRadius(gpu);
+    return gpu;
+}
+
+void App::add_demo_lights(size_t count) {
+    // Light cluster test scene: small colored lights circling over the whole terrain,
+    // every fourth one is a spot light pointing down. Fixed seed, same scene on every run.
+    std::mt19937 rng(2012);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 center(unit(rng) * (terrain_heights.columns() - 1), 0.0f, unit(rng) * (terrain_heights.rows() - 1));
+        center.y = terrain_heights.heightAt(center.x, center.z) + 2.0f + 4.0f * unit(rng);
+        glm::vec3 color(unit(rng), unit(rng), unit(rng));
+        color = color / std::max({ color.x, color.y, color.z, 0.01f });
+
+        const bool spot = (i % 4 == 3);
+        pointLights.push_back(Light{
+            center,
+            glm::vec3(0.0f, -1.0f, 0.0f),
+            glm::vec3(0.0f),
+            color,
+            color * 0.5f,
+            1.0f, 0.35f, 0.44f,                                   // ~30 units to the 1/256 cutoff
+            spot ? std::cos(glm::radians(30.0f)) : 0.0f,
+            spot ? std::cos(glm::radians(40.0f)) : 0.0f
+        });
+        demo_light_orbits.push_back(glm::vec4(center, unit(rng) * 6.2831853f));
+    }
+    if (count > 0) {
+        std::cout << "Added " << count << " demo lights" << std::endl;
     }
+}
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int idx = y * width + x;
-            float hL = (x > 0) ? heightmap.at<uchar>(y, x - 1) / 255.0f * maxHeight : heightmap.at<uchar>(y, x) / 255.0f * maxHeight;
-            float hR = (x < width - 1) ? heightmap.at<uchar>(y, x + 1) / 255.0f * maxHeight : heightmap.at<uchar>(y, x) / 255.0f * maxHeight;
-            float hU = (y > 0) ? heightmap.at<uchar>(y - 1, x) / 255.0f * maxHeight : heightmap.at<uchar>(y, x) / 255.0f * maxHeight;
-            float hD = (y < height - 1) ? heightmap.at<uchar>(y + 1, x) / 255.0f * maxHeight : heightmap.at<uchar>(y, x) / 255.0f * maxHeight;
-            glm::vec3 normal = glm::normalize(glm::vec3(hL - hR, 2.0f, hU - hD));
-            vertices[idx].normal = normal;
-        }
+void App::animate_demo_lights(float time) {
+    const size_t first = pointLights.size() - demo_light_orbits.size();
+    for (size_t i = 0; i < demo_light_orbits.size(); i++) {
+        const glm::vec4& orbit = demo_light_orbits[i];
+        const float angle = time * 0.5f + orbit.w;
+        pointLights[first + i].position = glm::vec3(orbit) + glm::vec3(cos(angle), 0.0f, sin(angle)) * 3.0f;
     }
+    upload_point_lights();
+}
 
-    for (int y = 0; y < height - 1; ++y) {
-        for (int x = 0; x < width - 1; ++x) {
-            int topLeft = y * width + x;
-            int topRight = topLeft + 1;
-            int bottomLeft = (y + 1) * width + x;
-            int bottomRight = bottomLeft + 1;
+void App::update_light_clusters(LightsBlock& lights) {
+    // Light lists of the view frustum clusters, tex.frag only evaluates the lights of its cluster
+    {
+        ProfileScope scope(profiler, "Light clustering");
+        light_clusters.assign(camera.GetViewMatrix(), gpu_point_lights, &frame_pool);
+    }
 
-            indices.push_back(topLeft);
-            indices.push_back(bottomLeft);
-            indices.push_back(topRight);
+    light_clusters_ssbo.update(light_clusters.clusterRanges());
+    light_indices_ssbo.update(light_clusters.lightIndices());
+    lights.clusterScale = light_clusters.shaderScale(width, height);
+    lights.clusterGrid[0] = CLUSTER_GRID_X;
+    lights.clusterGrid[1] = CLUSTER_GRID_Y;
+    lights.clusterGrid[2] = CLUSTER_GRID_Z;
+}
 
-            indices.push_back(topRight);
-            indices.push_back(bottomLeft);
-            indices.push_back(bottomRight);
+void App::init_light_buffers() {
+    // Throws if the shader blocks and the C++ mirrors in ShaderBlocks.hpp disagree
+    for (const ShaderProgram* program : { &shader, &terrain_shader }) {
+        if (program->getID() == 0) {
+            continue;
         }
+        program->bindUniformBlock("Lights", LIGHTS_UBO_BINDING, sizeof(LightsBlock));
+        program->bindStorageBlock("PointLights", POINT_LIGHTS_SSBO_BINDING, sizeof(GpuLight));
+        // Arrays of uvec2/uint: drivers may round the reported block size up to 16 bytes, no size check
+        program->bindStorageBlock("LightClusters", LIGHT_CLUSTERS_SSBO_BINDING);
+        program->bindStorageBlock("LightIndices", LIGHT_INDICES_SSBO_BINDING);
     }
 
-    terrain = new Model("", shader);
-    Mesh mesh(GL_TRIANGLES, shader, vertices, indices, glm::vec3(0.0f), glm::vec3(0.0f));
-    mesh.texture_id = terrainTexture;
-    mesh.diffuse_material = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
-    terrain->meshes.push_back(mesh);
-    terrain->origin = glm::vec3(0.0f);
-    terrain->scale = glm::vec3(1.0f);
-    terrain->orientation = glm::vec3(0.0f);
-
-    maze_walls.push_back(terrain);
+    lights_ubo = ShaderBuffer(GL_UNIFORM_BUFFER, LIGHTS_UBO_BINDING, sizeof(LightsBlock));
+    point_lights_ssbo = ShaderBuffer(GL_SHADER_STORAGE_BUFFER, POINT_LIGHTS_SSBO_BINDING, pointLights.size() * sizeof(GpuLight));
+    light_clusters_ssbo = ShaderBuffer(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTERS_SSBO_BINDING, CLUSTER_COUNT * sizeof(ClusterRange));
+    light_indices_ssbo = ShaderBuffer(GL_SHADER_STORAGE_BUFFER, LIGHT_INDICES_SSBO_BINDING, CLUSTER_COUNT * sizeof(GLuint));
+    upload_point_lights();
 }
 
-void App::createMazeModel() {
-    createTerrainModel();
-
-    const int width = 15;
-    const int height = 15;
-    maze_map = cv::Mat(height, width, CV_8U, cv::Scalar('.'));
+void App::upload_point_lights() {
+    gpu_point_lights.clear();
+    gpu_point_lights.reserve(pointLights.size());
+    for (const auto& light : pointLights) {
+        gpu_point_lights.push_back(toGpuLight(light));
+    }
+    point_lights_ssbo.update(gpu_point_lights);
 }
 
 uchar App::getmap(cv::Mat& map, int x, int y) {
@@ -637,12 +846,19 @@ bool App::run() {
     shader.setUniform("uP_m", projection_matrix);
     shader.setUniform("viewPos", camera.Position);
 
+    // Static point lights are traced once, per-frame state below every 60th frame (F9: debug traces)
+    for (size_t i = 0; i < pointLights.size() && i < 3; i++) {
+        TRACE(TraceLevel::Debug, "PointLight[%d] pos: %.2f, %.2f, %.2f", static_cast<int>(i),
+            pointLights[i].position.x, pointLights[i].position.y, pointLights[i].position.z);
+    }
+
     double lastTime = glfwGetTime();
     double lastFrameTime = lastTime;
     int frameCount = 0;
     std::string title = "PG2";
 
     while (!glfwWindowShouldClose(window)) {
+        profiler.beginFrame();
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -661,7 +877,243 @@ bool App::run() {
 
         // Activate shader and set uniforms
         shader.activate();
-        shader.setUniform("ambientLight.color", glm::vec3(0.2f)); // Set ambient light
+
+        // Camera movement
+        {
+            ProfileScope scope(profiler, "Camera move");
+            glm::vec3 direction = camera.ProcessKeyboard(window, deltaTime);
+            camera.Move(direction, maze_map, 1.0f, terrain_heights, deltaTime);
+            TRACE_EVERY_N(TraceLevel::Debug, 60, "Camera pos: %.2f, %.2f, %.2f", camera.Position.x, camera.Position.y, camera.Position.z);
+        }
+
+        render_scene(currentTime);
+
+        // ImGui rendering
+        {
+            ProfileScope scope(profiler, "ImGui");
+            GpuProfileScope gpu_scope(profiler, "ImGui");
+            if (show_imgui) {
+                ImGui::SetNextWindowPos(ImVec2(10, 10));
+                ImGui::SetNextWindowSize(ImVec2(330, 450));
+                ImGui::Begin("Monitoring", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+                ImGui::Text("V-Sync: %s", vsync ? "ON" : "OFF");
+                ImGui::Text("FPS: %d", frameCount);
+                ImGui::Text("Lights: %d (%.1f per cluster)", static_cast<int>(pointLights.size()),
+                    static_cast<float>(light_clusters.lightIndices().size()) / CLUSTER_COUNT);
+                ImGui::Text("Terrain: %d/%d chunks, %dk of %dk triangles",
+                    static_cast<int>(terrain.lastStats().visible_chunks), static_cast<int>(terrain.getChunks().size()),
+                    static_cast<int>(terrain.lastStats().triangles / 1000), static_cast<int>(terrain.fullTriangles() / 1000));
+                if (terrain_cache) {
+                    const TerrainTileCache::Stats& tiles = terrain_cache->getStats();
+                    ImGui::Text("Tiles: %d in RAM (%d MB), %d loading, %d/%d on GPU",
+                        static_cast<int>(tiles.resident_tiles), static_cast<int>(tiles.used_bytes >> 20),
+                        static_cast<int>(tiles.loading_tiles), terrain_atlas.residentTiles(), terrain_atlas.layerCount());
+                    ImGui::Text("Chunks waiting for tiles: %d (coarse)", static_cast<int>(terrain.lastStats().overview_chunks));
+                }
+                ImGui::Text("Objects: %d/%d in view (%d culled), %d models", static_cast<int>(visible_entities),
+                    static_cast<int>(entities.size()), static_cast<int>(entities.size() - visible_entities),
+                    static_cast<int>(model_assets.size()));
+                float pick_t = PICK_DISTANCE, object_t;
+                const bool terrain_hit = terrain_heights.raycast(camera.Position, camera.Front, PICK_DISTANCE, pick_t);
+                uint32_t picked;
+                if (object_bvh.raycast(camera.Position, camera.Front, pick_t, picked, object_t)) {
+                    ImGui::Text("Looking at: object %d, model %d (%.1f away)", static_cast<int>(picked),
+                        static_cast<int>(entities.modelColumn()[picked]), object_t);
+                }
+                else if (terrain_hit) {
+                    const glm::vec3 pick = camera.Position + camera.Front * pick_t;
+                    ImGui::Text("Looking at: %.1f, %.1f, %.1f (%.1f away)", pick.x, pick.y, pick.z, pick_t);
+                }
+                else {
+                    ImGui::Text("Looking at: sky");
+                }
+                object_query.clear();
+                object_bvh.overlapSphere(camera.Position, NEARBY_RADIUS, object_query);
+                ImGui::Text("Objects within %.0f: %d", NEARBY_RADIUS, static_cast<int>(object_query.size()));
+                ImGui::Separator();
+                profiler.drawImGui();
+                ImGui::Separator();
+                ImGui::Text("(press RMB to release mouse)");
+                ImGui::Text("(press H to show/hide info)");
+                ImGui::Text("(press F9 for debug traces)");
+                ImGui::Text("(press F8 to save a Chrome trace)");
+                ImGui::Text("(press F7 to record a camera key)");
+                ImGui::End();
+            }
+
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+
+        {
+            ProfileScope scope(profiler, "Swap");
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        profiler.endFrame();
+
+        if (save_profile) {
+            save_profile = false;
+            const std::string path = "trace_frame" + std::to_string(profiler.frameNumber()) + ".json";
+            if (profiler.writeChromeTrace(path)) {
+                TRACE(TraceLevel::Info, "Chrome trace of the last %d frames saved to %s", static_cast<int>(PROFILE_HISTORY - 1), path.c_str());
+            }
+            else {
+                TRACE(TraceLevel::Error, "Cannot write %s", path.c_str());
+            }
+        }
+    }
+
+    if (!recorded_path.empty()) {
+        const std::filesystem::path path = "recorded_camera_path.json";
+        if (writeCameraPath(path, recorded_path)) {
+            std::cout << recorded_path.size() << " camera keys saved to " << path.string() << std::endl;
+        }
+        else {
+            std::cerr << "Cannot write " << path.string() << std::endl;
+        }
+    }
+    return true;
+}
+
+bool App::run_benchmark(const BenchmarkScenario& scenario) {
+    if (!window) {
+        std::cerr << "No active GLFW window!" << std::endl;
+        return false;
+    }
+
+    // Offscreen target of the scenario size: independent of the hidden window, and the driver
+    // cannot skip shading pixels that are not visible on screen
+    GLuint fbo = 0, color_buffer = 0, depth_buffer = 0;
+    glCreateRenderbuffers(1, &color_buffer);
+    glNamedRenderbufferStorage(color_buffer, GL_RGBA8, scenario.width, scenario.height);
+    glCreateRenderbuffers(1, &depth_buffer);
+    glNamedRenderbufferStorage(depth_buffer, GL_DEPTH_COMPONENT24, scenario.width, scenario.height);
+    glCreateFramebuffers(1, &fbo);
+    glNamedFramebufferRenderbuffer(fbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+    glNamedFramebufferRenderbuffer(fbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+    auto release_framebuffer = [&]() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color_buffer);
+        glDeleteRenderbuffers(1, &depth_buffer);
+    };
+    if (glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Benchmark framebuffer " << scenario.width << "x" << scenario.height << " is not complete" << std::endl;
+        release_framebuffer();
+        return false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    width = scenario.width;
+    height = scenario.height;
+    glViewport(0, 0, width, height);
+    update_projection_matrix();
+    glfwSwapInterval(0);
+
+    // Like a swap chain without vsync, the CPU may run BENCHMARK_FRAMES_IN_FLIGHT frames ahead of
+    // the GPU and then waits on the fence of the oldest one. GPU time of a frame comes from two
+    // timestamp queries (GL_TIME_ELAPSED is taken by the profiler scopes), read once its fence signaled.
+    constexpr size_t BENCHMARK_FRAMES_IN_FLIGHT = 2;
+    struct FrameSlot {
+        GLsync fence = nullptr;
+        GLuint queries[2] = { 0, 0 };
+        int frame = -1;  // measured frame whose timestamps are pending
+    };
+    std::array<FrameSlot, BENCHMARK_FRAMES_IN_FLIGHT> slots;
+    for (auto& slot : slots) {
+        glCreateQueries(GL_TIMESTAMP, 2, slot.queries);
+    }
+
+    std::vector<BenchmarkFrame> frames(static_cast<size_t>(scenario.frames));
+    auto retire = [&](FrameSlot& slot) {
+        if (slot.fence) {
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        if (slot.frame >= 0) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+            frames[slot.frame].gpu_ms = static_cast<float>((end - begin) / 1e6);
+            slot.frame = -1;
+        }
+    };
+
+    using Clock = std::chrono::steady_clock;
+    auto milliseconds = [](Clock::duration d) { return std::chrono::duration<float, std::milli>(d).count(); };
+    std::cout << "Benchmark " << scenario.name << ": " << scenario.warmup_frames << " warmup + "
+        << scenario.frames << " frames" << std::endl;
+
+    const int total_frames = scenario.warmup_frames + scenario.frames;
+    Clock::time_point previous_start;
+    for (int i = 0; i < total_frames; ++i) {
+        FrameSlot& slot = slots[i % BENCHMARK_FRAMES_IN_FLIGHT];
+        retire(slot);
+
+        const Clock::time_point start = Clock::now();
+        const int measured = i - scenario.warmup_frames; // negative while warming up
+        if (measured > 0) {
+            frames[measured - 1].frame_ms = milliseconds(start - previous_start);
+        }
+        previous_start = start;
+
+        profiler.beginFrame();
+        Mesh::stats = DrawStats{};
+        // Warmup frames stay at the first key, the measured ones traverse the path once
+        const float t = scenario.frames > 1 ? static_cast<float>(std::max(measured, 0)) / (scenario.frames - 1) : 0.0f;
+        const CameraKey key = scenario.camera_path.sample(t);
+        camera.LookAt(key.position, key.target);
+
+        if (measured >= 0) {
+            glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+        }
+        render_scene(i / 60.0); // fixed clock, the animated lights are the same on every run
+        if (measured >= 0) {
+            glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+            slot.frame = measured;
+        }
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush(); // start the GPU work now, as a swap would
+        profiler.endFrame();
+
+        if (measured >= 0) {
+            BenchmarkFrame& frame = frames[measured];
+            frame.cpu_ms = milliseconds(Clock::now() - start);
+            frame.draw_calls = Mesh::stats.draw_calls;
+            frame.triangles = Mesh::stats.triangles;
+        }
+    }
+    for (auto& slot : slots) {
+        retire(slot);
+    }
+    frames.back().frame_ms = milliseconds(Clock::now() - previous_start);
+    checkGLError("After benchmark");
+
+    const std::string renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    const std::string gl_version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if (scenario.chrome_trace) {
+        std::filesystem::path trace_path = scenario.output;
+        trace_path += ".trace.json";
+        if (!profiler.writeChromeTrace(trace_path)) {
+            std::cerr << "Cannot write " << trace_path.string() << std::endl;
+        }
+    }
+
+    for (auto& slot : slots) {
+        glDeleteQueries(2, slot.queries);
+    }
+    release_framebuffer();
+    return writeBenchmarkReport(scenario, frames, renderer, gl_version);
+}
+
+void App::render_scene(double currentTime) {
+    shader.activate();
+    shader.setUniform(view_matrix_loc, camera.GetViewMatrix());
+    shader.setUniform(view_pos_loc, camera.Position);
+
+    {
+        ProfileScope scope(profiler, "Light upload");
 
         // Update directional light
         float sunAngle = currentTime * 0.1f;
@@ -669,136 +1121,170 @@ bool App::run() {
         directionalLight.ambient = glm::vec3(0.7f);
         directionalLight.diffuse = glm::vec3(0.9f + 0.1f * sin(sunAngle), 0.9f + 0.1f * cos(sunAngle), 0.9f);
         directionalLight.specular = glm::vec3(1.0f);
-        shader.setUniform("dirLights[0].direction", directionalLight.direction);
-        shader.setUniform("dirLights[0].ambient", directionalLight.ambient);
-        shader.setUniform("dirLights[0].diffuse", directionalLight.diffuse);
-        shader.setUniform("dirLights[0].specular", directionalLight.specular);
-        std::cout << "DirLight dir: " << directionalLight.direction.x << ", " << directionalLight.direction.y << ", " << directionalLight.direction.z << std::endl;
-
-        // Update point lights
-        shader.setUniform("numPointLights", 3);
-        for (int i = 0; i < 3; i++) {
-            float intensity = 0.7f + 0.3f * sin(currentTime * (i + 1));
-            pointLights[i].diffuse = pointLights[i].diffuse * intensity;
-            pointLights[i].specular = pointLights[i].diffuse;
-            std::string index = "[" + std::to_string(i) + "]";
-            shader.setUniform("pointLights" + index + ".position", pointLights[i].position);
-            shader.setUniform("pointLights" + index + ".ambient", pointLights[i].ambient);
-            shader.setUniform("pointLights" + index + ".diffuse", pointLights[i].diffuse);
-            shader.setUniform("pointLights" + index + ".specular", pointLights[i].specular);
-            shader.setUniform("pointLights" + index + ".constant", pointLights[i].constant);
-            shader.setUniform("pointLights" + index + ".linear", pointLights[i].linear);
-            shader.setUniform("pointLights" + index + ".quadratic", pointLights[i].quadratic);
-            std::cout << "PointLight[" << i << "] pos: " << pointLights[i].position.x << ", " << pointLights[i].position.y << ", " << pointLights[i].position.z << std::endl;
-        }
-
-        // Update spotlight
-        shader.setUniform("numSpotLights", 1);
+        TRACE_EVERY_N(TraceLevel::Debug, 60, "DirLight dir: %.3f, %.3f, %.3f",
+            directionalLight.direction.x, directionalLight.direction.y, directionalLight.direction.z);
+
+        // Update spotlight (attached to camera)
         spotLight.position = camera.Position;
         spotLight.direction = camera.Front;
-        shader.setUniform("spotLights[0].position", spotLight.position);
-        shader.setUniform("spotLights[0].direction", spotLight.direction);
-        shader.setUniform("spotLights[0].ambient", spotLight.ambient);
-        shader.setUniform("spotLights[0].diffuse", spotLight.diffuse);
-        shader.setUniform("spotLights[0].specular", spotLight.specular);
-        shader.setUniform("spotLights[0].constant", spotLight.constant);
-        shader.setUniform("spotLights[0].linear", spotLight.linear);
-        shader.setUniform("spotLights[0].quadratic", spotLight.quadratic);
-        shader.setUniform("spotLights[0].cutOff", spotLight.cutOff);
-        shader.setUniform("spotLights[0].outerCutOff", spotLight.outerCutOff);
-        std::cout << "SpotLight pos: " << spotLight.position.x << ", " << spotLight.position.y << ", " << spotLight.position.z << std::endl;
+        TRACE_EVERY_N(TraceLevel::Debug, 60, "SpotLight pos: %.2f, %.2f, %.2f", spotLight.position.x, spotLight.position.y, spotLight.position.z);
 
-        // Camera movement
-        glm::vec3 direction = camera.ProcessKeyboard(window, deltaTime); 
-        camera.Move(direction, maze_map, 1.0f, heightmap, 20.0f, deltaTime);
-        shader.setUniform("uV_m", camera.GetViewMatrix());
-        shader.setUniform("viewPos", camera.Position);
-        std::cout << "Camera pos: " << camera.Position.x << ", " << camera.Position.y << ", " << camera.Position.z << std::endl;
+        // Point lights pulse in the shader (flicker), their SSBO is only uploaded when they change
+        if (!demo_light_orbits.empty()) {
+            animate_demo_lights(static_cast<float>(currentTime));
+        }
 
-        // Rendering
-        glClearColor(0.3f, 0.3f, 0.4f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // All per-frame light data goes to the GPU in a single buffer update
+        LightsBlock lights{};
+        lights.ambientColor = glm::vec4(glm::vec3(0.2f), 1.0f);
+        lights.dirLight = toGpuLight(directionalLight);
+        lights.spotLight = toGpuLight(spotLight);
+        lights.time = static_cast<float>(currentTime);
+        lights.numPointLights = static_cast<GLint>(pointLights.size());
+        lights.numSpotLights = 1;
+        update_light_clusters(lights);
+        lights_ubo.update(lights);
+    }
 
-        // Render opaque objects
-        for (auto& wall : maze_walls) {
-            if (!wall->transparent) {
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, wall->meshes[0].texture_id);
-                shader.setUniform("tex0", 0);
-                shader.setUniform("uM_m", wall->getModelMatrix());
-                // Remove u_diffuse_color as it's not used in tex.frag
-                wall->draw();
-                checkGLError("After drawing wall");
+    // World matrices of the nodes moved since the last frame, nothing for static scenery
+    {
+        ProfileScope scope(profiler, "Scene graph");
+        scene_changes.clear();
+        scene.update(&scene_changes);
+        moved_entities.clear();
+        entities.syncTransforms(scene, scene_changes, &moved_entities);
+        // Objects placed or removed (dense indices moved): a new tree, objects moved: refit their leaves
+        if (object_bvh_layout != entities.layoutVersion()) {
+            object_bvh_layout = entities.layoutVersion();
+            object_boxes.resize(entities.size());
+            for (uint32_t i = 0; i < entities.size(); ++i) {
+                object_boxes[i] = entities.worldBounds(i);
             }
+            object_bvh.build(object_boxes.data(), object_boxes.size());
         }
-
-        // Render models
-        for (auto& model : models) {
-            if (!model->transparent) {
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, model->meshes[0].texture_id);
-                shader.setUniform("tex0", 0);
-                shader.setUniform("uM_m", model->getModelMatrix());
-                model->draw();
-                checkGLError("After drawing model");
+        else {
+            for (const uint32_t i : moved_entities) {
+                object_bvh.update(i, entities.worldBounds(i));
             }
         }
-
-        // Render transparent objects
-        std::vector<Model*> transparent_draw_list;
-        for (auto& wall : maze_walls) {
-            if (wall->transparent) {
-                transparent_draw_list.push_back(wall);
+    }
+    // Entities whose world box is outside the view frustum are not submitted
+    {
+        ProfileScope scope(profiler, "Object culling");
+        entity_visible.resize(entities.size());
+        const Frustum frustum(projection_matrix * camera.GetViewMatrix());
+        if (entities.size() >= BVH_CULLING_OBJECTS) {
+            // Only the part of the tree in view is visited
+            std::fill(entity_visible.begin(), entity_visible.end(), uint8_t{ 0 });
+            object_query.clear();
+            object_bvh.frustum(frustum, object_query);
+            for (const uint32_t i : object_query) {
+                entity_visible[i] = 1;
             }
+            visible_entities = object_query.size();
         }
-        for (auto& obj : transparent_objects) {
-            transparent_draw_list.push_back(obj);
+        else {
+            frustum.cullBoxes(entities.minXColumn(), entities.minYColumn(), entities.minZColumn(), entities.maxXColumn(),
+                entities.maxYColumn(), entities.maxZColumn(), entities.size(), entity_visible.data());
+            visible_entities = 0;
+            for (const uint8_t visible : entity_visible) {
+                visible_entities += visible;
+            }
         }
-        for (auto& model : models) {
-            if (model->transparent) {
-                transparent_draw_list.push_back(model);
+    }
+
+    // Rendering
+    {
+        ProfileScope scope(profiler, "Opaque pass");
+        GpuProfileScope gpu_scope(profiler, "Opaque pass");
+        glClearColor(0.3f, 0.3f, 0.4f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Streamed terrain: tiles around the camera to memory and to the GPU, without waiting for either
+        if (terrain_cache) {
+            ProfileScope streaming_scope(profiler, "Terrain streaming");
+            terrain_cache->update(glm::vec2(camera.Position.x, camera.Position.z), terrain_view_distance,
+                static_cast<size_t>(terrain_atlas.layerCount()));
+            terrain_atlas.update(*terrain_cache);
+        }
+        // Terrain chunks in the view frustum, at a level of detail by distance
+        {
+            ProfileScope terrain_scope(profiler, "Terrain culling");
+            terrain.select(projection_matrix * camera.GetViewMatrix(), camera.Position);
+        }
+        if (terrain.getMode() != TerrainMode::Mesh) {
+            terrain_shader.activate();
+            terrain_shader.setUniform(terrain_view_matrix_loc, camera.GetViewMatrix());
+            terrain_shader.setUniform(terrain_view_pos_loc, camera.Position);
+            terrain.draw();
+            shader.activate();
+            if (terrain.getMode() == TerrainMode::Streamed) {
+                // Chunks whose tile is still on its way, coarse
+                shader.setUniform(model_matrix_loc, glm::mat4(1.0f));
+                terrain.drawOverview();
             }
         }
+        else {
+            shader.setUniform(model_matrix_loc, glm::mat4(1.0f));
+            terrain.draw();
+        }
+        checkGLError("After drawing terrain");
+
+        // Render opaque objects: all visible placements of a model in one instanced draw per mesh
+        {
+            ProfileScope batch_scope(profiler, "Instance batching");
+            opaque_instances.build(entities, entity_visible.data(), ENTITY_VISIBLE | ENTITY_TRANSPARENT, ENTITY_VISIBLE,
+                model_assets.size());
+            instances_ssbo.update(opaque_instances.instances());
+        }
+        shader.setUniform(instanced_loc, 1);
+        for (const InstanceBatch& batch : opaque_instances.batches()) {
+            // Textures are bound per mesh in Mesh::drawInstanced
+            shader.setUniform(first_instance_loc, static_cast<int>(batch.first));
+            model_assets[batch.model]->drawInstanced(static_cast<GLsizei>(batch.count));
+        }
+        shader.setUniform(instanced_loc, 0);
+        checkGLError("After drawing models");
+    }
 
-        std::sort(transparent_draw_list.begin(), transparent_draw_list.end(),
-            [this](Model* a, Model* b) {
-                float dist_a = glm::distance(camera.Position, a->origin);
-                float dist_b = glm::distance(camera.Position, b->origin);
-                return dist_a > dist_b;
+    // Render transparent objects, back to front by the distance of their model's bounding sphere
+    // centre in the world (the world box of a rotated object is centred elsewhere), computed once
+    // per object instead of in every comparison
+    {
+        ProfileScope scope(profiler, "Transparent sort");
+        transparent_order.clear();
+        const uint8_t* flags = entities.flagColumn();
+        const uint32_t* model_ids = entities.modelColumn();
+        const glm::mat4* world_matrices = entities.worldMatrixColumn();
+        for (uint32_t i = 0; i < entities.size(); ++i) {
+            if ((flags[i] & (ENTITY_VISIBLE | ENTITY_TRANSPARENT)) == (ENTITY_VISIBLE | ENTITY_TRANSPARENT) && entity_visible[i]) {
+                const glm::vec3 center(world_matrices[i] * glm::vec4(model_assets[model_ids[i]]->bounding_sphere.center, 1.0f));
+                const glm::vec3 d = center - camera.Position;
+                transparent_order.emplace_back(glm::dot(d, d), i);
+            }
+        }
+        std::sort(transparent_order.begin(), transparent_order.end(),
+            [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+                return a.first > b.first;
             });
+    }
 
+    {
+        ProfileScope scope(profiler, "Transparent pass");
+        GpuProfileScope gpu_scope(profiler, "Transparent pass");
         glEnable(GL_BLEND);
         glDepthMask(GL_FALSE);
-        for (auto* model : transparent_draw_list) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, model->meshes[0].texture_id);
-            shader.setUniform("tex0", 0);
-            shader.setUniform("uM_m", model->getModelMatrix());
-            model->draw();
-            checkGLError("After drawing transparent model");
+        const uint32_t* model_ids = entities.modelColumn();
+        const glm::mat4* world_matrices = entities.worldMatrixColumn();
+        const glm::vec4* tints = entities.tintColumn();
+        for (const auto& [distance2, i] : transparent_order) {
+            shader.setUniform(model_matrix_loc, world_matrices[i]);
+            model_assets[model_ids[i]]->drawTinted(tints[i]);
         }
+        checkGLError("After drawing transparent models");
         glDepthMask(GL_TRUE);
         glDisable(GL_BLEND);
-
-        // ImGui rendering
-        if (show_imgui) {
-            ImGui::SetNextWindowPos(ImVec2(10, 10));
-            ImGui::SetNextWindowSize(ImVec2(250, 100));
-            ImGui::Begin("Monitoring", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
-            ImGui::Text("V-Sync: %s", vsync ? "ON" : "OFF");
-            ImGui::Text("FPS: %d", frameCount);
-            ImGui::Text("(press RMB to release mouse)");
-            ImGui::Text("(press H to show/hide info)");
-            ImGui::End();
-        }
-
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-        glfwSwapBuffers(window);
-        glfwPollEvents();
     }
-    return true;
 }
 
 void App::update_projection_matrix() {
@@ -807,16 +1293,24 @@ void App::update_projection_matrix() {
 
     float ratio = static_cast<float>(width) / height;
     projection_matrix = glm::perspective(glm::radians(fov), ratio, 0.1f, 20000.0f);
+    light_clusters.setProjection(glm::radians(fov), ratio);
 
     if (shader.getID() != 0) {
         shader.activate();
         shader.setUniform("uP_m", projection_matrix);
     }
+    if (terrain_shader.getID() != 0) {
+        terrain_shader.activate();
+        terrain_shader.setUniform("uP_m", projection_matrix);
+        shader.activate();
+    }
 }
 
 GLuint App::compileShader(GLenum type, const char* source) {
+    const std::string matched_source = ShaderProgram::matchGlslVersion(source);
+    const char* source_cstr = matched_source.c_str();
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, NULL);
+    glShaderSource(shader, 1, &source_cstr, NULL);
     glCompileShader(shader);
 
     GLint success;
@@ -867,7 +1361,20 @@ void App::key_callback(GLFWwindow* window, int key, int scancode, int action, in
         case GLFW_KEY_F10:
             app->vsync = !app->vsync;
             glfwSwapInterval(app->vsync ? 1 : 0);
-            std::cout << "VSync: " << (app->vsync ? "ON" : "OFF") << std::endl;
+            TRACE(TraceLevel::Info, "VSync: %s", app->vsync ? "ON" : "OFF");
+            break;
+        case GLFW_KEY_F9:
+            Tracer::setLevel(Tracer::level() == TraceLevel::Debug ? TraceLevel::Info : TraceLevel::Debug);
+            TRACE(TraceLevel::Info, "Debug traces %s", Tracer::level() == TraceLevel::Debug ? "ON" : "OFF");
+            break;
+        case GLFW_KEY_F8:
+            app->save_profile = true; // written after the frame ends
+            break;
+        case GLFW_KEY_F7:
+            if (action == GLFW_PRESS) {
+                app->recorded_path.push_back(CameraKey{ app->camera.Position, app->camera.Position + app->camera.Front * 10.0f });
+                TRACE(TraceLevel::Info, "Camera key %d recorded", static_cast<int>(app->recorded_path.size()));
+            }
             break;
         case GLFW_KEY_F11:
             app->toggleFullscreen();
@@ -906,7 +1413,7 @@ void App::mouse_button_callback(GLFWwindow* window, int button, int action, int
     if (button == GLFW_MOUSE_BUTTON_MIDDLE && action == GLFW_PRESS) {
         app->fov = app->DEFAULT_FOV;
         app->update_projection_matrix();
-        std::cout << "Zoom reset to default" << std::endl;
+        TRACE(TraceLevel::Info, "Zoom reset to default");
     }
 }
 
@@ -935,7 +1442,8 @@ void create_default_config() {
         {"antialiasing", {
             {"enabled", false},
             {"samples", 4}
-        }}
+        }},
+        {"terrain", "heightmap"}
     };
     std::ofstream file("config.json");
     if (!file.is_open()) {
@@ -970,7 +1478,8 @@ json load_config() {
             {"antialiasing", {
                 {"enabled", false},
                 {"samples", 4}
-            }}
+            }},
+            {"terrain", "heightmap"}
         };
         return default_config;
     }
@@ -7,12 +7,29 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <map>
+#include <tuple>
 #include <nlohmann/json.hpp>
 
 #include "assets.hpp"
 #include "ShaderProgram.hpp"
 #include "Model.hpp"
 #include "Camera.hpp"
+#include "AssetLoader.hpp"
+#include "ShaderBlocks.hpp"
+#include "ShaderBuffer.hpp"
+#include "LightClusters.hpp"
+#include "ThreadPool.hpp"
+#include "Tracer.hpp"
+#include "Profiler.hpp"
+#include "BenchmarkScenario.hpp"
+#include "Terrain.hpp"
+#include "TerrainTiles.hpp"
+#include "TerrainHeightField.hpp"
+#include "SceneGraph.hpp"
+#include "EntityStore.hpp"
+#include "Bvh.hpp"
+#include "InstanceBatches.hpp"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -21,11 +38,13 @@
 using json = nlohmann::json;
 class App {
 public:
-    App();
+    explicit App(size_t demo_light_count = 0); // demo_light_count extra point lights over the terrain
     ~App();
     bool init();
     bool run();
-    void init_glfw();
+    // Renders the scenario offscreen and writes its report, false if the report was not written
+    bool run_benchmark(const BenchmarkScenario& scenario);
+    void init_glfw(bool hidden_window = false);
 
 private:
     struct Light {
@@ -39,16 +58,15 @@ private:
         float quadratic;
         float cutOff;
         float outerCutOff;
+        float flicker = 0.0f; // intensity 0.7 + 0.3 * sin(time * flicker), evaluated in the shader
     };
 
     GLFWwindow* window = nullptr;
     ShaderProgram shader;
     Model* triangle = nullptr;
-    std::vector<Model*> maze_walls;
-    std::vector<Model*> transparent_objects;
     std::vector<GLuint> transparent_textures;
     Camera camera;
-    cv::Mat heightmap;
+    cv::Mat heightmap;                  // Heightmap and Mesh mode, Streamed mode reads the tile file
     cv::Mat maze_map;
     float maxTerrainHeight = 0.0f;
     int width = 800;
@@ -61,8 +79,41 @@ private:
     bool show_imgui = true;
     bool vsync = false;
     float r = 0.0f, g = 0.0f, b = 0.0f;
-    Model* terrain;
-    std::vector<Model*> models;
+    Terrain terrain;                   // heightmap chunks with LOD, not an entity
+    TerrainHeightField terrain_heights;  // the same surface for the CPU: collision, placement, picking
+    size_t demo_light_count{ 0 };      // added by init_terrain_heights(), they are placed over the terrain
+    SceneGraph scene;                  // transforms of the entities
+    std::vector<SceneNodeId> scene_changes;  // nodes recomputed this frame, to EntityStore::syncTransforms
+    // Placed objects: model assets (owned, shared by all their entities) and the entities
+    std::vector<Model*> model_assets;
+    // Model asset of every loaded file + texture for meshes without one + transparency, the same
+    // combination loads once and its placements draw as instances of one model
+    std::map<std::tuple<std::string, GLuint, bool>, uint32_t> model_asset_ids;
+    EntityStore entities;
+    std::vector<uint8_t> entity_visible;  // frustum test of the entities' world boxes this frame
+    size_t visible_entities{ 0 };
+    // Entities' world boxes by dense index: rebuilt when entities are added or removed, refit
+    // for the ones that moved; culls large scenes, picks and finds objects near the camera
+    Bvh object_bvh;
+    uint64_t object_bvh_layout{ UINT64_MAX };  // EntityStore::layoutVersion() the tree was built for
+    std::vector<AABB> object_boxes;
+    std::vector<uint32_t> moved_entities;
+    std::vector<uint32_t> object_query;
+    InstanceBatches opaque_instances;  // visible opaque entities grouped by model, this frame
+    ShaderBuffer instances_ssbo;       // GpuInstance[] of opaque_instances, updated every frame
+    std::vector<std::pair<float, uint32_t>> transparent_order;  // squared distance, entity index; reused every frame
+    size_t scatter_objects{ 0 };       // config.json graphics.scatter_objects: copies of the models spread over the terrain
+    TerrainMode terrain_mode{ TerrainMode::Heightmap };  // config.json graphics.terrain: "heightmap", "mesh" or "streamed"
+    ShaderProgram terrain_shader;      // terrain.vert + tex.frag, Heightmap and Streamed mode
+    // Streamed mode, config.json graphics.terrain_tiles (made from the heightmap if missing or outdated),
+    // terrain_memory_mb, terrain_gpu_tiles and terrain_view_distance (cells)
+    std::filesystem::path terrain_tiles_path{ "resources/terrain/heightmap.terrain" };
+    size_t terrain_memory_mb{ 256 };
+    int terrain_gpu_tiles{ 64 };
+    float terrain_view_distance{ 1024.0f };
+    TerrainTileFile terrain_tiles;
+    std::unique_ptr<TerrainTileCache> terrain_cache;
+    TerrainTileAtlas terrain_atlas;
     std::vector<GLuint> model_textures;
 
 
@@ -75,14 +126,48 @@ private:
     Light directionalLight; // Směrové světlo (slunce)
     std::vector<Light> pointLights; // Bodová světla
     Light spotLight; // Reflektor
+    std::vector<GpuLight> gpu_point_lights;     // pointLights as uploaded, input of the clustering
+    std::vector<glm::vec4> demo_light_orbits;   // center + phase of the animated demo lights (the last pointLights)
+    ShaderBuffer lights_ubo;           // LightsBlock, updated every frame
+    ShaderBuffer point_lights_ssbo;    // GpuLight[], uploaded when the point lights change
+    LightClusterGrid light_clusters;
+    ShaderBuffer light_clusters_ssbo;  // ClusterRange[CLUSTER_COUNT], updated every frame
+    ShaderBuffer light_indices_ssbo;   // GLuint[], updated every frame
+    ThreadPool frame_pool;             // per-frame CPU jobs (light clustering)
+    Profiler profiler;
+    bool save_profile = false;         // F8: Chrome trace of the recent frames
+    std::vector<CameraKey> recorded_path; // F7: camera keys for a --benchmark scenario
+
+    // Uniform locations resolved once in init_assets(), the frame loop only passes handles
+    GLint view_matrix_loc{ -1 };
+    GLint view_pos_loc{ -1 };
+    GLint model_matrix_loc{ -1 };
+    GLint instanced_loc{ -1 };
+    GLint first_instance_loc{ -1 };
+    GLint terrain_view_matrix_loc{ -1 };  // terrain_shader
+    GLint terrain_view_pos_loc{ -1 };
 
     // Metody
+    void init_terrain_heights();  // heightmap or tile file, camera start and demo lights over the terrain
     void init_assets();
+    void init_light_buffers();
+    void upload_point_lights();
+    void add_demo_lights(size_t count);
+    void animate_demo_lights(float time);
+    void update_light_clusters(LightsBlock& lights);
+    void render_scene(double time); // lights, opaque and transparent passes for the current camera
+    static GpuLight toGpuLight(const Light& light);
     void init_triangle();
     void createTerrainModel();
     void createMazeModel();
-    void createModels();
-    void createTransparentObjects();
+    void createModels(AssetLoader& loader);
+    void createTransparentObjects(AssetLoader& loader);
+    // Throws like AssetLoader::createModel
+    uint32_t load_model_asset(AssetLoader& loader, const std::filesystem::path& path, GLuint texture, bool transparent);
+    uint32_t add_model_asset(Model* model);
+    EntityHandle place_object(uint32_t model, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale,
+        const glm::vec4& tint, uint8_t flags);
+    void scatter_models(const std::vector<uint32_t>& model_ids, size_t count);
     GLuint textureInit(const std::filesystem::path& filepath);
     GLuint gen_tex(cv::Mat& image);
     cv::Mat loadHeightmap(const std::filesystem::path& filepath);
@@ -3,6 +3,10 @@
 #include <GL/wglew.h> 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
 
 //vertex description
 struct vertex {
@@ -15,4 +19,60 @@ struct vertex {
     vertex(const glm::vec3& pos, const glm::vec2& tex, const glm::vec3& norm)
         : position(pos), texCoord(tex), normal(norm) {
     }
+};
+
+// Compressed GPU layout of vertex (16 instead of 32 bytes), see VertexPacking.hpp
+struct packed_vertex {
+    GLushort position[4];  // unorm16 relative to the mesh AABB, [3] is padding
+    GLuint normal;         // snorm 10:10:10:2 (GL_INT_2_10_10_10_REV)
+    GLushort texCoord[2];  // half float
+};
+static_assert(sizeof(packed_vertex) == 16, "packed_vertex must stay 16 bytes");
+
+enum class VertexFormat {
+    Float,   // vertex as is
+    Packed   // packed_vertex, decoded by the vertex shader / attribute formats
+};
+
+// Material from a .mtl library (newmtl block)
+struct Material {
+    std::string name;
+    glm::vec4 ambient{ 1.0f };   // Ka
+    glm::vec4 diffuse{ 1.0f };   // Kd, alpha from d / Tr
+    glm::vec4 specular{ 1.0f };  // Ks
+    float shininess{ 1.0f };     // Ns
+    std::filesystem::path diffuse_map; // map_Kd, resolved relative to the .mtl file
+};
+
+// Range of the shared index buffer drawn as one Mesh
+struct SubmeshRange {
+    GLuint first_index;
+    GLuint index_count;
+    GLuint material;    // index into MeshData::materials
+};
+
+class MappedFile;
+
+// CPU side indexed mesh, as produced by the OBJ loader or read from the mesh cache.
+// Submeshes are sorted by material and share one vertex and one index buffer.
+struct MeshData {
+    std::vector<vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<SubmeshRange> submeshes;
+    std::vector<Material> materials;
+    std::vector<std::filesystem::path> material_libraries; // mtllib files the materials came from
+
+    // Read from the mesh cache, vertices and indices stay empty: the arrays are used in place in
+    // the mapped file, which stays open while any copy of this MeshData holds it
+    std::shared_ptr<const MappedFile> mapping;
+    const vertex* mapped_vertices{ nullptr };
+    const GLuint* mapped_indices{ nullptr };
+    size_t mapped_vertex_count{ 0 };
+    size_t mapped_index_count{ 0 };
+
+    // The arrays wherever they are, what the uploads read
+    const vertex* vertexData() const { return mapping ? mapped_vertices : vertices.data(); }
+    size_t vertexCount() const { return mapping ? mapped_vertex_count : vertices.size(); }
+    const GLuint* indexData() const { return mapping ? mapped_indices : indices.data(); }
+    size_t indexCount() const { return mapping ? mapped_index_count : indices.size(); }
 };
\ No newline at end of file
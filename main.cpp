@@ -1,14 +1,128 @@
 ﻿#define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <GL/glew.h>
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include "app.hpp"
+#include "Benchmark.hpp"
 
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Offline benchmarks, no window is created
+    if (argc > 1 && std::string(argv[1]) == "--bench-obj") {
+        std::filesystem::path dir = argc > 2 ? argv[2] : "resources/models";
+        int iterations = argc > 3 ? std::atoi(argv[3]) : 5;
+        return benchmarkOBJLoader(dir, iterations);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-obj-threads") {
+        std::filesystem::path file = argc > 2 ? argv[2] : "resources/models/Tree.obj";
+        unsigned int max_threads = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 0;
+        int iterations = argc > 4 ? std::atoi(argv[4]) : 5;
+        return benchmarkOBJThreads(file, max_threads, iterations);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-meshopt") {
+        std::filesystem::path dir = argc > 2 ? argv[2] : "resources/models";
+        return benchmarkMeshOptimizer(dir);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--check-vertex-packing") {
+        std::filesystem::path dir = argc > 2 ? argv[2] : "resources/models";
+        return checkVertexPacking(dir);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-clusters") {
+        std::filesystem::path heightmap = argc > 2 ? argv[2] : "resources/textures/heightmap.png";
+        int lights = argc > 3 ? std::atoi(argv[3]) : 1000;
+        int frames = argc > 4 ? std::atoi(argv[4]) : 200;
+        return benchmarkLightClusters(heightmap, lights, frames);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-terrain") {
+        std::filesystem::path heightmap = argc > 2 ? argv[2] : "resources/textures/heightmap.png";
+        int frames = argc > 3 ? std::atoi(argv[3]) : 200;
+        return benchmarkTerrain(heightmap, frames);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-terrain-build") {
+        std::vector<std::filesystem::path> heightmaps = { "resources/textures/heightmap.png", "resources/textures/heightmap2.png" };
+        if (argc > 2) {
+            heightmaps = { argv[2] };
+        }
+        int iterations = argc > 3 ? std::atoi(argv[3]) : 10;
+        return benchmarkTerrainBuild(heightmaps, iterations);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-heightfield") {
+        std::filesystem::path heightmap = argc > 2 ? argv[2] : "resources/textures/heightmap2.png";
+        int queries = argc > 3 ? std::atoi(argv[3]) : 100000;
+        return benchmarkHeightField(heightmap, queries);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-scene-graph") {
+        int nodes = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int frames = argc > 3 ? std::atoi(argv[3]) : 100;
+        return benchmarkSceneGraph(nodes, frames);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-entities") {
+        int entities = argc > 2 ? std::atoi(argv[2]) : 50000;
+        int frames = argc > 3 ? std::atoi(argv[3]) : 100;
+        return benchmarkEntities(entities, frames);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-culling") {
+        int boxes = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int frames = argc > 3 ? std::atoi(argv[3]) : 100;
+        return benchmarkCulling(boxes, frames);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-bvh") {
+        int objects = argc > 2 ? std::atoi(argv[2]) : 100000;
+        int queries = argc > 3 ? std::atoi(argv[3]) : 100000;
+        return benchmarkBvh(objects, queries);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-terrain-streaming") {
+        std::filesystem::path tiles = argc > 2 ? argv[2] : "resources/terrain/heightmap.terrain";
+        size_t memory_mb = argc > 3 ? static_cast<size_t>(std::max(1, std::atoi(argv[3]))) : 256;
+        int frames = argc > 4 ? std::atoi(argv[4]) : 600;
+        return benchmarkTerrainStreaming(tiles, memory_mb, frames);
+    }
+
+    // my_app --make-terrain-tiles <heightmap> <out.terrain> [scale] writes the tile file of the
+    // streamed terrain (TerrainTiles.hpp), scale > 1 upsamples the heightmap into a larger test map
+    if (argc > 3 && std::string(argv[1]) == "--make-terrain-tiles") {
+        cv::Mat heightmap = cv::imread(argv[2], cv::IMREAD_GRAYSCALE | cv::IMREAD_ANYDEPTH);
+        if (heightmap.empty()) {
+            std::cerr << "Cannot read heightmap " << argv[2] << std::endl;
+            return 1;
+        }
+        int scale = argc > 4 ? std::atoi(argv[4]) : 1;
+        if (!writeTerrainTiles(heightmap, argv[3], scale)) {
+            return 1;
+        }
+        std::cout << "Terrain tiles written: " << argv[3] << std::endl;
+        return 0;
+    }
+
+    // my_app --benchmark <scenario.json> renders a scripted camera path offscreen (BenchmarkScenario.hpp)
+    if (argc > 2 && std::string(argv[1]) == "--benchmark") {
+        try {
+            BenchmarkScenario scenario = BenchmarkScenario::load(argv[2]);
+            App benchmarkApp(scenario.lights);
+            benchmarkApp.init_glfw(true);
+            if (!benchmarkApp.init()) {
+                throw std::runtime_error("Failed to initialize application");
+            }
+            return benchmarkApp.run_benchmark(scenario) ? 0 : 1;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return -1;
+        }
+    }
+
+    // my_app --lights N adds N animated point/spot lights over the terrain (light cluster test scene)
+    size_t demo_lights = 0;
+    if (argc > 2 && std::string(argv[1]) == "--lights") {
+        demo_lights = static_cast<size_t>(std::max(0, std::atoi(argv[2])));
+    }
+
     try {
-        App myApp;
+        App myApp(demo_lights);
         myApp.init_glfw(); // Inicializace GLFW a okna je nyní v App
         if (!myApp.init()) { // Upraveno: init již nepřijímá GLFWwindow*
             throw std::runtime_error("Failed to initialize application");
@@ -20,4 +134,4 @@ int main() {
         std::cerr << "Error: " << e.what() << std::endl;
         return -1;
     }
-}
\ No newline at end of file
+}
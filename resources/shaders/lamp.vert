@@ -4,8 +4,10 @@ layout (location = 0) in vec3 aPos;
 uniform mat4 uM_m;
 uniform mat4 uV_m;
 uniform mat4 uP_m;
+uniform vec3 uPosOffset = vec3(0.0); // dekvantizace pozic u packed meshů
+uniform vec3 uPosScale = vec3(1.0);
 
 void main()
 {
-    gl_Position = uP_m * uV_m * uM_m * vec4(aPos, 1.0);
+    gl_Position = uP_m * uV_m * uM_m * vec4(uPosOffset + aPos * uPosScale, 1.0);
 }
\ No newline at end of file
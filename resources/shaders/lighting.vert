@@ -10,11 +10,13 @@ out vec2 TexCoords;
 uniform mat4 uM_m;
 uniform mat4 uV_m;
 uniform mat4 uP_m;
+uniform vec3 uPosOffset = vec3(0.0); // dekvantizace pozic u packed meshů
+uniform vec3 uPosScale = vec3(1.0);
 
 void main()
 {
     // Pozice fragmentu ve world space pro výpočet osvětlení
-    FragPos = vec3(uM_m * vec4(aPos, 1.0));
+    FragPos = vec3(uM_m * vec4(uPosOffset + aPos * uPosScale, 1.0));
     
     // Transformace normály - pro správnou transformaci bychom měli použít normálovou matici
     // (inverze transpozice model matice), ale pro jednoduchost použijeme jen část model matice
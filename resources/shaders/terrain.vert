@@ -0,0 +1,46 @@
+#version 460 core
+// Terrain in TerrainMode::Heightmap and Streamed (Terrain.hpp): every chunk draws the same flat grid
+// patch, heights and normals come from a heightmap texture array. Outputs are the ones of tex.vert (tex.frag).
+layout (location = 0) in uvec2 aCell;   // patch vertex, cells from the chunk corner
+layout (location = 1) in ivec3 aChunk;  // first cell of the chunk and its layer, per draw (base instance)
+uniform mat4 uP_m = mat4(1.0f);
+uniform mat4 uV_m = mat4(1.0f);
+uniform sampler2DArray uHeightmap;      // R8/R16, one texel per grid vertex
+uniform float uMaxHeight = 1.0f;
+uniform float uTileSize = 1.0f;
+// A layer holds the cells of one tile (TerrainTiles.hpp) and uTileBorder samples around it,
+// Heightmap mode has a single tile covering the whole heightmap and no border
+uniform int uTileCells = 1 << 30;
+uniform int uTileBorder = 0;
+uniform vec2 uTexCoordScale = vec2(1.0f); // 1 / (heightmap samples - 1)
+out vec3 FragPos;
+out vec3 Normal;
+out float ViewDepth; // distance along the view direction, selects the light cluster
+flat out vec4 Tint;
+out VS_OUT
+{
+    vec2 texcoord;
+} vs_out;
+
+// Clamped at the layer border, like Terrain::build does at the heightmap border for TerrainMode::Mesh
+float height(ivec2 cell, ivec2 origin)
+{
+    ivec2 texel = clamp(cell - origin, ivec2(0), textureSize(uHeightmap, 0).xy - 1);
+    return texelFetch(uHeightmap, ivec3(texel, aChunk.z), 0).r * uMaxHeight;
+}
+
+void main()
+{
+    ivec2 cell = aChunk.xy + ivec2(aCell);
+    ivec2 origin = aChunk.xy / uTileCells * uTileCells - uTileBorder; // cell of the layer's first texel
+    vec3 position = vec3(cell.x * uTileSize, height(cell, origin), cell.y * uTileSize);
+    vec4 viewPosition = uV_m * vec4(position, 1.0f);
+    gl_Position = uP_m * viewPosition;
+    ViewDepth = -viewPosition.z;
+    vs_out.texcoord = vec2(cell) * uTexCoordScale;
+    FragPos = position;
+    Tint = vec4(1.0f);
+    // Central differences, the same normal as the CPU built vertices
+    Normal = normalize(vec3(height(cell - ivec2(1, 0), origin) - height(cell + ivec2(1, 0), origin), 2.0f,
+        height(cell - ivec2(0, 1), origin) - height(cell + ivec2(0, 1), origin)));
+}
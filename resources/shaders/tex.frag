@@ -2,39 +2,119 @@
 // (interpolated) input from previous pipeline stage
 in vec3 FragPos;
 in vec3 Normal;
+in float ViewDepth;
+flat in vec4 Tint; // of the instance, 1 for single draws
 in VS_OUT {
     vec2 texcoord;
 } fs_in;
 // uniform variables
 uniform sampler2D tex0; // texture unit from C++
 uniform vec4 u_diffuse_color = vec4(1.0f); // přidaný uniform pro barvu a průhlednost
+uniform vec3 viewPos;
 // mandatory: final output color
 out vec4 FragColor;
-uniform vec3 lightPos;
-uniform vec3 lightColor;
-uniform vec3 viewPos;
+
+// Light data, mirrored by GpuLight / LightsBlock in ShaderBlocks.hpp (keep in sync!)
+struct Light {
+    vec3 position;  float constant;
+    vec3 direction; float linear;
+    vec3 ambient;   float quadratic;
+    vec3 diffuse;   float cutOff;
+    vec3 specular;  float outerCutOff;
+    float flicker;  // angular frequency of the point light intensity, 0 = steady
+    float radius;   // attenuation below 1/256 beyond it, bounds the light in the clusters
+};
+
+layout(std140) uniform Lights {
+    vec4 ambientColor;
+    Light dirLight;
+    Light spotLight;
+    float time;
+    int numPointLights;
+    int numSpotLights;
+    int padding;
+    vec4 clusterScale;  // tiles per pixel (xy), depth slice = log(depth) * z + w
+    uvec4 clusterGrid;  // tiles x, tiles y, depth slices
+};
+
+// Point (and spot) lights, they are only reached through the cluster light lists
+layout(std430) readonly buffer PointLights {
+    Light pointLights[];
+};
+
+// Clustered forward lighting, see LightClusters.hpp: every cluster of the view frustum
+// holds a range (offset, count) of lightIndices
+layout(std430) readonly buffer LightClusters {
+    uvec2 clusters[];
+};
+
+layout(std430) readonly buffer LightIndices {
+    uint lightIndices[];
+};
+
+const float shininess = 32.0;
+
+vec3 phong(Light light, vec3 lightDir, vec3 norm, vec3 viewDir, vec3 albedo) {
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    return light.ambient * albedo + light.diffuse * diff * albedo + light.specular * spec;
+}
+
+float attenuation(Light light, float distance) {
+    return 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+}
+
+// Same mapping as LightClusterGrid::slice() and the tile planes on the CPU
+uint clusterIndex() {
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterScale.xy), clusterGrid.xy - 1u);
+    float slice = log(max(ViewDepth, 1e-6)) * clusterScale.z + clusterScale.w;
+    uint z = uint(clamp(slice, 0.0, float(clusterGrid.z - 1u)));
+    return (z * clusterGrid.y + tile.y) * clusterGrid.x + tile.x;
+}
+
+// 1 inside the inner cone, fading to 0 at the outer cone (cutOff and outerCutOff are cosines)
+float spotCone(Light light, vec3 lightDir) {
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    return clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+}
+
 void main() {
-    // Ambient
-    float ambientStrength = 0.1;
-    vec3 ambient = ambientStrength * lightColor;
-  	
-    // Diffuse 
+    vec4 texColor = texture(tex0, fs_in.texcoord);
+    vec4 baseColor = u_diffuse_color * Tint * texColor;
     vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
-    
-    // Specular
-    float specularStrength = 0.5;
     vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);  
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * lightColor;  
-    
-    // Výsledek
-    vec3 result = (ambient + diffuse + specular);
-    
-    // Modifikujte původní barvu osvětlením
-    vec4 texColor = texture(tex0, fs_in.texcoord);
-    FragColor = vec4(result, 1.0) * u_diffuse_color * texColor;
-}
\ No newline at end of file
+
+    // Ambient + slunce
+    vec3 result = ambientColor.rgb * baseColor.rgb;
+    result += phong(dirLight, normalize(-dirLight.direction), norm, viewDir, baseColor.rgb);
+
+    // Bodová světla, jen ta ze seznamu clusteru tohoto fragmentu
+    uvec2 cluster = clusters[clusterIndex()];
+    for (uint i = 0u; i < cluster.y; i++) {
+        Light light = pointLights[lightIndices[cluster.x + i]];
+        vec3 toLight = light.position - FragPos;
+        float distance = length(toLight);
+        if (distance >= light.radius) {
+            continue;
+        }
+        float intensity = light.flicker > 0.0 ? 0.7 + 0.3 * sin(time * light.flicker) : 1.0;
+        light.diffuse *= intensity;
+        light.specular *= intensity;
+        vec3 lightDir = toLight / distance;
+        float cone = light.cutOff > light.outerCutOff ? spotCone(light, lightDir) : 1.0;
+        result += phong(light, lightDir, norm, viewDir, baseColor.rgb) * attenuation(light, distance) * cone;
+    }
+
+    // Reflektor (svítilna kamery)
+    if (numSpotLights > 0) {
+        vec3 toLight = spotLight.position - FragPos;
+        float distance = length(toLight);
+        vec3 lightDir = toLight / distance;
+        float cone = spotCone(spotLight, lightDir);
+        result += phong(spotLight, lightDir, norm, viewDir, baseColor.rgb) * attenuation(spotLight, distance) * cone;
+    }
+
+    FragColor = vec4(result, baseColor.a);
+}
@@ -5,17 +5,42 @@ in vec2 aTex;
 uniform mat4 uP_m = mat4(1.0f);
 uniform mat4 uM_m = mat4(1.0f);
 uniform mat4 uV_m = mat4(1.0f);
+// Packed meshes store positions as unorm16 inside their AABB (identity for float meshes)
+uniform vec3 uPosOffset = vec3(0.0f);
+uniform vec3 uPosScale = vec3(1.0f);
+// Instanced draws (Mesh::drawInstanced) take the model matrix and tint of instance
+// uFirstInstance + gl_InstanceID instead of uM_m, mirrored by GpuInstance in ShaderBlocks.hpp
+struct Instance {
+    mat4 model;
+    vec4 tint;
+};
+layout(std430) readonly buffer Instances {
+    Instance instances[];
+};
+uniform bool uInstanced = false;
+uniform int uFirstInstance = 0;
 out vec3 FragPos;
 out vec3 Normal;
+out float ViewDepth; // distance along the view direction, selects the light cluster
+flat out vec4 Tint;  // times u_diffuse_color
 out VS_OUT
 {
     vec2 texcoord;
 } vs_out;
 void main()
 {
+    vec3 position = uPosOffset + aPos * uPosScale;
+    mat4 model = uM_m;
+    Tint = vec4(1.0f);
+    if (uInstanced) {
+        model = instances[uFirstInstance + gl_InstanceID].model;
+        Tint = instances[uFirstInstance + gl_InstanceID].tint;
+    }
     // Outputs the positions/coordinates of all vertices
-    gl_Position = uP_m * uV_m * uM_m * vec4(aPos, 1.0f);
+    vec4 viewPosition = uV_m * model * vec4(position, 1.0f);
+    gl_Position = uP_m * viewPosition;
+    ViewDepth = -viewPosition.z;
     vs_out.texcoord = aTex;
-    FragPos = vec3(uM_m * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(uM_m))) * aNorm;
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNorm;
 }
\ No newline at end of file